@@ -0,0 +1,67 @@
+#ifndef CDC_LOG_H
+#define CDC_LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// RAM ring size for buffered CDC output (must be a power of two)
+#ifndef CDC_LOG_BUFFER_SIZE
+#define CDC_LOG_BUFFER_SIZE 4096U
+#endif
+
+#ifndef CDC_LOG_DEFAULT_ENABLED
+#define CDC_LOG_DEFAULT_ENABLED 1
+#endif
+
+typedef struct {
+    uint32_t dropped_messages;  // Messages discarded because the ring was full
+    uint32_t dropped_bytes;     // Bytes discarded with them
+    uint16_t buffered_bytes;    // Bytes currently waiting for the CDC endpoint
+    uint16_t capacity;          // Ring size in bytes
+    bool enabled;               // Runtime logging switch
+} cdc_log_stats_t;
+
+/**
+ * @brief Append a message to the log ring without touching USB.
+ *
+ * Safe to call from interrupt context. The whole message is dropped (and
+ * counted) when it does not fit, so a slow or absent host can never stall
+ * the caller.
+ *
+ * @param data Bytes to append.
+ * @param len  Number of bytes.
+ * @return true when the message was buffered.
+ */
+bool cdc_log_write(const char *data, uint16_t len);
+
+/**
+ * @brief Append a binary trace record; bypasses the text logging switch.
+ */
+bool cdc_log_write_record(const void *data, uint16_t len);
+
+/**
+ * @brief Format a message into the log ring (no-op while logging is disabled).
+ */
+void cdc_log_vprintf(const char *format, va_list args);
+
+/**
+ * @brief Drain buffered output into the CDC endpoint as space allows.
+ *
+ * Called from usb_app_task(); never blocks.
+ */
+void cdc_log_task(void);
+
+void cdc_log_set_enabled(bool enabled);
+bool cdc_log_is_enabled(void);
+void cdc_log_get_stats(cdc_log_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CDC_LOG_H */
@@ -9,7 +9,7 @@ extern "C" {
 #endif
 
 // Configuration Protocol Version
-#define CONFIG_PROTOCOL_VERSION 1
+#define CONFIG_PROTOCOL_VERSION 2
 
 // Packet header and sizes
 #define CONFIG_PACKET_HEADER 0x4F47    // "OG" - matches Tauri app
@@ -25,7 +25,7 @@ typedef enum {
     CMD_SET_KEYMAP = 0x03,         // Set keymap entry
     CMD_GET_ENCODER_MAP = 0x04,    // Get encoder mapping
     CMD_SET_ENCODER_MAP = 0x05,    // Set encoder mapping
-    CMD_SAVE_CONFIG = 0x06,        // Save to EEPROM
+    CMD_SAVE_CONFIG = 0x06,        // Commit to EEPROM now instead of after the idle delay
     CMD_LOAD_CONFIG = 0x07,        // Load from EEPROM  
     CMD_RESET_CONFIG = 0x08,       // Reset to defaults
     CMD_GET_I2C_DEVICES = 0x09,    // Get connected I2C devices
@@ -46,8 +46,8 @@ typedef enum {
     CMD_GET_SLAVE_ENCODER = 0x14,  // Get encoder mapping from slave (payload: address(1), encoder_id(1))
     CMD_SET_SLAVE_ENCODER = 0x15,  // Set encoder mapping on slave (payload: address(1), encoder_id(1), keycodes(4))
     CMD_GET_LAYOUT_INFO = 0x16,        // Retrieve static board layout metadata
-    CMD_SET_LAYER_STATE = 0x17,        // Update active layer mask/default
-    CMD_GET_LAYER_STATE = 0x18,        // Query active layer mask/default
+    CMD_SET_LAYER_STATE = 0x17,        // Update active layers 0-7/default (higher layers are kept)
+    CMD_GET_LAYER_STATE = 0x18,        // Query active layers 0-7/default
     CMD_GET_LAYOUT_CELL_TYPE = 0x19,   // Get layout cell type at matrix position (payload: row(1), col(1))
     CMD_GET_LAYOUT_CELL_COMPONENT_ID = 0x1A, // Get component ID at matrix position (payload: row(1), col(1))
     CMD_GET_SLIDER_VALUE = 0x1B,       // Get current slider value (payload: slider_id(1)) -> value(1)
@@ -59,7 +59,41 @@ typedef enum {
     CMD_GET_MAGNETIC_SWITCH_CONFIG = 0x1F,     // Get magnetic switch configuration
     CMD_SET_MAGNETIC_SWITCH_CONFIG = 0x20,     // Set magnetic switch configuration
     CMD_CALIBRATE_MAGNETIC_SWITCH = 0x21,      // Calibrate magnetic switch (step-based)
-    CMD_SET_MAGNETIC_SWITCH_SENSITIVITY = 0x22 // Set magnetic switch sensitivity
+    CMD_SET_MAGNETIC_SWITCH_SENSITIVITY = 0x22, // Set magnetic switch sensitivity
+
+    // Debounce commands
+    CMD_GET_DEBOUNCE_CONFIG = 0x23,    // Get debounce config -> algorithm(1), time_ms(1), default_algorithm(1), default_time_ms(1)
+    CMD_SET_DEBOUNCE_CONFIG = 0x24,    // Set debounce config (payload: algorithm(1), time_ms(1)); algorithm 0 restores keyboard default
+
+    // CDC log commands
+    CMD_GET_LOG_STATUS = 0x25,         // Get CDC log status -> enabled(1), dropped_messages(4), dropped_bytes(4), buffered(2), capacity(2), trace_enabled(1)
+    CMD_SET_LOG_ENABLED = 0x26,        // Enable/disable CDC logging at runtime (payload: enabled(1), trace_enabled(1, optional))
+
+    // Latency measurement commands
+    CMD_GET_LATENCY_STATS = 0x27,      // Input-to-USB latency (payload: source(1), reset(1, optional)) -> source(1), count(4), min_us(4), avg_us(4), p99_us(4), max_us(4)
+
+    // EEPROM commands
+    CMD_GET_EEPROM_STATUS = 0x28,      // Get write-behind state -> dirty(1), writing(1), last_commit_ok(1), commit_in_ms(4), migration_dropped(2)
+
+    // Configuration profile commands
+    CMD_GET_PROFILE = 0x29,            // Get active profile -> profile(1), profile_count(1)
+    CMD_SET_PROFILE = 0x2A,            // Switch profile on this device and I2C slaves (payload: profile(1)) -> profile(1), profile_count(1)
+
+    // Staged configuration commands (local keymap, encoder and slider writes)
+    CMD_CONFIG_BEGIN = 0x2B,           // Stage following SET_KEYMAP/SET_ENCODER_MAP/SET_SLIDER_CONFIG writes; restarts an open transaction
+    CMD_CONFIG_COMMIT = 0x2C,          // Apply staged writes at once and save them together
+    CMD_CONFIG_ABORT = 0x2D,           // Discard staged writes
+
+    // 32-bit layer state commands
+    CMD_SET_LAYER_STATE_32 = 0x2E,     // Update active layer mask/default (payload: mask(4), default(1), options(1, optional)) -> mask(4), default(1)
+    CMD_GET_LAYER_STATE_32 = 0x2F,     // Query active layer mask/default -> mask(4), default(1), layer_count(1)
+    CMD_GET_TAP_HOLD_CONFIG = 0x30,    // Get tap-hold config (payload: row(1), col(1); 0xFF/0xFF = profile) -> row, col, term_ms(2), flags, effective term_ms(2), effective flags
+    CMD_SET_TAP_HOLD_CONFIG = 0x31,    // Set tap-hold config (payload: row(1), col(1), term_ms(2), flags(1)); term 0 inherits the profile/keyboard default
+    CMD_GET_COMBO = 0x32,              // Get combo slot (payload: index(1)) -> index, layer, keys(4), keycode(2), combo_count, term_ms(2)
+    CMD_SET_COMBO = 0x33,              // Set combo slot (payload: index(1), layer(1), keys(4) as row*cols+col or 0xFF, keycode(2)); KC_NO clears it
+    CMD_SET_COMBO_TERM = 0x34,         // Set combo window (payload: term_ms(2)); 0 restores the keyboard default
+    CMD_GET_MACRO_DATA = 0x35,         // Read macro byte-code (payload: offset(2), length(1)) -> offset(2), length, area_size(2), data
+    CMD_SET_MACRO_DATA = 0x36          // Write macro byte-code (payload: offset(2), length(1), data); stops playback
 } config_command_t;
 
 // Response status codes
@@ -0,0 +1,32 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Standard CRC-32 (reflected 0x04C11DB7, init and final XOR 0xFFFFFFFF), the
+ * same value the old bit-serial loop in eeprom_emulation.c produced.
+ *
+ * On target the STM32G4 CRC peripheral does the work, fed one 32-bit word
+ * per write. Builds without the HAL (CRC32_SOFTWARE, or no USE_HAL_DRIVER)
+ * use a slicing-by-4 table instead. The peripheral is shared state, so call
+ * this from thread context only.
+ */
+
+void crc32_init(void);
+uint32_t crc32_compute(const void *data, uint32_t length);
+
+// Incremental form for data that is not contiguous; one calculation at a time
+void crc32_begin(void);
+void crc32_update(const void *data, uint32_t length);
+uint32_t crc32_finish(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CRC32_H */
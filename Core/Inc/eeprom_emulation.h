@@ -20,41 +20,147 @@ extern "C" {
 
 // EEPROM emulation configuration
 #define EEPROM_PAGE_SIZE        2048    // STM32G4 flash page size
-#define EEPROM_START_ADDRESS    0x0807F000  // Last 4KB of flash (2 pages)
+#define EEPROM_START_ADDRESS    0x08070000  // Last 64KB of bank 2 (EEPROM region in the linker script)
 #define EEPROM_END_ADDRESS      0x08080000
+#define EEPROM_LEGACY_ADDRESS   0x0807F000  // Storage used by older firmware (last 4KB)
 
 // Data structure versions for migration
-#define EEPROM_VERSION          4  // Incremented for magnetic switch support
+#define EEPROM_VERSION          5  // Sparse overrides, tap-hold, combos and macros (v4 was the last dense layout)
 #define EEPROM_MAGIC            0x4F47454D  // "OGEM" - OpenGrader EEPROM Magic
 #define MAX_MAGNETIC_SWITCHES_EEPROM 8  // Maximum magnetic switches to store
 
+// Capacity of the sparse override tables; storage no longer grows with layers.
+// Never more entries than the keyboard has cells, and capped so one profile
+// image stays within EEPROM_PROFILE_IMAGE_MAX.
+#define EEPROM_KEYMAP_CELLS     (KEYMAP_LAYER_COUNT * MATRIX_ROWS * MATRIX_COLS)
+#define EEPROM_ENCODER_CELLS    (KEYMAP_LAYER_COUNT * ENCODER_COUNT)
+#ifndef EEPROM_KEYMAP_OVERRIDES
+#define EEPROM_KEYMAP_OVERRIDES     ((EEPROM_KEYMAP_CELLS < 384U) ? EEPROM_KEYMAP_CELLS : 384U)
+#endif
+#ifndef EEPROM_ENCODER_OVERRIDES
+#define EEPROM_ENCODER_OVERRIDES    ((EEPROM_ENCODER_CELLS < 1U) ? 1U : (EEPROM_ENCODER_CELLS < 192U) ? EEPROM_ENCODER_CELLS : 192U)
+#endif
+
+// Largest eeprom_data_t a profile may take, the size of the image older firmware used
+#define EEPROM_PROFILE_IMAGE_MAX    4096U
+
+// Complete configurations stored side by side in flash; one of them is live
+#ifndef EEPROM_PROFILE_COUNT
+#define EEPROM_PROFILE_COUNT        4
+#endif
+
+// Changes are committed once no new change arrived for this long
+#ifndef EEPROM_COMMIT_IDLE_MS
+#define EEPROM_COMMIT_IDLE_MS   1500
+#endif
+
+// Keycode that differs from the compiled keymap, sorted by (layer, cell)
+typedef struct {
+    uint8_t layer;
+    uint8_t cell;                                       // row * MATRIX_COLS + col
+    uint16_t keycode;
+} __attribute__((packed)) keymap_override_t;
+
+// Encoder pair that differs from the compiled encoder_map, sorted by (layer, encoder_id)
+typedef struct {
+    uint8_t layer;
+    uint8_t encoder_id;
+    uint16_t ccw_keycode;
+    uint16_t cw_keycode;
+} __attribute__((packed)) encoder_override_t;
+
+// Per-key tap-hold settings; tapping_term_ms 0 follows the profile setting
+typedef struct {
+    uint16_t tapping_term_ms;
+    uint8_t flags;              // TAP_HOLD_* decision flags
+} __attribute__((packed)) tap_hold_eeprom_t;
+
+// Row/column value addressing the profile-wide tap-hold setting
+#define EEPROM_TAP_HOLD_PROFILE 0xFF
+
+// Combo slots per profile (a combo is matched as one bit of a 32-bit mask)
+#ifndef EEPROM_COMBO_COUNT
+#define EEPROM_COMBO_COUNT 16
+#endif
+
+// Keys per combo; unused entries hold EEPROM_COMBO_NO_KEY
+#define EEPROM_COMBO_KEYS   4
+#define EEPROM_COMBO_NO_KEY 0xFF
+
+// Macro byte-code per profile (see macro.h for the format), multiple of the 4-byte record chunk
+#ifndef EEPROM_MACRO_BYTES
+#define EEPROM_MACRO_BYTES 256
+#endif
+
+typedef struct {
+    uint8_t layer;                      // Combo only fires while this layer is active
+    uint8_t keys[EEPROM_COMBO_KEYS];    // row * MATRIX_COLS + col
+    uint16_t keycode;                   // KC_NO = slot unused
+} __attribute__((packed)) combo_eeprom_t;
+
 // EEPROM data structure
 typedef struct {
     uint32_t magic;                                     // Magic number for validation
     uint32_t version;                                   // Data structure version
     uint32_t checksum;                                  // CRC32 checksum
-    uint16_t keymap[KEYMAP_LAYER_COUNT][MATRIX_ROWS][MATRIX_COLS];
-    uint16_t encoder_map[KEYMAP_LAYER_COUNT][ENCODER_COUNT][2];
+    uint16_t keymap_override_count;
+    uint16_t encoder_override_count;
+    keymap_override_t keymap_overrides[EEPROM_KEYMAP_OVERRIDES];
+    encoder_override_t encoder_overrides[EEPROM_ENCODER_OVERRIDES];
     slider_config_t slider_map[KEYMAP_LAYER_COUNT][SLIDER_COUNT];  // Slider configurations per layer
     magnetic_switch_eeprom_t magnetic_switches[MAX_MAGNETIC_SWITCHES_EEPROM];  // Magnetic switch calibration data
-    uint8_t startup_layer_mask;                         // Layer mask restored on boot
+    uint32_t startup_layer_mask;                        // Layer mask restored on boot
     uint8_t default_layer;                              // Default layer index
-    uint8_t reserved[18];                               // Reserved for future use (reduced for magnetic switches)
+    uint8_t debounce_algorithm;                         // debounce_algorithm_t, 0 = keyboard default
+    uint8_t debounce_ms;                                // Debounce time when debounce_algorithm is set
+    uint8_t reserved[16];                               // Reserved for future use
+    uint16_t tap_hold_term_ms;                          // 0 = keyboard default (TAP_HOLD_TERM_MS)
+    uint8_t tap_hold_flags;                             // Used with tap_hold_term_ms
+    tap_hold_eeprom_t tap_hold_keys[MATRIX_ROWS * MATRIX_COLS];
+    uint16_t combo_term_ms;                             // 0 = keyboard default (COMBO_TERM_MS)
+    combo_eeprom_t combos[EEPROM_COMBO_COUNT];
+    uint8_t macro_data[EEPROM_MACRO_BYTES];
 } __attribute__((packed)) eeprom_data_t;
 
+typedef struct {
+    bool dirty;                 // RAM holds changes not yet committed to flash
+    bool writing;               // A commit is scheduled or being written
+    bool last_commit_ok;        // Result of the most recent commit
+    uint32_t commit_in_ms;      // Time until the idle commit starts, 0 if none is waiting
+    uint16_t migration_dropped; // Overrides lost to a full table while migrating old images since boot
+} eeprom_status_t;
+
 // Public API
 bool eeprom_init(void);
-bool eeprom_save_config(void);
+void eeprom_task(void);                // Advances background flash writes, call from the main loop
+bool eeprom_save_config(void);         // Commits now instead of waiting for EEPROM_COMMIT_IDLE_MS
 bool eeprom_force_save_config(void);  // Force save even if no changes
+bool eeprom_is_busy(void);             // True while a save is scheduled or being written
+bool eeprom_flush(uint32_t timeout_ms);  // Blocks until pending saves reach flash
+void eeprom_get_status(eeprom_status_t *status);
 bool eeprom_load_config(void);
 bool eeprom_reset_config(void);
 bool eeprom_is_valid(void);
 
+// Profiles. All other getters and setters act on the active profile.
+bool eeprom_set_active_profile(uint8_t profile);
+uint8_t eeprom_get_active_profile(void);
+
+// Staged transactions. Between begin and commit the keymap, encoder and slider
+// setters collect their changes apart from the active profile; getters keep
+// reporting the live values. Commit makes the changes live and schedules one
+// save of the difference.
+bool eeprom_stage_begin(void);
+bool eeprom_stage_commit(uint8_t *profile);  // Reports the profile the transaction belonged to
+void eeprom_stage_abort(void);
+bool eeprom_stage_active(void);
+
 // Layer state persistence
-bool eeprom_set_layer_state(uint8_t active_mask, uint8_t default_layer);
-bool eeprom_get_layer_state(uint8_t *active_mask, uint8_t *default_layer);
+bool eeprom_set_layer_state(uint32_t active_mask, uint8_t default_layer);
+bool eeprom_get_layer_state(uint32_t *active_mask, uint8_t *default_layer);
 
-// Keymap and encoder map access
+// Keymap and encoder map access. Getters report 0 for entries that follow the
+// compiled keymap; setting an entry back to its compiled value drops the override.
 bool eeprom_set_keycode(uint8_t layer, uint8_t row, uint8_t col, uint16_t keycode);
 uint16_t eeprom_get_keycode(uint8_t layer, uint8_t row, uint8_t col);
 bool eeprom_set_encoder_map(uint8_t layer, uint8_t encoder_id, uint16_t ccw_keycode, uint16_t cw_keycode);
@@ -68,6 +174,25 @@ bool eeprom_get_slider_config(uint8_t layer, uint8_t slider_id, slider_config_t
 bool eeprom_set_magnetic_switch_calibration(uint8_t switch_id, uint16_t unpressed_value, uint16_t pressed_value, uint8_t sensitivity);
 bool eeprom_get_magnetic_switch_calibration(uint8_t switch_id, uint16_t *unpressed_value, uint16_t *pressed_value, uint8_t *sensitivity, bool *is_calibrated);
 
+// Debounce configuration (algorithm 0 means "use keyboard default")
+bool eeprom_set_debounce_config(uint8_t algorithm, uint8_t time_ms);
+bool eeprom_get_debounce_config(uint8_t *algorithm, uint8_t *time_ms);
+
+// Tap-hold configuration for one key, or the profile with row = col = EEPROM_TAP_HOLD_PROFILE
+// (tapping_term_ms 0 means "inherit")
+bool eeprom_set_tap_hold_config(uint8_t row, uint8_t col, uint16_t tapping_term_ms, uint8_t flags);
+bool eeprom_get_tap_hold_config(uint8_t row, uint8_t col, uint16_t *tapping_term_ms, uint8_t *flags);
+
+// Combo slots of the active profile, and the window their keys must be pressed in (0 = default)
+bool eeprom_set_combo(uint8_t index, const combo_eeprom_t *combo);
+bool eeprom_get_combo(uint8_t index, combo_eeprom_t *combo);
+bool eeprom_set_combo_term(uint16_t term_ms);
+uint16_t eeprom_get_combo_term(void);
+
+// Macro byte-code of the active profile (EEPROM_MACRO_BYTES); the getter copies out a range
+bool eeprom_set_macro_data(uint16_t offset, const uint8_t *data, uint16_t length);
+bool eeprom_get_macro_data(uint16_t offset, uint8_t *data, uint16_t length);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,39 @@
+#ifndef EEPROM_FLASH_H
+#define EEPROM_FLASH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Non-blocking flash backend for the EEPROM emulation.
+ *
+ * The EEPROM region lives in bank 2 (see the EEPROM memory region in
+ * STM32G474XX_FLASH.ld) while code runs from bank 1, so with DBANK set the
+ * CPU keeps fetching instructions while a page erase or doubleword program
+ * runs. One operation is in flight at a time; start it, then poll for
+ * completion from the main loop.
+ */
+
+typedef enum {
+    EEPROM_FLASH_IDLE = 0,    // Nothing started since the last completion was collected
+    EEPROM_FLASH_BUSY,        // Operation in progress
+    EEPROM_FLASH_DONE,        // Operation finished successfully (reported once)
+    EEPROM_FLASH_ERROR        // Operation failed (reported once)
+} eeprom_flash_status_t;
+
+void eeprom_flash_init(void);
+bool eeprom_flash_is_dual_bank(void);
+
+bool eeprom_flash_erase_async(uint32_t address, uint32_t size);
+bool eeprom_flash_program_async(uint32_t address, uint64_t data);
+eeprom_flash_status_t eeprom_flash_poll(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEPROM_FLASH_H */
@@ -8,6 +8,7 @@
 #define I2C_MSG_KEY_EVENT 0x01
 #define I2C_MSG_MIDI_EVENT 0x02
 #define I2C_MSG_LAYER_STATE 0x03
+#define I2C_MSG_LAYER_STATE_32 0x04
 #define I2C_MIDI_EVENT_TYPE_CC 0x00
 #define I2C_MIDI_EVENT_TYPE_NOTE_ON 0x01
 #define I2C_MIDI_EVENT_TYPE_NOTE_OFF 0x02
@@ -21,7 +22,7 @@ typedef struct {
     uint8_t col;        // Matrix column (0-6)
     uint8_t pressed;    // 1 = pressed, 0 = released
     uint8_t keycode;    // HID keycode
-    uint8_t layer_mask; // Active layer bitmask (shared across devices)
+    uint8_t layer_mask; // Active layers 0-7 (shared across devices; higher layers sync via layer state)
     uint8_t checksum;   // Simple checksum for data integrity
 } __attribute__((packed)) i2c_key_event_t;
 
@@ -48,6 +49,20 @@ typedef struct {
     uint8_t checksum;     // Simple checksum for data integrity
 } __attribute__((packed)) i2c_layer_state_t;
 
+// Layer state with the full mask and the configuration profile, which
+// I2C_MSG_LAYER_STATE does not carry; default layer and profile share one
+// byte to stay within I2C_MSG_MAX_SIZE
+#define I2C_LAYER_INFO_DEFAULT_MASK 0x1Fu
+#define I2C_LAYER_INFO_PROFILE_SHIFT 5u
+
+typedef struct {
+    uint8_t header;       // Always I2C_MSG_HEADER (0xAB)
+    uint8_t msg_type;     // I2C_MSG_LAYER_STATE_32 (0x04)
+    uint32_t layer_mask;  // Active layer mask, little endian
+    uint8_t layer_info;   // Default layer (bits 0-4), profile (bits 5-7)
+    uint8_t checksum;     // Simple checksum for data integrity
+} __attribute__((packed)) i2c_layer_state32_t;
+
 // Union for different message types
 typedef union {
     struct {
@@ -57,6 +72,7 @@ typedef union {
     i2c_key_event_t key_event;
     i2c_midi_event_t midi_event;
     i2c_layer_state_t layer_state;
+    i2c_layer_state32_t layer_state32;
 } __attribute__((packed)) i2c_message_t;
 
 // Calculate checksum for message
@@ -76,6 +92,13 @@ static inline uint8_t i2c_calc_layer_checksum(const i2c_layer_state_t *msg)
     return msg->header + msg->msg_type + msg->layer_mask + msg->default_layer;
 }
 
+static inline uint8_t i2c_calc_layer32_checksum(const i2c_layer_state32_t *msg)
+{
+    uint32_t mask = msg->layer_mask;
+    return msg->header + msg->msg_type + (uint8_t)mask + (uint8_t)(mask >> 8) +
+           (uint8_t)(mask >> 16) + (uint8_t)(mask >> 24) + msg->layer_info;
+}
+
 // Validate message checksum
 static inline uint8_t i2c_validate_message(const i2c_key_event_t *msg)
 {
@@ -93,4 +116,9 @@ static inline uint8_t i2c_validate_layer_message(const i2c_layer_state_t *msg)
     return (i2c_calc_layer_checksum(msg) == msg->checksum) ? 1 : 0;
 }
 
+static inline uint8_t i2c_validate_layer32_message(const i2c_layer_state32_t *msg)
+{
+    return (i2c_calc_layer32_checksum(msg) == msg->checksum) ? 1 : 0;
+}
+
 #endif // I2C_PROTOCOL_H
\ No newline at end of file
@@ -0,0 +1,29 @@
+#ifndef COMBO_H
+#define COMBO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix.h"
+
+// Per-keyboard default window for pressing all keys of a combo, override in
+// keyboards/<name>/config.h (the stored combo term takes precedence when set)
+#ifndef COMBO_TERM_MS
+#define COMBO_TERM_MS 50
+#endif
+
+// Called by the matrix for every key event before tap-hold. Returns true if
+// the engine took the event; keys that belong to no combo on an active layer
+// pass straight through while no combo is pending.
+bool combo_process_key(uint8_t row, uint8_t col, uint8_t pressed);
+
+// Expire the combo window; call once per matrix scan
+void combo_task(void);
+
+// Rebuild the compiled combo table from EEPROM on next use (after the stored
+// combos or the active profile changed)
+void combo_invalidate_cache(void);
+
+// Effective combo window in ms
+uint16_t combo_get_term(void);
+
+#endif // COMBO_H
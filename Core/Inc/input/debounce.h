@@ -0,0 +1,37 @@
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix.h"
+
+// Debounce algorithms (value 0 is reserved for "keyboard default" in EEPROM)
+typedef enum {
+    DEBOUNCE_SYM_DEFER_PK = 1,  // Report a change once the key has been stable for the debounce time
+    DEBOUNCE_EAGER_PK = 2,      // Report the first edge immediately, then ignore the key for the debounce time
+    DEBOUNCE_EAGER_PR = 3       // Like eager-per-key but with one lockout timer per row
+} debounce_algorithm_t;
+
+// Per-keyboard defaults, override in keyboards/<name>/config.h
+#ifndef DEBOUNCE_ALGORITHM
+#define DEBOUNCE_ALGORITHM DEBOUNCE_EAGER_PK
+#endif
+
+#ifndef DEBOUNCE_MS
+#define DEBOUNCE_MS 5
+#endif
+
+void debounce_init(void);
+
+// Re-read the stored algorithm/time (e.g. after the configuration profile changed)
+void debounce_reload_config(void);
+
+// Change algorithm/time at runtime; resets all pending timers
+bool debounce_set_config(uint8_t algorithm, uint8_t time_ms);
+void debounce_get_config(uint8_t *algorithm, uint8_t *time_ms);
+
+// Filter raw row bitmaps (bit c = column c) into debounced row bitmaps.
+// Must be called on every scan so timers can expire. Returns true if cooked changed.
+bool debounce_update(const uint32_t raw[MATRIX_ROWS], uint32_t cooked[MATRIX_ROWS], uint32_t now_ms);
+
+#endif // DEBOUNCE_H
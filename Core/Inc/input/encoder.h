@@ -19,4 +19,12 @@ void encoder_register_callback(encoder_event_cb_t cb); // register callback for
 // HAL EXTI callback hook
 void encoder_handle_exti(uint16_t pin);
 
+// Sample every encoder pin once and decode the transitions. encoder_task()
+// calls this when polling; with ENCODER_SAMPLE_BACKGROUND the TIM7 interrupt
+// does. Host builds can call it directly to feed synthetic pin waveforms.
+void encoder_sample_tick(void);
+
+// TIM7 update interrupt hook for background sampling (ENCODER_SAMPLE_BACKGROUND)
+void encoder_timer_isr(void);
+
 #endif // ENCODER_H
@@ -8,9 +8,13 @@
 #include "config_protocol.h"  // For slider_config_t
 
 #ifndef KEYMAP_LAYER_COUNT
-#define KEYMAP_LAYER_COUNT 8
+#define KEYMAP_LAYER_COUNT 32
 #endif
 
+// Layer masks are 32-bit, one bit per layer (KEYMAP_LAYER_COUNT <= 32)
+#define KEYMAP_LAYER_BIT(layer)  ((uint32_t)1u << (layer))
+#define KEYMAP_LAYER_MASK_ALL    ((uint32_t)(((uint64_t)1u << KEYMAP_LAYER_COUNT) - 1u))
+
 // Define pins using the board GPIO naming used in CubeMX (port + pin)
 // For simplicity we'll expose arrays of pin_t used by matrix.c
 // pin_t is defined in the keyboard config (via matrix.h)
@@ -31,6 +35,9 @@ uint16_t keymap_get_active_keycode(uint8_t row, uint8_t col);
 bool keymap_set_keycode(uint8_t layer, uint8_t row, uint8_t col, uint16_t keycode);
 bool keymap_translate_keycode(uint16_t keycode, bool pressed, uint8_t *hid_code);
 
+// Mark the resolved active-layer tables stale (e.g. after the EEPROM image was reloaded)
+void keymap_invalidate_cache(void);
+
 // Encoder helper functions
 bool keymap_get_encoder_map(uint8_t layer, uint8_t encoder_id, uint16_t *ccw_keycode, uint16_t *cw_keycode);
 bool keymap_get_active_encoder_map(uint8_t encoder_id, uint16_t *ccw_keycode, uint16_t *cw_keycode);
@@ -83,10 +90,20 @@ extern const slider_config_t slider_config_map[KEYMAP_LAYER_COUNT][1];
 void keymap_layer_on(uint8_t layer);
 void keymap_layer_off(uint8_t layer);
 void keymap_layer_move(uint8_t layer);
-uint8_t keymap_get_layer_mask(void);
+uint32_t keymap_get_layer_mask(void);
 uint8_t keymap_get_default_layer(void);
-void keymap_apply_layer_mask(uint8_t mask, uint8_t default_layer, bool propagate, bool update_default);
+void keymap_apply_layer_mask(uint32_t mask, uint8_t default_layer, bool propagate, bool update_default);
 void keymap_persist_default_layer_state(void);
 
+// Configuration profiles (EEPROM_PROFILE_COUNT); propagate also switches I2C peers
+bool keymap_set_profile(uint8_t profile, bool propagate);
+uint8_t keymap_get_profile(void);
+
+// Staged configuration: keymap, encoder and slider writes between begin and
+// commit are applied together and persisted once; abort drops them
+bool keymap_config_begin(void);
+bool keymap_config_commit(void);
+void keymap_config_abort(void);
+
 
 #endif // KEYMAP_H
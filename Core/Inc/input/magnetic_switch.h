@@ -45,6 +45,7 @@ extern uint8_t magnetic_switch_count;
 // Initialization
 void magnetic_switch_init(void);
 void magnetic_switch_setup_from_config(void);
+void magnetic_switch_reload_calibration(void);
 
 // Runtime functions
 void magnetic_switch_update(void);
@@ -29,4 +29,22 @@ void matrix_init(void);
 void matrix_scan(void);
 void matrix_register_callback(matrix_event_cb_t cb);
 
+// Resolve and dispatch one key event as if it came from the scan (used to
+// replay events held back by the combo and tap-hold engines)
+void matrix_process_key(uint8_t row, uint8_t col, uint8_t pressed);
+// Dispatch a keycode for a key, bypassing keymap lookup and tap-hold
+void matrix_dispatch_keycode(uint8_t row, uint8_t col, uint16_t keycode, uint8_t pressed);
+
+// trace_cycles() stamp of the scan that produced the event being dispatched;
+// valid inside the matrix callback
+uint32_t matrix_get_event_cycles(void);
+
+// TIM2 update interrupt hook for background scanning (MATRIX_SCAN_BACKGROUND)
+void matrix_timer_isr(void);
+// DMA1 channel 2 interrupt hook counting capture buffer wraps (MATRIX_SCAN_BACKGROUND, DMA mode)
+void matrix_dma_isr(void);
+
+// Background scan frames overwritten before the main loop diffed them
+uint32_t matrix_get_scan_overruns(void);
+
 #endif // MATRIX_H
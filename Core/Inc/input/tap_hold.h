@@ -0,0 +1,41 @@
+#ifndef TAP_HOLD_H
+#define TAP_HOLD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix.h"
+
+// Decision flags (stored per key / per profile in EEPROM)
+#define TAP_HOLD_PERMISSIVE_HOLD          0x01U  // Hold when another key is pressed and released inside the term
+#define TAP_HOLD_HOLD_ON_OTHER_KEY_PRESS  0x02U  // Hold as soon as another key is pressed inside the term
+#define TAP_HOLD_FLAGS_MASK               0x03U
+
+// Per-keyboard defaults, override in keyboards/<name>/config.h
+#ifndef TAP_HOLD_TERM_MS
+#define TAP_HOLD_TERM_MS 200
+#endif
+
+#ifndef TAP_HOLD_FLAGS
+#define TAP_HOLD_FLAGS 0
+#endif
+
+// Key events held back while a tap-hold key is undecided
+#ifndef TAP_HOLD_BUFFER_SIZE
+#define TAP_HOLD_BUFFER_SIZE 8
+#endif
+
+// Called by the matrix for every key event with the resolved keycode. Returns
+// true if the engine took the event (buffered or handled); keys that are not
+// tap-hold keys pass straight through while no tap-hold key is pending.
+bool tap_hold_process_key(uint8_t row, uint8_t col, uint16_t keycode, uint8_t pressed);
+
+// True while a release of this key is buffered and will be replayed through the matrix
+bool tap_hold_release_buffered(uint8_t row, uint8_t col);
+
+// Expire the tapping term; call once per matrix scan
+void tap_hold_task(void);
+
+// Effective term/flags for a key after per-key, profile and keyboard defaults
+void tap_hold_get_key_config(uint8_t row, uint8_t col, uint16_t *tapping_term_ms, uint8_t *flags);
+
+#endif // TAP_HOLD_H
@@ -1,16 +1,39 @@
 #ifndef KEY_STATE_H
 #define KEY_STATE_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
+// Keyboards may override KEY_STATE_NKRO in their config
+#ifdef KEYBOARD_CONFIG_HEADER
+    #include KEYBOARD_CONFIG_HEADER
+#endif
+
+// Report slots in the boot protocol keyboard report
 #define MAX_PRESSED_KEYS 6
 
+// 1: report mode sends a modifier byte + bitmap of usages 0x00-0x7F (NKRO),
+//    falling back to the 6-key boot report when the host selects boot protocol
+// 0: always send the boot report
+#ifndef KEY_STATE_NKRO
+#define KEY_STATE_NKRO 1
+#endif
+
+#define KEY_STATE_NKRO_BITMAP_BYTES 16
+
 void key_state_init(void);
 void key_state_add_key(uint8_t keycode);
 void key_state_remove_key(uint8_t keycode);
 void key_state_update_hid_report(void);
 void key_state_send_encoder_event(uint8_t keycode);
 uint8_t key_state_get_pressed_count(void);
+bool key_state_send_keyboard_report(uint8_t modifier, const uint8_t keycodes[MAX_PRESSED_KEYS]);
+void key_state_protocol_changed(void);
+void key_state_report_complete(void);
+void key_state_set_event_stamp(uint8_t source, uint32_t detect_cycles);
+uint32_t key_state_get_report_overflows(void);
+// True while snapshots are waiting for the host (lets generated input pace itself)
+bool key_state_report_pending(void);
 void key_state_task(void);
 
-#endif /* KEY_STATE_H */
\ No newline at end of file
+#endif /* KEY_STATE_H */
@@ -0,0 +1,48 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Input-to-USB latency statistics.
+ *
+ * Inputs are stamped with the DWT cycle counter (trace_cycles()) when they
+ * are detected; key_state carries the stamp with the HID report and records
+ * the delta once TinyUSB reports the transfer complete.
+ */
+
+typedef enum {
+    LATENCY_SRC_MATRIX = 0,   // Debounced matrix edge
+    LATENCY_SRC_ENCODER,      // Encoder detent
+    LATENCY_SRC_MAGNETIC,     // Magnetic switch threshold crossing
+    LATENCY_SRC_I2C,          // Slave key event received by the master
+    LATENCY_SRC_COUNT,
+    LATENCY_SRC_NONE = 0xFF
+} latency_source_t;
+
+// Histogram resolution used for the p99 estimate
+#define LATENCY_BIN_US    16U
+#define LATENCY_BIN_COUNT 128U
+
+typedef struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t avg_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+} latency_stats_t;
+
+void latency_record(uint8_t source, uint32_t cycles);
+bool latency_get_stats(uint8_t source, latency_stats_t *stats);
+void latency_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LATENCY_H */
@@ -0,0 +1,42 @@
+#ifndef MACRO_H
+#define MACRO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Macro byte-code. Macros are stored back to back in the EEPROM macro area and
+// KC_MACRO(n) plays the n-th one. Bytes 0x01-0x7F type that ASCII character.
+#define MACRO_END    0x00  // End of the macro
+#define MACRO_TAP    0x80  // usage(1): press and release a HID usage
+#define MACRO_DOWN   0x81  // usage(1): press a HID usage (released by MACRO_UP or the end of the macro)
+#define MACRO_UP     0x82  // usage(1): release a usage pressed with MACRO_DOWN
+#define MACRO_DELAY  0x83  // ms(2, little endian): wait before the next step
+
+// Characters received for typing (CDC text injection), waiting for playback
+#ifndef MACRO_TEXT_QUEUE_SIZE
+#define MACRO_TEXT_QUEUE_SIZE 256U
+#endif
+
+// Most keys pressed together in one report; 6 also fits the boot report
+#ifndef MACRO_FRAME_KEYS
+#define MACRO_FRAME_KEYS 6U
+#endif
+
+// Start macro n; false if it does not exist or another macro is still playing
+bool macro_play(uint8_t index);
+
+// Queue one character to be typed after the characters before it
+bool macro_queue_char(uint8_t ascii);
+
+// Drop queued text and the playing macro, releasing everything they hold
+void macro_stop(void);
+
+bool macro_busy(void);
+
+// Advance playback by at most one keyboard report; call from the main loop
+void macro_task(void);
+
+// US layout usage and modifier for a printable ASCII character, \n or \t
+bool macro_ascii_to_hid(uint8_t ascii, uint8_t *modifier, uint8_t *keycode);
+
+#endif // MACRO_H
@@ -39,6 +39,8 @@ enum op_keycode_ranges {
     OP_LAYER_TAP_TOGGLE_MAX        = 0x52DF,
     OP_PERSISTENT_DEF_LAYER        = 0x52E0,
     OP_PERSISTENT_DEF_LAYER_MAX    = 0x52FF,
+    OP_PROFILE                     = 0x5300,
+    OP_PROFILE_MAX                 = 0x530F,
     OP_SWAP_HANDS                  = 0x5600,
     OP_SWAP_HANDS_MAX              = 0x56FF,
     OP_TAP_DANCE                   = 0x5700,
@@ -257,6 +259,41 @@ enum op_keycode_defines {
 #define KC_TO(layer) OP_TO_LAYER(layer)
 #define KC_MO(layer) OP_MO_LAYER(layer)
 
+// Configuration profile keycode helpers
+#define OP_PROFILE_ID_MASK 0x0FU
+#define OP_PROFILE_SELECT(profile) ((uint16_t)(OP_PROFILE + ((profile) & OP_PROFILE_ID_MASK)))
+#define IS_OP_PROFILE(code) ((code) >= OP_PROFILE && (code) <= OP_PROFILE_MAX)
+#define OP_PROFILE_TARGET(code) ((uint8_t)((code) & OP_PROFILE_ID_MASK))
+
+#define KC_PROFILE(profile) OP_PROFILE_SELECT(profile)
+
+// Tap-hold keycode helpers: a basic key on tap, modifiers (mod-tap) or a
+// momentary layer (layer-tap, layers 0-15) while held
+#define OP_MOD_CTRL  0x01U
+#define OP_MOD_SHIFT 0x02U
+#define OP_MOD_ALT   0x04U
+#define OP_MOD_GUI   0x08U
+#define OP_MOD_RIGHT 0x10U  // Use the right-hand modifiers
+#define OP_MOD_TAP_KEY(mods, kc) ((uint16_t)(OP_MOD_TAP | (((mods) & 0x1FU) << 8) | ((kc) & 0xFFU)))
+#define OP_LAYER_TAP_KEY(layer, kc) ((uint16_t)(OP_LAYER_TAP | (((layer) & 0x0FU) << 8) | ((kc) & 0xFFU)))
+#define IS_OP_MOD_TAP(code) ((code) >= OP_MOD_TAP && (code) <= OP_MOD_TAP_MAX)
+#define IS_OP_LAYER_TAP(code) ((code) >= OP_LAYER_TAP && (code) <= OP_LAYER_TAP_MAX)
+#define IS_OP_TAP_HOLD(code) ((code) >= OP_MOD_TAP && (code) <= OP_LAYER_TAP_MAX)
+#define OP_TAP_HOLD_TAP_KEY(code) ((uint8_t)((code) & 0xFFU))
+#define OP_MOD_TAP_MODS(code) ((uint8_t)(((code) >> 8) & 0x1FU))
+#define OP_LAYER_TAP_LAYER(code) ((uint8_t)(((code) >> 8) & 0x0FU))
+
+#define KC_MT(mods, kc) OP_MOD_TAP_KEY(mods, kc)
+#define KC_LT(layer, kc) OP_LAYER_TAP_KEY(layer, kc)
+
+// Macro keycode helpers (macros 0-127 of the active profile's macro area)
+#define OP_MACRO_ID_MASK 0x7FU
+#define OP_MACRO_KEY(index) ((uint16_t)(OP_MACRO + ((index) & OP_MACRO_ID_MASK)))
+#define IS_OP_MACRO(code) ((code) >= OP_MACRO && (code) <= OP_MACRO_MAX)
+#define OP_MACRO_TARGET(code) ((uint8_t)((code) & OP_MACRO_ID_MASK))
+
+#define KC_MACRO(index) OP_MACRO_KEY(index)
+
 // MIDI helper functions
 // Helper function to get value index from MIDI value
 static inline uint8_t op_midi_get_value_index(uint8_t value) {
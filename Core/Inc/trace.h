@@ -0,0 +1,107 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "stm32g4xx.h"
+
+// Keyboards may override TRACE_COMPILE_LEVEL in their config
+#ifdef KEYBOARD_CONFIG_HEADER
+    #include KEYBOARD_CONFIG_HEADER
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Tokenized binary trace.
+ *
+ * Call sites emit an event ID, the DWT cycle counter and up to four raw
+ * 32-bit arguments into the CDC log stream; trace_decode.py turns them back
+ * into text using the format strings in trace_events.h. Sites above
+ * TRACE_COMPILE_LEVEL expand to nothing, arguments included.
+ *
+ * Record layout (little endian):
+ *   0xA5 | id(1) | nargs(1) | cycles(4) | args(4 * nargs)
+ */
+
+#define TRACE_LEVEL_NONE  0
+#define TRACE_LEVEL_ERROR 1
+#define TRACE_LEVEL_WARN  2
+#define TRACE_LEVEL_INFO  3
+#define TRACE_LEVEL_DEBUG 4
+
+#ifndef TRACE_COMPILE_LEVEL
+#define TRACE_COMPILE_LEVEL TRACE_LEVEL_INFO
+#endif
+
+#define TRACE_SYNC_BYTE 0xA5U
+#define TRACE_MAX_ARGS  4U
+
+typedef enum {
+#define TRACE_EVENT(name, fmt) TRACE_EVT_##name,
+#include "trace_events.h"
+#undef TRACE_EVENT
+    TRACE_EVT_COUNT
+} trace_event_id_t;
+
+/**
+ * @brief Enable the DWT cycle counter used for timestamps.
+ */
+void trace_init(void);
+
+void trace_set_enabled(bool enabled);
+bool trace_is_enabled(void);
+
+void trace_emit(uint8_t id, uint8_t nargs, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+
+static inline uint32_t trace_cycles(void)
+{
+    return DWT->CYCCNT;
+}
+
+// Pad the argument list to four values and pass the real count
+#define TRACE_NARGS_(_0, _1, _2, _3, _4, n, ...) n
+#define TRACE_NARGS(...) TRACE_NARGS_(_, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+#define TRACE_PAD_(_, a0, a1, a2, a3, ...) (uint32_t)(a0), (uint32_t)(a1), (uint32_t)(a2), (uint32_t)(a3)
+#define TRACE_EMIT(event, ...) \
+    trace_emit((uint8_t)TRACE_EVT_##event, (uint8_t)TRACE_NARGS(__VA_ARGS__), TRACE_PAD_(_, ##__VA_ARGS__, 0, 0, 0, 0))
+
+#if TRACE_COMPILE_LEVEL >= TRACE_LEVEL_ERROR
+#define TRACE_ERROR(event, ...) TRACE_EMIT(event, ##__VA_ARGS__)
+#else
+#define TRACE_ERROR(event, ...) ((void)0)
+#endif
+
+#if TRACE_COMPILE_LEVEL >= TRACE_LEVEL_WARN
+#define TRACE_WARN(event, ...) TRACE_EMIT(event, ##__VA_ARGS__)
+#else
+#define TRACE_WARN(event, ...) ((void)0)
+#endif
+
+#if TRACE_COMPILE_LEVEL >= TRACE_LEVEL_INFO
+#define TRACE_INFO(event, ...) TRACE_EMIT(event, ##__VA_ARGS__)
+#else
+#define TRACE_INFO(event, ...) ((void)0)
+#endif
+
+#if TRACE_COMPILE_LEVEL >= TRACE_LEVEL_DEBUG
+#define TRACE_DEBUG(event, ...) TRACE_EMIT(event, ##__VA_ARGS__)
+#else
+#define TRACE_DEBUG(event, ...) ((void)0)
+#endif
+
+// String arguments are limited to a small set of tokens the decoder knows
+#define TRACE_STR_PRESSED  0U
+#define TRACE_STR_RELEASED 1U
+#define TRACE_STR_CW       2U
+#define TRACE_STR_CCW      3U
+#define TRACE_STR_SENT     4U
+#define TRACE_STR_QUEUED   5U
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRACE_H */
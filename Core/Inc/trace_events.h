@@ -0,0 +1,37 @@
+/*
+ * Trace event table.
+ *
+ * Each entry is TRACE_EVENT(name, "format"). The firmware only sees the
+ * enumerated ID; the format strings are read from this file by
+ * trace_decode.py on the host, so keep one entry per line and only append
+ * (reordering changes the IDs of existing events).
+ * Formats use printf conversions on 32-bit arguments (%u, %d, %x, %02X...).
+ */
+TRACE_EVENT(KEY_EVENT,            "Key %s: row=%u, col=%u, keycode=0x%02X")
+TRACE_EVENT(KEY_ADDED,            "Added key 0x%02X, total pressed: %u")
+TRACE_EVENT(KEY_ALREADY_PRESSED,  "Key 0x%02X already pressed, ignoring")   // unused, see KEY_ADD_REF
+TRACE_EVENT(KEY_BUFFER_FULL,      "Key buffer full, dropping key 0x%02X")    // unused, see KEY_ROLLOVER
+TRACE_EVENT(KEY_REMOVED,          "Removed key 0x%02X, total pressed: %u")
+TRACE_EVENT(KEY_NOT_FOUND,        "Key 0x%02X not found in pressed array")   // unused, see KEY_RELEASE_UNPRESSED
+TRACE_EVENT(HID_REPORT,           "HID report updated: keys=%u modifiers=0x%02X, %s")   // unused, see HID_REPORT_SEND
+TRACE_EVENT(ENCODER_DETENT,       "Encoder %u: %s event (step=%d)")
+TRACE_EVENT(ENCODER_EVENT,        "Processing encoder event: idx=%u, dir=%s, keycode=0x%04X")
+TRACE_EVENT(ENCODER_TAP,          "Encoder event: keycode=0x%02X with %u held keys")
+TRACE_EVENT(ENCODER_TAP_FORCED,   "Encoder tap: previous event 0x%02X pending, forcing release")   // unused, taps are scheduled
+TRACE_EVENT(ENCODER_TAP_RELEASE,  "Encoder tap: triggering release for keycode=0x%02X")
+TRACE_EVENT(ENCODER_TAP_DONE,     "Encoder tap: completed for keycode=0x%02X")
+TRACE_EVENT(I2C_FIFO_PUSH,        "I2C FIFO: Pushed msg_type=0x%02X (count=%u)")
+TRACE_EVENT(I2C_FIFO_POP,         "I2C FIFO: Popped msg_type=0x%02X (count=%u)")
+TRACE_EVENT(I2C_SLAVE_QUEUE,      "Slave mode: queueing key event for master via I2C (row=%u, col=%u, pressed=%u, keycode=0x%02X)")
+TRACE_EVENT(I2C_MASTER_ENQUEUE,   "Master mode: enqueued local key event (row=%u, col=%u, pressed=%u, keycode=0x%02X)")
+TRACE_EVENT(I2C_MASTER_KEY,       "Master: Processing matrix key: %s keycode=0x%02X")
+TRACE_EVENT(I2C_MASTER_ENCODER,   "Master: Processing encoder event (%s), keycode=0x%02X")
+TRACE_EVENT(I2C_MASTER_BATCH,     "Master: processed %u queued events")
+TRACE_EVENT(HID_QUEUE_OVERFLOW,   "HID report queue full, merged transition (overflows=%u)")
+TRACE_EVENT(ENCODER_TAP_QUEUED,   "Encoder tap: keycode=0x%02X still tapping, %u taps queued")
+TRACE_EVENT(ENCODER_TAP_DROPPED,  "Encoder tap: no room for keycode=0x%02X, detent dropped")
+TRACE_EVENT(KEY_ADD_REF,          "Key 0x%02X already pressed (refs=%u)")
+TRACE_EVENT(KEY_ROLLOVER,         "Boot report rollover: %u keys pressed")
+TRACE_EVENT(KEY_RELEASE_UNPRESSED, "Key 0x%02X released but not pressed")
+TRACE_EVENT(HID_REPORT_SEND,      "HID report: pending=%u modifiers=0x%02X, %s")
+TRACE_EVENT(MATRIX_SCAN_OVERRUN,  "Matrix capture overrun: %u frames lost (total %u)")
@@ -0,0 +1,156 @@
+#include "cdc_log.h"
+#include "tusb.h"
+#include "class/cdc/cdc_device.h"
+#include "stm32g4xx_hal.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define CDC_LOG_MASK (CDC_LOG_BUFFER_SIZE - 1U)
+#define CDC_LOG_LINE_MAX 256U
+
+_Static_assert((CDC_LOG_BUFFER_SIZE & CDC_LOG_MASK) == 0U, "CDC_LOG_BUFFER_SIZE must be a power of two");
+
+static char log_ring[CDC_LOG_BUFFER_SIZE];
+// Free-running indices: writers advance head, cdc_log_task() advances tail
+static volatile uint32_t log_head = 0;
+static volatile uint32_t log_tail = 0;
+static volatile bool log_enabled = CDC_LOG_DEFAULT_ENABLED;
+static volatile uint32_t dropped_messages = 0;
+static volatile uint32_t dropped_bytes = 0;
+static uint32_t dropped_reported = 0;
+
+static bool cdc_log_append(const char *data, uint16_t len)
+{
+    if (data == NULL || len == 0U) {
+        return false;
+    }
+
+    // Writers can be interrupt handlers (I2C callbacks), so reserve and copy atomically
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    uint32_t head = log_head;
+    uint32_t free_space = CDC_LOG_BUFFER_SIZE - (head - log_tail);
+    if (len > free_space) {
+        dropped_messages++;
+        dropped_bytes += len;
+        __set_PRIMASK(primask);
+        return false;
+    }
+
+    uint32_t offset = head & CDC_LOG_MASK;
+    uint32_t first = CDC_LOG_BUFFER_SIZE - offset;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(&log_ring[offset], data, first);
+    memcpy(&log_ring[0], data + first, len - first);
+    log_head = head + len;
+
+    __set_PRIMASK(primask);
+    return true;
+}
+
+bool cdc_log_write(const char *data, uint16_t len)
+{
+    if (!log_enabled) {
+        return false;
+    }
+
+    return cdc_log_append(data, len);
+}
+
+bool cdc_log_write_record(const void *data, uint16_t len)
+{
+    return cdc_log_append((const char *)data, len);
+}
+
+void cdc_log_vprintf(const char *format, va_list args)
+{
+    if (!log_enabled) {
+        return;
+    }
+
+    char buffer[CDC_LOG_LINE_MAX];
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    if (len <= 0) {
+        return;
+    }
+    if ((uint32_t)len >= sizeof(buffer)) {
+        len = (int)sizeof(buffer) - 1;
+    }
+
+    cdc_log_write(buffer, (uint16_t)len);
+}
+
+void cdc_log_task(void)
+{
+    if (!tud_cdc_connected()) {
+        return;
+    }
+
+    // Report drops in-band once there is room again
+    uint32_t dropped = dropped_messages;
+    if (dropped != dropped_reported && log_enabled) {
+        char notice[48];
+        int len = snprintf(notice, sizeof(notice), "[log] %lu message(s) dropped\r\n",
+                           (unsigned long)(dropped - dropped_reported));
+        if (len > 0 && cdc_log_write(notice, (uint16_t)len)) {
+            dropped_reported = dropped;
+        }
+    }
+
+    uint32_t available = tud_cdc_write_available();
+    uint32_t head = log_head;
+    uint32_t tail = log_tail;
+    bool wrote = false;
+
+    while (available > 0U && tail != head) {
+        uint32_t offset = tail & CDC_LOG_MASK;
+        uint32_t chunk = head - tail;
+        if (chunk > CDC_LOG_BUFFER_SIZE - offset) {
+            chunk = CDC_LOG_BUFFER_SIZE - offset;
+        }
+        if (chunk > available) {
+            chunk = available;
+        }
+
+        uint32_t written = tud_cdc_write(&log_ring[offset], chunk);
+        if (written == 0U) {
+            break;
+        }
+        tail += written;
+        available -= written;
+        wrote = true;
+    }
+
+    log_tail = tail;
+
+    if (wrote) {
+        tud_cdc_write_flush();
+    }
+}
+
+void cdc_log_set_enabled(bool enabled)
+{
+    log_enabled = enabled;
+}
+
+bool cdc_log_is_enabled(void)
+{
+    return log_enabled;
+}
+
+void cdc_log_get_stats(cdc_log_stats_t *stats)
+{
+    if (stats == NULL) {
+        return;
+    }
+
+    stats->dropped_messages = dropped_messages;
+    stats->dropped_bytes = dropped_bytes;
+    stats->buffered_bytes = (uint16_t)(log_head - log_tail);
+    stats->capacity = (uint16_t)CDC_LOG_BUFFER_SIZE;
+    stats->enabled = log_enabled;
+}
@@ -4,10 +4,17 @@
 #include "input/board_layout.h"
 #include "input/slider.h"
 #include "input/magnetic_switch.h"
+#include "input/debounce.h"
+#include "input/tap_hold.h"
+#include "input/combo.h"
+#include "macro.h"
 #include "i2c_manager.h"
 #include "i2c.h"  // Added to include hi2c2 declaration
 #include "pin_config.h"
 #include "eeprom_emulation.h"
+#include "cdc_log.h"
+#include "latency.h"
+#include "trace.h"
 #include "device_info_util.h"
 #include "tusb.h"
 #include "class/hid/hid_device.h"
@@ -37,6 +44,9 @@ static void handle_get_layout_cell_type(const config_packet_t *request, config_p
 static void handle_get_layout_cell_component_id(const config_packet_t *request, config_packet_t *response);
 static void handle_set_layer_state(const config_packet_t *request, config_packet_t *response);
 static void handle_get_layer_state(config_packet_t *response);
+static void handle_set_layer_state_32(const config_packet_t *request, config_packet_t *response);
+static void handle_get_layer_state_32(config_packet_t *response);
+static void apply_layer_state(uint32_t mask, uint8_t default_layer, bool has_options, uint8_t options);
 static void handle_midi_send_raw(const config_packet_t *request, config_packet_t *response);
 static void handle_midi_note_on(const config_packet_t *request, config_packet_t *response);
 static void handle_midi_note_off(const config_packet_t *request, config_packet_t *response);
@@ -53,6 +63,42 @@ static void handle_get_magnetic_switch_config(const config_packet_t *request, co
 static void handle_set_magnetic_switch_config(const config_packet_t *request, config_packet_t *response);
 static void handle_calibrate_magnetic_switch(const config_packet_t *request, config_packet_t *response);
 static void handle_set_magnetic_switch_sensitivity(const config_packet_t *request, config_packet_t *response);
+
+// Debounce protocol handlers
+static void handle_get_debounce_config(config_packet_t *response);
+static void handle_set_debounce_config(const config_packet_t *request, config_packet_t *response);
+
+// Tap-hold protocol handlers
+static void handle_get_tap_hold_config(const config_packet_t *request, config_packet_t *response);
+static void handle_set_tap_hold_config(const config_packet_t *request, config_packet_t *response);
+
+// Combo protocol handlers
+static void handle_get_combo(const config_packet_t *request, config_packet_t *response);
+static void handle_set_combo(const config_packet_t *request, config_packet_t *response);
+static void handle_set_combo_term(const config_packet_t *request, config_packet_t *response);
+
+// Macro protocol handlers
+static void handle_get_macro_data(const config_packet_t *request, config_packet_t *response);
+static void handle_set_macro_data(const config_packet_t *request, config_packet_t *response);
+
+// CDC log protocol handlers
+static void handle_get_log_status(config_packet_t *response);
+static void handle_set_log_enabled(const config_packet_t *request, config_packet_t *response);
+
+// Latency protocol handlers
+static void handle_get_latency_stats(const config_packet_t *request, config_packet_t *response);
+
+// EEPROM protocol handlers
+static void handle_get_eeprom_status(config_packet_t *response);
+
+// Profile protocol handlers
+static void handle_get_profile(config_packet_t *response);
+static void handle_set_profile(const config_packet_t *request, config_packet_t *response);
+
+// Staged configuration handlers
+static void handle_config_begin(config_packet_t *response);
+static void handle_config_commit(config_packet_t *response);
+static void handle_config_abort(config_packet_t *response);
 static bool request_keymap_from_slave(uint8_t slave_addr, uint8_t layer, uint8_t row, uint8_t col, uint16_t *keycode);
 static bool send_keymap_to_slave(uint8_t slave_addr, uint8_t layer, uint8_t row, uint8_t col, uint16_t keycode);
 static bool request_encoder_from_slave(uint8_t slave_addr, uint8_t layer, uint8_t encoder_id, uint16_t *ccw_keycode, uint16_t *cw_keycode);
@@ -617,6 +663,86 @@ bool config_protocol_process_packet(const config_packet_t *packet)
             handle_set_magnetic_switch_sensitivity(&rx_packet, &tx_packet);
             break;
 
+        case CMD_GET_DEBOUNCE_CONFIG:
+            handle_get_debounce_config(&tx_packet);
+            break;
+
+        case CMD_SET_DEBOUNCE_CONFIG:
+            handle_set_debounce_config(packet, &tx_packet);
+            break;
+
+        case CMD_GET_TAP_HOLD_CONFIG:
+            handle_get_tap_hold_config(packet, &tx_packet);
+            break;
+
+        case CMD_SET_TAP_HOLD_CONFIG:
+            handle_set_tap_hold_config(packet, &tx_packet);
+            break;
+
+        case CMD_GET_COMBO:
+            handle_get_combo(packet, &tx_packet);
+            break;
+
+        case CMD_SET_COMBO:
+            handle_set_combo(packet, &tx_packet);
+            break;
+
+        case CMD_SET_COMBO_TERM:
+            handle_set_combo_term(packet, &tx_packet);
+            break;
+
+        case CMD_GET_MACRO_DATA:
+            handle_get_macro_data(packet, &tx_packet);
+            break;
+
+        case CMD_SET_MACRO_DATA:
+            handle_set_macro_data(packet, &tx_packet);
+            break;
+
+        case CMD_GET_LOG_STATUS:
+            handle_get_log_status(&tx_packet);
+            break;
+
+        case CMD_SET_LOG_ENABLED:
+            handle_set_log_enabled(packet, &tx_packet);
+            break;
+
+        case CMD_GET_LATENCY_STATS:
+            handle_get_latency_stats(packet, &tx_packet);
+            break;
+
+        case CMD_GET_EEPROM_STATUS:
+            handle_get_eeprom_status(&tx_packet);
+            break;
+
+        case CMD_GET_PROFILE:
+            handle_get_profile(&tx_packet);
+            break;
+
+        case CMD_SET_PROFILE:
+            handle_set_profile(packet, &tx_packet);
+            break;
+
+        case CMD_CONFIG_BEGIN:
+            handle_config_begin(&tx_packet);
+            break;
+
+        case CMD_CONFIG_COMMIT:
+            handle_config_commit(&tx_packet);
+            break;
+
+        case CMD_CONFIG_ABORT:
+            handle_config_abort(&tx_packet);
+            break;
+
+        case CMD_SET_LAYER_STATE_32:
+            handle_set_layer_state_32(packet, &tx_packet);
+            break;
+
+        case CMD_GET_LAYER_STATE_32:
+            handle_get_layer_state_32(&tx_packet);
+            break;
+
         case CMD_MIDI_SEND_RAW:
             handle_midi_send_raw(packet, &tx_packet);
             break;
@@ -796,16 +922,9 @@ static void handle_set_keymap(const config_packet_t *request, config_packet_t *r
     }
     
     // Set keycode in EEPROM
+    // Committed to flash by eeprom_task() once the configurator goes idle
     if (keymap_set_keycode(entry->layer, entry->row, entry->col, entry->keycode)) {
-        // Save configuration to EEPROM immediately for consistency
-        if (eeprom_save_config()) {
-            response->status = STATUS_OK;
-            usb_app_cdc_printf("Config: Set keycode R%dC%d L%d = 0x%04X (saved to EEPROM)\r\n", 
-                         entry->row, entry->col, entry->layer, entry->keycode);
-        } else {
-            response->status = STATUS_ERROR;
-            usb_app_cdc_printf("Config: Failed to save keycode to EEPROM\r\n");
-        }
+        response->status = STATUS_OK;
     } else {
         response->status = STATUS_ERROR;
     }
@@ -861,16 +980,11 @@ static void handle_set_encoder_map(const config_packet_t *request, config_packet
     }
     
     // Set encoder mapping in EEPROM
+    // Committed to flash by eeprom_task() once the configurator goes idle
     if (keymap_set_encoder_map(entry->layer, entry->encoder_id, entry->ccw_keycode, entry->cw_keycode)) {
-        // Save configuration to EEPROM immediately for consistency
-        if (eeprom_save_config()) {
-            response->status = STATUS_OK;
-            usb_app_cdc_printf("Config: Set encoder E%d L%d = CCW:0x%04X CW:0x%04X (saved to EEPROM)\r\n", 
-                         entry->encoder_id, entry->layer, entry->ccw_keycode, entry->cw_keycode);
-        } else {
-            response->status = STATUS_ERROR;
-            usb_app_cdc_printf("Config: Failed to save encoder to EEPROM\r\n");
-        }
+        response->status = STATUS_OK;
+        usb_app_cdc_printf("Config: Set encoder E%d L%d = CCW:0x%04X CW:0x%04X\r\n", 
+                     entry->encoder_id, entry->layer, entry->ccw_keycode, entry->cw_keycode);
     } else {
         response->status = STATUS_ERROR;
     }
@@ -986,25 +1100,18 @@ static void handle_get_layout_cell_component_id(const config_packet_t *request,
     usb_app_cdc_printf("Config: Layout component ID at (%u,%u) = %u\r\n", row, col, component_id);
 }
 
-static void handle_set_layer_state(const config_packet_t *request, config_packet_t *response)
+// options bit 0: take default_layer as the new default, bit 1: also persist it.
+// Without options the default follows default_layer when it changes.
+static void apply_layer_state(uint32_t mask, uint8_t default_layer, bool has_options, uint8_t options)
 {
-    if (request->payload_length < 2) {
-        response->status = STATUS_INVALID_PARAM;
-        return;
-    }
-
-    uint8_t mask = request->payload[0];
-    uint8_t default_layer = request->payload[1];
-    uint8_t current_default = keymap_get_default_layer();
     bool update_default = false;
     bool persist_default = false;
 
-    if (request->payload_length >= 3) {
-        uint8_t options = request->payload[2];
+    if (has_options) {
         update_default = (options & 0x01u) != 0u;
         persist_default = (options & 0x02u) != 0u;
     } else {
-        if (default_layer < KEYMAP_LAYER_COUNT && default_layer != current_default) {
+        if (default_layer < KEYMAP_LAYER_COUNT && default_layer != keymap_get_default_layer()) {
             update_default = true;
         }
     }
@@ -1014,8 +1121,20 @@ static void handle_set_layer_state(const config_packet_t *request, config_packet
     if (update_default && persist_default) {
         keymap_persist_default_layer_state();
     }
+}
+
+static void handle_set_layer_state(const config_packet_t *request, config_packet_t *response)
+{
+    if (request->payload_length < 2) {
+        response->status = STATUS_INVALID_PARAM;
+        return;
+    }
+
+    // The 8-bit form only addresses layers 0-7; higher layers stay as they are
+    uint32_t mask = (keymap_get_layer_mask() & ~(uint32_t)0xFFu) | request->payload[0];
+    apply_layer_state(mask, request->payload[1], request->payload_length >= 3, request->payload[2]);
 
-    response->payload[0] = keymap_get_layer_mask();
+    response->payload[0] = (uint8_t)keymap_get_layer_mask();
     response->payload[1] = keymap_get_default_layer();
     response->payload_length = 2;
     response->status = STATUS_OK;
@@ -1026,12 +1145,48 @@ static void handle_set_layer_state(const config_packet_t *request, config_packet
 
 static void handle_get_layer_state(config_packet_t *response)
 {
-    response->payload[0] = keymap_get_layer_mask();
+    response->payload[0] = (uint8_t)keymap_get_layer_mask();
     response->payload[1] = keymap_get_default_layer();
     response->payload_length = 2;
     response->status = STATUS_OK;
 }
 
+static void handle_set_layer_state_32(const config_packet_t *request, config_packet_t *response)
+{
+    if (request->payload_length < 5) {
+        response->status = STATUS_INVALID_PARAM;
+        return;
+    }
+
+    uint32_t mask = (uint32_t)request->payload[0] | ((uint32_t)request->payload[1] << 8) |
+                    ((uint32_t)request->payload[2] << 16) | ((uint32_t)request->payload[3] << 24);
+    apply_layer_state(mask, request->payload[4], request->payload_length >= 6, request->payload[5]);
+
+    uint32_t active = keymap_get_layer_mask();
+    response->payload[0] = (uint8_t)active;
+    response->payload[1] = (uint8_t)(active >> 8);
+    response->payload[2] = (uint8_t)(active >> 16);
+    response->payload[3] = (uint8_t)(active >> 24);
+    response->payload[4] = keymap_get_default_layer();
+    response->payload_length = 5;
+    response->status = STATUS_OK;
+
+    usb_app_cdc_printf("Config: Set layer state mask=0x%08lX default=%d\r\n", active, response->payload[4]);
+}
+
+static void handle_get_layer_state_32(config_packet_t *response)
+{
+    uint32_t active = keymap_get_layer_mask();
+    response->payload[0] = (uint8_t)active;
+    response->payload[1] = (uint8_t)(active >> 8);
+    response->payload[2] = (uint8_t)(active >> 16);
+    response->payload[3] = (uint8_t)(active >> 24);
+    response->payload[4] = keymap_get_default_layer();
+    response->payload[5] = KEYMAP_LAYER_COUNT;
+    response->payload_length = 6;
+    response->status = STATUS_OK;
+}
+
 static void handle_midi_send_raw(const config_packet_t *request, config_packet_t *response)
 {
     if (request->payload_length < 4) {
@@ -1204,17 +1359,12 @@ static void handle_set_slider_config(const config_packet_t *request, config_pack
     }
 
     // Set slider configuration for the specified layer
+    // Committed to flash by eeprom_task() once the configurator goes idle
     if (keymap_set_slider_config(config->layer, config->slider_id, config)) {
-        // Save configuration to EEPROM immediately for simplicity
-        if (eeprom_save_config()) {
-            response->status = STATUS_OK;
-            usb_app_cdc_printf("Config: Set slider %d layer %d config - CC%d Ch%d Range%d-%d (saved to EEPROM)\r\n", 
-                         config->slider_id, config->layer, config->midi_cc, config->midi_channel,
-                         config->min_midi_value, config->max_midi_value);
-        } else {
-            response->status = STATUS_ERROR;
-            usb_app_cdc_printf("Config: Failed to save slider config to EEPROM\r\n");
-        }
+        response->status = STATUS_OK;
+        usb_app_cdc_printf("Config: Set slider %d layer %d config - CC%d Ch%d Range%d-%d\r\n", 
+                     config->slider_id, config->layer, config->midi_cc, config->midi_channel,
+                     config->min_midi_value, config->max_midi_value);
     } else {
         response->status = STATUS_ERROR;
     }
@@ -1395,4 +1545,335 @@ static void handle_set_magnetic_switch_sensitivity(const config_packet_t *reques
 #else
     response->status = STATUS_NOT_SUPPORTED;
 #endif
-}
\ No newline at end of file
+}
+
+static void handle_get_debounce_config(config_packet_t *response)
+{
+    uint8_t algorithm = 0;
+    uint8_t time_ms = 0;
+    debounce_get_config(&algorithm, &time_ms);
+
+    response->payload[0] = algorithm;
+    response->payload[1] = time_ms;
+    response->payload[2] = DEBOUNCE_ALGORITHM;
+    response->payload[3] = DEBOUNCE_MS;
+    response->payload_length = 4;
+    response->status = STATUS_OK;
+}
+
+static void handle_set_debounce_config(const config_packet_t *request, config_packet_t *response)
+{
+    if (request->payload_length < 2) {
+        response->status = STATUS_INVALID_PARAM;
+        return;
+    }
+
+    uint8_t algorithm = request->payload[0];
+    uint8_t time_ms = request->payload[1];
+
+    // Algorithm 0 drops the stored override and returns to the keyboard default
+    uint8_t effective_algorithm = (algorithm == 0) ? DEBOUNCE_ALGORITHM : algorithm;
+    uint8_t effective_ms = (algorithm == 0) ? DEBOUNCE_MS : time_ms;
+
+    if (!debounce_set_config(effective_algorithm, effective_ms)) {
+        response->status = STATUS_INVALID_PARAM;
+        return;
+    }
+
+    if (eeprom_set_debounce_config(algorithm, (algorithm == 0) ? 0 : time_ms)) {
+        response->status = STATUS_OK;
+        usb_app_cdc_printf("Config: Debounce set to algorithm=%u time=%ums\r\n", effective_algorithm, effective_ms);
+    } else {
+        response->status = STATUS_ERROR;
+    }
+}
+
+static void handle_get_tap_hold_config(const config_packet_t *request, config_packet_t *response)
+{
+    if (request->payload_length < 2) {
+        response->status = STATUS_INVALID_PARAM;
+        return;
+    }
+
+    uint8_t row = request->payload[0];
+    uint8_t col = request->payload[1];
+    uint16_t term_ms = 0;
+    uint8_t flags = 0;
+    if (!eeprom_get_tap_hold_config(row, col, &term_ms, &flags)) {
+        response->status = STATUS_INVALID_PARAM;
+        return;
+    }
+
+    uint16_t effective_ms = TAP_HOLD_TERM_MS;
+    uint8_t effective_flags = TAP_HOLD_FLAGS;
+    if (row == EEPROM_TAP_HOLD_PROFILE) {
+        if (term_ms != 0) {
+            effective_ms = term_ms;
+            effective_flags = flags;
+        }
+    } else {
+        tap_hold_get_key_config(row, col, &effective_ms, &effective_flags);
+    }
+
+    response->payload[0] = row;
+    response->payload[1] = col;
+    response->payload[2] = (uint8_t)term_ms;
+    response->payload[3] = (uint8_t)(term_ms >> 8);
+    response->payload[4] = flags;
+    response->payload[5] = (uint8_t)effective_ms;
+    response->payload[6] = (uint8_t)(effective_ms >> 8);
+    response->payload[7] = effective_flags;
+    response->payload_length = 8;
+    response->status = STATUS_OK;
+}
+
+static void handle_set_tap_hold_config(const config_packet_t *request, config_packet_t *response)
+{
+    if (request->payload_length < 5) {
+        response->status = STATUS_INVALID_PARAM;
+        return;
+    }
+
+    uint8_t row = request->payload[0];
+    uint8_t col = request->payload[1];
+    uint16_t term_ms = (uint16_t)(request->payload[2] | (request->payload[3] << 8));
+    uint8_t flags = request->payload[4];
+
+    if (flags & ~TAP_HOLD_FLAGS_MASK) {
+        response->status = STATUS_INVALID_PARAM;
+        return;
+    }
+
+    if (eeprom_set_tap_hold_config(row, col, term_ms, flags)) {
+        response->status = STATUS_OK;
+        usb_app_cdc_printf("Config: Tap-hold[%u][%u] set to term=%ums flags=0x%02X\r\n", row, col, term_ms, flags);
+    } else {
+        response->status = STATUS_INVALID_PARAM;
+    }
+}
+
+static void handle_get_combo(const config_packet_t *request, config_packet_t *response)
+{
+    combo_eeprom_t combo;
+    if (request->payload_length < 1 || !eeprom_get_combo(request->payload[0], &combo)) {
+        response->status = STATUS_INVALID_PARAM;
+        return;
+    }
+
+    uint16_t term_ms = combo_get_term();
+    response->payload[0] = request->payload[0];
+    response->payload[1] = combo.layer;
+    memcpy(&response->payload[2], combo.keys, EEPROM_COMBO_KEYS);
+    response->payload[6] = (uint8_t)combo.keycode;
+    response->payload[7] = (uint8_t)(combo.keycode >> 8);
+    response->payload[8] = EEPROM_COMBO_COUNT;
+    response->payload[9] = (uint8_t)term_ms;
+    response->payload[10] = (uint8_t)(term_ms >> 8);
+    response->payload_length = 11;
+    response->status = STATUS_OK;
+}
+
+static void handle_set_combo(const config_packet_t *request, config_packet_t *response)
+{
+    if (request->payload_length < 8) {
+        response->status = STATUS_INVALID_PARAM;
+        return;
+    }
+
+    uint8_t index = request->payload[0];
+    combo_eeprom_t combo;
+    combo.layer = request->payload[1];
+    memcpy(combo.keys, &request->payload[2], EEPROM_COMBO_KEYS);
+    combo.keycode = (uint16_t)(request->payload[6] | (request->payload[7] << 8));
+
+    if (!eeprom_set_combo(index, &combo)) {
+        response->status = STATUS_INVALID_PARAM;
+        return;
+    }
+
+    combo_invalidate_cache();
+    response->status = STATUS_OK;
+    usb_app_cdc_printf("Config: Combo %u set to layer=%u keycode=0x%04X\r\n", index, combo.layer, combo.keycode);
+}
+
+static void handle_set_combo_term(const config_packet_t *request, config_packet_t *response)
+{
+    if (request->payload_length < 2) {
+        response->status = STATUS_INVALID_PARAM;
+        return;
+    }
+
+    uint16_t term_ms = (uint16_t)(request->payload[0] | (request->payload[1] << 8));
+    if (!eeprom_set_combo_term(term_ms)) {
+        response->status = STATUS_ERROR;
+        return;
+    }
+
+    combo_invalidate_cache();
+    response->status = STATUS_OK;
+    usb_app_cdc_printf("Config: Combo term set to %ums\r\n", combo_get_term());
+}
+
+static void handle_get_macro_data(const config_packet_t *request, config_packet_t *response)
+{
+    if (request->payload_length < 3) {
+        response->status = STATUS_INVALID_PARAM;
+        return;
+    }
+
+    uint16_t offset = (uint16_t)(request->payload[0] | (request->payload[1] << 8));
+    uint8_t length = request->payload[2];
+    if (length > CONFIG_MAX_PAYLOAD_SIZE - 5U ||
+        !eeprom_get_macro_data(offset, &response->payload[5], length)) {
+        response->status = STATUS_INVALID_PARAM;
+        return;
+    }
+
+    response->payload[0] = (uint8_t)offset;
+    response->payload[1] = (uint8_t)(offset >> 8);
+    response->payload[2] = length;
+    response->payload[3] = (uint8_t)EEPROM_MACRO_BYTES;
+    response->payload[4] = (uint8_t)(EEPROM_MACRO_BYTES >> 8);
+    response->payload_length = (uint8_t)(5U + length);
+    response->status = STATUS_OK;
+}
+
+static void handle_set_macro_data(const config_packet_t *request, config_packet_t *response)
+{
+    if (request->payload_length < 3 || request->payload[2] > request->payload_length - 3U) {
+        response->status = STATUS_INVALID_PARAM;
+        return;
+    }
+
+    uint16_t offset = (uint16_t)(request->payload[0] | (request->payload[1] << 8));
+    uint8_t length = request->payload[2];
+
+    // Playback reads the area in place
+    macro_stop();
+    if (!eeprom_set_macro_data(offset, &request->payload[3], length)) {
+        response->status = STATUS_INVALID_PARAM;
+        return;
+    }
+
+    response->status = STATUS_OK;
+    usb_app_cdc_printf("Config: Macro data %u+%u written\r\n", offset, length);
+}
+
+static void handle_get_log_status(config_packet_t *response)
+{
+    cdc_log_stats_t stats;
+    cdc_log_get_stats(&stats);
+
+    response->payload[0] = stats.enabled ? 1 : 0;
+    memcpy(&response->payload[1], &stats.dropped_messages, sizeof(stats.dropped_messages));
+    memcpy(&response->payload[5], &stats.dropped_bytes, sizeof(stats.dropped_bytes));
+    memcpy(&response->payload[9], &stats.buffered_bytes, sizeof(stats.buffered_bytes));
+    memcpy(&response->payload[11], &stats.capacity, sizeof(stats.capacity));
+    response->payload[13] = trace_is_enabled() ? 1 : 0;
+    response->payload_length = 14;
+    response->status = STATUS_OK;
+}
+
+static void handle_set_log_enabled(const config_packet_t *request, config_packet_t *response)
+{
+    if (request->payload_length < 1) {
+        response->status = STATUS_INVALID_PARAM;
+        return;
+    }
+
+    cdc_log_set_enabled(request->payload[0] != 0);
+    // Binary trace records can be switched off separately to keep plain text logging readable
+    if (request->payload_length >= 2) {
+        trace_set_enabled(request->payload[1] != 0);
+    }
+    response->status = STATUS_OK;
+}
+
+static void handle_get_latency_stats(const config_packet_t *request, config_packet_t *response)
+{
+    if (request->payload_length < 1 || request->payload[0] >= LATENCY_SRC_COUNT) {
+        response->status = STATUS_INVALID_PARAM;
+        return;
+    }
+
+    latency_stats_t stats;
+    uint8_t source = request->payload[0];
+    latency_get_stats(source, &stats);
+
+    response->payload[0] = source;
+    memcpy(&response->payload[1], &stats.count, sizeof(stats.count));
+    memcpy(&response->payload[5], &stats.min_us, sizeof(stats.min_us));
+    memcpy(&response->payload[9], &stats.avg_us, sizeof(stats.avg_us));
+    memcpy(&response->payload[13], &stats.p99_us, sizeof(stats.p99_us));
+    memcpy(&response->payload[17], &stats.max_us, sizeof(stats.max_us));
+    response->payload_length = 21;
+    response->status = STATUS_OK;
+
+    // Optional reset after read, so the host can sample fixed windows
+    if (request->payload_length >= 2 && request->payload[1] != 0) {
+        latency_reset();
+    }
+}
+
+static void handle_get_eeprom_status(config_packet_t *response)
+{
+    eeprom_status_t status;
+    eeprom_get_status(&status);
+
+    response->payload[0] = status.dirty ? 1 : 0;
+    response->payload[1] = status.writing ? 1 : 0;
+    response->payload[2] = status.last_commit_ok ? 1 : 0;
+    memcpy(&response->payload[3], &status.commit_in_ms, sizeof(status.commit_in_ms));
+    memcpy(&response->payload[7], &status.migration_dropped, sizeof(status.migration_dropped));
+    response->payload_length = 9;
+    response->status = STATUS_OK;
+}
+
+static void handle_get_profile(config_packet_t *response)
+{
+    response->payload[0] = keymap_get_profile();
+    response->payload[1] = EEPROM_PROFILE_COUNT;
+    response->payload_length = 2;
+    response->status = STATUS_OK;
+}
+
+static void handle_set_profile(const config_packet_t *request, config_packet_t *response)
+{
+    if (request->payload_length < 1 || request->payload[0] >= EEPROM_PROFILE_COUNT) {
+        response->status = STATUS_INVALID_PARAM;
+        return;
+    }
+
+    // Slaves follow through the layer state broadcast
+    if (!keymap_set_profile(request->payload[0], true)) {
+        response->status = STATUS_ERROR;
+        return;
+    }
+
+    handle_get_profile(response);
+    usb_app_cdc_printf("Config: Profile %d active\r\n", response->payload[0]);
+}
+
+static void handle_config_begin(config_packet_t *response)
+{
+    response->status = keymap_config_begin() ? STATUS_OK : STATUS_ERROR;
+    usb_app_cdc_printf("Config: Staging configuration changes\r\n");
+}
+
+static void handle_config_commit(config_packet_t *response)
+{
+    // Nothing to commit outside a transaction
+    if (!eeprom_stage_active()) {
+        response->status = STATUS_INVALID_PARAM;
+        return;
+    }
+
+    response->status = keymap_config_commit() ? STATUS_OK : STATUS_ERROR;
+    usb_app_cdc_printf("Config: Staged configuration committed\r\n");
+}
+
+static void handle_config_abort(config_packet_t *response)
+{
+    keymap_config_abort();
+    response->status = STATUS_OK;
+}
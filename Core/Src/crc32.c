@@ -0,0 +1,124 @@
+#include "crc32.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(USE_HAL_DRIVER) && !defined(CRC32_SOFTWARE)
+#include "stm32g4xx_hal.h"
+
+static bool crc32_ready = false;
+
+void crc32_init(void)
+{
+    __HAL_RCC_CRC_CLK_ENABLE();
+
+    CRC->POL = 0x04C11DB7U;
+    CRC->INIT = 0xFFFFFFFFU;
+    // 32-bit polynomial, input bit-reversed per byte, output bit-reversed
+    CRC->CR = CRC_CR_REV_IN_0 | CRC_CR_REV_OUT;
+    crc32_ready = true;
+}
+
+void crc32_begin(void)
+{
+    if (!crc32_ready) {
+        crc32_init();
+    }
+
+    CRC->CR |= CRC_CR_RESET;
+}
+
+void crc32_update(const void *data, uint32_t length)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+
+    // The unit shifts each write in MSB first; byte-swapping the little-endian
+    // word keeps the stream in memory order, and REV_IN then makes each byte LSB first
+    while (length >= 4U) {
+        uint32_t word;
+        memcpy(&word, bytes, sizeof(word));
+        CRC->DR = __REV(word);
+        bytes += 4U;
+        length -= 4U;
+    }
+
+    while (length > 0U) {
+        *(volatile uint8_t *)&CRC->DR = *bytes++;
+        length--;
+    }
+}
+
+uint32_t crc32_finish(void)
+{
+    return ~CRC->DR;
+}
+
+#else
+
+static uint32_t crc32_table[4][256];
+static bool crc32_ready = false;
+static uint32_t crc32_state = 0xFFFFFFFFU;
+
+void crc32_init(void)
+{
+    for (uint32_t i = 0; i < 256U; i++) {
+        uint32_t crc = i;
+        for (uint8_t bit = 0; bit < 8U; bit++) {
+            crc = (crc & 1U) ? ((crc >> 1) ^ 0xEDB88320U) : (crc >> 1);
+        }
+        crc32_table[0][i] = crc;
+    }
+
+    for (uint32_t i = 0; i < 256U; i++) {
+        for (uint8_t slice = 1; slice < 4U; slice++) {
+            uint32_t prev = crc32_table[slice - 1U][i];
+            crc32_table[slice][i] = (prev >> 8) ^ crc32_table[0][prev & 0xFFU];
+        }
+    }
+    crc32_ready = true;
+}
+
+void crc32_begin(void)
+{
+    if (!crc32_ready) {
+        crc32_init();
+    }
+
+    crc32_state = 0xFFFFFFFFU;
+}
+
+void crc32_update(const void *data, uint32_t length)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint32_t crc = crc32_state;
+
+    while (length >= 4U) {
+        crc ^= (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) |
+               ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+        crc = crc32_table[3][crc & 0xFFU] ^ crc32_table[2][(crc >> 8) & 0xFFU] ^
+              crc32_table[1][(crc >> 16) & 0xFFU] ^ crc32_table[0][crc >> 24];
+        bytes += 4U;
+        length -= 4U;
+    }
+
+    while (length > 0U) {
+        crc = (crc >> 8) ^ crc32_table[0][(crc ^ *bytes++) & 0xFFU];
+        length--;
+    }
+
+    crc32_state = crc;
+}
+
+uint32_t crc32_finish(void)
+{
+    return ~crc32_state;
+}
+
+#endif
+
+uint32_t crc32_compute(const void *data, uint32_t length)
+{
+    crc32_begin();
+    crc32_update(data, length);
+    return crc32_finish();
+}
@@ -1,4 +1,6 @@
 #include "eeprom_emulation.h"
+#include "eeprom_flash.h"
+#include "crc32.h"
 #include "stm32g4xx_hal.h"
 #include "input/keymap.h"
 #include "usb_app.h"
@@ -14,32 +16,1506 @@ typedef struct {
     uint8_t reserved[64];
 } __attribute__((packed)) eeprom_data_v1_t;
 
+// Images up to v4 were written by the 8-layer engine
+#define EEPROM_LEGACY_LAYER_COUNT   8U
+#define EEPROM_LEGACY_LAYERS_LOADED ((KEYMAP_LAYER_COUNT < EEPROM_LEGACY_LAYER_COUNT) ? KEYMAP_LAYER_COUNT : EEPROM_LEGACY_LAYER_COUNT)
+
 typedef struct {
     uint32_t magic;
     uint32_t version;
     uint32_t checksum;
-    uint16_t keymap[KEYMAP_LAYER_COUNT][MATRIX_ROWS][MATRIX_COLS];
-    uint16_t encoder_map[KEYMAP_LAYER_COUNT][ENCODER_COUNT][2];
+    uint16_t keymap[EEPROM_LEGACY_LAYER_COUNT][MATRIX_ROWS][MATRIX_COLS];
+    uint16_t encoder_map[EEPROM_LEGACY_LAYER_COUNT][ENCODER_COUNT][2];
     uint8_t reserved[32];
 } __attribute__((packed)) eeprom_data_v2_t;
 
-#define EEPROM_V3_PAYLOAD_OFFSET offsetof(eeprom_data_t, keymap)
-#define EEPROM_V3_PAYLOAD_SIZE   (sizeof(eeprom_data_t) - EEPROM_V3_PAYLOAD_OFFSET)
+// Dense layout used before the sparse override tables
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t checksum;
+    uint16_t keymap[EEPROM_LEGACY_LAYER_COUNT][MATRIX_ROWS][MATRIX_COLS];
+    uint16_t encoder_map[EEPROM_LEGACY_LAYER_COUNT][ENCODER_COUNT][2];
+    slider_config_t slider_map[EEPROM_LEGACY_LAYER_COUNT][SLIDER_COUNT];
+    magnetic_switch_eeprom_t magnetic_switches[MAX_MAGNETIC_SWITCHES_EEPROM];
+    uint8_t startup_layer_mask;
+    uint8_t default_layer;
+    uint8_t debounce_algorithm;
+    uint8_t debounce_ms;
+    uint8_t reserved[16];
+} __attribute__((packed)) eeprom_data_v4_t;
+
+#define EEPROM_PAYLOAD_OFFSET    offsetof(eeprom_data_t, keymap_override_count)
+#define EEPROM_PAYLOAD_SIZE      (sizeof(eeprom_data_t) - EEPROM_PAYLOAD_OFFSET)
+#define EEPROM_V4_PAYLOAD_OFFSET offsetof(eeprom_data_v4_t, keymap)
+#define EEPROM_V4_PAYLOAD_SIZE   (sizeof(eeprom_data_v4_t) - EEPROM_V4_PAYLOAD_OFFSET)
 #define EEPROM_V2_PAYLOAD_OFFSET offsetof(eeprom_data_v2_t, keymap)
 #define EEPROM_V2_PAYLOAD_SIZE   (sizeof(eeprom_data_v2_t) - EEPROM_V2_PAYLOAD_OFFSET)
 #define EEPROM_V1_PAYLOAD_OFFSET offsetof(eeprom_data_v1_t, keymap)
 #define EEPROM_V1_PAYLOAD_SIZE   (sizeof(eeprom_data_v1_t) - EEPROM_V1_PAYLOAD_OFFSET)
 
+/*
+ * Log-structured storage
+ *
+ * The EEPROM region is split into two sectors. A sector holds a header
+ * doubleword, a profile directory doubleword, one eeprom_data_t base image per
+ * profile and then 8-byte change records appended into the erased space behind
+ * them. The high nibble of a record's tag names the profile it belongs to.
+ *
+ * Readers use the base images where they lie in flash, validated in place.
+ * RAM only holds the change table: one entry per setting changed since the
+ * images were written, kept as the record that logs it and sorted by the
+ * entry it overwrites. A getter looks its entry up there and otherwise reads
+ * the base image (or the compiled defaults for a profile without one).
+ * Loading replays the log of the newest sector into the table; saving programs
+ * one record per entry changed since the last save. Once the table or the
+ * sector fills up, the images are compacted into the other sector with the
+ * table folded in, which empties the table again.
+ *
+ * Saves only schedule work. eeprom_task() runs it one erase or doubleword
+ * program at a time through eeprom_flash.c; the region sits in the bank the
+ * firmware does not execute from, so input and USB keep running meanwhile.
+ * Compaction generates each image doubleword by doubleword from the old image
+ * and the folded entries, and checksums what reached flash.
+ *
+ * Switching profiles changes an index and queues a single record.
+ *
+ * Changes are write-behind: eeprom_set_* only updates the table. eeprom_task()
+ * commits them once no further change arrived for EEPROM_COMMIT_IDLE_MS, so a
+ * configurator pushing a whole keymap costs one commit. eeprom_save_config(),
+ * USB suspend and the PVD brown-out warning commit right away. While the
+ * supply is low only records are appended; compaction waits until it recovers.
+ */
+#define EEPROM_SECTOR_COUNT     2U
+#define EEPROM_SECTOR_SIZE      ((EEPROM_END_ADDRESS - EEPROM_START_ADDRESS) / EEPROM_SECTOR_COUNT)
+#define EEPROM_PROFILE_LOG_MAGIC 0x504C474FU // "OGLP", profile directory and one image per profile
+#define EEPROM_HEADER_SIZE      8U
+#define EEPROM_DIRECTORY_SIZE   8U
+#define EEPROM_IMAGE_SIZE       ((sizeof(eeprom_data_t) + 7U) & ~7U)
+#define EEPROM_IMAGES_OFFSET    (EEPROM_HEADER_SIZE + EEPROM_DIRECTORY_SIZE)
+#define EEPROM_RECORDS_OFFSET   (EEPROM_IMAGES_OFFSET + EEPROM_PROFILE_COUNT * EEPROM_IMAGE_SIZE)
+#define EEPROM_RECORD_SIZE      8U
+#define EEPROM_MACRO_CHUNK      4U   // Macro bytes per record
+#define EEPROM_NO_SECTOR        0xFFU
+#define EEPROM_REC_TYPE_MASK    0x0FU
+
+// Where the parts of an image start
+#define EEPROM_KEYMAP_TABLE_OFFSET   offsetof(eeprom_data_t, keymap_overrides)
+#define EEPROM_ENCODER_TABLE_OFFSET  offsetof(eeprom_data_t, encoder_overrides)
+#define EEPROM_SETTINGS_OFFSET       offsetof(eeprom_data_t, slider_map)
+
+// Records programmed per append job
+#ifndef EEPROM_PENDING_RECORDS
+#define EEPROM_PENDING_RECORDS  32U
+#endif
+
+// Entries changed since the base images; compaction starts at three quarters
+#ifndef EEPROM_CHANGE_ENTRIES
+#define EEPROM_CHANGE_ENTRIES   192U
+#endif
+#define EEPROM_COMPACT_THRESHOLD ((EEPROM_CHANGE_ENTRIES * 3U) / 4U)
+
+// Entries a staged transaction can change
+#ifndef EEPROM_STAGED_ENTRIES
+#define EEPROM_STAGED_ENTRIES   128U
+#endif
+
+_Static_assert(EEPROM_RECORDS_OFFSET + 16U * EEPROM_RECORD_SIZE <= EEPROM_SECTOR_SIZE,
+               "EEPROM sector too small for the config image and a useful record log");
+_Static_assert(EEPROM_SECTOR_SIZE % FLASH_PAGE_SIZE_128_BITS == 0,
+               "EEPROM sectors must be whole flash pages in both bank modes");
+_Static_assert(sizeof(eeprom_data_v4_t) <= EEPROM_END_ADDRESS - EEPROM_LEGACY_ADDRESS, "Legacy image layout changed");
+_Static_assert(offsetof(eeprom_data_v4_t, keymap) == offsetof(eeprom_data_v2_t, keymap) &&
+               offsetof(eeprom_data_v4_t, encoder_map) == offsetof(eeprom_data_v2_t, encoder_map),
+               "v2 and v4 images share their keymap layout");
+_Static_assert(sizeof(eeprom_data_t) <= EEPROM_PROFILE_IMAGE_MAX, "Profile image exceeds 4KB, shrink the override tables");
+_Static_assert(MATRIX_ROWS * MATRIX_COLS <= 256, "Keymap override cells are 8-bit");
+_Static_assert(EEPROM_MACRO_BYTES % EEPROM_MACRO_CHUNK == 0 && EEPROM_MACRO_BYTES <= 0x10000U,
+               "Macro data is logged in 4-byte chunks at 16-bit offsets");
+_Static_assert(KEYMAP_LAYER_COUNT <= 256 && ENCODER_COUNT <= 256, "Override keys are 8-bit");
+_Static_assert(EEPROM_PROFILE_COUNT >= 1 && EEPROM_PROFILE_COUNT <= 16, "Record tags carry the profile in 4 bits");
+_Static_assert(EEPROM_STAGED_ENTRIES <= EEPROM_CHANGE_ENTRIES, "A committed transaction must fit the change table");
+
+typedef struct {
+    uint32_t magic;         // EEPROM_PROFILE_LOG_MAGIC, programmed last when the sector is complete
+    uint32_t sequence;      // Higher sequence wins when both sectors are valid
+} eeprom_sector_header_t;
+
+// Follows the header
+typedef struct {
+    uint8_t profile_count;  // Images stored behind the directory
+    uint8_t active_profile; // Live profile when the sector was written
+    uint8_t reserved[6];
+} eeprom_profile_directory_t;
+
+_Static_assert(sizeof(eeprom_profile_directory_t) == EEPROM_DIRECTORY_SIZE, "Profile directory must be one doubleword");
+
+// One change record, programmed as a single doubleword. An erased record
+// reads as tag 0xFF and ends the log. The low nibble of the tag is the
+// record type, the high nibble the profile it applies to.
+typedef struct {
+    uint8_t tag;
+    uint8_t data[6];
+    uint8_t check;
+} __attribute__((packed)) eeprom_record_t;
+
+_Static_assert(sizeof(eeprom_record_t) == EEPROM_RECORD_SIZE, "EEPROM record must be one doubleword");
+
+enum {
+    EEPROM_REC_KEYCODE = 0x01,      // layer, row, col, keycode(2)
+    EEPROM_REC_ENCODER = 0x02,      // layer, encoder, ccw(2), cw(2)
+    EEPROM_REC_SLIDER = 0x03,       // layer, slider, cc, channel, min, max
+    EEPROM_REC_MAGNETIC = 0x04,     // switch, unpressed(2), pressed(2), sensitivity
+    EEPROM_REC_LAYER_STATE = 0x05,  // unused, see EEPROM_REC_LAYER_MASK
+    EEPROM_REC_DEBOUNCE = 0x06,     // algorithm, time_ms
+    EEPROM_REC_PROFILE = 0x07,      // active profile (not tied to a profile itself)
+    EEPROM_REC_LAYER_MASK = 0x08,   // mask(4), default layer
+    EEPROM_REC_TAP_HOLD = 0x09,     // row, col (0xFF/0xFF = profile), term(2), flags
+    EEPROM_REC_COMBO_KEYS = 0x0A,   // index, layer, keys(4)
+    EEPROM_REC_COMBO_ACTION = 0x0B, // index, keycode(2); index 0xFF: combo term(2)
+    EEPROM_REC_MACRO = 0x0C,        // offset(2), 4 bytes of macro data
+    EEPROM_REC_FREE = 0xFF
+};
+
+// Entry of the change table: the record that logs the change, sorted by tag
+// and the leading data bytes naming the entry it overwrites
+typedef struct {
+    uint8_t tag;
+    uint8_t data[6];
+    uint8_t flags;          // EEPROM_CHANGE_*
+} eeprom_change_t;
+
+#define EEPROM_CHANGE_PENDING   0x01U   // Not in the log yet
+#define EEPROM_CHANGE_FOLDED    0x02U   // Written into the images of the compaction in flight
+
+// Background write job, advanced by eeprom_task() one flash operation at a time
+typedef enum {
+    EEPROM_JOB_IDLE = 0,
+    EEPROM_JOB_ERASE,       // Erasing the compaction target sector
+    EEPROM_JOB_DIRECTORY,   // Programming the profile directory
+    EEPROM_JOB_IMAGE,       // Programming a profile image past its first EEPROM_IMAGE_HEAD_SIZE bytes
+    EEPROM_JOB_IMAGE_HEAD,  // Programming magic, version and the checksum of what was written
+    EEPROM_JOB_HEADER,      // Programming the header, which makes the sector valid
+    EEPROM_JOB_RECORDS      // Appending change records to the active sector
+} eeprom_job_state_t;
+
+#define EEPROM_FLUSH_TIMEOUT_MS 1000U
+
+// The image head holds magic, version, checksum and the override counts
+#define EEPROM_IMAGE_HEAD_SIZE  16U
+
+_Static_assert(EEPROM_PAYLOAD_OFFSET <= EEPROM_IMAGE_HEAD_SIZE &&
+               EEPROM_KEYMAP_TABLE_OFFSET == EEPROM_IMAGE_HEAD_SIZE, "EEPROM image head layout changed");
+
 // Private variables
-static eeprom_data_t eeprom_data;
+static uint8_t active_profile = 0;
 static bool eeprom_initialized = false;
 static bool config_modified = false;
 
+// Base image of each profile in the active sector; NULL follows the compiled defaults
+static const eeprom_data_t *profile_base[EEPROM_PROFILE_COUNT];
+// Image of older firmware standing in for profile 0's base until a compaction converts it
+static const uint8_t *legacy_image = NULL;
+static uint16_t legacy_keymap_last = 0;    // Override keys past these did not fit the tables
+static uint16_t legacy_encoder_last = 0;
+
+// Changes since the base images. An entry folded into the compaction in flight
+// stays as it is for the image; changing it again adds an entry right after it.
+static eeprom_change_t changes[EEPROM_CHANGE_ENTRIES];
+static uint16_t change_count = 0;
+// Overrides of each profile with its changes applied, bounded by the image tables
+static uint16_t keymap_override_total[EEPROM_PROFILE_COUNT];
+static uint16_t encoder_override_total[EEPROM_PROFILE_COUNT];
+
+// Staged transaction: keymap, encoder and slider edits of one profile collect
+// here and reach the change table and the log only on commit
+static eeprom_change_t staged_changes[EEPROM_STAGED_ENTRIES];
+static uint16_t staged_count = 0;
+static uint16_t staged_keymap_total = 0;
+static uint16_t staged_encoder_total = 0;
+static uint8_t staged_profile = 0;
+static bool staging_active = false;
+
+static uint8_t active_sector = EEPROM_NO_SECTOR;
+static uint32_t active_sequence = 0;
+static uint32_t log_write_offset = 0;
+static bool compact_required = false;
+
+static volatile bool save_requested = false;
+// Set by the PVD warning while VDD is low: pending changes are appended as
+// records, which finish quickly, but no compaction is started
+static volatile bool brownout_active = false;
+static bool idle_commit_pending = false;
+static uint32_t last_change_tick = 0;
+static bool last_save_ok = true;
+static uint16_t migration_dropped = 0;  // Overrides lost to a full table while migrating old images
+static eeprom_job_state_t job_state = EEPROM_JOB_IDLE;
+static uint8_t job_sector = EEPROM_NO_SECTOR;
+static uint32_t job_address = 0;        // Flash address of the doubleword in flight
+static const uint8_t *job_data = NULL;  // Source bytes of the doubleword in flight
+static uint32_t job_remaining = 0;      // Bytes left in the current job step
+static uint64_t job_doubleword = 0;     // Value handed to the flash, checked on read-back
+
+// Images are generated from the base images and the folded entries, which
+// stay fixed until the header is written. Changes made meanwhile are appended
+// as records once the new sector is valid.
+static uint8_t job_profile = 0;         // Profile whose image is being programmed
+static uint16_t job_keymap_count = 0;   // Overrides in that image
+static uint16_t job_encoder_count = 0;
+static bool job_entry_encoder = false;  // Override entry last generated, and its table
+static uint16_t job_entry_index = 0;
+static uint16_t job_entry_key = 0;
+static uint8_t job_entry[sizeof(encoder_override_t)];
+static uint8_t job_image_head[EEPROM_IMAGE_HEAD_SIZE];
+static eeprom_profile_directory_t job_directory;
+static eeprom_sector_header_t job_header;
+static eeprom_record_t job_records[EEPROM_PENDING_RECORDS];
+
 // Private function declarations
-static uint32_t calculate_crc32(const uint8_t *data, uint32_t length);
-static bool flash_erase_page(uint32_t page_address);
-static bool flash_write_data(uint32_t address, const uint8_t *data, uint32_t length);
+static void load_default_profiles(void);
 static void load_default_config(void);
+static bool eeprom_image_valid(const eeprom_data_t *image);
+static bool eeprom_load_legacy(const uint8_t *image);
+static void eeprom_start_job(void);
+static bool eeprom_flush_job(void);
+
+static uint32_t sector_address(uint8_t sector)
+{
+    return EEPROM_START_ADDRESS + (uint32_t)sector * EEPROM_SECTOR_SIZE;
+}
+
+static uint32_t image_address(uint8_t sector, uint8_t profile)
+{
+    return sector_address(sector) + EEPROM_IMAGES_OFFSET + (uint32_t)profile * EEPROM_IMAGE_SIZE;
+}
+
+static uint8_t record_tag(uint8_t profile, uint8_t type)
+{
+    return (uint8_t)(type | (profile << 4));
+}
+
+// Tag for a record that edits the active profile
+static uint8_t profile_tag(uint8_t type)
+{
+    return record_tag(active_profile, type);
+}
+
+static uint8_t record_check(const eeprom_record_t *record)
+{
+    const uint8_t *bytes = (const uint8_t *)record;
+    uint8_t check = 0x5A;
+    for (uint8_t i = 0; i < EEPROM_RECORD_SIZE - 1U; i++) {
+        check = (uint8_t)((check << 1) | (check >> 7)) ^ bytes[i];
+    }
+    return check;
+}
+
+// Number of leading data bytes identifying the entry a record overwrites
+static uint8_t record_key_length(uint8_t tag)
+{
+    switch (tag & EEPROM_REC_TYPE_MASK) {
+        case EEPROM_REC_KEYCODE:     return 3;
+        case EEPROM_REC_ENCODER:     return 2;
+        case EEPROM_REC_SLIDER:      return 2;
+        case EEPROM_REC_MAGNETIC:    return 1;
+        case EEPROM_REC_TAP_HOLD:    return 2;
+        case EEPROM_REC_COMBO_KEYS:
+        case EEPROM_REC_COMBO_ACTION: return 1;
+        case EEPROM_REC_MACRO:       return 2;
+        default:                     return 0;
+    }
+}
+
+static uint16_t override_key(uint8_t layer, uint8_t id)
+{
+    return (uint16_t)(((uint16_t)layer << 8) | id);
+}
+
+// Override a keycode needs: KC_NO or the compiled keycode need none (0)
+static uint16_t keymap_override_value(uint8_t layer, uint8_t row, uint8_t col, uint16_t keycode)
+{
+    return (keycode == keycodes[layer][row][col]) ? KC_NO : keycode;
+}
+
+// Same for an encoder's CCW/CW pair; both are 0 when it needs none
+static void encoder_override_value(uint8_t layer, uint8_t encoder_id, uint16_t *ccw_keycode, uint16_t *cw_keycode)
+{
+    if ((*ccw_keycode == KC_NO && *cw_keycode == KC_NO) ||
+        (*ccw_keycode == encoder_map[layer][encoder_id][0] && *cw_keycode == encoder_map[layer][encoder_id][1])) {
+        *ccw_keycode = KC_NO;
+        *cw_keycode = KC_NO;
+    }
+}
+
+// Index of the first keymap override at or after (layer, cell)
+static uint16_t keymap_override_lower_bound(const eeprom_data_t *profile, uint16_t key)
+{
+    uint16_t lo = 0;
+    uint16_t hi = profile->keymap_override_count;
+    while (lo < hi) {
+        uint16_t mid = (uint16_t)((lo + hi) / 2U);
+        const keymap_override_t *entry = &profile->keymap_overrides[mid];
+        if (override_key(entry->layer, entry->cell) < key) {
+            lo = (uint16_t)(mid + 1U);
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static uint16_t encoder_override_lower_bound(const eeprom_data_t *profile, uint16_t key)
+{
+    uint16_t lo = 0;
+    uint16_t hi = profile->encoder_override_count;
+    while (lo < hi) {
+        uint16_t mid = (uint16_t)((lo + hi) / 2U);
+        const encoder_override_t *entry = &profile->encoder_overrides[mid];
+        if (override_key(entry->layer, entry->encoder_id) < key) {
+            lo = (uint16_t)(mid + 1U);
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static int change_compare(const eeprom_change_t *entry, uint8_t tag, const uint8_t *key)
+{
+    if (entry->tag != tag) {
+        return (entry->tag < tag) ? -1 : 1;
+    }
+    return memcmp(entry->data, key, record_key_length(tag));
+}
+
+// Index of the first entry at or after (tag, key)
+static uint16_t change_lower_bound(const eeprom_change_t *table, uint16_t count, uint8_t tag, const uint8_t *key)
+{
+    uint16_t lo = 0;
+    uint16_t hi = count;
+    while (lo < hi) {
+        uint16_t mid = (uint16_t)((lo + hi) / 2U);
+        if (change_compare(&table[mid], tag, key) < 0) {
+            lo = (uint16_t)(mid + 1U);
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Latest entry for (tag, key), or NULL
+static const eeprom_change_t *change_find(const eeprom_change_t *table, uint16_t count, uint8_t tag, const uint8_t *key)
+{
+    uint16_t idx = change_lower_bound(table, count, tag, key);
+    if (idx >= count || change_compare(&table[idx], tag, key) != 0) {
+        return NULL;
+    }
+    if (idx + 1U < count && change_compare(&table[idx + 1U], tag, key) == 0) {
+        idx++;
+    }
+    return &table[idx];
+}
+
+// Insert or update the entry for a record. Fails only when the table is full.
+static bool change_store(eeprom_change_t *table, uint16_t *count, uint16_t capacity,
+                         uint8_t tag, const uint8_t data[6], uint8_t flags)
+{
+    uint16_t idx = change_lower_bound(table, *count, tag, data);
+    if (idx < *count && (table[idx].flags & EEPROM_CHANGE_FOLDED) && change_compare(&table[idx], tag, data) == 0) {
+        idx++;
+    }
+    if (idx >= *count || change_compare(&table[idx], tag, data) != 0) {
+        if (*count >= capacity) {
+            return false;
+        }
+        memmove(&table[idx + 1U], &table[idx], (size_t)(*count - idx) * sizeof(eeprom_change_t));
+        table[idx].tag = tag;
+        *count = (uint16_t)(*count + 1U);
+    }
+    memcpy(table[idx].data, data, sizeof(table[idx].data));
+    table[idx].flags = flags;
+    return true;
+}
+
+// End a compaction: written images take over the folded entries, after a
+// failure they are plain changes again unless a later entry superseded them
+static void change_end_fold(bool written)
+{
+    uint16_t kept = 0;
+    for (uint16_t i = 0; i < change_count; i++) {
+        eeprom_change_t entry = changes[i];
+        if (entry.flags & EEPROM_CHANGE_FOLDED) {
+            bool superseded = (i + 1U < change_count) && change_compare(&changes[i + 1U], entry.tag, entry.data) == 0;
+            if (written || superseded) {
+                continue;
+            }
+            entry.flags &= (uint8_t)~EEPROM_CHANGE_FOLDED;
+        }
+        changes[kept++] = entry;
+    }
+    change_count = kept;
+}
+
+static uint16_t change_pending_count(void)
+{
+    uint16_t pending = 0;
+    for (uint16_t i = 0; i < change_count; i++) {
+        if (changes[i].flags & EEPROM_CHANGE_PENDING) {
+            pending++;
+        }
+    }
+    return pending;
+}
+
+// Copy the part of a field at field_offset that falls into the image bytes
+// [offset, offset + length) held in out
+static void patch_range(uint8_t *out, uint32_t offset, uint32_t length,
+                        uint32_t field_offset, const void *field, uint32_t field_length)
+{
+    uint32_t start = (field_offset > offset) ? field_offset : offset;
+    uint32_t end = field_offset + field_length;
+    if (end > offset + length) {
+        end = offset + length;
+    }
+    if (start < end) {
+        memcpy(&out[start - offset], (const uint8_t *)field + (start - field_offset), end - start);
+    }
+}
+
+// Image offset and bytes of the setting a record carries. Returns the
+// length, 0 for records that are no setting (keys, encoders, profile) or
+// that address nothing in this build.
+static uint8_t record_field(uint8_t tag, const uint8_t d[6], uint32_t *offset, uint8_t value[6])
+{
+    switch (tag & EEPROM_REC_TYPE_MASK) {
+        case EEPROM_REC_SLIDER:
+#if SLIDER_COUNT > 0
+            if (d[0] >= KEYMAP_LAYER_COUNT || d[1] >= SLIDER_COUNT) {
+                return 0;
+            }
+            *offset = offsetof(eeprom_data_t, slider_map) + ((uint32_t)d[0] * SLIDER_COUNT + d[1]) * sizeof(slider_config_t);
+            memcpy(value, d, 6);  // layer, slider_id, midi_cc, midi_channel, min, max
+            return 6;
+#else
+            return 0;
+#endif
+
+        case EEPROM_REC_MAGNETIC:
+            if (d[0] >= MAX_MAGNETIC_SWITCHES_EEPROM) {
+                return 0;
+            }
+            *offset = offsetof(eeprom_data_t, magnetic_switches) + (uint32_t)d[0] * sizeof(magnetic_switch_eeprom_t);
+            memcpy(value, &d[1], 5);  // unpressed, pressed, sensitivity
+            value[5] = true;          // is_calibrated
+            return 6;
+
+        case EEPROM_REC_LAYER_MASK: {
+            uint32_t mask = ((uint32_t)d[0] | ((uint32_t)d[1] << 8) |
+                             ((uint32_t)d[2] << 16) | ((uint32_t)d[3] << 24)) & KEYMAP_LAYER_MASK_ALL;
+            *offset = offsetof(eeprom_data_t, startup_layer_mask);
+            memcpy(value, &mask, sizeof(mask));
+            value[4] = d[4];          // default_layer
+            return 5;
+        }
+
+        case EEPROM_REC_DEBOUNCE:
+            *offset = offsetof(eeprom_data_t, debounce_algorithm);
+            memcpy(value, d, 2);
+            return 2;
+
+        case EEPROM_REC_TAP_HOLD:
+            if (d[0] == EEPROM_TAP_HOLD_PROFILE && d[1] == EEPROM_TAP_HOLD_PROFILE) {
+                *offset = offsetof(eeprom_data_t, tap_hold_term_ms);
+            } else if (d[0] < MATRIX_ROWS && d[1] < MATRIX_COLS) {
+                *offset = offsetof(eeprom_data_t, tap_hold_keys) + ((uint32_t)d[0] * MATRIX_COLS + d[1]) * sizeof(tap_hold_eeprom_t);
+            } else {
+                return 0;
+            }
+            memcpy(value, &d[2], 3);  // term, flags
+            return 3;
+
+        case EEPROM_REC_COMBO_KEYS:
+            if (d[0] >= EEPROM_COMBO_COUNT) {
+                return 0;
+            }
+            *offset = offsetof(eeprom_data_t, combos) + (uint32_t)d[0] * sizeof(combo_eeprom_t);
+            memcpy(value, &d[1], 1U + EEPROM_COMBO_KEYS);  // layer, keys
+            return 1U + EEPROM_COMBO_KEYS;
+
+        case EEPROM_REC_COMBO_ACTION:
+            if (d[0] == EEPROM_COMBO_NO_KEY) {
+                *offset = offsetof(eeprom_data_t, combo_term_ms);
+            } else if (d[0] < EEPROM_COMBO_COUNT) {
+                *offset = offsetof(eeprom_data_t, combos) + (uint32_t)d[0] * sizeof(combo_eeprom_t) +
+                          offsetof(combo_eeprom_t, keycode);
+            } else {
+                return 0;
+            }
+            memcpy(value, &d[1], 2);
+            return 2;
+
+        case EEPROM_REC_MACRO: {
+            uint16_t chunk = (uint16_t)(d[0] | (d[1] << 8));
+            if (chunk > EEPROM_MACRO_BYTES - EEPROM_MACRO_CHUNK) {
+                return 0;
+            }
+            *offset = offsetof(eeprom_data_t, macro_data) + chunk;
+            memcpy(value, &d[2], EEPROM_MACRO_CHUNK);
+            return EEPROM_MACRO_CHUNK;
+        }
+
+        default:
+            return 0;
+    }
+}
+
+// Settings of a profile without a base image
+static void default_read(uint32_t offset, uint8_t *out, uint32_t length, bool default_sliders)
+{
+    memset(out, 0, length);
+
+#if SLIDER_COUNT > 0
+    uint32_t sliders_start = offsetof(eeprom_data_t, slider_map);
+    uint32_t sliders_end = sliders_start + sizeof(((eeprom_data_t *)0)->slider_map);
+    if (default_sliders && offset < sliders_end && offset + length > sliders_start) {
+        for (uint8_t layer = 0; layer < KEYMAP_LAYER_COUNT; layer++) {
+            for (uint8_t idx = 0; idx < SLIDER_COUNT; idx++) {
+                slider_config_t config = slider_config_map[layer][idx];
+                // Ensure layer and slider_id are correct
+                config.layer = layer;
+                config.slider_id = idx;
+                patch_range(out, offset, length,
+                            sliders_start + ((uint32_t)layer * SLIDER_COUNT + idx) * sizeof(slider_config_t),
+                            &config, sizeof(config));
+            }
+        }
+    }
+#else
+    (void)default_sliders;
+#endif
+
+    const uint32_t startup_layer_mask = 0x01;
+    patch_range(out, offset, length, offsetof(eeprom_data_t, startup_layer_mask),
+                &startup_layer_mask, sizeof(startup_layer_mask));
+}
+
+// Settings of profile 0 while a legacy image stands in for its base
+static void legacy_read(uint32_t offset, uint8_t *out, uint32_t length)
+{
+    const eeprom_data_v4_t *legacy4 = (const eeprom_data_v4_t *)legacy_image;
+
+    // v1 and v2 images started from a blank configuration, v4 from the defaults
+    default_read(offset, out, length, legacy4->version == 4U);
+    if (legacy4->version != 4U) {
+        return;
+    }
+
+    patch_range(out, offset, length, offsetof(eeprom_data_t, slider_map),
+                legacy4->slider_map, EEPROM_LEGACY_LAYERS_LOADED * sizeof(legacy4->slider_map[0]));
+    patch_range(out, offset, length, offsetof(eeprom_data_t, magnetic_switches),
+                legacy4->magnetic_switches, sizeof(legacy4->magnetic_switches));
+    const uint32_t startup_layer_mask = legacy4->startup_layer_mask & KEYMAP_LAYER_MASK_ALL;
+    patch_range(out, offset, length, offsetof(eeprom_data_t, startup_layer_mask),
+                &startup_layer_mask, sizeof(startup_layer_mask));
+    // default_layer, debounce_algorithm and debounce_ms follow each other in both layouts
+    patch_range(out, offset, length, offsetof(eeprom_data_t, default_layer), &legacy4->default_layer, 3);
+}
+
+// Settings bytes [offset, offset + length) of a profile's base
+static void base_read(uint8_t profile, uint32_t offset, uint8_t *out, uint32_t length)
+{
+    if (profile == 0U && legacy_image) {
+        legacy_read(offset, out, length);
+    } else if (profile_base[profile]) {
+        memcpy(out, (const uint8_t *)profile_base[profile] + offset, length);
+    } else {
+        default_read(offset, out, length, true);
+    }
+}
+
+// Apply the latest entry of a table for (type, key) to the image bytes read into out
+static void apply_change(const eeprom_change_t *table, uint16_t count, uint8_t profile, uint8_t type,
+                         const uint8_t *key, uint32_t offset, uint8_t *out, uint32_t length)
+{
+    const eeprom_change_t *change = change_find(table, count, record_tag(profile, type), key);
+    uint32_t field_offset = 0;
+    uint8_t value[6];
+    uint8_t field_length = change ? record_field(change->tag, change->data, &field_offset, value) : 0U;
+    if (field_length > 0U) {
+        patch_range(out, offset, length, field_offset, value, field_length);
+    }
+}
+
+// Current bytes of a profile setting that one record type and key address
+static void setting_read(uint8_t profile, uint8_t type, const uint8_t *key, uint32_t offset, void *out, uint32_t length)
+{
+    base_read(profile, offset, (uint8_t *)out, length);
+    apply_change(changes, change_count, profile, type, key, offset, (uint8_t *)out, length);
+}
+
+// Keycode a dense legacy image gives a key, as an override
+static uint16_t legacy_keycode(uint8_t layer, uint8_t row, uint8_t col)
+{
+    const eeprom_data_v1_t *legacy1 = (const eeprom_data_v1_t *)legacy_image;
+    const eeprom_data_v2_t *legacy2 = (const eeprom_data_v2_t *)legacy_image;
+
+    if (layer >= EEPROM_LEGACY_LAYERS_LOADED ||
+        override_key(layer, (uint8_t)(row * MATRIX_COLS + col)) > legacy_keymap_last) {
+        return KC_NO;
+    }
+    // v1 held a single layer; the others became transparent. v4 shares the v2 keymap layout.
+    uint16_t keycode = (legacy1->version == 1U) ? ((layer == 0U) ? legacy1->keymap[row][col] : KC_TRANSPARENT)
+                                                : legacy2->keymap[layer][row][col];
+    return keymap_override_value(layer, row, col, keycode);
+}
+
+static void legacy_encoder(uint8_t layer, uint8_t encoder_id, uint16_t *ccw_keycode, uint16_t *cw_keycode)
+{
+    const eeprom_data_v1_t *legacy1 = (const eeprom_data_v1_t *)legacy_image;
+    const eeprom_data_v2_t *legacy2 = (const eeprom_data_v2_t *)legacy_image;
+
+    *ccw_keycode = KC_NO;
+    *cw_keycode = KC_NO;
+    if (layer >= EEPROM_LEGACY_LAYERS_LOADED || override_key(layer, encoder_id) > legacy_encoder_last) {
+        return;
+    }
+    if (legacy1->version == 1U) {
+        *ccw_keycode = (layer == 0U) ? legacy1->encoder_map[encoder_id][0] : KC_TRANSPARENT;
+        *cw_keycode = (layer == 0U) ? legacy1->encoder_map[encoder_id][1] : KC_TRANSPARENT;
+    } else {
+        *ccw_keycode = legacy2->encoder_map[layer][encoder_id][0];
+        *cw_keycode = legacy2->encoder_map[layer][encoder_id][1];
+    }
+    encoder_override_value(layer, encoder_id, ccw_keycode, cw_keycode);
+}
+
+static uint16_t base_keycode(uint8_t profile, uint8_t layer, uint8_t row, uint8_t col)
+{
+    const eeprom_data_t *base = profile_base[profile];
+    if (profile == 0U && legacy_image) {
+        return legacy_keycode(layer, row, col);
+    }
+    if (!base) {
+        return KC_NO;
+    }
+    uint8_t cell = (uint8_t)(row * MATRIX_COLS + col);
+    uint16_t idx = keymap_override_lower_bound(base, override_key(layer, cell));
+    if (idx < base->keymap_override_count &&
+        base->keymap_overrides[idx].layer == layer && base->keymap_overrides[idx].cell == cell) {
+        return base->keymap_overrides[idx].keycode;
+    }
+    return KC_NO;
+}
+
+static void base_encoder(uint8_t profile, uint8_t layer, uint8_t encoder_id, uint16_t *ccw_keycode, uint16_t *cw_keycode)
+{
+    const eeprom_data_t *base = profile_base[profile];
+    *ccw_keycode = KC_NO;
+    *cw_keycode = KC_NO;
+    if (profile == 0U && legacy_image) {
+        legacy_encoder(layer, encoder_id, ccw_keycode, cw_keycode);
+        return;
+    }
+    if (!base) {
+        return;
+    }
+    uint16_t idx = encoder_override_lower_bound(base, override_key(layer, encoder_id));
+    if (idx < base->encoder_override_count &&
+        base->encoder_overrides[idx].layer == layer && base->encoder_overrides[idx].encoder_id == encoder_id) {
+        *ccw_keycode = base->encoder_overrides[idx].ccw_keycode;
+        *cw_keycode = base->encoder_overrides[idx].cw_keycode;
+    }
+}
+
+// Keycode override of a key in a profile, from the given table or the change table
+static uint16_t lookup_keycode(const eeprom_change_t *table, uint16_t count, uint8_t profile,
+                               uint8_t layer, uint8_t row, uint8_t col)
+{
+    const uint8_t key[3] = { layer, row, col };
+    const eeprom_change_t *change = change_find(table, count, record_tag(profile, EEPROM_REC_KEYCODE), key);
+    if (!change && table != changes) {
+        change = change_find(changes, change_count, record_tag(profile, EEPROM_REC_KEYCODE), key);
+    }
+    return change ? (uint16_t)(change->data[3] | (change->data[4] << 8)) : base_keycode(profile, layer, row, col);
+}
+
+static void lookup_encoder(const eeprom_change_t *table, uint16_t count, uint8_t profile,
+                           uint8_t layer, uint8_t encoder_id, uint16_t *ccw_keycode, uint16_t *cw_keycode)
+{
+    const uint8_t key[2] = { layer, encoder_id };
+    const eeprom_change_t *change = change_find(table, count, record_tag(profile, EEPROM_REC_ENCODER), key);
+    if (!change && table != changes) {
+        change = change_find(changes, change_count, record_tag(profile, EEPROM_REC_ENCODER), key);
+    }
+    if (change) {
+        *ccw_keycode = (uint16_t)(change->data[2] | (change->data[3] << 8));
+        *cw_keycode = (uint16_t)(change->data[4] | (change->data[5] << 8));
+    } else {
+        base_encoder(profile, layer, encoder_id, ccw_keycode, cw_keycode);
+    }
+}
+
+static void slider_read(const eeprom_change_t *table, uint16_t count, uint8_t profile,
+                        uint8_t layer, uint8_t slider_id, slider_config_t *config)
+{
+    const uint8_t key[2] = { layer, slider_id };
+    uint32_t offset = offsetof(eeprom_data_t, slider_map) + ((uint32_t)layer * SLIDER_COUNT + slider_id) * sizeof(slider_config_t);
+    setting_read(profile, EEPROM_REC_SLIDER, key, offset, config, sizeof(*config));
+    if (table != changes) {
+        apply_change(table, count, profile, EEPROM_REC_SLIDER, key, offset, (uint8_t *)config, sizeof(*config));
+    }
+}
+
+// Take a logged record into the change table while loading
+static bool apply_record(const eeprom_record_t *record)
+{
+    const uint8_t *d = record->data;
+    uint8_t type = record->tag & EEPROM_REC_TYPE_MASK;
+    uint8_t profile = (uint8_t)(record->tag >> 4);
+    uint8_t data[6];
+    memcpy(data, d, sizeof(data));
+
+    if (type == EEPROM_REC_PROFILE) {
+        if (d[0] >= EEPROM_PROFILE_COUNT) {
+            return false;
+        }
+        active_profile = d[0];
+        return true;
+    }
+    if (profile >= EEPROM_PROFILE_COUNT) {
+        return false;
+    }
+
+    if (type == EEPROM_REC_KEYCODE) {
+        if (d[0] >= KEYMAP_LAYER_COUNT || d[1] >= MATRIX_ROWS || d[2] >= MATRIX_COLS) {
+            return false;
+        }
+        uint16_t keycode = keymap_override_value(d[0], d[1], d[2], (uint16_t)(d[3] | (d[4] << 8)));
+        uint16_t stored = lookup_keycode(changes, change_count, profile, d[0], d[1], d[2]);
+        if (keycode != KC_NO && stored == KC_NO && keymap_override_total[profile] >= EEPROM_KEYMAP_OVERRIDES) {
+            usb_app_cdc_printf("EEPROM: Keymap override table full (%u entries)\r\n", EEPROM_KEYMAP_OVERRIDES);
+            return false;
+        }
+        data[3] = (uint8_t)keycode;
+        data[4] = (uint8_t)(keycode >> 8);
+        if (!change_store(changes, &change_count, EEPROM_CHANGE_ENTRIES, record->tag, data, 0)) {
+            return false;
+        }
+        keymap_override_total[profile] = (uint16_t)(keymap_override_total[profile] + (keycode != KC_NO) - (stored != KC_NO));
+        return true;
+    }
+
+    if (type == EEPROM_REC_ENCODER) {
+        if (d[0] >= KEYMAP_LAYER_COUNT || d[1] >= ENCODER_COUNT) {
+            return false;
+        }
+        uint16_t ccw_keycode = (uint16_t)(d[2] | (d[3] << 8));
+        uint16_t cw_keycode = (uint16_t)(d[4] | (d[5] << 8));
+        uint16_t stored_ccw = KC_NO;
+        uint16_t stored_cw = KC_NO;
+        encoder_override_value(d[0], d[1], &ccw_keycode, &cw_keycode);
+        lookup_encoder(changes, change_count, profile, d[0], d[1], &stored_ccw, &stored_cw);
+        bool has = (ccw_keycode != KC_NO || cw_keycode != KC_NO);
+        bool had = (stored_ccw != KC_NO || stored_cw != KC_NO);
+        if (has && !had && encoder_override_total[profile] >= EEPROM_ENCODER_OVERRIDES) {
+            usb_app_cdc_printf("EEPROM: Encoder override table full (%u entries)\r\n", EEPROM_ENCODER_OVERRIDES);
+            return false;
+        }
+        data[2] = (uint8_t)ccw_keycode;
+        data[3] = (uint8_t)(ccw_keycode >> 8);
+        data[4] = (uint8_t)cw_keycode;
+        data[5] = (uint8_t)(cw_keycode >> 8);
+        if (!change_store(changes, &change_count, EEPROM_CHANGE_ENTRIES, record->tag, data, 0)) {
+            return false;
+        }
+        encoder_override_total[profile] = (uint16_t)(encoder_override_total[profile] + has - had);
+        return true;
+    }
+
+    uint32_t offset = 0;
+    uint8_t value[6];
+    if (record_field(record->tag, data, &offset, value) == 0U) {
+        return false;
+    }
+    return change_store(changes, &change_count, EEPROM_CHANGE_ENTRIES, record->tag, data, 0);
+}
+
+// Fold the change table into new images to make room for entries, waiting for flash
+static bool eeprom_make_room(uint16_t entries)
+{
+    if (change_count + entries <= EEPROM_CHANGE_ENTRIES) {
+        return true;
+    }
+    if (!eeprom_initialized || brownout_active) {
+        return false;
+    }
+
+    usb_app_cdc_printf("EEPROM: Change table full, compacting now\r\n");
+    // A compaction in flight frees the entries it folded once it completes
+    eeprom_flush_job();
+    if (change_count + entries > EEPROM_CHANGE_ENTRIES) {
+        compact_required = true;
+        save_requested = true;
+        eeprom_flush_job();
+    }
+    return change_count + entries <= EEPROM_CHANGE_ENTRIES;
+}
+
+// Record a change for the next save, replacing an earlier change of the same entry
+static bool eeprom_queue_record(uint8_t tag, const uint8_t data[6])
+{
+    if (!change_store(changes, &change_count, EEPROM_CHANGE_ENTRIES, tag, data, EEPROM_CHANGE_PENDING) &&
+        (!eeprom_make_room(1) ||
+         !change_store(changes, &change_count, EEPROM_CHANGE_ENTRIES, tag, data, EEPROM_CHANGE_PENDING))) {
+        usb_app_cdc_printf("EEPROM: Change table full (%u entries)\r\n", EEPROM_CHANGE_ENTRIES);
+        return false;
+    }
+
+    config_modified = true;
+    idle_commit_pending = true;
+    last_change_tick = HAL_GetTick();
+
+    // Fold the table in the background before it runs full
+    if (change_count >= EEPROM_COMPACT_THRESHOLD && job_state == EEPROM_JOB_IDLE && !compact_required) {
+        compact_required = true;
+        save_requested = true;
+    }
+    return true;
+}
+
+// Every profile follows the compiled defaults and profile 0 is live
+static void load_default_profiles(void)
+{
+    for (uint8_t profile = 0; profile < EEPROM_PROFILE_COUNT; profile++) {
+        profile_base[profile] = NULL;
+        keymap_override_total[profile] = 0;
+        encoder_override_total[profile] = 0;
+    }
+    legacy_image = NULL;
+    change_count = 0;
+    active_profile = 0;
+}
+
+// Find the newest complete sector, validate its images and replay its records.
+// Returns the sector index, or EEPROM_NO_SECTOR if none is valid.
+static uint8_t eeprom_load_log(uint32_t *sequence, uint32_t *tail)
+{
+    uint8_t best = EEPROM_NO_SECTOR;
+    uint32_t best_sequence = 0;
+
+    for (uint8_t sector = 0; sector < EEPROM_SECTOR_COUNT; sector++) {
+        const eeprom_sector_header_t *header = (const eeprom_sector_header_t *)sector_address(sector);
+        if (header->magic != EEPROM_PROFILE_LOG_MAGIC) {
+            continue;
+        }
+        if (best == EEPROM_NO_SECTOR || header->sequence > best_sequence) {
+            best = sector;
+            best_sequence = header->sequence;
+        }
+    }
+
+    if (best == EEPROM_NO_SECTOR) {
+        return EEPROM_NO_SECTOR;
+    }
+
+    uint32_t base = sector_address(best);
+    const eeprom_profile_directory_t *directory = (const eeprom_profile_directory_t *)(base + EEPROM_HEADER_SIZE);
+    uint8_t image_count = directory->profile_count;
+    uint32_t offset = EEPROM_IMAGES_OFFSET;
+
+    // Profiles the sector does not hold (a build with more profiles than the
+    // one that wrote it) follow the defaults
+    load_default_profiles();
+    if (directory->active_profile < EEPROM_PROFILE_COUNT) {
+        active_profile = directory->active_profile;
+    }
+
+    for (uint8_t profile = 0; profile < image_count; profile++) {
+        if (offset + EEPROM_IMAGE_SIZE > EEPROM_SECTOR_SIZE) {
+            return EEPROM_NO_SECTOR;
+        }
+        const eeprom_data_t *image = (const eeprom_data_t *)(base + offset);
+        if (profile < EEPROM_PROFILE_COUNT) {
+            if (!eeprom_image_valid(image)) {
+                return EEPROM_NO_SECTOR;
+            }
+            profile_base[profile] = image;
+            keymap_override_total[profile] = image->keymap_override_count;
+            encoder_override_total[profile] = image->encoder_override_count;
+        }
+        offset += EEPROM_IMAGE_SIZE;
+    }
+    if (image_count > EEPROM_PROFILE_COUNT) {
+        usb_app_cdc_printf("EEPROM: Dropping %u profile(s) beyond this build's %u\r\n",
+                           image_count - EEPROM_PROFILE_COUNT, EEPROM_PROFILE_COUNT);
+        compact_required = true;
+        config_modified = true;
+    }
+    uint32_t replayed = 0;
+    while (offset + EEPROM_RECORD_SIZE <= EEPROM_SECTOR_SIZE) {
+        const eeprom_record_t *record = (const eeprom_record_t *)(base + offset);
+        if (record->tag == EEPROM_REC_FREE) {
+            break;
+        }
+        // Records that fail the check (torn write) are skipped but keep their slot
+        if (record->check == record_check(record) && apply_record(record)) {
+            replayed++;
+        }
+        offset += EEPROM_RECORD_SIZE;
+    }
+    if (change_count >= EEPROM_COMPACT_THRESHOLD) {
+        compact_required = true;
+        config_modified = true;
+    }
+
+    *sequence = best_sequence;
+    *tail = offset;
+    keymap_invalidate_cache();
+    usb_app_cdc_printf("EEPROM: Sector %u at 0x%08lX (seq %lu) loaded, %lu record(s) replayed, profile %u active\r\n",
+                       best, base, best_sequence, replayed, active_profile);
+    return best;
+}
+
+// First override of the image being compacted at or after key. Merges the
+// base table with the entries folded into this compaction.
+static bool image_next_keymap(uint8_t profile, uint32_t key, keymap_override_t *entry)
+{
+    const eeprom_data_t *base = (profile == 0U && legacy_image) ? NULL : profile_base[profile];
+    uint8_t tag = record_tag(profile, EEPROM_REC_KEYCODE);
+
+    while (key <= UINT16_MAX) {
+        uint32_t base_key = UINT32_MAX;
+        uint16_t base_keycode_value = KC_NO;
+        if (base) {
+            uint16_t idx = keymap_override_lower_bound(base, (uint16_t)key);
+            if (idx < base->keymap_override_count) {
+                base_key = override_key(base->keymap_overrides[idx].layer, base->keymap_overrides[idx].cell);
+                base_keycode_value = base->keymap_overrides[idx].keycode;
+            }
+        } else if (profile == 0U && legacy_image) {
+            for (uint32_t k = key; k < (uint32_t)EEPROM_LEGACY_LAYERS_LOADED << 8; k = (k | 0xFFU) + 1U) {
+                for (uint32_t cell = k & 0xFFU; cell < MATRIX_ROWS * MATRIX_COLS; cell++) {
+                    uint16_t keycode = legacy_keycode((uint8_t)(k >> 8), (uint8_t)(cell / MATRIX_COLS),
+                                                      (uint8_t)(cell % MATRIX_COLS));
+                    if (keycode != KC_NO) {
+                        base_key = (k & ~0xFFU) | cell;
+                        base_keycode_value = keycode;
+                        break;
+                    }
+                }
+                if (base_key != UINT32_MAX) {
+                    break;
+                }
+            }
+        }
+
+        uint32_t change_key = UINT32_MAX;
+        const eeprom_change_t *change = NULL;
+        uint8_t cell = (uint8_t)(key & 0xFFU);
+        const uint8_t search[3] = { (uint8_t)(key >> 8), (uint8_t)(cell / MATRIX_COLS), (uint8_t)(cell % MATRIX_COLS) };
+        for (uint16_t idx = change_lower_bound(changes, change_count, tag, search);
+             idx < change_count && changes[idx].tag == tag; idx++) {
+            if (changes[idx].flags & EEPROM_CHANGE_FOLDED) {
+                change = &changes[idx];
+                change_key = override_key(change->data[0], (uint8_t)(change->data[1] * MATRIX_COLS + change->data[2]));
+                break;
+            }
+        }
+
+        if (base_key == UINT32_MAX && change_key == UINT32_MAX) {
+            return false;
+        }
+        uint32_t next = (change_key <= base_key) ? change_key : base_key;
+        uint16_t keycode = (change_key <= base_key) ? (uint16_t)(change->data[3] | (change->data[4] << 8)) : base_keycode_value;
+        if (keycode != KC_NO) {
+            entry->layer = (uint8_t)(next >> 8);
+            entry->cell = (uint8_t)next;
+            entry->keycode = keycode;
+            return true;
+        }
+        key = next + 1U;  // The change removed this override
+    }
+    return false;
+}
+
+// Same for the encoder table
+static bool image_next_encoder(uint8_t profile, uint32_t key, encoder_override_t *entry)
+{
+    const eeprom_data_t *base = (profile == 0U && legacy_image) ? NULL : profile_base[profile];
+    uint8_t tag = record_tag(profile, EEPROM_REC_ENCODER);
+
+    while (key <= UINT16_MAX) {
+        uint32_t base_key = UINT32_MAX;
+        uint16_t base_ccw = KC_NO;
+        uint16_t base_cw = KC_NO;
+        if (base) {
+            uint16_t idx = encoder_override_lower_bound(base, (uint16_t)key);
+            if (idx < base->encoder_override_count) {
+                base_key = override_key(base->encoder_overrides[idx].layer, base->encoder_overrides[idx].encoder_id);
+                base_ccw = base->encoder_overrides[idx].ccw_keycode;
+                base_cw = base->encoder_overrides[idx].cw_keycode;
+            }
+        } else if (profile == 0U && legacy_image) {
+            for (uint32_t k = key; k < (uint32_t)EEPROM_LEGACY_LAYERS_LOADED << 8; k = (k | 0xFFU) + 1U) {
+                for (uint32_t idx = k & 0xFFU; idx < ENCODER_COUNT; idx++) {
+                    legacy_encoder((uint8_t)(k >> 8), (uint8_t)idx, &base_ccw, &base_cw);
+                    if (base_ccw != KC_NO || base_cw != KC_NO) {
+                        base_key = (k & ~0xFFU) | idx;
+                        break;
+                    }
+                }
+                if (base_key != UINT32_MAX) {
+                    break;
+                }
+            }
+        }
+
+        uint32_t change_key = UINT32_MAX;
+        const eeprom_change_t *change = NULL;
+        const uint8_t search[2] = { (uint8_t)(key >> 8), (uint8_t)key };
+        for (uint16_t idx = change_lower_bound(changes, change_count, tag, search);
+             idx < change_count && changes[idx].tag == tag; idx++) {
+            if (changes[idx].flags & EEPROM_CHANGE_FOLDED) {
+                change = &changes[idx];
+                change_key = override_key(change->data[0], change->data[1]);
+                break;
+            }
+        }
+
+        if (base_key == UINT32_MAX && change_key == UINT32_MAX) {
+            return false;
+        }
+        uint32_t next = (change_key <= base_key) ? change_key : base_key;
+        uint16_t ccw_keycode = (change_key <= base_key) ? (uint16_t)(change->data[2] | (change->data[3] << 8)) : base_ccw;
+        uint16_t cw_keycode = (change_key <= base_key) ? (uint16_t)(change->data[4] | (change->data[5] << 8)) : base_cw;
+        if (ccw_keycode != KC_NO || cw_keycode != KC_NO) {
+            entry->layer = (uint8_t)(next >> 8);
+            entry->encoder_id = (uint8_t)next;
+            entry->ccw_keycode = ccw_keycode;
+            entry->cw_keycode = cw_keycode;
+            return true;
+        }
+        key = next + 1U;  // The change removed this override
+    }
+    return false;
+}
+
+// Settings bytes of the image being compacted: the base with the folded entries applied
+static void image_settings_read(uint8_t profile, uint32_t offset, uint8_t *out, uint32_t length)
+{
+    base_read(profile, offset, out, length);
+    for (uint16_t i = 0; i < change_count; i++) {
+        const eeprom_change_t *change = &changes[i];
+        if ((change->tag >> 4) != profile || !(change->flags & EEPROM_CHANGE_FOLDED)) {
+            continue;
+        }
+        uint32_t field_offset = 0;
+        uint8_t value[6];
+        uint8_t field_length = record_field(change->tag, change->data, &field_offset, value);
+        if (field_length > 0U) {
+            patch_range(out, offset, length, field_offset, value, field_length);
+        }
+    }
+}
+
+// Byte of the override tables of the image being programmed. Called with
+// rising offsets, so each entry is generated once from the one before it.
+static uint8_t job_override_byte(uint32_t offset)
+{
+    bool encoder = offset >= EEPROM_ENCODER_TABLE_OFFSET;
+    uint32_t entry_size = encoder ? sizeof(encoder_override_t) : sizeof(keymap_override_t);
+    uint32_t position = offset - (encoder ? EEPROM_ENCODER_TABLE_OFFSET : EEPROM_KEYMAP_TABLE_OFFSET);
+    uint16_t index = (uint16_t)(position / entry_size);
+
+    if (index >= (encoder ? job_encoder_count : job_keymap_count)) {
+        return 0;
+    }
+    if (encoder != job_entry_encoder || index != job_entry_index) {
+        uint32_t after = (encoder != job_entry_encoder || job_entry_index == UINT16_MAX) ? 0U : job_entry_key + 1U;
+        if (encoder) {
+            encoder_override_t entry = { 0 };
+            image_next_encoder(job_profile, after, &entry);
+            job_entry_key = override_key(entry.layer, entry.encoder_id);
+            memcpy(job_entry, &entry, sizeof(entry));
+        } else {
+            keymap_override_t entry = { 0 };
+            image_next_keymap(job_profile, after, &entry);
+            job_entry_key = override_key(entry.layer, entry.cell);
+            memcpy(job_entry, &entry, sizeof(entry));
+        }
+        job_entry_encoder = encoder;
+        job_entry_index = index;
+    }
+    return job_entry[position % entry_size];
+}
+
+// Program the next doubleword of the current job step, padding a short tail with 0xFF
+static bool job_program_next(void)
+{
+    uint32_t length = (job_remaining < 8U) ? job_remaining : 8U;
+    job_doubleword = UINT64_MAX;
+    if (job_state == EEPROM_JOB_IMAGE) {
+        uint8_t bytes[8];
+        uint32_t offset = job_address - image_address(job_sector, job_profile);
+        for (uint32_t i = 0; i < length; i++) {
+            if (offset + i >= EEPROM_SETTINGS_OFFSET) {
+                image_settings_read(job_profile, offset + i, &bytes[i], length - i);
+                break;
+            }
+            bytes[i] = job_override_byte(offset + i);
+        }
+        memcpy(&job_doubleword, bytes, length);
+    } else {
+        memcpy(&job_doubleword, job_data, length);
+    }
+    return eeprom_flash_program_async(job_address, job_doubleword);
+}
+
+// Read back the doubleword that just finished programming
+static bool job_verify_last(void)
+{
+    if (*(const volatile uint64_t *)job_address != job_doubleword) {
+        usb_app_cdc_printf("EEPROM: Verification mismatch at 0x%08lX\r\n", job_address);
+        return false;
+    }
+    return true;
+}
+
+// Fill in the image head once the rest of the image is in flash. The checksum
+// covers the bytes actually programmed.
+static void job_build_image_head(void)
+{
+    const uint8_t *written = (const uint8_t *)image_address(job_sector, job_profile);
+    const uint32_t magic = EEPROM_MAGIC;
+    const uint32_t version = EEPROM_VERSION;
+
+    memset(job_image_head, 0, sizeof(job_image_head));
+    memcpy(&job_image_head[offsetof(eeprom_data_t, magic)], &magic, sizeof(magic));
+    memcpy(&job_image_head[offsetof(eeprom_data_t, version)], &version, sizeof(version));
+    memcpy(&job_image_head[offsetof(eeprom_data_t, keymap_override_count)], &job_keymap_count, sizeof(job_keymap_count));
+    memcpy(&job_image_head[offsetof(eeprom_data_t, encoder_override_count)], &job_encoder_count, sizeof(job_encoder_count));
+
+    crc32_begin();
+    crc32_update(&job_image_head[EEPROM_PAYLOAD_OFFSET], EEPROM_IMAGE_HEAD_SIZE - EEPROM_PAYLOAD_OFFSET);
+    crc32_update(written + EEPROM_IMAGE_HEAD_SIZE, sizeof(eeprom_data_t) - EEPROM_IMAGE_HEAD_SIZE);
+    uint32_t checksum = crc32_finish();
+    memcpy(&job_image_head[offsetof(eeprom_data_t, checksum)], &checksum, sizeof(checksum));
+}
+
+static void job_begin_step(eeprom_job_state_t state, uint32_t address, const void *data, uint32_t length)
+{
+    job_state = state;
+    job_address = address;
+    job_data = (const uint8_t *)data;
+    job_remaining = length;
+}
+
+// Program one profile image, all but its head. Overrides beyond what the
+// tables hold are only possible when migrating and are dropped.
+static void job_begin_image(uint8_t profile)
+{
+    keymap_override_t keymap_entry;
+    encoder_override_t encoder_entry;
+
+    job_profile = profile;
+    job_keymap_count = 0;
+    for (uint32_t key = 0; job_keymap_count < EEPROM_KEYMAP_OVERRIDES &&
+                           image_next_keymap(profile, key, &keymap_entry); job_keymap_count++) {
+        key = override_key(keymap_entry.layer, keymap_entry.cell) + 1U;
+    }
+    job_encoder_count = 0;
+    for (uint32_t key = 0; job_encoder_count < EEPROM_ENCODER_OVERRIDES &&
+                           image_next_encoder(profile, key, &encoder_entry); job_encoder_count++) {
+        key = override_key(encoder_entry.layer, encoder_entry.encoder_id) + 1U;
+    }
+    job_entry_encoder = false;
+    job_entry_index = UINT16_MAX;
+
+    job_begin_step(EEPROM_JOB_IMAGE, image_address(job_sector, profile) + EEPROM_IMAGE_HEAD_SIZE,
+                   NULL, sizeof(eeprom_data_t) - EEPROM_IMAGE_HEAD_SIZE);
+}
+
+static void eeprom_job_finished(bool ok)
+{
+    job_state = EEPROM_JOB_IDLE;
+    last_save_ok = ok;
+    config_modified = (change_pending_count() > 0U) || compact_required;
+    if (ok) {
+        usb_app_cdc_printf("EEPROM: Configuration saved (sector %u, %lu bytes of log used)\r\n",
+                           active_sector, log_write_offset - EEPROM_RECORDS_OFFSET);
+    }
+}
+
+static void eeprom_job_failed(void)
+{
+    if (job_state == EEPROM_JOB_RECORDS) {
+        // Skip the damaged slot and fall back to a full rewrite
+        usb_app_cdc_printf("EEPROM: Record write failed, compacting instead\r\n");
+        log_write_offset += EEPROM_RECORD_SIZE;
+        compact_required = true;
+        save_requested = true;
+    } else {
+        // The previous sector is still the valid one; the next save retries the rewrite
+        usb_app_cdc_printf("EEPROM: Failed to rewrite sector %u\r\n", job_sector);
+        change_end_fold(false);
+        compact_required = true;
+    }
+    eeprom_job_finished(false);
+}
+
+// Start rewriting the base images, changes folded in, into a freshly erased sector
+static void eeprom_start_compact(void)
+{
+    // Sector 1 overlaps the storage of older firmware, so a first compaction
+    // goes to sector 0 and the old data stays readable until the new log is valid
+    uint8_t target = (active_sector == 0U) ? 1U : 0U;
+
+    usb_app_cdc_printf("EEPROM: Compacting into sector %u\r\n", target);
+
+    memset(&job_directory, 0, sizeof(job_directory));
+    job_directory.profile_count = EEPROM_PROFILE_COUNT;
+    job_directory.active_profile = active_profile;
+    job_header.magic = EEPROM_PROFILE_LOG_MAGIC;
+    job_header.sequence = active_sequence + 1U;
+    job_sector = target;
+
+    // Everything changed so far is part of the images
+    for (uint16_t i = 0; i < change_count; i++) {
+        changes[i].flags = EEPROM_CHANGE_FOLDED;
+    }
+    compact_required = false;
+
+    job_begin_step(EEPROM_JOB_ERASE, sector_address(target), NULL, 0);
+    if (!eeprom_flash_erase_async(sector_address(target), EEPROM_SECTOR_SIZE)) {
+        eeprom_job_failed();
+    }
+}
+
+// Start programming records for the pending changes behind the log tail
+static void eeprom_start_append(void)
+{
+    uint8_t count = 0;
+    for (uint16_t i = 0; i < change_count && count < EEPROM_PENDING_RECORDS; i++) {
+        if (!(changes[i].flags & EEPROM_CHANGE_PENDING)) {
+            continue;
+        }
+        eeprom_record_t *record = &job_records[count++];
+        record->tag = changes[i].tag;
+        memcpy(record->data, changes[i].data, sizeof(record->data));
+        record->check = record_check(record);
+        changes[i].flags &= (uint8_t)~EEPROM_CHANGE_PENDING;
+    }
+    // Whatever did not fit this job follows in the next one
+    if (change_pending_count() > 0U) {
+        save_requested = true;
+    }
+
+    job_begin_step(EEPROM_JOB_RECORDS, sector_address(active_sector) + log_write_offset,
+                   job_records, (uint32_t)count * EEPROM_RECORD_SIZE);
+    if (!job_program_next()) {
+        eeprom_job_failed();
+    }
+}
+
+static void eeprom_start_job(void)
+{
+    uint16_t pending = change_pending_count();
+    uint16_t batch = (pending < EEPROM_PENDING_RECORDS) ? pending : EEPROM_PENDING_RECORDS;
+    bool records_fit = active_sector != EEPROM_NO_SECTOR &&
+                       log_write_offset + (uint32_t)batch * EEPROM_RECORD_SIZE <= EEPROM_SECTOR_SIZE;
+
+    if (brownout_active) {
+        // An erase and a rewrite of every image would not finish before the supply fails
+        if (pending > 0U && records_fit) {
+            eeprom_start_append();
+            return;
+        }
+        if (pending > 0U || compact_required) {
+            usb_app_cdc_printf("EEPROM: Supply low, compaction postponed\r\n");
+        }
+        eeprom_job_finished(pending == 0U);
+        return;
+    }
+
+    if (compact_required || !records_fit) {
+        eeprom_start_compact();
+    } else if (pending > 0U) {
+        eeprom_start_append();
+    } else {
+        eeprom_job_finished(true);
+    }
+}
+
+// Move the job on after its last flash operation completed successfully
+static void eeprom_job_advance(void)
+{
+    switch (job_state) {
+        case EEPROM_JOB_ERASE:
+            job_begin_step(EEPROM_JOB_DIRECTORY, sector_address(job_sector) + EEPROM_HEADER_SIZE,
+                           &job_directory, sizeof(job_directory));
+            break;
+
+        case EEPROM_JOB_DIRECTORY:
+        case EEPROM_JOB_IMAGE:
+        case EEPROM_JOB_IMAGE_HEAD:
+        case EEPROM_JOB_RECORDS: {
+            uint32_t length = (job_remaining < 8U) ? job_remaining : 8U;
+            if (job_state == EEPROM_JOB_RECORDS) {
+                log_write_offset += EEPROM_RECORD_SIZE;
+            }
+            job_address += 8U;
+            if (job_data) {
+                job_data += length;
+            }
+            job_remaining -= length;
+            if (job_remaining > 0U) {
+                break;
+            }
+            if (job_state == EEPROM_JOB_RECORDS) {
+                eeprom_job_finished(true);
+                return;
+            }
+            if (job_state == EEPROM_JOB_DIRECTORY) {
+                job_begin_image(0);
+                break;
+            }
+            if (job_state == EEPROM_JOB_IMAGE) {
+                job_build_image_head();
+                job_begin_step(EEPROM_JOB_IMAGE_HEAD, image_address(job_sector, job_profile),
+                               job_image_head, sizeof(job_image_head));
+                break;
+            }
+            if (job_profile + 1U < EEPROM_PROFILE_COUNT) {
+                job_begin_image((uint8_t)(job_profile + 1U));
+                break;
+            }
+            // The header goes last: a sector only becomes valid once its image is complete
+            job_begin_step(EEPROM_JOB_HEADER, sector_address(job_sector), &job_header, sizeof(job_header));
+            break;
+        }
+
+        case EEPROM_JOB_HEADER:
+            active_sector = job_sector;
+            active_sequence = job_header.sequence;
+            log_write_offset = EEPROM_RECORDS_OFFSET;
+            // The new images are the base from now on and hold the folded entries
+            for (uint8_t profile = 0; profile < EEPROM_PROFILE_COUNT; profile++) {
+                profile_base[profile] = (const eeprom_data_t *)image_address(active_sector, profile);
+            }
+            legacy_image = NULL;
+            change_end_fold(true);
+            eeprom_job_finished(true);
+            return;
+
+        default:
+            return;
+    }
+
+    if (!job_program_next()) {
+        eeprom_job_failed();
+    }
+}
+
+// Advance the background save, never waiting on flash
+void eeprom_task(void)
+{
+    if (job_state == EEPROM_JOB_IDLE) {
+        if (brownout_active && !__HAL_PWR_GET_FLAG(PWR_FLAG_PVDO)) {
+            brownout_active = false;    // VDD is back above the threshold
+        }
+        if (idle_commit_pending && (HAL_GetTick() - last_change_tick) >= EEPROM_COMMIT_IDLE_MS) {
+            save_requested = true;
+        }
+        if (save_requested && eeprom_initialized) {
+            save_requested = false;
+            idle_commit_pending = false;
+            eeprom_start_job();
+        }
+        return;
+    }
+
+    eeprom_flash_status_t status = eeprom_flash_poll();
+    if (status == EEPROM_FLASH_BUSY || status == EEPROM_FLASH_IDLE) {
+        return;
+    }
+
+    if (status == EEPROM_FLASH_ERROR) {
+        usb_app_cdc_printf("EEPROM: Flash operation failed at 0x%08lX\r\n", job_address);
+        eeprom_job_failed();
+        return;
+    }
+
+    if (job_state != EEPROM_JOB_ERASE && !job_verify_last()) {
+        eeprom_job_failed();
+        return;
+    }
+
+    eeprom_job_advance();
+}
+
+bool eeprom_is_busy(void)
+{
+    return save_requested || job_state != EEPROM_JOB_IDLE;
+}
+
+void eeprom_get_status(eeprom_status_t *status)
+{
+    if (!status) {
+        return;
+    }
+
+    status->dirty = config_modified;
+    status->writing = eeprom_is_busy();
+    status->last_commit_ok = last_save_ok;
+    status->migration_dropped = migration_dropped;
+    status->commit_in_ms = 0;
+    if (idle_commit_pending && !status->writing) {
+        uint32_t idle = HAL_GetTick() - last_change_tick;
+        status->commit_in_ms = (idle < EEPROM_COMMIT_IDLE_MS) ? (EEPROM_COMMIT_IDLE_MS - idle) : 0;
+    }
+}
+
+// Run eeprom_task() until every scheduled save has reached flash
+bool eeprom_flush(uint32_t timeout_ms)
+{
+    uint32_t start = HAL_GetTick();
+    while (eeprom_is_busy()) {
+        if ((HAL_GetTick() - start) >= timeout_ms) {
+            usb_app_cdc_printf("EEPROM: Flush timed out\r\n");
+            return false;
+        }
+        eeprom_task();
+    }
+    return last_save_ok;
+}
+
+// Flush with the default timeout
+static bool eeprom_flush_job(void)
+{
+    return eeprom_flush(EEPROM_FLUSH_TIMEOUT_MS);
+}
+
+// Raise an interrupt when VDD falls below ~2.9V so dirty changes get committed
+static void brownout_warning_init(void)
+{
+    PWR_PVDTypeDef pvd = {
+        .PVDLevel = PWR_PVDLEVEL_6,
+        .Mode = PWR_PVD_MODE_IT_RISING      // PVDO rises as VDD drops below the threshold
+    };
+
+    HAL_PWR_ConfigPVD(&pvd);
+    HAL_PWR_EnablePVD();
+    HAL_NVIC_SetPriority(PVD_PVM_IRQn, 6, 0);
+    HAL_NVIC_EnableIRQ(PVD_PVM_IRQn);
+}
+
+// Called from PVD_PVM_IRQHandler(); eeprom_task() does the actual write
+void HAL_PWR_PVDCallback(void)
+{
+    brownout_active = true;
+    eeprom_save_config();
+}
 
 // Initialize EEPROM emulation
 bool eeprom_init(void)
@@ -47,227 +1523,377 @@ bool eeprom_init(void)
     if (eeprom_initialized) {
         return true;
     }
-    
+
+    crc32_init();
+    eeprom_flash_init();
+
     // Try to load existing configuration
     if (eeprom_load_config()) {
         eeprom_initialized = true;
-        config_modified = false;
+        // Only now is there a configuration for the warning to commit
+        brownout_warning_init();
+        if (config_modified) {
+            // Migrated from an older layout: write it back in the current format
+            eeprom_save_config();
+            eeprom_flush(EEPROM_FLUSH_TIMEOUT_MS);
+        }
         usb_app_cdc_printf("EEPROM: Configuration loaded from flash\r\n");
         return true;
     }
-    
+
     // If no valid config found, load defaults and save them immediately
     // This is normal for first boot or after firmware updates
     usb_app_cdc_printf("EEPROM: First boot detected, initializing with defaults\r\n");
     load_default_config();
-    
-    // Save the defaults immediately so they become the "valid" configuration
-    if (eeprom_save_config()) {
-        eeprom_initialized = true;
-        config_modified = false;
-        
+    eeprom_initialized = true;
+    brownout_warning_init();
+
+    // Save the defaults immediately so they become the "valid" configuration.
+    // Nothing else runs yet, so waiting for flash here costs no input.
+    eeprom_save_config();
+    if (eeprom_flush(EEPROM_FLUSH_TIMEOUT_MS)) {
         usb_app_cdc_printf("EEPROM: Default configuration saved and active\r\n");
         return true;
     }
-    
-    // If we can't save to flash, still initialize with defaults in RAM
-    eeprom_initialized = true;
+
+    // If we can't save to flash, still run with the compiled defaults
     config_modified = false; // Don't mark as modified since we tried to save
     usb_app_cdc_printf("EEPROM: Flash write failed, using defaults in RAM only\r\n");
     return true; // Always succeed - we have valid data even if not persisted
 }
 
-// Save current configuration to flash
-bool eeprom_save_config(void)
-{
-    if (!eeprom_initialized) {
-        usb_app_cdc_printf("EEPROM: Cannot save - not initialized\r\n");
+// Schedule pending changes to be written by eeprom_task()
+bool eeprom_save_config(void)
+{
+    if (!eeprom_initialized) {
+        usb_app_cdc_printf("EEPROM: Cannot save - not initialized\r\n");
+        return false;
+    }
+
+    if (!config_modified) {
+        return true; // No changes to save
+    }
+
+    save_requested = true;
+    return true;
+}
+
+// Make sure flash will hold the configuration, even if nothing was marked modified
+bool eeprom_force_save_config(void)
+{
+    if (!eeprom_initialized) {
+        usb_app_cdc_printf("EEPROM: Cannot save - not initialized\r\n");
+        return false;
+    }
+
+    if (active_sector == EEPROM_NO_SECTOR) {
+        compact_required = true;
+    }
+
+    save_requested = true;
+    return true;
+}
+
+// Load configuration from flash, discarding unsaved changes
+bool eeprom_load_config(void)
+{
+    // Let a write already in flight finish so the log tail is consistent
+    staging_active = false;
+    save_requested = false;
+    idle_commit_pending = false;
+    eeprom_flush(EEPROM_FLUSH_TIMEOUT_MS);
+
+    compact_required = false;
+    config_modified = false;
+
+    uint32_t sequence = 0;
+    uint32_t tail = 0;
+    uint8_t sector = eeprom_load_log(&sequence, &tail);
+    if (sector != EEPROM_NO_SECTOR) {
+        active_sector = sector;
+        active_sequence = sequence;
+        log_write_offset = tail;
+        return true;
+    }
+
+    // Older firmware kept a single v1/v2/v4 image in the last 4KB
+    active_sector = EEPROM_NO_SECTOR;
+    active_sequence = 0;
+    load_default_profiles();
+    if (eeprom_load_legacy((const uint8_t *)EEPROM_LEGACY_ADDRESS)) {
+        usb_app_cdc_printf("EEPROM: Moving older storage to 0x%08lX as profile 0\r\n", (uint32_t)EEPROM_START_ADDRESS);
+        compact_required = true;
+        config_modified = true;
+        return true;
+    }
+    return false;
+}
+
+// Check a current-format image where it lies in flash
+static bool eeprom_image_valid(const eeprom_data_t *image)
+{
+    if (image->magic != EEPROM_MAGIC || image->version != EEPROM_VERSION) {
+        usb_app_cdc_printf("EEPROM: Unsupported profile image (will use defaults)\r\n");
+        return false;
+    }
+
+    uint32_t calculated_checksum = crc32_compute((const uint8_t *)image + EEPROM_PAYLOAD_OFFSET, EEPROM_PAYLOAD_SIZE);
+    if (image->checksum != calculated_checksum) {
+        usb_app_cdc_printf("EEPROM: Checksum mismatch for v%lu data (will use defaults)\r\n", image->version);
+        return false;
+    }
+    if (image->keymap_override_count > EEPROM_KEYMAP_OVERRIDES ||
+        image->encoder_override_count > EEPROM_ENCODER_OVERRIDES) {
+        usb_app_cdc_printf("EEPROM: Override tables exceed this build's capacity (will use defaults)\r\n");
+        return false;
+    }
+    return true;
+}
+
+// Keys and encoders whose override did not fit are lost from the migrated image
+static void eeprom_count_migration_drops(uint16_t dropped)
+{
+    if (dropped == 0U) {
+        return;
+    }
+    migration_dropped = (uint16_t)(migration_dropped + dropped);
+    usb_app_cdc_printf("EEPROM: Migration dropped %u overrides (override table full)\r\n", dropped);
+}
+
+// Validate a v1/v2/v4 image where it lies and make it profile 0's base. Its
+// dense keymap is read as overrides until the next compaction converts it;
+// overrides past what the tables hold are cut off here already.
+static bool eeprom_load_legacy(const uint8_t *image)
+{
+    const eeprom_data_v4_t *stored = (const eeprom_data_v4_t *)image;
+    uint32_t payload_offset = 0;
+    uint32_t payload_size = 0;
+
+    if (stored->magic != EEPROM_MAGIC) {
+        return false;
+    }
+
+    switch (stored->version) {
+        case 4:
+            payload_offset = EEPROM_V4_PAYLOAD_OFFSET;
+            payload_size = EEPROM_V4_PAYLOAD_SIZE;
+            usb_app_cdc_printf("EEPROM: Migrating dense v4 keymap to sparse overrides\r\n");
+            break;
+        case 2:
+            payload_offset = EEPROM_V2_PAYLOAD_OFFSET;
+            payload_size = EEPROM_V2_PAYLOAD_SIZE;
+            usb_app_cdc_printf("EEPROM: Migrating v2 data to multilayer layout with layer state\r\n");
+            break;
+        case 1:
+            payload_offset = EEPROM_V1_PAYLOAD_OFFSET;
+            payload_size = EEPROM_V1_PAYLOAD_SIZE;
+            usb_app_cdc_printf("EEPROM: Migrating legacy v1 data to multilayer layout\r\n");
+            break;
+        default:
+            usb_app_cdc_printf("EEPROM: Unsupported data version %lu\r\n", stored->version);
+            return false;
+    }
+
+    if (stored->checksum != crc32_compute(image + payload_offset, payload_size)) {
+        usb_app_cdc_printf("EEPROM: v%lu checksum mismatch (will use defaults)\r\n", stored->version);
         return false;
     }
-    
-    if (!config_modified) {
-        usb_app_cdc_printf("EEPROM: No changes to save\r\n");
-        return true; // No changes to save
+
+    legacy_image = image;
+    legacy_keymap_last = UINT16_MAX;
+    legacy_encoder_last = UINT16_MAX;
+
+    uint16_t keys = 0;
+    uint16_t encoders = 0;
+    uint16_t keymap_last = UINT16_MAX;
+    uint16_t encoder_last = UINT16_MAX;
+    for (uint8_t layer = 0; layer < EEPROM_LEGACY_LAYERS_LOADED; layer++) {
+        for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+            for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+                if (legacy_keycode(layer, row, col) != KC_NO && ++keys == EEPROM_KEYMAP_OVERRIDES) {
+                    keymap_last = override_key(layer, (uint8_t)(row * MATRIX_COLS + col));
+                }
+            }
+        }
+        for (uint8_t idx = 0; idx < ENCODER_COUNT; idx++) {
+            uint16_t ccw_keycode = KC_NO;
+            uint16_t cw_keycode = KC_NO;
+            legacy_encoder(layer, idx, &ccw_keycode, &cw_keycode);
+            if ((ccw_keycode != KC_NO || cw_keycode != KC_NO) && ++encoders == EEPROM_ENCODER_OVERRIDES) {
+                encoder_last = override_key(layer, idx);
+            }
+        }
     }
-    
-    usb_app_cdc_printf("EEPROM: Saving configuration to flash...\r\n");
-    
-    // Update metadata
-    eeprom_data.magic = EEPROM_MAGIC;
-    eeprom_data.version = EEPROM_VERSION;
-    
-    // Calculate checksum (excluding the checksum field itself)
-    eeprom_data.checksum = calculate_crc32(((const uint8_t*)&eeprom_data) + EEPROM_V3_PAYLOAD_OFFSET,
-                                           EEPROM_V3_PAYLOAD_SIZE);
-    
-    // Erase flash page
-    if (!flash_erase_page(EEPROM_START_ADDRESS)) {
-        usb_app_cdc_printf("EEPROM: Failed to erase flash page\r\n");
-        return false;
-    }
-    
-    // Write data to flash
-    if (!flash_write_data(EEPROM_START_ADDRESS, (uint8_t*)&eeprom_data, sizeof(eeprom_data_t))) {
-        usb_app_cdc_printf("EEPROM: Failed to write data to flash\r\n");
-        return false;
-    }
-    
-    config_modified = false;
-    usb_app_cdc_printf("EEPROM: Configuration saved successfully to flash\r\n");
+
+    legacy_keymap_last = keymap_last;
+    legacy_encoder_last = encoder_last;
+    keymap_override_total[0] = (keys < EEPROM_KEYMAP_OVERRIDES) ? keys : EEPROM_KEYMAP_OVERRIDES;
+    encoder_override_total[0] = (encoders < EEPROM_ENCODER_OVERRIDES) ? encoders : EEPROM_ENCODER_OVERRIDES;
+    eeprom_count_migration_drops((uint16_t)((keys - keymap_override_total[0]) + (encoders - encoder_override_total[0])));
+    keymap_invalidate_cache();
     return true;
 }
 
-// Force save current configuration to flash (even if no changes)
-bool eeprom_force_save_config(void)
+// Reset configuration to defaults
+bool eeprom_reset_config(void)
 {
-    if (!eeprom_initialized) {
-        usb_app_cdc_printf("EEPROM: Cannot save - not initialized\r\n");
-        return false;
-    }
-    
-    usb_app_cdc_printf("EEPROM: Force saving configuration to flash...\r\n");
-    
-    // Update metadata
-    eeprom_data.magic = EEPROM_MAGIC;
-    eeprom_data.version = EEPROM_VERSION;
-    
-    // Calculate checksum (excluding the checksum field itself)
-    eeprom_data.checksum = calculate_crc32(((const uint8_t*)&eeprom_data) + EEPROM_V3_PAYLOAD_OFFSET,
-                                           EEPROM_V3_PAYLOAD_SIZE);
-    
-    usb_app_cdc_printf("EEPROM: Calculated checksum: 0x%08lX\r\n", eeprom_data.checksum);
-    
-    // Erase flash page
-    usb_app_cdc_printf("EEPROM: Erasing flash page at 0x%08lX...\r\n", EEPROM_START_ADDRESS);
-    if (!flash_erase_page(EEPROM_START_ADDRESS)) {
-        usb_app_cdc_printf("EEPROM: Failed to erase flash page\r\n");
-        return false;
-    }
-    usb_app_cdc_printf("EEPROM: Flash page erased successfully\r\n");
-    
-    // Write data to flash
-    usb_app_cdc_printf("EEPROM: Writing %lu bytes to flash...\r\n", sizeof(eeprom_data_t));
-    if (!flash_write_data(EEPROM_START_ADDRESS, (uint8_t*)&eeprom_data, sizeof(eeprom_data_t))) {
-        usb_app_cdc_printf("EEPROM: Failed to write data to flash\r\n");
-        return false;
-    }
-    
-    config_modified = false;
-    usb_app_cdc_printf("EEPROM: Configuration force-saved successfully to flash\r\n");
-    return true;
+    staging_active = false;
+    // The images a compaction in flight reads from are about to be dropped
+    eeprom_flush(EEPROM_FLUSH_TIMEOUT_MS);
+    load_default_config();
+    return eeprom_save_config();
 }
 
-// Load configuration from flash
-bool eeprom_load_config(void)
+// Check if EEPROM contains valid data
+bool eeprom_is_valid(void)
 {
-    eeprom_data_t candidate = {0};
-    memcpy(&candidate, (void*)EEPROM_START_ADDRESS, sizeof(eeprom_data_t));
+    return eeprom_initialized && !config_modified;
+}
 
-    if (candidate.magic != EEPROM_MAGIC) {
+// Make another profile live. Only an index changes; the switch itself is
+// persisted like any other change so the profile survives a reboot.
+bool eeprom_set_active_profile(uint8_t profile)
+{
+    if (profile >= EEPROM_PROFILE_COUNT) {
         return false;
     }
 
-    if (candidate.version == EEPROM_VERSION) {
-        uint32_t calculated_checksum = calculate_crc32(((const uint8_t*)&candidate) + EEPROM_V3_PAYLOAD_OFFSET,
-                                                       EEPROM_V3_PAYLOAD_SIZE);
-        if (candidate.checksum != calculated_checksum) {
-            usb_app_cdc_printf("EEPROM: Checksum mismatch for v3 data (will use defaults)\r\n");
+    if (!eeprom_initialized) {
+        if (!eeprom_init()) {
             return false;
         }
+    }
 
-        eeprom_data = candidate;
-        return true;
+    if (profile != active_profile) {
+        const uint8_t record[6] = { profile, 0, 0, 0, 0, 0 };
+        if (!eeprom_queue_record(EEPROM_REC_PROFILE, record)) {
+            return false;
+        }
+        active_profile = profile;
+        usb_app_cdc_printf("EEPROM: Profile %u active\r\n", profile);
     }
 
-    if (candidate.version == 2) {
-        eeprom_data_v2_t legacy2 = {0};
-        memcpy(&legacy2, (void*)EEPROM_START_ADDRESS, sizeof(eeprom_data_v2_t));
+    return true;
+}
+
+uint8_t eeprom_get_active_profile(void)
+{
+    return active_profile;
+}
 
-        uint32_t calculated_checksum = calculate_crc32(((const uint8_t*)&legacy2) + EEPROM_V2_PAYLOAD_OFFSET,
-                                                       EEPROM_V2_PAYLOAD_SIZE);
-        if (legacy2.checksum != calculated_checksum) {
-            usb_app_cdc_printf("EEPROM: v2 checksum mismatch (will use defaults)\r\n");
+// Start a transaction on the active profile. Starting again discards what was staged.
+bool eeprom_stage_begin(void)
+{
+    if (!eeprom_initialized) {
+        if (!eeprom_init()) {
             return false;
         }
+    }
 
-        usb_app_cdc_printf("EEPROM: Migrating v2 data to multilayer layout with layer state\r\n");
-
-        memset(&eeprom_data, 0, sizeof(eeprom_data));
-        eeprom_data.magic = EEPROM_MAGIC;
-        eeprom_data.version = EEPROM_VERSION;
+    staged_profile = active_profile;
+    staged_count = 0;
+    staged_keymap_total = keymap_override_total[active_profile];
+    staged_encoder_total = encoder_override_total[active_profile];
+    staging_active = true;
+    return true;
+}
 
-        memcpy(eeprom_data.keymap, legacy2.keymap, sizeof(legacy2.keymap));
-        memcpy(eeprom_data.encoder_map, legacy2.encoder_map, sizeof(legacy2.encoder_map));
-        eeprom_data.startup_layer_mask = 0x01;
-        eeprom_data.default_layer = 0;
+bool eeprom_stage_active(void)
+{
+    return staging_active;
+}
 
-        config_modified = true;
-        return true;
+void eeprom_stage_abort(void)
+{
+    if (staging_active) {
+        staging_active = false;
+        usb_app_cdc_printf("EEPROM: Staged changes discarded\r\n");
     }
+}
 
-    if (candidate.version == 1) {
-        eeprom_data_v1_t legacy = {0};
-        memcpy(&legacy, (void*)EEPROM_START_ADDRESS, sizeof(eeprom_data_v1_t));
+// True when a staged entry differs from what the staged profile holds live
+static bool staged_entry_changes(const eeprom_change_t *entry)
+{
+    const uint8_t *d = entry->data;
+
+    switch (entry->tag & EEPROM_REC_TYPE_MASK) {
+        case EEPROM_REC_KEYCODE:
+            return lookup_keycode(changes, change_count, staged_profile, d[0], d[1], d[2]) !=
+                   (uint16_t)(d[3] | (d[4] << 8));
+
+        case EEPROM_REC_ENCODER: {
+            uint16_t ccw_keycode = KC_NO;
+            uint16_t cw_keycode = KC_NO;
+            lookup_encoder(changes, change_count, staged_profile, d[0], d[1], &ccw_keycode, &cw_keycode);
+            return ccw_keycode != (uint16_t)(d[2] | (d[3] << 8)) || cw_keycode != (uint16_t)(d[4] | (d[5] << 8));
+        }
 
-        uint32_t calculated_checksum = calculate_crc32(((const uint8_t*)&legacy) + EEPROM_V1_PAYLOAD_OFFSET,
-                                                       EEPROM_V1_PAYLOAD_SIZE);
-        if (legacy.checksum != calculated_checksum) {
-            usb_app_cdc_printf("EEPROM: Legacy checksum mismatch (will use defaults)\r\n");
-            return false;
+        default: {
+            slider_config_t config;
+            slider_read(changes, change_count, staged_profile, d[0], d[1], &config);
+            return config.midi_cc != d[2] || config.midi_channel != d[3] ||
+                   config.min_midi_value != d[4] || config.max_midi_value != d[5];
         }
+    }
+}
 
-        usb_app_cdc_printf("EEPROM: Migrating legacy v1 data to multilayer layout\r\n");
+// Queue the staged entries that differ from the live profile and schedule a
+// single commit of them. Room for the whole transaction is made first, so it
+// is taken over completely or not at all.
+bool eeprom_stage_commit(uint8_t *profile)
+{
+    if (!staging_active) {
+        return false;
+    }
 
-        memset(&eeprom_data, 0, sizeof(eeprom_data));
-        eeprom_data.magic = EEPROM_MAGIC;
-        eeprom_data.version = EEPROM_VERSION;
+    staging_active = false;
+    if (profile) {
+        *profile = staged_profile;
+    }
 
-        for (uint8_t layer = 0; layer < KEYMAP_LAYER_COUNT; layer++) {
-            for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
-                for (uint8_t col = 0; col < MATRIX_COLS; col++) {
-                    if (layer == 0) {
-                        eeprom_data.keymap[layer][row][col] = legacy.keymap[row][col];
-                    } else {
-                        eeprom_data.keymap[layer][row][col] = KC_TRANSPARENT;
-                    }
-                }
-            }
-        }
+    if (!eeprom_make_room(staged_count)) {
+        usb_app_cdc_printf("EEPROM: No room for %u staged change(s), discarded\r\n", staged_count);
+        return false;
+    }
 
-        for (uint8_t layer = 0; layer < KEYMAP_LAYER_COUNT; layer++) {
-            for (uint8_t idx = 0; idx < ENCODER_COUNT; idx++) {
-                if (layer == 0) {
-                    eeprom_data.encoder_map[layer][idx][0] = legacy.encoder_map[idx][0];
-                    eeprom_data.encoder_map[layer][idx][1] = legacy.encoder_map[idx][1];
-                } else {
-                    eeprom_data.encoder_map[layer][idx][0] = KC_TRANSPARENT;
-                    eeprom_data.encoder_map[layer][idx][1] = KC_TRANSPARENT;
-                }
-            }
+    uint16_t changed = 0;
+    for (uint16_t i = 0; i < staged_count; i++) {
+        if (staged_entry_changes(&staged_changes[i])) {
+            eeprom_queue_record(staged_changes[i].tag, staged_changes[i].data);
+            changed++;
         }
-
-        eeprom_data.startup_layer_mask = 0x01;
-        eeprom_data.default_layer = 0;
-        config_modified = true; // ensure we rewrite in new format
-        return true;
     }
+    keymap_override_total[staged_profile] = staged_keymap_total;
+    encoder_override_total[staged_profile] = staged_encoder_total;
 
-    usb_app_cdc_printf("EEPROM: Unsupported data version %lu\r\n", candidate.version);
-    return false;
+    usb_app_cdc_printf("EEPROM: %u staged change(s) committed to profile %u\r\n", changed, staged_profile);
+    return (changed == 0U) || eeprom_save_config();
 }
 
-// Reset configuration to defaults
-bool eeprom_reset_config(void)
+// Store a keymap, encoder or slider change in the table the setters edit
+static bool store_edit(uint8_t type, const uint8_t record[6])
 {
-    load_default_config();
-    config_modified = true;
-    return eeprom_save_config();
+    if (staging_active) {
+        if (!change_store(staged_changes, &staged_count, EEPROM_STAGED_ENTRIES,
+                          record_tag(staged_profile, type), record, 0)) {
+            usb_app_cdc_printf("EEPROM: Staged transaction full (%u entries)\r\n", EEPROM_STAGED_ENTRIES);
+            return false;
+        }
+        return true;
+    }
+    return eeprom_queue_record(profile_tag(type), record);
 }
 
-// Check if EEPROM contains valid data
-bool eeprom_is_valid(void)
+// True when a setting record would change what the active profile holds
+static bool setting_changes(uint8_t type, const uint8_t record[6])
 {
-    return eeprom_initialized && !config_modified;
+    uint32_t offset = 0;
+    uint8_t value[6];
+    uint8_t current[6];
+    uint8_t length = record_field(profile_tag(type), record, &offset, value);
+
+    setting_read(active_profile, type, record, offset, current, length);
+    return memcmp(current, value, length) != 0;
 }
 
 // Set keycode for specific position
@@ -276,19 +1902,34 @@ bool eeprom_set_keycode(uint8_t layer, uint8_t row, uint8_t col, uint16_t keycod
     if (layer >= KEYMAP_LAYER_COUNT || row >= MATRIX_ROWS || col >= MATRIX_COLS) {
         return false;
     }
-    
+
     if (!eeprom_initialized) {
         if (!eeprom_init()) {
             return false;
         }
     }
-    
-    if (eeprom_data.keymap[layer][row][col] != keycode) {
-        eeprom_data.keymap[layer][row][col] = keycode;
-        config_modified = true;
-        usb_app_cdc_printf("EEPROM: Keymap[L%d][%d][%d] = 0x%04X\r\n", layer, row, col, keycode);
+
+    uint8_t profile = staging_active ? staged_profile : active_profile;
+    uint16_t *total = staging_active ? &staged_keymap_total : &keymap_override_total[profile];
+    uint16_t stored = staging_active ? lookup_keycode(staged_changes, staged_count, profile, layer, row, col)
+                                     : lookup_keycode(changes, change_count, profile, layer, row, col);
+    uint16_t wanted = keymap_override_value(layer, row, col, keycode);
+
+    if (stored != wanted) {
+        if (wanted != KC_NO && stored == KC_NO && *total >= EEPROM_KEYMAP_OVERRIDES) {
+            usb_app_cdc_printf("EEPROM: Keymap override table full (%u entries)\r\n", EEPROM_KEYMAP_OVERRIDES);
+            return false;
+        }
+        const uint8_t record[6] = { layer, row, col, (uint8_t)wanted, (uint8_t)(wanted >> 8), 0 };
+        if (!store_edit(EEPROM_REC_KEYCODE, record)) {
+            return false;
+        }
+        *total = (uint16_t)(*total + (wanted != KC_NO) - (stored != KC_NO));
+        if (!staging_active) {
+            usb_app_cdc_printf("EEPROM: Keymap[L%d][%d][%d] = 0x%04X\r\n", layer, row, col, keycode);
+        }
     }
-    
+
     return true;
 }
 
@@ -298,15 +1939,15 @@ uint16_t eeprom_get_keycode(uint8_t layer, uint8_t row, uint8_t col)
     if (layer >= KEYMAP_LAYER_COUNT || row >= MATRIX_ROWS || col >= MATRIX_COLS) {
         return 0;
     }
-    
+
     if (!eeprom_initialized) {
         if (!eeprom_init()) {
             // EEPROM init failed, return 0 to indicate fallback needed
             return 0;
         }
     }
-    
-    return eeprom_data.keymap[layer][row][col];
+
+    return lookup_keycode(changes, change_count, active_profile, layer, row, col);
 }
 
 // Set encoder mapping
@@ -322,21 +1963,37 @@ bool eeprom_set_encoder_map(uint8_t layer, uint8_t encoder_id, uint16_t ccw_keyc
         }
     }
 
-    bool changed = false;
-    if (eeprom_data.encoder_map[layer][encoder_id][0] != ccw_keycode) {
-        eeprom_data.encoder_map[layer][encoder_id][0] = ccw_keycode;
-        changed = true;
-    }
-
-    if (eeprom_data.encoder_map[layer][encoder_id][1] != cw_keycode) {
-        eeprom_data.encoder_map[layer][encoder_id][1] = cw_keycode;
-        changed = true;
+    uint8_t profile = staging_active ? staged_profile : active_profile;
+    uint16_t *total = staging_active ? &staged_encoder_total : &encoder_override_total[profile];
+    uint16_t stored_ccw = KC_NO;
+    uint16_t stored_cw = KC_NO;
+    uint16_t wanted_ccw = ccw_keycode;
+    uint16_t wanted_cw = cw_keycode;
+    if (staging_active) {
+        lookup_encoder(staged_changes, staged_count, profile, layer, encoder_id, &stored_ccw, &stored_cw);
+    } else {
+        lookup_encoder(changes, change_count, profile, layer, encoder_id, &stored_ccw, &stored_cw);
     }
+    encoder_override_value(layer, encoder_id, &wanted_ccw, &wanted_cw);
 
-    if (changed) {
-        config_modified = true;
-        usb_app_cdc_printf("EEPROM: Encoder[L%d][%d] = CCW:0x%04X CW:0x%04X\r\n",
-                           layer, encoder_id, ccw_keycode, cw_keycode);
+    if (stored_ccw != wanted_ccw || stored_cw != wanted_cw) {
+        bool has = (wanted_ccw != KC_NO || wanted_cw != KC_NO);
+        bool had = (stored_ccw != KC_NO || stored_cw != KC_NO);
+        if (has && !had && *total >= EEPROM_ENCODER_OVERRIDES) {
+            usb_app_cdc_printf("EEPROM: Encoder override table full (%u entries)\r\n", EEPROM_ENCODER_OVERRIDES);
+            return false;
+        }
+        const uint8_t record[6] = { layer, encoder_id,
+                                    (uint8_t)wanted_ccw, (uint8_t)(wanted_ccw >> 8),
+                                    (uint8_t)wanted_cw, (uint8_t)(wanted_cw >> 8) };
+        if (!store_edit(EEPROM_REC_ENCODER, record)) {
+            return false;
+        }
+        *total = (uint16_t)(*total + has - had);
+        if (!staging_active) {
+            usb_app_cdc_printf("EEPROM: Encoder[L%d][%d] = CCW:0x%04X CW:0x%04X\r\n",
+                               layer, encoder_id, ccw_keycode, cw_keycode);
+        }
     }
 
     return true;
@@ -354,8 +2011,7 @@ bool eeprom_get_encoder_map(uint8_t layer, uint8_t encoder_id, uint16_t *ccw_key
         }
     }
 
-    *ccw_keycode = eeprom_data.encoder_map[layer][encoder_id][0];
-    *cw_keycode = eeprom_data.encoder_map[layer][encoder_id][1];
+    lookup_encoder(changes, change_count, active_profile, layer, encoder_id, ccw_keycode, cw_keycode);
     return true;
 }
 
@@ -372,24 +2028,27 @@ bool eeprom_set_slider_config(uint8_t layer, uint8_t slider_id, const slider_con
     }
 
     // Check if the configuration actually changed
-    bool changed = false;
-    slider_config_t *current_config = &eeprom_data.slider_map[layer][slider_id];
-    
-    if (current_config->midi_cc != config->midi_cc ||
-        current_config->midi_channel != config->midi_channel ||
-        current_config->min_midi_value != config->min_midi_value ||
-        current_config->max_midi_value != config->max_midi_value) {
-        changed = true;
-    }
-
-    if (changed) {
-        *current_config = *config;  // Copy the entire config
-        current_config->layer = layer;  // Ensure layer is correct
-        current_config->slider_id = slider_id;  // Ensure slider_id is correct
-        config_modified = true;
-        usb_app_cdc_printf("EEPROM: Slider[L%d][%d] = CC%d Ch%d Range%d-%d\r\n",
-                           layer, slider_id, config->midi_cc, config->midi_channel,
-                           config->min_midi_value, config->max_midi_value);
+    slider_config_t current_config;
+    if (staging_active) {
+        slider_read(staged_changes, staged_count, staged_profile, layer, slider_id, &current_config);
+    } else {
+        slider_read(changes, change_count, active_profile, layer, slider_id, &current_config);
+    }
+
+    if (current_config.midi_cc != config->midi_cc ||
+        current_config.midi_channel != config->midi_channel ||
+        current_config.min_midi_value != config->min_midi_value ||
+        current_config.max_midi_value != config->max_midi_value) {
+        const uint8_t record[6] = { layer, slider_id, config->midi_cc, config->midi_channel,
+                                    config->min_midi_value, config->max_midi_value };
+        if (!store_edit(EEPROM_REC_SLIDER, record)) {
+            return false;
+        }
+        if (!staging_active) {
+            usb_app_cdc_printf("EEPROM: Slider[L%d][%d] = CC%d Ch%d Range%d-%d\r\n",
+                               layer, slider_id, config->midi_cc, config->midi_channel,
+                               config->min_midi_value, config->max_midi_value);
+        }
     }
 
     return true;
@@ -407,7 +2066,7 @@ bool eeprom_get_slider_config(uint8_t layer, uint8_t slider_id, slider_config_t
         }
     }
 
-    *config = eeprom_data.slider_map[layer][slider_id];
+    slider_read(changes, change_count, active_profile, layer, slider_id, config);
     return true;
 }
 
@@ -423,18 +2082,15 @@ bool eeprom_set_magnetic_switch_calibration(uint8_t switch_id, uint16_t unpresse
         }
     }
 
-    // Check if the calibration actually changed (avoid taking address of packed member)
-    bool changed = (eeprom_data.magnetic_switches[switch_id].unpressed_value != unpressed_value ||
-                   eeprom_data.magnetic_switches[switch_id].pressed_value != pressed_value ||
-                   eeprom_data.magnetic_switches[switch_id].sensitivity != sensitivity ||
-                   !eeprom_data.magnetic_switches[switch_id].is_calibrated);
-
-    if (changed) {
-        eeprom_data.magnetic_switches[switch_id].unpressed_value = unpressed_value;
-        eeprom_data.magnetic_switches[switch_id].pressed_value = pressed_value;
-        eeprom_data.magnetic_switches[switch_id].sensitivity = sensitivity;
-        eeprom_data.magnetic_switches[switch_id].is_calibrated = true;
-        config_modified = true;
+    const uint8_t record[6] = { switch_id,
+                                (uint8_t)unpressed_value, (uint8_t)(unpressed_value >> 8),
+                                (uint8_t)pressed_value, (uint8_t)(pressed_value >> 8),
+                                sensitivity };
+    // Also stored when only the is_calibrated flag is missing
+    if (setting_changes(EEPROM_REC_MAGNETIC, record)) {
+        if (!eeprom_queue_record(profile_tag(EEPROM_REC_MAGNETIC), record)) {
+            return false;
+        }
         usb_app_cdc_printf("EEPROM: MagSwitch[%d] = unpressed:%d pressed:%d sensitivity:%d%%\r\n",
                            switch_id, unpressed_value, pressed_value, sensitivity);
     }
@@ -444,7 +2100,7 @@ bool eeprom_set_magnetic_switch_calibration(uint8_t switch_id, uint16_t unpresse
 
 bool eeprom_get_magnetic_switch_calibration(uint8_t switch_id, uint16_t *unpressed_value, uint16_t *pressed_value, uint8_t *sensitivity, bool *is_calibrated)
 {
-    if (switch_id >= MAX_MAGNETIC_SWITCHES_EEPROM || 
+    if (switch_id >= MAX_MAGNETIC_SWITCHES_EEPROM ||
         !unpressed_value || !pressed_value || !sensitivity || !is_calibrated) {
         return false;
     }
@@ -455,16 +2111,19 @@ bool eeprom_get_magnetic_switch_calibration(uint8_t switch_id, uint16_t *unpress
         }
     }
 
-    // Avoid taking address of packed member
-    *unpressed_value = eeprom_data.magnetic_switches[switch_id].unpressed_value;
-    *pressed_value = eeprom_data.magnetic_switches[switch_id].pressed_value;
-    *sensitivity = eeprom_data.magnetic_switches[switch_id].sensitivity;
-    *is_calibrated = eeprom_data.magnetic_switches[switch_id].is_calibrated;
-    
+    const uint8_t key[1] = { switch_id };
+    magnetic_switch_eeprom_t stored;
+    setting_read(active_profile, EEPROM_REC_MAGNETIC, key,
+                 offsetof(eeprom_data_t, magnetic_switches) + (uint32_t)switch_id * sizeof(stored), &stored, sizeof(stored));
+    *unpressed_value = stored.unpressed_value;
+    *pressed_value = stored.pressed_value;
+    *sensitivity = stored.sensitivity;
+    *is_calibrated = stored.is_calibrated;
+
     return true;
 }
 
-bool eeprom_set_layer_state(uint8_t active_mask, uint8_t default_layer)
+bool eeprom_set_layer_state(uint32_t active_mask, uint8_t default_layer)
 {
     if (!eeprom_initialized) {
         if (!eeprom_init()) {
@@ -477,30 +2136,25 @@ bool eeprom_set_layer_state(uint8_t active_mask, uint8_t default_layer)
         sanitized_default = 0;
     }
 
-    uint8_t allowed_mask = (KEYMAP_LAYER_COUNT >= 8)
-        ? 0xFF
-        : (uint8_t)((1u << KEYMAP_LAYER_COUNT) - 1u);
-
-    uint8_t sanitized_mask = active_mask & allowed_mask;
+    uint32_t sanitized_mask = active_mask & KEYMAP_LAYER_MASK_ALL;
     if (sanitized_mask == 0) {
-        uint16_t startup_bit = (uint16_t)1u << sanitized_default;
-        sanitized_mask = (uint8_t)(startup_bit & 0xFFu);
-        if (sanitized_mask == 0) {
-            sanitized_mask = 1u;
-        }
+        sanitized_mask = KEYMAP_LAYER_BIT(sanitized_default);
     }
 
-    if (eeprom_data.startup_layer_mask != sanitized_mask || eeprom_data.default_layer != sanitized_default) {
-        eeprom_data.startup_layer_mask = sanitized_mask;
-        eeprom_data.default_layer = sanitized_default;
-        config_modified = true;
-        usb_app_cdc_printf("EEPROM: Layer state stored mask=0x%02X default=%u\r\n", sanitized_mask, sanitized_default);
+    const uint8_t record[6] = { (uint8_t)sanitized_mask, (uint8_t)(sanitized_mask >> 8),
+                                (uint8_t)(sanitized_mask >> 16), (uint8_t)(sanitized_mask >> 24),
+                                sanitized_default, 0 };
+    if (setting_changes(EEPROM_REC_LAYER_MASK, record)) {
+        if (!eeprom_queue_record(profile_tag(EEPROM_REC_LAYER_MASK), record)) {
+            return false;
+        }
+        usb_app_cdc_printf("EEPROM: Layer state stored mask=0x%08lX default=%u\r\n", sanitized_mask, sanitized_default);
     }
 
     return true;
 }
 
-bool eeprom_get_layer_state(uint8_t *active_mask, uint8_t *default_layer)
+bool eeprom_get_layer_state(uint32_t *active_mask, uint8_t *default_layer)
 {
     if (!active_mask || !default_layer) {
         return false;
@@ -512,169 +2166,251 @@ bool eeprom_get_layer_state(uint8_t *active_mask, uint8_t *default_layer)
         }
     }
 
-    *active_mask = eeprom_data.startup_layer_mask;
-    *default_layer = eeprom_data.default_layer;
+    // startup_layer_mask is followed by default_layer
+    const uint8_t key[1] = { 0 };
+    uint8_t stored[sizeof(uint32_t) + 1U];
+    setting_read(active_profile, EEPROM_REC_LAYER_MASK, key, offsetof(eeprom_data_t, startup_layer_mask),
+                 stored, sizeof(stored));
+    memcpy(active_mask, stored, sizeof(uint32_t));
+    *default_layer = stored[sizeof(uint32_t)];
     return true;
 }
 
-// Private functions
-
-// Simple CRC32 implementation
-static uint32_t calculate_crc32(const uint8_t *data, uint32_t length)
+bool eeprom_set_debounce_config(uint8_t algorithm, uint8_t time_ms)
 {
-    uint32_t crc = 0xFFFFFFFF;
-    
-    for (uint32_t i = 0; i < length; i++) {
-        crc ^= data[i];
-        for (int j = 0; j < 8; j++) {
-            if (crc & 1) {
-                crc = (crc >> 1) ^ 0xEDB88320;
-            } else {
-                crc >>= 1;
-            }
+    if (!eeprom_initialized) {
+        if (!eeprom_init()) {
+            return false;
+        }
+    }
+
+    const uint8_t record[6] = { algorithm, time_ms, 0, 0, 0, 0 };
+    if (setting_changes(EEPROM_REC_DEBOUNCE, record)) {
+        if (!eeprom_queue_record(profile_tag(EEPROM_REC_DEBOUNCE), record)) {
+            return false;
         }
+        usb_app_cdc_printf("EEPROM: Debounce stored algorithm=%u time=%ums\r\n", algorithm, time_ms);
     }
-    
-    return ~crc;
+
+    return true;
 }
 
-// Erase flash page
-static bool flash_erase_page(uint32_t page_address)
+bool eeprom_get_debounce_config(uint8_t *algorithm, uint8_t *time_ms)
 {
-    HAL_StatusTypeDef status;
-    FLASH_EraseInitTypeDef erase_init;
-    uint32_t page_error;
-    
-    // STM32G4 uses 2KB pages; compute bank and page index relative to bank base
-    uint32_t bank_base = FLASH_BASE;
-    uint32_t bank = FLASH_BANK_1;
+    if (!algorithm || !time_ms) {
+        return false;
+    }
 
-    // Determine bank based on address and FLASH_BANK_SIZE
-    if (page_address >= (FLASH_BASE + FLASH_BANK_SIZE)) {
-        bank = FLASH_BANK_2;
-        bank_base = FLASH_BASE + FLASH_BANK_SIZE;
-    } else {
-        bank = FLASH_BANK_1;
-        bank_base = FLASH_BASE;
+    if (!eeprom_initialized) {
+        if (!eeprom_init()) {
+            return false;
+        }
     }
 
-    uint32_t page_number = (page_address - bank_base) / FLASH_PAGE_SIZE;
+    const uint8_t key[1] = { 0 };
+    uint8_t stored[2];
+    setting_read(active_profile, EEPROM_REC_DEBOUNCE, key, offsetof(eeprom_data_t, debounce_algorithm),
+                 stored, sizeof(stored));
+    *algorithm = stored[0];
+    *time_ms = stored[1];
+    return true;
+}
 
-    // Calculate number of pages to erase covering the EEPROM region (safe: erase entire reserved range)
-    uint32_t nb_pages = (EEPROM_END_ADDRESS - EEPROM_START_ADDRESS) / FLASH_PAGE_SIZE;
+bool eeprom_set_tap_hold_config(uint8_t row, uint8_t col, uint16_t tapping_term_ms, uint8_t flags)
+{
+    bool profile_wide = (row == EEPROM_TAP_HOLD_PROFILE && col == EEPROM_TAP_HOLD_PROFILE);
+    if (!profile_wide && (row >= MATRIX_ROWS || col >= MATRIX_COLS)) {
+        return false;
+    }
 
-    usb_app_cdc_printf("EEPROM: Erasing %lu page(s) starting at page %lu (address 0x%08lX) on bank %lu\r\n",
-                        nb_pages, page_number, page_address, (uint32_t)bank == FLASH_BANK_1 ? 1U : 2U);
+    if (!eeprom_initialized) {
+        if (!eeprom_init()) {
+            return false;
+        }
+    }
 
-    // Disable interrupts during flash erase to avoid code execution from flash during operation
-    __disable_irq();
-    HAL_FLASH_Unlock();
+    if (tapping_term_ms == 0) {
+        flags = 0;
+    }
 
-    erase_init.TypeErase = FLASH_TYPEERASE_PAGES;
-    erase_init.Banks = bank;
-    erase_init.Page = page_number;
-    erase_init.NbPages = nb_pages;
+    const uint8_t record[6] = { row, col, (uint8_t)tapping_term_ms, (uint8_t)(tapping_term_ms >> 8), flags, 0 };
+    if (setting_changes(EEPROM_REC_TAP_HOLD, record)) {
+        if (!eeprom_queue_record(profile_tag(EEPROM_REC_TAP_HOLD), record)) {
+            return false;
+        }
+        usb_app_cdc_printf("EEPROM: Tap-hold[%u][%u] term=%ums flags=0x%02X\r\n", row, col, tapping_term_ms, flags);
+    }
 
-    status = HAL_FLASHEx_Erase(&erase_init, &page_error);
+    return true;
+}
 
-    if (status != HAL_OK) {
-        usb_app_cdc_printf("EEPROM: Erase failed, status=%d, page_error=%lu\r\n", status, page_error);
-    } else {
-        usb_app_cdc_printf("EEPROM: Pages erased successfully\r\n");
+bool eeprom_get_tap_hold_config(uint8_t row, uint8_t col, uint16_t *tapping_term_ms, uint8_t *flags)
+{
+    bool profile_wide = (row == EEPROM_TAP_HOLD_PROFILE && col == EEPROM_TAP_HOLD_PROFILE);
+    if (!tapping_term_ms || !flags || (!profile_wide && (row >= MATRIX_ROWS || col >= MATRIX_COLS))) {
+        return false;
     }
 
-    HAL_FLASH_Lock();
-    __enable_irq();
+    if (!eeprom_initialized) {
+        if (!eeprom_init()) {
+            return false;
+        }
+    }
 
-    return (status == HAL_OK);
+    // The profile-wide term and flags share the per-key layout
+    const uint8_t key[2] = { row, col };
+    uint32_t offset = profile_wide ? offsetof(eeprom_data_t, tap_hold_term_ms)
+                                   : offsetof(eeprom_data_t, tap_hold_keys) + ((uint32_t)row * MATRIX_COLS + col) * sizeof(tap_hold_eeprom_t);
+    tap_hold_eeprom_t stored;
+    setting_read(active_profile, EEPROM_REC_TAP_HOLD, key, offset, &stored, sizeof(stored));
+    *tapping_term_ms = stored.tapping_term_ms;
+    *flags = stored.flags;
+    return true;
 }
 
-// Write data to flash
-static bool flash_write_data(uint32_t address, const uint8_t *data, uint32_t length)
+bool eeprom_set_combo(uint8_t index, const combo_eeprom_t *combo)
 {
-    HAL_StatusTypeDef status = HAL_OK;
-    
-    usb_app_cdc_printf("EEPROM: Unlocking flash...\r\n");
-    HAL_FLASH_Unlock();
-    
-    // STM32G4 requires 64-bit (8-byte) aligned writes
-    for (uint32_t i = 0; i < length; i += 8) {
-        uint64_t data_to_write = 0;
-        
-        // Copy up to 8 bytes, padding with 0xFF if necessary
-        for (int j = 0; j < 8; j++) {
-            if (i + j < length) {
-                data_to_write |= ((uint64_t)data[i + j]) << (j * 8);
-            } else {
-                data_to_write |= ((uint64_t)0xFF) << (j * 8);
-            }
+    if (index >= EEPROM_COMBO_COUNT || !combo || combo->layer >= KEYMAP_LAYER_COUNT) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < EEPROM_COMBO_KEYS; ++i) {
+        if (combo->keys[i] != EEPROM_COMBO_NO_KEY && combo->keys[i] >= MATRIX_ROWS * MATRIX_COLS) {
+            return false;
         }
-        
-        usb_app_cdc_printf("EEPROM: Writing 8 bytes at offset %lu\r\n", i);
-        status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, address + i, data_to_write);
-        if (status != HAL_OK) {
-            usb_app_cdc_printf("EEPROM: Flash write failed at offset %lu, status=%d\r\n", i, status);
-            break;
+    }
+
+    if (!eeprom_initialized) {
+        if (!eeprom_init()) {
+            return false;
         }
     }
-    
-    HAL_FLASH_Lock();
-    usb_app_cdc_printf("EEPROM: Flash locked, final status=%d\r\n", status);
-    
-    if (status != HAL_OK) {
+
+    const uint8_t keys_record[6] = { index, combo->layer, combo->keys[0], combo->keys[1], combo->keys[2], combo->keys[3] };
+    if (setting_changes(EEPROM_REC_COMBO_KEYS, keys_record) &&
+        !eeprom_queue_record(profile_tag(EEPROM_REC_COMBO_KEYS), keys_record)) {
+        return false;
+    }
+    const uint8_t action_record[6] = { index, (uint8_t)combo->keycode, (uint8_t)(combo->keycode >> 8), 0, 0, 0 };
+    if (setting_changes(EEPROM_REC_COMBO_ACTION, action_record) &&
+        !eeprom_queue_record(profile_tag(EEPROM_REC_COMBO_ACTION), action_record)) {
+        return false;
+    }
+
+    return true;
+}
+
+bool eeprom_get_combo(uint8_t index, combo_eeprom_t *combo)
+{
+    if (index >= EEPROM_COMBO_COUNT || !combo) {
         return false;
     }
 
-    // Read-back verification
-    usb_app_cdc_printf("EEPROM: Verifying written data...\r\n");
-    const uint8_t *written = (const uint8_t*)address;
-    for (uint32_t i = 0; i < length; i++) {
-        if (written[i] != data[i]) {
-            usb_app_cdc_printf("EEPROM: Verification mismatch at offset %lu (flash=0x%02X expected=0x%02X)\r\n",
-                                i, written[i], data[i]);
+    if (!eeprom_initialized) {
+        if (!eeprom_init()) {
             return false;
         }
     }
 
-    usb_app_cdc_printf("EEPROM: Verification passed\r\n");
+    // Keys and action are logged as separate records
+    const uint8_t key[1] = { index };
+    uint32_t offset = offsetof(eeprom_data_t, combos) + (uint32_t)index * sizeof(combo_eeprom_t);
+    base_read(active_profile, offset, (uint8_t *)combo, sizeof(*combo));
+    apply_change(changes, change_count, active_profile, EEPROM_REC_COMBO_KEYS, key, offset, (uint8_t *)combo, sizeof(*combo));
+    apply_change(changes, change_count, active_profile, EEPROM_REC_COMBO_ACTION, key, offset, (uint8_t *)combo, sizeof(*combo));
     return true;
 }
 
-// Load default configuration from const arrays
-static void load_default_config(void)
+bool eeprom_set_combo_term(uint16_t term_ms)
 {
-    // Clear the structure
-    memset(&eeprom_data, 0, sizeof(eeprom_data_t));
-    
-    // Copy default keymap for all layers
-    for (uint8_t layer = 0; layer < KEYMAP_LAYER_COUNT; layer++) {
-        for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
-            for (uint8_t col = 0; col < MATRIX_COLS; col++) {
-                eeprom_data.keymap[layer][row][col] = keycodes[layer][row][col];
-            }
+    if (!eeprom_initialized) {
+        if (!eeprom_init()) {
+            return false;
         }
     }
 
-    // Copy default encoder map for all layers
-    for (uint8_t layer = 0; layer < KEYMAP_LAYER_COUNT; layer++) {
-        for (uint8_t idx = 0; idx < ENCODER_COUNT; idx++) {
-            eeprom_data.encoder_map[layer][idx][0] = encoder_map[layer][idx][0];
-            eeprom_data.encoder_map[layer][idx][1] = encoder_map[layer][idx][1];
+    const uint8_t record[6] = { EEPROM_COMBO_NO_KEY, (uint8_t)term_ms, (uint8_t)(term_ms >> 8), 0, 0, 0 };
+    if (setting_changes(EEPROM_REC_COMBO_ACTION, record)) {
+        if (!eeprom_queue_record(profile_tag(EEPROM_REC_COMBO_ACTION), record)) {
+            return false;
+        }
+        usb_app_cdc_printf("EEPROM: Combo term=%ums\r\n", term_ms);
+    }
+
+    return true;
+}
+
+uint16_t eeprom_get_combo_term(void)
+{
+    if (!eeprom_initialized) {
+        if (!eeprom_init()) {
+            return 0;
+        }
+    }
+
+    const uint8_t key[1] = { EEPROM_COMBO_NO_KEY };
+    uint16_t term_ms = 0;
+    setting_read(active_profile, EEPROM_REC_COMBO_ACTION, key, offsetof(eeprom_data_t, combo_term_ms),
+                 &term_ms, sizeof(term_ms));
+    return term_ms;
+}
+
+// Changed 4-byte chunks are logged one record each
+bool eeprom_set_macro_data(uint16_t offset, const uint8_t *data, uint16_t length)
+{
+    if (!data || offset > EEPROM_MACRO_BYTES || length > EEPROM_MACRO_BYTES - offset) {
+        return false;
+    }
+
+    if (!eeprom_initialized) {
+        if (!eeprom_init()) {
+            return false;
+        }
+    }
+
+    uint16_t first = (uint16_t)(offset & ~(EEPROM_MACRO_CHUNK - 1U));
+    for (uint16_t chunk = first; chunk < offset + length; chunk += EEPROM_MACRO_CHUNK) {
+        uint8_t record[6] = { (uint8_t)chunk, (uint8_t)(chunk >> 8) };
+        eeprom_get_macro_data(chunk, &record[2], EEPROM_MACRO_CHUNK);
+        patch_range(&record[2], chunk, EEPROM_MACRO_CHUNK, offset, data, length);
+        if (setting_changes(EEPROM_REC_MACRO, record) &&
+            !eeprom_queue_record(profile_tag(EEPROM_REC_MACRO), record)) {
+            return false;
         }
     }
 
-    // Copy default slider configuration map for all layers
-    for (uint8_t layer = 0; layer < KEYMAP_LAYER_COUNT; layer++) {
-        for (uint8_t idx = 0; idx < SLIDER_COUNT; idx++) {
-            eeprom_data.slider_map[layer][idx] = slider_config_map[layer][idx];
-            // Ensure layer and slider_id are correct
-            eeprom_data.slider_map[layer][idx].layer = layer;
-            eeprom_data.slider_map[layer][idx].slider_id = idx;
+    return true;
+}
+
+bool eeprom_get_macro_data(uint16_t offset, uint8_t *data, uint16_t length)
+{
+    if (!data || offset > EEPROM_MACRO_BYTES || length > EEPROM_MACRO_BYTES - offset) {
+        return false;
+    }
+
+    if (!eeprom_initialized) {
+        if (!eeprom_init()) {
+            return false;
         }
     }
 
-    eeprom_data.startup_layer_mask = 0x01;
-    eeprom_data.default_layer = 0;
-    
+    uint32_t area = offsetof(eeprom_data_t, macro_data);
+    base_read(active_profile, area + offset, data, length);
+    for (uint16_t chunk = (uint16_t)(offset & ~(EEPROM_MACRO_CHUNK - 1U)); chunk < offset + length; chunk += EEPROM_MACRO_CHUNK) {
+        const uint8_t key[2] = { (uint8_t)chunk, (uint8_t)(chunk >> 8) };
+        apply_change(changes, change_count, active_profile, EEPROM_REC_MACRO, key, area + offset, data, length);
+    }
+    return true;
+}
+
+// Private functions
+
+// Every profile follows the compiled defaults again
+static void load_default_config(void)
+{
+    load_default_profiles();
+
     config_modified = true;
+    compact_required = true;
+    keymap_invalidate_cache();
 }
@@ -0,0 +1,100 @@
+#include "eeprom_flash.h"
+#include "stm32g4xx_hal.h"
+#include "usb_app.h"
+
+static volatile eeprom_flash_status_t flash_status = EEPROM_FLASH_IDLE;
+static volatile bool erase_in_progress = false;
+static bool dual_bank = false;
+
+void eeprom_flash_init(void)
+{
+    dual_bank = (FLASH->OPTR & FLASH_OPTR_DBANK) != 0U;
+    if (!dual_bank) {
+        usb_app_cdc_printf("EEPROM: Single-bank flash (DBANK=0), saves will stall the CPU\r\n");
+    }
+
+    HAL_NVIC_SetPriority(FLASH_IRQn, 6, 0);
+    HAL_NVIC_EnableIRQ(FLASH_IRQn);
+}
+
+bool eeprom_flash_is_dual_bank(void)
+{
+    return dual_bank;
+}
+
+bool eeprom_flash_erase_async(uint32_t address, uint32_t size)
+{
+    if (flash_status == EEPROM_FLASH_BUSY) {
+        return false;
+    }
+
+    // Dual-bank mode has 2 KB pages split across two banks; single-bank mode
+    // has 4 KB pages counted from the start of flash
+    uint32_t page_size = dual_bank ? FLASH_PAGE_SIZE : FLASH_PAGE_SIZE_128_BITS;
+    uint32_t bank = FLASH_BANK_1;
+    uint32_t bank_base = FLASH_BASE;
+    if (dual_bank && address >= (FLASH_BASE + FLASH_BANK_SIZE)) {
+        bank = FLASH_BANK_2;
+        bank_base = FLASH_BASE + FLASH_BANK_SIZE;
+    }
+
+    FLASH_EraseInitTypeDef erase_init = {
+        .TypeErase = FLASH_TYPEERASE_PAGES,
+        .Banks = bank,
+        .Page = (address - bank_base) / page_size,
+        .NbPages = (size + page_size - 1U) / page_size
+    };
+
+    flash_status = EEPROM_FLASH_BUSY;
+    erase_in_progress = true;
+    HAL_FLASH_Unlock();
+    if (HAL_FLASHEx_Erase_IT(&erase_init) != HAL_OK) {
+        HAL_FLASH_Lock();
+        flash_status = EEPROM_FLASH_ERROR;
+        return false;
+    }
+    return true;
+}
+
+bool eeprom_flash_program_async(uint32_t address, uint64_t data)
+{
+    if (flash_status == EEPROM_FLASH_BUSY) {
+        return false;
+    }
+
+    flash_status = EEPROM_FLASH_BUSY;
+    erase_in_progress = false;
+    HAL_FLASH_Unlock();
+    if (HAL_FLASH_Program_IT(FLASH_TYPEPROGRAM_DOUBLEWORD, address, data) != HAL_OK) {
+        HAL_FLASH_Lock();
+        flash_status = EEPROM_FLASH_ERROR;
+        return false;
+    }
+    return true;
+}
+
+eeprom_flash_status_t eeprom_flash_poll(void)
+{
+    eeprom_flash_status_t status = flash_status;
+    if (status == EEPROM_FLASH_DONE || status == EEPROM_FLASH_ERROR) {
+        HAL_FLASH_Lock();
+        flash_status = EEPROM_FLASH_IDLE;
+    }
+    return status;
+}
+
+// HAL callbacks, called from HAL_FLASH_IRQHandler()
+void HAL_FLASH_EndOfOperationCallback(uint32_t ReturnValue)
+{
+    // Page erases report each page; 0xFFFFFFFF marks the last one
+    if (erase_in_progress && ReturnValue != 0xFFFFFFFFU) {
+        return;
+    }
+    flash_status = EEPROM_FLASH_DONE;
+}
+
+void HAL_FLASH_OperationErrorCallback(uint32_t ReturnValue)
+{
+    (void)ReturnValue;
+    flash_status = EEPROM_FLASH_ERROR;
+}
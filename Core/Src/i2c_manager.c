@@ -8,6 +8,8 @@
 #include "main.h"
 #include <string.h>
 #include "usb_app.h"
+#include "trace.h"
+#include "latency.h"
 #include "input/keymap.h"
 #include "config_protocol.h"
 #include "eeprom_emulation.h"
@@ -17,6 +19,8 @@
 #define I2C_EVENT_FIFO_SIZE 16
 #define I2C_TAP_TIMEOUT_MS 100
 
+_Static_assert(EEPROM_PROFILE_COUNT <= 8, "I2C_MSG_LAYER_STATE_32 carries the profile in 3 bits");
+
 /* Private types */
 typedef enum { 
     I2C_TAP_IDLE = 0, 
@@ -38,6 +42,8 @@ static uint32_t last_slave_scan = 0;
 #define SLAVE_SCAN_INTERVAL_MS 500
 uint8_t detected_slaves[I2C_MAX_SLAVE_COUNT]; // Track detected slave addresses
 uint8_t detected_slave_count = 0;
+// Slaves that did not acknowledge CMD_SET_LAYER_STATE_32 (older firmware) get the 8-bit command
+static uint8_t legacy_layer_slaves[I2C_MAX_SLAVE_COUNT];
 
 /* I2C Event FIFO Queue for handling multiple simultaneous key events */
 static i2c_message_t i2c_event_fifo[I2C_EVENT_FIFO_SIZE];
@@ -46,7 +52,13 @@ static volatile uint8_t i2c_fifo_tail = 0;
 static volatile uint8_t i2c_fifo_count = 0;
 
 /* Master-side event FIFO to preserve ordering of slave messages */
-static i2c_key_event_t i2c_master_event_fifo[I2C_EVENT_FIFO_SIZE];
+typedef struct {
+    i2c_key_event_t event;
+    uint32_t detect_cycles;   /* trace_cycles() at detection / I2C receipt */
+    uint8_t source;           /* latency_source_t */
+} i2c_master_fifo_entry_t;
+
+static i2c_master_fifo_entry_t i2c_master_event_fifo[I2C_EVENT_FIFO_SIZE];
 static volatile uint8_t i2c_master_fifo_head = 0;
 static volatile uint8_t i2c_master_fifo_tail = 0;
 static volatile uint8_t i2c_master_fifo_count = 0;
@@ -74,6 +86,15 @@ static uint8_t i2c_slave_config_response[I2C_SLAVE_CONFIG_MAX_RESPONSE] = {0};
 static volatile uint8_t i2c_slave_config_response_length = 0;
 static volatile uint8_t i2c_slave_has_config_response = 0;
 
+/* Layer state received from the master in the RX interrupt, applied by i2c_manager_task() */
+static volatile uint8_t i2c_slave_layer_state_pending = 0;
+static volatile uint32_t i2c_slave_layer_mask = 0;
+static volatile uint8_t i2c_slave_default_layer = 0;
+static volatile uint8_t i2c_slave_profile = 0;
+
+// Profile argument for layer states from the 8-bit forms, which carry none
+#define LAYER_STATE_KEEP_PROFILE 0xFFu
+
 /* Private function prototypes */
 static uint8_t i2c_fifo_is_full(void);
 static uint8_t i2c_fifo_is_empty(void);
@@ -81,18 +102,21 @@ static uint8_t i2c_fifo_push(const i2c_message_t *message);
 static uint8_t i2c_fifo_pop(i2c_message_t *message);
 static uint8_t i2c_master_fifo_is_full(void);
 static uint8_t i2c_master_fifo_is_empty(void);
-static uint8_t i2c_master_fifo_push(const i2c_key_event_t *event);
-static uint8_t i2c_master_fifo_pop(i2c_key_event_t *event);
+static uint8_t i2c_master_fifo_push(const i2c_key_event_t *event, uint8_t source, uint32_t detect_cycles);
+static uint8_t i2c_master_fifo_pop(i2c_master_fifo_entry_t *entry);
 static void init_i2c_tx_buffer(void);
 static void configure_i2c_master_internal(bool force);
 static void configure_i2c_master(void);
 static void configure_i2c_master_force(void);
 static void configure_i2c_slave(void);
-static void process_slave_key_event(const i2c_key_event_t *event);
+static void process_slave_key_event(const i2c_key_event_t *event, uint8_t source, uint32_t detect_cycles);
 static void process_slave_midi_event(const i2c_midi_event_t *event);
 static void process_slave_layer_state(const i2c_layer_state_t *event);
-static uint8_t first_active_layer(uint8_t mask);
+static void apply_peer_layer_state(uint32_t mask, uint8_t default_layer, uint8_t profile);
+static void process_slave_layer_state32(const i2c_layer_state32_t *event);
+static uint8_t first_active_layer(uint32_t mask);
 static void process_i2c_encoder_state_machine(void);
+static void apply_pending_layer_state(void);
 static void process_master_event_queue(void);
 static void queue_midi_event(uint8_t event_type, uint8_t channel, uint8_t data1, uint8_t data2);
 
@@ -119,8 +143,7 @@ static uint8_t i2c_fifo_push(const i2c_message_t *message)
     i2c_fifo_head = (i2c_fifo_head + 1) % I2C_EVENT_FIFO_SIZE;
     i2c_fifo_count++;
     
-    usb_app_cdc_printf("I2C FIFO: Pushed msg_type=0x%02X (count=%d)\r\n",
-                 message->common.msg_type, i2c_fifo_count);
+    TRACE_DEBUG(I2C_FIFO_PUSH, message->common.msg_type, i2c_fifo_count);
     return 1; // Success
 }
 
@@ -135,8 +158,7 @@ static uint8_t i2c_fifo_pop(i2c_message_t *message)
     i2c_fifo_tail = (i2c_fifo_tail + 1) % I2C_EVENT_FIFO_SIZE;
     i2c_fifo_count--;
     
-    usb_app_cdc_printf("I2C FIFO: Popped msg_type=0x%02X (count=%d)\r\n",
-                 message->common.msg_type, i2c_fifo_count);
+    TRACE_DEBUG(I2C_FIFO_POP, message->common.msg_type, i2c_fifo_count);
     return 1; // Success
 }
 
@@ -150,27 +172,29 @@ static uint8_t i2c_master_fifo_is_empty(void)
     return i2c_master_fifo_count == 0;
 }
 
-static uint8_t i2c_master_fifo_push(const i2c_key_event_t *event)
+static uint8_t i2c_master_fifo_push(const i2c_key_event_t *event, uint8_t source, uint32_t detect_cycles)
 {
     if (i2c_master_fifo_is_full()) {
         usb_app_cdc_printf("I2C Master FIFO: OVERFLOW! Dropping event\r\n");
         return 0;
     }
 
-    i2c_master_event_fifo[i2c_master_fifo_head] = *event;
+    i2c_master_event_fifo[i2c_master_fifo_head].event = *event;
+    i2c_master_event_fifo[i2c_master_fifo_head].source = source;
+    i2c_master_event_fifo[i2c_master_fifo_head].detect_cycles = detect_cycles;
     i2c_master_fifo_head = (i2c_master_fifo_head + 1) % I2C_EVENT_FIFO_SIZE;
     i2c_master_fifo_count++;
 
     return 1;
 }
 
-static uint8_t i2c_master_fifo_pop(i2c_key_event_t *event)
+static uint8_t i2c_master_fifo_pop(i2c_master_fifo_entry_t *entry)
 {
     if (i2c_master_fifo_is_empty()) {
         return 0;
     }
 
-    *event = i2c_master_event_fifo[i2c_master_fifo_tail];
+    *entry = i2c_master_event_fifo[i2c_master_fifo_tail];
     i2c_master_fifo_tail = (i2c_master_fifo_tail + 1) % I2C_EVENT_FIFO_SIZE;
     i2c_master_fifo_count--;
     return 1;
@@ -279,20 +303,17 @@ static void configure_i2c_slave(void)
 }
 
 /* I2C master: process received key event from slave */
-static void process_slave_key_event(const i2c_key_event_t *event)
+static void process_slave_key_event(const i2c_key_event_t *event, uint8_t source, uint32_t detect_cycles)
 {
     if (!i2c_validate_message(event)) {
         return; // Invalid message, ignore
     }
 
-    uint8_t mask = event->layer_mask;
+    // The event only carries layers 0-7; keep the higher layers as they are
+    uint32_t mask = (keymap_get_layer_mask() & ~(uint32_t)0xFFu) | event->layer_mask;
     uint8_t default_layer = keymap_get_default_layer();
     if (mask == 0u) {
-        uint8_t default_bit = (uint8_t)(1u << default_layer);
-        if (default_bit == 0u) {
-            default_bit = 1u;
-        }
-        mask = default_bit;
+        mask = KEYMAP_LAYER_BIT(default_layer);
     }
 
     keymap_apply_layer_mask(mask, default_layer, false, false);
@@ -300,22 +321,22 @@ static void process_slave_key_event(const i2c_key_event_t *event)
 
     // Check if this is an encoder event (row 254) or regular matrix key
     if (event->row == 254) {
-        const char *dir = event->pressed ? "CW" : "CCW";
         // Encoder event: col=encoder_idx, pressed encodes direction, keycode=HID key
-        usb_app_cdc_printf("Master: Processing encoder event (%s), keycode=0x%02X\r\n", dir, event->keycode);
+        TRACE_DEBUG(I2C_MASTER_ENCODER, event->pressed ? TRACE_STR_CW : TRACE_STR_CCW, event->keycode);
+        key_state_set_event_stamp(source, detect_cycles);
         key_state_send_encoder_event(event->keycode);
         return;
     }
 
     // Regular matrix key event from slave or locally queued master event
-    usb_app_cdc_printf("Master: Processing matrix key: %s keycode=0x%02X\r\n",
-                 event->pressed ? "press" : "release", event->keycode);
+    TRACE_DEBUG(I2C_MASTER_KEY, event->pressed ? TRACE_STR_PRESSED : TRACE_STR_RELEASED, event->keycode);
 
     if (event->pressed) {
         key_state_add_key(event->keycode);
     } else {
         key_state_remove_key(event->keycode);
     }
+    key_state_set_event_stamp(source, detect_cycles);
     key_state_update_hid_report();
 }
 
@@ -351,19 +372,14 @@ static void process_slave_midi_event(const i2c_midi_event_t *event)
     }
 }
 
-static uint8_t first_active_layer(uint8_t mask)
+static uint8_t first_active_layer(uint32_t mask)
 {
+    mask &= KEYMAP_LAYER_MASK_ALL;
     if (mask == 0) {
         return 0;
     }
 
-    for (uint8_t idx = 0; idx < KEYMAP_LAYER_COUNT; idx++) {
-        if ((mask & (uint8_t)(1u << idx)) != 0) {
-            return idx;
-        }
-    }
-
-    return 0;
+    return (uint8_t)__builtin_ctz(mask);
 }
 
 static void process_slave_layer_state(const i2c_layer_state_t *event)
@@ -372,19 +388,40 @@ static void process_slave_layer_state(const i2c_layer_state_t *event)
         return;
     }
 
+    apply_peer_layer_state(event->layer_mask, event->default_layer, LAYER_STATE_KEEP_PROFILE);
+}
+
+static void process_slave_layer_state32(const i2c_layer_state32_t *event)
+{
+    if (!i2c_validate_layer32_message(event)) {
+        return;
+    }
+
+    apply_peer_layer_state(event->layer_mask, event->layer_info & I2C_LAYER_INFO_DEFAULT_MASK,
+                           (uint8_t)(event->layer_info >> I2C_LAYER_INFO_PROFILE_SHIFT));
+}
+
+static void apply_peer_layer_state(uint32_t mask, uint8_t default_layer, uint8_t profile)
+{
     if (current_i2c_mode == 1u) {
-        uint8_t current_mask = keymap_get_layer_mask();
+        uint32_t current_mask = keymap_get_layer_mask();
         uint8_t current_default = keymap_get_default_layer();
+        uint8_t current_profile = keymap_get_profile();
+        if (profile == LAYER_STATE_KEEP_PROFILE) {
+            profile = current_profile;
+        }
 
-        if ((event->layer_mask != current_mask) || (event->default_layer != current_default)) {
-            i2c_manager_broadcast_layer_state(current_mask, current_default);
+        if ((mask != current_mask) || (default_layer != current_default) || (profile != current_profile)) {
+            i2c_manager_broadcast_layer_state(current_mask, current_default, current_profile);
         }
 
         return;
     }
 
-    uint8_t mask = event->layer_mask;
-    uint8_t default_layer = event->default_layer;
+    // Switch profile first so the layer defaults below are the new profile's
+    if (profile != LAYER_STATE_KEEP_PROFILE) {
+        keymap_set_profile(profile, false);
+    }
 
     if (default_layer >= KEYMAP_LAYER_COUNT) {
         default_layer = first_active_layer(mask);
@@ -394,6 +431,32 @@ static void process_slave_layer_state(const i2c_layer_state_t *event)
     keymap_apply_layer_mask(mask, default_layer, false, update_default);
 }
 
+/* I2C slave: apply the layer state latched by the RX interrupt */
+static void apply_pending_layer_state(void)
+{
+    if (!i2c_slave_layer_state_pending) {
+        return;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t mask = i2c_slave_layer_mask;
+    uint8_t def_layer = i2c_slave_default_layer;
+    uint8_t profile = i2c_slave_profile;
+    i2c_slave_layer_state_pending = 0;
+    __set_PRIMASK(primask);
+
+    // Switch profile first so the layer defaults below are the new profile's
+    if (profile != LAYER_STATE_KEEP_PROFILE) {
+        keymap_set_profile(profile, false);
+    }
+    bool update_default = (def_layer < KEYMAP_LAYER_COUNT) && (def_layer != keymap_get_default_layer());
+    keymap_apply_layer_mask(mask, def_layer, false, update_default);
+
+    usb_app_cdc_printf("SLAVE RX: layer state updated mask=0x%08lX default=%d profile=%d\r\n",
+                       mask, def_layer, keymap_get_profile());
+}
+
 /* I2C master: burst poll to drain slave FIFO quickly */
 /* Process I2C encoder state machine for slave mode */
 static void process_i2c_encoder_state_machine(void)
@@ -529,6 +592,7 @@ static void i2c_manager_scan_slaves_internal(bool force)
     if (changed) {
         memset(detected_slaves, 0, sizeof(detected_slaves));
         memcpy(detected_slaves, new_detected, new_count);
+        memset(legacy_layer_slaves, 0, sizeof(legacy_layer_slaves));
         detected_slave_count = new_count;
 
         if (new_count == 0) {
@@ -536,9 +600,9 @@ static void i2c_manager_scan_slaves_internal(bool force)
             usb_app_cdc_printf("I2C: No slaves detected, bus reset\r\n");
         } else {
             usb_app_cdc_printf("I2C: Scan found %d slave(s)\r\n", detected_slave_count);
-            uint8_t current_mask = keymap_get_layer_mask();
+            uint32_t current_mask = keymap_get_layer_mask();
             uint8_t current_default = keymap_get_default_layer();
-            i2c_manager_broadcast_layer_state(current_mask, current_default);
+            i2c_manager_broadcast_layer_state(current_mask, current_default, keymap_get_profile());
         }
     } else {
         detected_slave_count = new_count;
@@ -558,7 +622,8 @@ void i2c_manager_scan_slaves_force(void)
 void i2c_manager_task(void)
 {
     if (current_i2c_mode == 0) { 
-        // Slave mode - process encoder state machine
+        // Slave mode - apply layer state from the master, process encoder state machine
+        apply_pending_layer_state();
         process_i2c_encoder_state_machine();
     } else if (current_i2c_mode == 1) {
         i2c_manager_scan_slaves();
@@ -579,7 +644,7 @@ void i2c_manager_send_key_event(uint8_t row, uint8_t col, uint8_t pressed, uint8
     message.key_event.col = col;
     message.key_event.pressed = pressed;
     message.key_event.keycode = keycode;
-    message.key_event.layer_mask = keymap_get_layer_mask();
+    message.key_event.layer_mask = (uint8_t)keymap_get_layer_mask();
     message.key_event.checksum = i2c_calc_checksum(&message.key_event);
 
     // Add to FIFO queue for transmission
@@ -588,24 +653,63 @@ void i2c_manager_send_key_event(uint8_t row, uint8_t col, uint8_t pressed, uint8
     }
 }
 
-void i2c_manager_send_layer_state(uint8_t layer_mask, uint8_t default_layer)
+void i2c_manager_send_layer_state(uint32_t layer_mask, uint8_t default_layer, uint8_t profile)
 {
     i2c_message_t message = {0};
-    message.layer_state.header = I2C_MSG_HEADER;
-    message.layer_state.msg_type = I2C_MSG_LAYER_STATE;
-    message.layer_state.layer_mask = layer_mask;
-    message.layer_state.default_layer = default_layer;
-    message.layer_state.reserved0 = 0;
-    message.layer_state.reserved1 = 0;
-    message.layer_state.reserved2 = 0;
-    message.layer_state.checksum = i2c_calc_layer_checksum(&message.layer_state);
 
+    // The 32-bit message carries the profile, so it always goes out
+    message.layer_state32.header = I2C_MSG_HEADER;
+    message.layer_state32.msg_type = I2C_MSG_LAYER_STATE_32;
+    message.layer_state32.layer_mask = layer_mask;
+    message.layer_state32.layer_info = (uint8_t)((default_layer & I2C_LAYER_INFO_DEFAULT_MASK) |
+                                                 (profile << I2C_LAYER_INFO_PROFILE_SHIFT));
+    message.layer_state32.checksum = i2c_calc_layer32_checksum(&message.layer_state32);
     if (!i2c_fifo_push(&message)) {
-        usb_app_cdc_printf("Failed to queue I2C layer state: mask=0x%02X default=%d\r\n", layer_mask, default_layer);
+        usb_app_cdc_printf("Failed to queue I2C layer state: mask=0x%08lX default=%d\r\n", layer_mask, default_layer);
+        return;
+    }
+
+    // States that fit the 8-bit message follow it so older masters still track layers
+    if (layer_mask <= 0xFFu && default_layer < 8u) {
+        memset(&message, 0, sizeof(message));
+        message.layer_state.header = I2C_MSG_HEADER;
+        message.layer_state.msg_type = I2C_MSG_LAYER_STATE;
+        message.layer_state.layer_mask = (uint8_t)layer_mask;
+        message.layer_state.default_layer = default_layer;
+        message.layer_state.checksum = i2c_calc_layer_checksum(&message.layer_state);
+        if (!i2c_fifo_push(&message)) {
+            usb_app_cdc_printf("Failed to queue I2C layer state: mask=0x%08lX default=%d\r\n", layer_mask, default_layer);
+        }
     }
 }
 
-void i2c_manager_broadcast_layer_state(uint8_t layer_mask, uint8_t default_layer)
+// Send one layer state command to a slave. Returns false if the bus failed;
+// otherwise *response is the command the slave acknowledged, 0 if none.
+static bool send_layer_state_command(uint8_t address, uint8_t *tx_data, uint8_t *response)
+{
+    uint8_t rx_data[2] = {0};
+
+    if (HAL_I2C_Master_Transmit(&hi2c2, address << 1, tx_data, I2C_SLAVE_CONFIG_CMD_SIZE, 100) != HAL_OK) {
+        usb_app_cdc_printf("LAYER_STATE: TX failed to 0x%02X\r\n", address);
+        return false;
+    }
+
+    HAL_Delay(5);
+
+    if (HAL_I2C_Master_Receive(&hi2c2, address << 1, rx_data, sizeof(rx_data), 100) != HAL_OK) {
+        usb_app_cdc_printf("LAYER_STATE: RX failed from 0x%02X\r\n", address);
+        return false;
+    }
+
+    *response = (rx_data[1] == STATUS_OK) ? rx_data[0] : 0;
+    if (*response != tx_data[0]) {
+        usb_app_cdc_printf("LAYER_STATE: Bad response from 0x%02X [%02X %02X]\r\n",
+                           address, rx_data[0], rx_data[1]);
+    }
+    return true;
+}
+
+void i2c_manager_broadcast_layer_state(uint32_t layer_mask, uint8_t default_layer, uint8_t profile)
 {
     if (current_i2c_mode == 0xFF) {
         return;
@@ -613,7 +717,7 @@ void i2c_manager_broadcast_layer_state(uint8_t layer_mask, uint8_t default_layer
 
     if (current_i2c_mode == 0) {
         // In slave mode, queue update for the master
-        i2c_manager_send_layer_state(layer_mask, default_layer);
+        i2c_manager_send_layer_state(layer_mask, default_layer, profile);
         return;
     }
 
@@ -625,16 +729,23 @@ void i2c_manager_broadcast_layer_state(uint8_t layer_mask, uint8_t default_layer
         return;
     }
 
-    uint8_t tx_data[I2C_SLAVE_CONFIG_CMD_SIZE] = {
-        CMD_SET_LAYER_STATE,
-        layer_mask,
+    // The 32-bit command carries the profile. Slaves running older firmware
+    // only know the 8-bit one, and only follow states that fit it.
+    uint8_t wide_cmd[I2C_SLAVE_CONFIG_CMD_SIZE] = {
+        CMD_SET_LAYER_STATE_32,
+        (uint8_t)layer_mask,
+        (uint8_t)(layer_mask >> 8),
+        (uint8_t)(layer_mask >> 16),
+        (uint8_t)(layer_mask >> 24),
         default_layer,
-        0,
-        0,
-        0,
-        0
+        profile
     };
-    uint8_t rx_data[2] = {0};
+    uint8_t legacy_cmd[I2C_SLAVE_CONFIG_CMD_SIZE] = {
+        CMD_SET_LAYER_STATE,
+        (uint8_t)layer_mask,
+        default_layer
+    };
+    bool fits = (layer_mask <= 0xFFu);
 
     for (uint8_t idx = 0; idx < detected_slave_count; idx++) {
         uint8_t address = detected_slaves[idx];
@@ -642,21 +753,18 @@ void i2c_manager_broadcast_layer_state(uint8_t layer_mask, uint8_t default_layer
             continue;
         }
 
-        if (HAL_I2C_Master_Transmit(&hi2c2, address << 1, tx_data, sizeof(tx_data), 100) != HAL_OK) {
-            usb_app_cdc_printf("LAYER_STATE: TX failed to 0x%02X\r\n", address);
-            continue;
-        }
-
-        HAL_Delay(5);
-
-        if (HAL_I2C_Master_Receive(&hi2c2, address << 1, rx_data, sizeof(rx_data), 100) != HAL_OK) {
-            usb_app_cdc_printf("LAYER_STATE: RX failed from 0x%02X\r\n", address);
-            continue;
+        if (!legacy_layer_slaves[idx]) {
+            uint8_t response = 0;
+            if (!send_layer_state_command(address, wide_cmd, &response) || response == CMD_SET_LAYER_STATE_32) {
+                continue;
+            }
+            usb_app_cdc_printf("LAYER_STATE: 0x%02X has no 32-bit layer state, using the 8-bit command\r\n", address);
+            legacy_layer_slaves[idx] = 1;
         }
 
-        if (rx_data[0] != CMD_SET_LAYER_STATE || rx_data[1] != STATUS_OK) {
-            usb_app_cdc_printf("LAYER_STATE: Bad response from 0x%02X [%02X %02X]\r\n",
-                               address, rx_data[0], rx_data[1]);
+        if (fits) {
+            uint8_t response = 0;
+            send_layer_state_command(address, legacy_cmd, &response);
         }
     }
 }
@@ -730,13 +838,15 @@ void i2c_manager_poll_slaves(void)
             }
 
             if (i2c_rx_buffer.common.msg_type == I2C_MSG_KEY_EVENT) {
-                if (!i2c_master_fifo_push(&i2c_rx_buffer.key_event)) {
+                if (!i2c_master_fifo_push(&i2c_rx_buffer.key_event, LATENCY_SRC_I2C, trace_cycles())) {
                     usb_app_cdc_printf("Master FIFO full, dropping key event\r\n");
                 }
             } else if (i2c_rx_buffer.common.msg_type == I2C_MSG_MIDI_EVENT) {
                 process_slave_midi_event(&i2c_rx_buffer.midi_event);
             } else if (i2c_rx_buffer.common.msg_type == I2C_MSG_LAYER_STATE) {
                 process_slave_layer_state(&i2c_rx_buffer.layer_state);
+            } else if (i2c_rx_buffer.common.msg_type == I2C_MSG_LAYER_STATE_32) {
+                process_slave_layer_state32(&i2c_rx_buffer.layer_state32);
             } else {
                 break;
             }
@@ -747,15 +857,15 @@ void i2c_manager_poll_slaves(void)
     }
 }
 
-void i2c_manager_process_local_key_event(uint8_t row, uint8_t col, uint8_t pressed, uint8_t keycode)
+void i2c_manager_process_local_key_event(uint8_t row, uint8_t col, uint8_t pressed, uint8_t keycode,
+                                         uint8_t source, uint32_t detect_cycles)
 {
     if (keycode == 0) {
         return;
     }
 
     if (current_i2c_mode != 1U) {
-        usb_app_cdc_printf("Slave mode: queueing key event for master via I2C (row=%d, col=%d, pressed=%d, keycode=0x%02X)\r\n",
-                 row, col, pressed, keycode);
+        TRACE_DEBUG(I2C_SLAVE_QUEUE, row, col, pressed, keycode);
         i2c_manager_send_key_event(row, col, pressed, keycode);
         return;
     }
@@ -767,33 +877,32 @@ void i2c_manager_process_local_key_event(uint8_t row, uint8_t col, uint8_t press
         .col = col,
         .pressed = pressed,
         .keycode = keycode,
-        .layer_mask = keymap_get_layer_mask(),
+        .layer_mask = (uint8_t)keymap_get_layer_mask(),
         .checksum = 0
     };
 
     event.checksum = i2c_calc_checksum(&event);
 
-    if (!i2c_master_fifo_push(&event)) {
+    if (!i2c_master_fifo_push(&event, source, detect_cycles)) {
         usb_app_cdc_printf("Master FIFO full, dropping local key event (row=%d, col=%d, pressed=%d)\r\n", row, col, pressed);
         return;
     }
 
-    usb_app_cdc_printf("Master mode: enqueued local key event (row=%d, col=%d, pressed=%d, keycode=0x%02X)\r\n",
-                 row, col, pressed, keycode);
+    TRACE_DEBUG(I2C_MASTER_ENQUEUE, row, col, pressed, keycode);
 }
 
 static void process_master_event_queue(void)
 {
-    i2c_key_event_t event;
+    i2c_master_fifo_entry_t entry;
     uint8_t events_this_cycle = 0;
 
-    while (i2c_master_fifo_pop(&event)) {
-        process_slave_key_event(&event);
+    while (i2c_master_fifo_pop(&entry)) {
+        process_slave_key_event(&entry.event, entry.source, entry.detect_cycles);
         events_this_cycle++;
     }
 
     if (events_this_cycle) {
-        usb_app_cdc_printf("Master: processed %d queued events\r\n", events_this_cycle);
+        TRACE_DEBUG(I2C_MASTER_BATCH, events_this_cycle);
     }
 }
 
@@ -978,31 +1087,64 @@ void i2c_manager_slave_rx_complete_callback(I2C_HandleTypeDef *hi2c)
             i2c_slave_config_response_length = 2;
             i2c_slave_has_config_response = 1;
         }
-        else if (i2c_slave_rx_buffer[0] == CMD_SET_LAYER_STATE) {
-            uint8_t mask = i2c_slave_rx_buffer[1];
-            uint8_t def_layer = i2c_slave_rx_buffer[2];
-            bool update_default = (def_layer < KEYMAP_LAYER_COUNT) && (def_layer != keymap_get_default_layer());
-            keymap_apply_layer_mask(mask, def_layer, false, update_default);
+        else if (i2c_slave_rx_buffer[0] == CMD_SET_LAYER_STATE ||
+                 i2c_slave_rx_buffer[0] == CMD_SET_LAYER_STATE_32) {
+            uint8_t command = i2c_slave_rx_buffer[0];
+            uint32_t mask;
+            uint8_t def_layer;
+            uint8_t profile;
+            if (command == CMD_SET_LAYER_STATE_32) {
+                mask = (uint32_t)i2c_slave_rx_buffer[1] | ((uint32_t)i2c_slave_rx_buffer[2] << 8) |
+                       ((uint32_t)i2c_slave_rx_buffer[3] << 16) | ((uint32_t)i2c_slave_rx_buffer[4] << 24);
+                def_layer = i2c_slave_rx_buffer[5];
+                profile = i2c_slave_rx_buffer[6];
+            } else {
+                // Older masters leave the rest of the 8-bit command zero, so it carries no profile
+                mask = i2c_slave_rx_buffer[1];
+                def_layer = i2c_slave_rx_buffer[2];
+                profile = LAYER_STATE_KEEP_PROFILE;
+            }
+            // Switching profiles touches the EEPROM queue and reloads settings, so only
+            // latch the request here; a newer one before the main loop runs replaces it
+            i2c_slave_layer_mask = mask;
+            i2c_slave_default_layer = def_layer;
+            i2c_slave_profile = profile;
+            i2c_slave_layer_state_pending = 1;
 
             memset(i2c_slave_config_response, 0, sizeof(i2c_slave_config_response));
-            i2c_slave_config_response[0] = CMD_SET_LAYER_STATE;
+            i2c_slave_config_response[0] = command;
             i2c_slave_config_response[1] = STATUS_OK;
             i2c_slave_config_response_length = 2;
             i2c_slave_has_config_response = 1;
-            usb_app_cdc_printf("SLAVE RX: layer state updated mask=0x%02X default=%d\r\n", mask, def_layer);
         }
         else if (i2c_slave_rx_buffer[0] == CMD_GET_LAYER_STATE) {
-            uint8_t mask = keymap_get_layer_mask();
+            uint32_t mask = keymap_get_layer_mask();
             uint8_t def_layer = keymap_get_default_layer();
 
             memset(i2c_slave_config_response, 0, sizeof(i2c_slave_config_response));
             i2c_slave_config_response[0] = CMD_GET_LAYER_STATE;
-            i2c_slave_config_response[1] = mask;
+            i2c_slave_config_response[1] = (uint8_t)mask;
             i2c_slave_config_response[2] = def_layer;
+            i2c_slave_config_response[3] = keymap_get_profile();
             i2c_slave_config_response[6] = STATUS_OK;
             i2c_slave_config_response_length = 7;
             i2c_slave_has_config_response = 1;
         }
+        else if (i2c_slave_rx_buffer[0] == CMD_GET_LAYER_STATE_32) {
+            uint32_t mask = keymap_get_layer_mask();
+
+            memset(i2c_slave_config_response, 0, sizeof(i2c_slave_config_response));
+            i2c_slave_config_response[0] = CMD_GET_LAYER_STATE_32;
+            i2c_slave_config_response[1] = (uint8_t)mask;
+            i2c_slave_config_response[2] = (uint8_t)(mask >> 8);
+            i2c_slave_config_response[3] = (uint8_t)(mask >> 16);
+            i2c_slave_config_response[4] = (uint8_t)(mask >> 24);
+            i2c_slave_config_response[5] = keymap_get_default_layer();
+            i2c_slave_config_response[6] = keymap_get_profile();
+            i2c_slave_config_response[7] = STATUS_OK;
+            i2c_slave_config_response_length = 8;
+            i2c_slave_has_config_response = 1;
+        }
         else if (i2c_slave_rx_buffer[0] == CMD_SAVE_CONFIG) {
             bool success = eeprom_save_config();
 
@@ -1058,7 +1200,7 @@ void i2c_manager_error_callback(I2C_HandleTypeDef *hi2c)
 
 void i2c_manager_handle_slave_key_event(const i2c_key_event_t *event)
 {
-    process_slave_key_event(event);
+    process_slave_key_event(event, LATENCY_SRC_I2C, trace_cycles());
 }
 
 void i2c_manager_handle_slave_midi_event(const i2c_midi_event_t *event)
@@ -0,0 +1,266 @@
+#include "combo.h"
+#include "eeprom_emulation.h"
+#include "keymap.h"
+#include "op_keycodes.h"
+#include <string.h>
+
+_Static_assert(EEPROM_COMBO_COUNT <= 32, "combos are matched as bits of a 32-bit mask");
+
+// Compiled from the active profile's combo slots. key_combos holds, per key,
+// a bit for every combo using it, so matching a chord is an AND per key press
+// instead of comparing every combo against every pressed key.
+static bool compiled = false;
+static uint32_t key_combos[MATRIX_ROWS][MATRIX_COLS];
+// Keys used by any combo (bit c = column c); every other key bypasses the engine
+static uint32_t member_rows[MATRIX_ROWS];
+static uint8_t combo_size[EEPROM_COMBO_COUNT];
+static uint8_t combo_layer[EEPROM_COMBO_COUNT];
+static uint16_t combo_keycode[EEPROM_COMBO_COUNT];
+static uint16_t term_ms = COMBO_TERM_MS;
+
+// Combos whose layer is active, refreshed when the layer mask changes
+static uint32_t enabled = 0;
+static uint32_t enabled_layer_mask = 0;
+static bool enabled_valid = false;
+
+// Keys pressed since the first key of a possible combo, in order
+static struct {
+    bool active;
+    uint8_t count;
+    uint8_t rows[EEPROM_COMBO_KEYS];
+    uint8_t cols[EEPROM_COMBO_KEYS];
+    uint32_t candidates;    // Combos containing every buffered key
+    uint32_t start_ms;
+} pending;
+
+// Fired combos are released with the first of their keys; the other keys'
+// releases are swallowed
+static uint32_t fired = 0;
+static uint16_t fired_keycode[EEPROM_COMBO_COUNT];
+static uint8_t fired_row[EEPROM_COMBO_COUNT];
+static uint8_t fired_col[EEPROM_COMBO_COUNT];
+static uint32_t fired_rows[EEPROM_COMBO_COUNT][MATRIX_ROWS];
+static uint32_t consumed[MATRIX_ROWS];
+
+// Set while buffered presses are fed back to the matrix as plain keys
+static bool replaying = false;
+
+static void combo_compile(void)
+{
+    memset(key_combos, 0, sizeof(key_combos));
+    memset(member_rows, 0, sizeof(member_rows));
+
+    for (uint8_t i = 0; i < EEPROM_COMBO_COUNT; ++i) {
+        combo_eeprom_t combo;
+        combo_keycode[i] = KC_NO;
+        combo_size[i] = 0;
+
+        if (!eeprom_get_combo(i, &combo) || combo.keycode == KC_NO || combo.layer >= KEYMAP_LAYER_COUNT) {
+            continue;
+        }
+
+        uint8_t keys[EEPROM_COMBO_KEYS];
+        uint8_t size = 0;
+        for (uint8_t k = 0; k < EEPROM_COMBO_KEYS; ++k) {
+            uint8_t key = combo.keys[k];
+            if (key >= MATRIX_ROWS * MATRIX_COLS || memchr(keys, key, size)) {
+                continue;
+            }
+            keys[size++] = key;
+        }
+
+        // A single key is not a chord
+        if (size < 2) {
+            continue;
+        }
+
+        for (uint8_t k = 0; k < size; ++k) {
+            uint8_t row = keys[k] / MATRIX_COLS;
+            uint8_t col = keys[k] % MATRIX_COLS;
+            key_combos[row][col] |= (1UL << i);
+            member_rows[row] |= (1UL << col);
+        }
+        combo_size[i] = size;
+        combo_layer[i] = combo.layer;
+        combo_keycode[i] = combo.keycode;
+    }
+
+    uint16_t stored_term = eeprom_get_combo_term();
+    term_ms = stored_term ? stored_term : COMBO_TERM_MS;
+    enabled_valid = false;
+    compiled = true;
+}
+
+void combo_invalidate_cache(void)
+{
+    compiled = false;
+}
+
+uint16_t combo_get_term(void)
+{
+    if (!compiled) {
+        combo_compile();
+    }
+    return term_ms;
+}
+
+static uint32_t combo_enabled(void)
+{
+    uint32_t layer_mask = keymap_get_layer_mask();
+    if (!enabled_valid || layer_mask != enabled_layer_mask) {
+        enabled = 0;
+        for (uint8_t i = 0; i < EEPROM_COMBO_COUNT; ++i) {
+            if (combo_keycode[i] != KC_NO && (layer_mask & KEYMAP_LAYER_BIT(combo_layer[i]))) {
+                enabled |= (1UL << i);
+            }
+        }
+        enabled_layer_mask = layer_mask;
+        enabled_valid = true;
+    }
+    return enabled;
+}
+
+// Candidates whose keys are exactly the buffered ones (all keys are distinct)
+static uint32_t combo_complete(void)
+{
+    uint32_t complete = 0;
+    uint32_t candidates = pending.candidates;
+    while (candidates) {
+        uint8_t i = (uint8_t)__builtin_ctz(candidates);
+        candidates &= candidates - 1U;
+        if (combo_size[i] == pending.count) {
+            complete |= (1UL << i);
+        }
+    }
+    return complete;
+}
+
+static void combo_fire(uint8_t index)
+{
+    pending.active = false;
+
+    memset(fired_rows[index], 0, sizeof(fired_rows[index]));
+    for (uint8_t k = 0; k < pending.count; ++k) {
+        fired_rows[index][pending.rows[k]] |= (1UL << pending.cols[k]);
+        consumed[pending.rows[k]] |= (1UL << pending.cols[k]);
+    }
+    fired |= (1UL << index);
+    fired_keycode[index] = combo_keycode[index];
+    fired_row[index] = pending.rows[0];
+    fired_col[index] = pending.cols[0];
+
+    matrix_dispatch_keycode(fired_row[index], fired_col[index], fired_keycode[index], 1);
+}
+
+// No combo matched: the buffered keys were ordinary presses after all
+static void combo_flush(void)
+{
+    uint8_t count = pending.count;
+    uint8_t rows[EEPROM_COMBO_KEYS];
+    uint8_t cols[EEPROM_COMBO_KEYS];
+
+    memcpy(rows, pending.rows, count);
+    memcpy(cols, pending.cols, count);
+    pending.active = false;
+
+    replaying = true;
+    for (uint8_t k = 0; k < count; ++k) {
+        matrix_process_key(rows[k], cols[k], 1);
+    }
+    replaying = false;
+}
+
+static void combo_resolve(void)
+{
+    uint32_t complete = combo_complete();
+    if (complete) {
+        combo_fire((uint8_t)__builtin_ctz(complete));
+    } else {
+        combo_flush();
+    }
+}
+
+static void combo_release_key(uint8_t row, uint8_t col)
+{
+    consumed[row] &= ~(1UL << col);
+
+    uint32_t active = fired;
+    while (active) {
+        uint8_t i = (uint8_t)__builtin_ctz(active);
+        active &= active - 1U;
+        if (fired_rows[i][row] & (1UL << col)) {
+            fired &= ~(1UL << i);
+            matrix_dispatch_keycode(fired_row[i], fired_col[i], fired_keycode[i], 0);
+        }
+    }
+}
+
+bool combo_process_key(uint8_t row, uint8_t col, uint8_t pressed)
+{
+    if (replaying) {
+        return false;
+    }
+
+    if (!compiled && !pending.active) {
+        combo_compile();
+    }
+
+    uint32_t bit = 1UL << col;
+    if (!pending.active) {
+        // Keys in no combo never get past this point
+        if (!((member_rows[row] | consumed[row]) & bit)) {
+            return false;
+        }
+
+        if (!pressed) {
+            if (!(consumed[row] & bit)) {
+                return false;
+            }
+            combo_release_key(row, col);
+            return true;
+        }
+
+        uint32_t candidates = key_combos[row][col] & combo_enabled();
+        if (!candidates) {
+            return false;
+        }
+
+        pending.active = true;
+        pending.count = 1;
+        pending.rows[0] = row;
+        pending.cols[0] = col;
+        pending.candidates = candidates;
+        pending.start_ms = HAL_GetTick();
+        return true;
+    }
+
+    if (pressed) {
+        uint32_t candidates = pending.candidates & key_combos[row][col];
+        if (candidates && pending.count < EEPROM_COMBO_KEYS) {
+            pending.rows[pending.count] = row;
+            pending.cols[pending.count] = col;
+            pending.count++;
+            pending.candidates = candidates;
+
+            // Fire as soon as the chord is complete and no longer combo can still match
+            uint32_t complete = combo_complete();
+            if (complete && complete == candidates) {
+                combo_fire((uint8_t)__builtin_ctz(complete));
+            }
+            return true;
+        }
+    }
+
+    // Any other key or a release ends the window; the event is then handled
+    // against the resulting state
+    combo_resolve();
+    matrix_process_key(row, col, pressed);
+    return true;
+}
+
+void combo_task(void)
+{
+    if (pending.active && (uint32_t)(HAL_GetTick() - pending.start_ms) >= term_ms) {
+        combo_resolve();
+    }
+}
@@ -0,0 +1,189 @@
+#include "debounce.h"
+#include "eeprom_emulation.h"
+#include "usb_app.h"
+#include <string.h>
+
+static uint8_t algorithm = DEBOUNCE_ALGORITHM;
+static uint8_t debounce_ms = DEBOUNCE_MS;
+
+// Remaining debounce time in ms, one byte per key (eager-per-row keeps each row's timer in column slot 0)
+static uint8_t timers[MATRIX_ROWS * MATRIX_COLS];
+// Keys (or rows, bit 0) with a running timer, so idle keys are never visited
+static uint32_t timer_active[MATRIX_ROWS];
+// Last raw sample, used by the deferred algorithm to restart timers on bounce
+static uint32_t last_raw[MATRIX_ROWS];
+static uint32_t last_ms = 0;
+
+static bool algorithm_valid(uint8_t algo)
+{
+    return algo == DEBOUNCE_SYM_DEFER_PK || algo == DEBOUNCE_EAGER_PK || algo == DEBOUNCE_EAGER_PR;
+}
+
+static void debounce_reset_timers(void)
+{
+    memset(timers, 0, sizeof(timers));
+    memset(timer_active, 0, sizeof(timer_active));
+}
+
+void debounce_init(void)
+{
+    debounce_reload_config();
+    memset(last_raw, 0, sizeof(last_raw));
+    last_ms = HAL_GetTick();
+
+    usb_app_cdc_printf("Debounce: algorithm=%u time=%ums\r\n", algorithm, debounce_ms);
+}
+
+void debounce_reload_config(void)
+{
+    algorithm = DEBOUNCE_ALGORITHM;
+    debounce_ms = DEBOUNCE_MS;
+
+    uint8_t stored_algo = 0;
+    uint8_t stored_ms = 0;
+    if (eeprom_get_debounce_config(&stored_algo, &stored_ms) && algorithm_valid(stored_algo)) {
+        algorithm = stored_algo;
+        debounce_ms = stored_ms;
+    }
+
+    debounce_reset_timers();
+}
+
+bool debounce_set_config(uint8_t algo, uint8_t time_ms)
+{
+    if (!algorithm_valid(algo)) {
+        return false;
+    }
+
+    algorithm = algo;
+    debounce_ms = time_ms;
+    debounce_reset_timers();
+    return true;
+}
+
+void debounce_get_config(uint8_t *algo, uint8_t *time_ms)
+{
+    if (algo) {
+        *algo = algorithm;
+    }
+    if (time_ms) {
+        *time_ms = debounce_ms;
+    }
+}
+
+// Count down running timers; returns per-row bitmaps of timers that just expired
+static void debounce_tick(uint8_t elapsed, uint32_t expired[MATRIX_ROWS])
+{
+    for (uint8_t r = 0; r < MATRIX_ROWS; ++r) {
+        uint32_t active = timer_active[r];
+        expired[r] = 0;
+        while (active) {
+            uint8_t c = (uint8_t)__builtin_ctz(active);
+            active &= active - 1u;
+
+            uint8_t *t = &timers[r * MATRIX_COLS + c];
+            if (*t <= elapsed) {
+                *t = 0;
+                expired[r] |= 1u << c;
+            } else {
+                *t = (uint8_t)(*t - elapsed);
+            }
+        }
+        timer_active[r] &= ~expired[r];
+    }
+}
+
+static void debounce_start(uint8_t r, uint8_t c)
+{
+    timers[r * MATRIX_COLS + c] = debounce_ms;
+    timer_active[r] |= 1u << c;
+}
+
+static bool debounce_sym_defer_pk(const uint32_t raw[MATRIX_ROWS], uint32_t cooked[MATRIX_ROWS],
+                                  const uint32_t expired[MATRIX_ROWS])
+{
+    bool changed = false;
+    for (uint8_t r = 0; r < MATRIX_ROWS; ++r) {
+        // Any raw edge (re)starts that key's timer
+        uint32_t bounced = raw[r] ^ last_raw[r];
+        uint32_t pending = bounced;
+        while (pending) {
+            uint8_t c = (uint8_t)__builtin_ctz(pending);
+            pending &= pending - 1u;
+            debounce_start(r, c);
+        }
+
+        // Commit keys that stayed stable for the whole period
+        uint32_t settled = expired[r] & ~bounced & (raw[r] ^ cooked[r]);
+        if (settled) {
+            cooked[r] ^= settled;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+static bool debounce_eager_pk(const uint32_t raw[MATRIX_ROWS], uint32_t cooked[MATRIX_ROWS])
+{
+    bool changed = false;
+    for (uint8_t r = 0; r < MATRIX_ROWS; ++r) {
+        uint32_t edges = (raw[r] ^ cooked[r]) & ~timer_active[r];
+        if (edges == 0) {
+            continue;
+        }
+
+        cooked[r] ^= edges;
+        changed = true;
+        while (edges) {
+            uint8_t c = (uint8_t)__builtin_ctz(edges);
+            edges &= edges - 1u;
+            debounce_start(r, c);
+        }
+    }
+    return changed;
+}
+
+static bool debounce_eager_pr(const uint32_t raw[MATRIX_ROWS], uint32_t cooked[MATRIX_ROWS])
+{
+    bool changed = false;
+    for (uint8_t r = 0; r < MATRIX_ROWS; ++r) {
+        if (timer_active[r] != 0 || raw[r] == cooked[r]) {
+            continue;
+        }
+
+        cooked[r] = raw[r];
+        changed = true;
+        // Row timers live in column slot 0 of each row
+        debounce_start(r, 0);
+    }
+    return changed;
+}
+
+bool debounce_update(const uint32_t raw[MATRIX_ROWS], uint32_t cooked[MATRIX_ROWS], uint32_t now_ms)
+{
+    uint32_t elapsed_ms = now_ms - last_ms;
+    last_ms = now_ms;
+
+    uint32_t expired[MATRIX_ROWS];
+    debounce_tick((uint8_t)(elapsed_ms > 0xFFu ? 0xFFu : elapsed_ms), expired);
+
+    bool changed;
+    if (debounce_ms == 0) {
+        changed = false;
+        for (uint8_t r = 0; r < MATRIX_ROWS; ++r) {
+            if (cooked[r] != raw[r]) {
+                cooked[r] = raw[r];
+                changed = true;
+            }
+        }
+    } else if (algorithm == DEBOUNCE_SYM_DEFER_PK) {
+        changed = debounce_sym_defer_pk(raw, cooked, expired);
+    } else if (algorithm == DEBOUNCE_EAGER_PR) {
+        changed = debounce_eager_pr(raw, cooked);
+    } else {
+        changed = debounce_eager_pk(raw, cooked);
+    }
+
+    memcpy(last_raw, raw, sizeof(last_raw));
+    return changed;
+}
@@ -1,12 +1,27 @@
 #include "encoder.h"
 #include "keymap.h"
 #include "usb_app.h"
+#include "trace.h"
+#include "latency.h"
 #include "main.h"
 #include <stddef.h>
 #include "pin_config.h"
 #include "midi_handler.h"
 #include "i2c_manager.h"
 
+// Background sampling: TIM7 samples every encoder pin at a fixed rate and
+// counts detents, so transitions are not lost while the main loop is busy
+// (blocking I2C, flash waits, USB work). encoder_task() only drains the
+// counts. Enable per keyboard with ENCODER_SAMPLE_BACKGROUND 1.
+#ifndef ENCODER_SAMPLE_BACKGROUND
+#define ENCODER_SAMPLE_BACKGROUND 0
+#endif
+
+// Samples per second in background mode
+#ifndef ENCODER_SAMPLE_RATE_HZ
+#define ENCODER_SAMPLE_RATE_HZ 20000
+#endif
+
 // Encoder event callback for slave mode
 static encoder_event_cb_t encoder_user_cb = NULL;
 
@@ -15,56 +30,231 @@ typedef struct {
 	uint16_t pin;
 } gpio_pin_t;
 
-static inline uint8_t read_pin(const pin_t *p) {
-	return (uint8_t)HAL_GPIO_ReadPin(p->port, p->pin);
-}
-
 // Per-encoder state
 typedef struct {
 	uint8_t state;        // last 2-bit state (B<<1 | A)
 	uint8_t rest_state;   // detected idle state (usually 3 with pull-ups)
 	uint8_t armed;        // only emit an event when armed; re-arm on rest
 	int8_t step;          // accumulates +1/-1 per valid transition
-	uint32_t last_push_ms;// last time we enqueued an event (debounce/oneshot)
 } enc_state_t;
 
 static enc_state_t enc[ENCODER_COUNT];
 
 // simple ring buffer of events
 typedef enum { ENC_NONE=0, ENC_CW=1, ENC_CCW=-1 } enc_dir_t;
-typedef struct { uint8_t idx; enc_dir_t dir; } enc_event_t;
+typedef struct { uint8_t idx; enc_dir_t dir; uint32_t detect_cycles; } enc_event_t;
 #define ENC_EVT_QSIZE 8
 static volatile enc_event_t q[ENC_EVT_QSIZE];
 static volatile uint8_t q_head = 0, q_tail = 0;
 
-static void q_push(uint8_t idx, enc_dir_t dir) {
+static int q_push(uint8_t idx, enc_dir_t dir, uint32_t detect_cycles) {
 	uint8_t n = (uint8_t)((q_head + 1) & (ENC_EVT_QSIZE-1));
-	if (n == q_tail) return; // drop if full
+	if (n == q_tail) return 0; // drop if full
 	q[q_head].idx = idx;
 	q[q_head].dir = dir;
+	q[q_head].detect_cycles = detect_cycles;
 	q_head = n;
+	return 1;
 }
 
 static int q_pop(enc_event_t *out) {
 	if (q_head == q_tail) return 0;
-	*out = (enc_event_t){ q[q_tail].idx, q[q_tail].dir };
+	*out = (enc_event_t){ q[q_tail].idx, q[q_tail].dir, q[q_tail].detect_cycles };
 	q_tail = (uint8_t)((q_tail + 1) & (ENC_EVT_QSIZE-1));
 	return 1;
 }
 
-static uint8_t get_state(uint8_t i) {
-	uint8_t a = read_pin(&encoder_pins[i].pin_a);
-	uint8_t b = read_pin(&encoder_pins[i].pin_b);
-	return (uint8_t)((b << 1) | a);
+#if ENCODER_SAMPLE_BACKGROUND
+// Signed detent counts per encoder. Each side writes only its own counter:
+// the ISR advances enc_counted, encoder_task() advances enc_drained, and the
+// difference (mod 2^16) is what is still to be sent, so no locking is needed.
+static volatile uint16_t enc_counted[ENCODER_COUNT];
+static uint16_t enc_drained[ENCODER_COUNT];
+static volatile uint32_t enc_counted_cycles[ENCODER_COUNT];	// stamp of the latest detent
+#endif
+
+// Port-batched sampling tables, built once from ENCODER_PIN_CONFIG. Each pass
+// reads every encoder port's IDR once and gathers the A/B bits by shift.
+#define ENC_MAX_PORTS (2 * ENCODER_COUNT)
+static GPIO_TypeDef *enc_ports[ENC_MAX_PORTS];
+static uint32_t enc_port_mask[ENC_MAX_PORTS];	// encoder pins on the port
+static uint32_t enc_port_last[ENC_MAX_PORTS];	// masked IDR of the previous pass
+static uint8_t enc_port_count = 0;
+static uint8_t enc_port_a[ENCODER_COUNT], enc_shift_a[ENCODER_COUNT];
+static uint8_t enc_port_b[ENCODER_COUNT], enc_shift_b[ENCODER_COUNT];
+
+// Quadrature steps indexed by (old state << 2) | new state, state = B<<1 | A.
+// Gray-code neighbours count +1 (CW) or -1 (CCW); both lines changing at once
+// cannot come from rotation (noise or a missed sample), so it counts 0.
+static const int8_t enc_transition[16] = {
+	 0, +1, -1,  0,
+	-1,  0,  0, +1,
+	+1,  0,  0, -1,
+	 0, -1, +1,  0,
+};
+
+static uint8_t enc_port_slot(const pin_t *p)
+{
+	uint8_t slot = 0;
+	while (slot < enc_port_count && enc_ports[slot] != p->port) {
+		++slot;
+	}
+	if (slot == enc_port_count) {
+		enc_ports[enc_port_count++] = p->port;
+	}
+	enc_port_mask[slot] |= p->pin;
+	return slot;
 }
 
-static const int8_t state_pos[4] = {0, 1, 3, 2};
+static void encoder_build_tables(void)
+{
+	enc_port_count = 0;
+	for (uint8_t i = 0; i < ENC_MAX_PORTS; ++i) {
+		enc_port_mask[i] = 0;
+	}
+	for (uint8_t i = 0; i < ENCODER_COUNT; ++i) {
+		enc_port_a[i] = enc_port_slot(&encoder_pins[i].pin_a);
+		enc_shift_a[i] = (uint8_t)__builtin_ctz(encoder_pins[i].pin_a.pin);
+		enc_port_b[i] = enc_port_slot(&encoder_pins[i].pin_b);
+		enc_shift_b[i] = (uint8_t)__builtin_ctz(encoder_pins[i].pin_b.pin);
+	}
+}
+
+// Sample every encoder port; false if no encoder pin changed since the last pass
+static bool encoder_sample(uint32_t *idr)
+{
+	bool changed = false;
+	for (uint8_t p = 0; p < enc_port_count; ++p) {
+		idr[p] = enc_ports[p]->IDR & enc_port_mask[p];
+		if (idr[p] != enc_port_last[p]) {
+			enc_port_last[p] = idr[p];
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+static inline uint8_t encoder_state(const uint32_t *idr, uint8_t i)
+{
+	return (uint8_t)((((idr[enc_port_b[i]] >> enc_shift_b[i]) & 1u) << 1) |
+	                 ((idr[enc_port_a[i]] >> enc_shift_a[i]) & 1u));
+}
 
 // Number of valid quarter-steps per detent click. Many encoders produce 4.
 #ifndef ENC_STEPS_PER_DETENT
 #define ENC_STEPS_PER_DETENT 4
 #endif
 
+// Hand a detent to encoder_task(): the event queue when polling, the counters
+// when sampling in the background
+static void encoder_detent(uint8_t i, enc_dir_t dir)
+{
+#if ENCODER_SAMPLE_BACKGROUND
+	enc_counted_cycles[i] = trace_cycles();
+	enc_counted[i] = (uint16_t)(enc_counted[i] + (uint16_t)dir);
+#else
+	q_push(i, dir, trace_cycles());
+#endif
+}
+
+void encoder_sample_tick(void)
+{
+	// Sample the encoder ports once; there is nothing to decode while no
+	// encoder pin has moved
+	uint32_t idr[ENC_MAX_PORTS];
+	if (!encoder_sample(idr)) {
+		return;
+	}
+
+	for (uint8_t i = 0; i < ENCODER_COUNT; ++i) {
+		uint8_t ns = encoder_state(idr, i);
+		uint8_t os = enc[i].state;
+		if (ns != os) {
+			enc[i].step += enc_transition[(os << 2) | ns];
+			enc[i].state = ns;
+
+			// Contact bounce is taken care of by the transition table and the
+			// rest-state re-arm; every detent is counted and the tap scheduler
+			// paces them to the host
+			if (enc[i].armed) {
+				if (enc[i].step >= ENC_STEPS_PER_DETENT) {
+					TRACE_DEBUG(ENCODER_DETENT, i, TRACE_STR_CW, enc[i].step);
+					encoder_detent(i, ENC_CW);
+					enc[i].armed = 0;
+					enc[i].step = 0;
+				} else if (enc[i].step <= -ENC_STEPS_PER_DETENT) {
+					TRACE_DEBUG(ENCODER_DETENT, i, TRACE_STR_CCW, enc[i].step);
+					encoder_detent(i, ENC_CCW);
+					enc[i].armed = 0;
+					enc[i].step = 0;
+				}
+			} else {
+				// Not armed - keep accumulator bounded
+				enc[i].step = 0;
+			}
+
+			if (ns == enc[i].rest_state) {
+				enc[i].armed = 1;
+				enc[i].step = 0;
+			}
+		}
+	}
+}
+
+#if ENCODER_SAMPLE_BACKGROUND
+static void encoder_bg_start(void)
+{
+	uint32_t pclk1 = HAL_RCC_GetPCLK1Freq();
+	// APB1 timers run at twice PCLK1 whenever the APB1 prescaler divides
+	uint32_t clock = (RCC->CFGR & RCC_CFGR_PPRE1_2) ? pclk1 * 2u : pclk1;
+	uint32_t ticks = clock / (uint32_t)ENCODER_SAMPLE_RATE_HZ;
+	if (ticks < 2u) {
+		return;
+	}
+	// TIM7 is a 16-bit timer: prescale whatever does not fit the reload register
+	uint32_t psc = (ticks - 1u) >> 16;
+
+	__HAL_RCC_TIM7_CLK_ENABLE();
+	TIM7->CR1 = 0;
+	TIM7->DIER = 0;
+	TIM7->PSC = psc;
+	TIM7->ARR = ticks / (psc + 1u) - 1u;
+	TIM7->EGR = TIM_EGR_UG;
+	TIM7->SR = 0;
+	TIM7->DIER = TIM_DIER_UIE;
+	HAL_NVIC_SetPriority(TIM7_DAC_IRQn, 1, 0);
+	HAL_NVIC_EnableIRQ(TIM7_DAC_IRQn);
+	TIM7->CR1 = TIM_CR1_CEN;
+}
+
+// Turn the detents counted since the last call into queue events, as many as fit
+static void encoder_drain(void)
+{
+	for (uint8_t i = 0; i < ENCODER_COUNT; ++i) {
+		int16_t pending = (int16_t)(uint16_t)(enc_counted[i] - enc_drained[i]);
+		while (pending != 0) {
+			enc_dir_t dir = (pending > 0) ? ENC_CW : ENC_CCW;
+			if (!q_push(i, dir, enc_counted_cycles[i])) {
+				return;
+			}
+			enc_drained[i] = (uint16_t)(enc_drained[i] + (uint16_t)dir);
+			pending = (int16_t)(pending - dir);
+		}
+	}
+}
+#endif
+
+void encoder_timer_isr(void)
+{
+#if ENCODER_SAMPLE_BACKGROUND
+	if ((TIM7->SR & TIM_SR_UIF) == 0u) {
+		return;
+	}
+	TIM7->SR = ~TIM_SR_UIF;
+	encoder_sample_tick();
+#endif
+}
+
 void encoder_init(void)
 {
 	// Enable GPIO clocks for used ports (A..E common case)
@@ -88,13 +278,24 @@ void encoder_init(void)
 		// Configure B
 		gi.Pin = encoder_pins[i].pin_b.pin;
 		HAL_GPIO_Init(encoder_pins[i].pin_b.port, &gi);
+	}
+
+	encoder_build_tables();
+	uint32_t idr[ENC_MAX_PORTS];
+	encoder_sample(idr);
 
-		enc[i].state = get_state(i);
+	for (uint8_t i = 0; i < ENCODER_COUNT; ++i) {
+		enc[i].state = encoder_state(idr, i);
 		enc[i].rest_state = enc[i].state; // treat current as idle
 		enc[i].armed = 1;
 		enc[i].step = 0;
-		enc[i].last_push_ms = 0;
 	}
+
+#if ENCODER_SAMPLE_BACKGROUND
+	if (ENCODER_COUNT > 0) {
+		encoder_bg_start();
+	}
+#endif
 }
 
 void encoder_register_callback(encoder_event_cb_t cb)
@@ -112,60 +313,12 @@ void encoder_handle_exti(uint16_t pin)
 
 void encoder_task(void)
 {
-	// 1) Poll all encoders and decode transitions into the event queue
-	for (uint8_t i = 0; i < ENCODER_COUNT; ++i) {
-
-
-
-
-
-		uint8_t ns = get_state(i);
-		uint8_t os = enc[i].state;
-		if (ns != os) {
-			int8_t delta = state_pos[ns] - state_pos[os];
-			if (delta > 2) {
-				delta -= 4;
-			} else if (delta < -2) {
-				delta += 4;
-			}
-
-			if (delta != 0) {
-				enc[i].step += delta;
-			}
-
-			enc[i].state = ns;
-
-			if (enc[i].armed) {
-				if (enc[i].step >= ENC_STEPS_PER_DETENT) {
-					uint32_t now = HAL_GetTick();
-					if (now - enc[i].last_push_ms >= 20U) {
-						enc[i].last_push_ms = now;
-						usb_app_cdc_printf("Encoder %d: CW event (step=%d, now=%lu)\r\n", i, enc[i].step, now);
-						q_push(i, ENC_CW);
-						enc[i].armed = 0;
-					}
-					enc[i].step = 0;
-				} else if (enc[i].step <= -ENC_STEPS_PER_DETENT) {
-					uint32_t now = HAL_GetTick();
-					if (now - enc[i].last_push_ms >= 20U) {
-						enc[i].last_push_ms = now;
-						usb_app_cdc_printf("Encoder %d: CCW event (step=%d, now=%lu)\r\n", i, enc[i].step, now);
-						q_push(i, ENC_CCW);
-						enc[i].armed = 0;
-					}
-					enc[i].step = 0;
-				}
-			} else {
-				// Not armed - keep accumulator bounded
-				enc[i].step = 0;
-			}
-
-			if (ns == enc[i].rest_state) {
-				enc[i].armed = 1;
-				enc[i].step = 0;
-			}
-		}
-	}
+	// 1) Collect new detents into the event queue
+#if ENCODER_SAMPLE_BACKGROUND
+	encoder_drain();
+#else
+	encoder_sample_tick();
+#endif
 
 	// 2) Process encoder events - either via callback (slave) or immediate HID (master)
 	enc_event_t ev;
@@ -178,8 +331,7 @@ void encoder_task(void)
 		}
 		
 		uint16_t keycode = (ev.dir == ENC_CW) ? cw_keycode : ccw_keycode;
-		usb_app_cdc_printf("Processing encoder event: idx=%d, dir=%s, keycode=0x%04X\r\n", 
-		             ev.idx, (ev.dir == ENC_CW) ? "CW" : "CCW", keycode);
+		TRACE_INFO(ENCODER_EVENT, ev.idx, (ev.dir == ENC_CW) ? TRACE_STR_CW : TRACE_STR_CCW, keycode);
 		
 		// Handle MIDI keycodes first (like matrix processing does)
 		midi_handle_keycode(keycode, 1); // Press
@@ -192,9 +344,8 @@ void encoder_task(void)
 
 		if (should_send && hid_to_send != 0) {
 			uint8_t direction_flag = (ev.dir == ENC_CW) ? 1U : 0U;
-			usb_app_cdc_printf("Queueing encoder HID event via I2C manager (dir=%s)\r\n",
-						 (direction_flag == 1U) ? "CW" : "CCW");
-			i2c_manager_process_local_key_event(254, ev.idx, direction_flag, hid_to_send);
+			i2c_manager_process_local_key_event(254, ev.idx, direction_flag, hid_to_send,
+			                                    LATENCY_SRC_ENCODER, ev.detect_cycles);
 		}
 	}
 }
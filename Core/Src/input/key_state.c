@@ -21,27 +21,83 @@
 #include "key_state.h"
 #include "main.h"
 #include "usb_app.h"
+#include "trace.h"
+#include "latency.h"
 #include "tusb.h"
 
 #include <stdbool.h>
+#include <string.h>
 
 /* Private variables ---------------------------------------------------------*/
-static uint8_t pressed_keys[MAX_PRESSED_KEYS] = {0};
+// One bit per HID usage (0x00-0xFF) plus a reference count per usage, so two
+// sources holding the same code (matrix + slave, or two keys mapped alike)
+// only release it when the last one lets go.
+static uint32_t key_bitmap[8] = {0};
+static uint8_t key_refcount[256] = {0};
 static uint8_t pressed_key_count = 0;
-static bool hid_report_dirty = false;
 
-typedef enum {
-  ENCODER_TAP_IDLE = 0,
-  ENCODER_TAP_WAIT_PRESS_FLUSH,
-  ENCODER_TAP_WAIT_RELEASE_FLUSH
-} encoder_tap_state_t;
+// Every state transition is queued as its own snapshot and reports are sent
+// one per completed IN transfer, so a press and release that land inside
+// the same polling interval still reach the host as two reports. When the
+// queue is full the newest snapshot absorbs further changes instead.
+#ifndef KEY_STATE_REPORT_QUEUE_SIZE
+#define KEY_STATE_REPORT_QUEUE_SIZE 16U
+#endif
 
+typedef struct {
+  uint32_t bitmap[8];
+  uint32_t detect_cycles;   // DWT stamp of the input that caused this snapshot
+  uint8_t source;           // latency_source_t, LATENCY_SRC_NONE if unstamped
+} key_state_snapshot_t;
+
+static key_state_snapshot_t report_queue[KEY_STATE_REPORT_QUEUE_SIZE];
+static uint8_t report_queue_head = 0;
+static uint8_t report_queue_count = 0;
+static key_state_snapshot_t last_queued = {0};
+static uint32_t report_queue_overflows = 0;
+
+// Stamp for the next queued snapshot, and for the report on the wire
+static uint8_t pending_source = LATENCY_SRC_NONE;
+static uint32_t pending_cycles = 0;
+static uint8_t in_flight_source = LATENCY_SRC_NONE;
+static uint32_t in_flight_cycles = 0;
+
+#define KEY_STATE_ERROR_ROLLOVER 0x01U
+
+// NKRO report: modifier byte followed by one bit per usage 0x00-0x7F
+typedef struct __attribute__((packed)) {
+  uint8_t modifier;
+  uint8_t bitmap[KEY_STATE_NKRO_BITMAP_BYTES];
+} key_state_nkro_report_t;
+
+// Encoder taps: one slot per key with a tap in progress, kept in order of
+// their next deadline. A slot alternates press and release; detents that
+// arrive while its key is still tapping are counted and played back to back,
+// one edge per report, while slots for different keys share reports.
+#ifndef ENCODER_TAP_SLOTS
+#define ENCODER_TAP_SLOTS 32U
+#endif
+
+// Hold time of a tap with no further detents queued behind it
+#ifndef ENCODER_TAP_DELAY_MS
 #define ENCODER_TAP_DELAY_MS 5U
+#endif
 
-static encoder_tap_state_t encoder_tap_state = ENCODER_TAP_IDLE;
-static uint8_t encoder_tap_keycode = 0;
-static uint32_t encoder_tap_release_time = 0;
-static void key_state_force_encoder_release(void);
+typedef struct {
+  uint8_t keycode;
+  uint8_t taps;             // Presses still to send after the current one
+  bool pressed;             // Key is down, release is next
+  uint8_t source;           // Stamp for the next press, LATENCY_SRC_NONE if unstamped
+  uint32_t detect_cycles;
+  uint32_t due;             // HAL tick of the next edge
+} encoder_tap_slot_t;
+
+static encoder_tap_slot_t encoder_taps[ENCODER_TAP_SLOTS];
+static uint8_t encoder_tap_count = 0;
+static void key_state_encoder_tap_task(void);
+static void key_state_sort_encoder_taps(void);
+static void key_state_queue_report(bool force);
+static void key_state_try_flush(void);
 
 /* Public functions ----------------------------------------------------------*/
 
@@ -53,62 +109,66 @@ static void key_state_force_encoder_release(void);
 void key_state_init(void)
 {
   pressed_key_count = 0;
-  for (uint8_t i = 0; i < MAX_PRESSED_KEYS; i++) {
-    pressed_keys[i] = 0;
-  }
-  hid_report_dirty = false;
-  encoder_tap_state = ENCODER_TAP_IDLE;
-  encoder_tap_keycode = 0;
-  encoder_tap_release_time = 0;
+  memset(key_bitmap, 0, sizeof(key_bitmap));
+  memset(key_refcount, 0, sizeof(key_refcount));
+  report_queue_head = 0;
+  report_queue_count = 0;
+  memset(&last_queued, 0, sizeof(last_queued));
+  report_queue_overflows = 0;
+  pending_source = LATENCY_SRC_NONE;
+  in_flight_source = LATENCY_SRC_NONE;
+  encoder_tap_count = 0;
   usb_app_cdc_printf("Key state management initialized\r\n");
 }
 
 /**
-  * @brief Add a key to the pressed keys array
+  * @brief Add a reference to a pressed key
   * @param keycode: HID keycode to add
   * @retval None
   */
 void key_state_add_key(uint8_t keycode)
 {
-  // Check if key is already in the array
-  for (uint8_t i = 0; i < pressed_key_count; i++) {
-    if (pressed_keys[i] == keycode) {
-      usb_app_cdc_printf("Key 0x%02X already pressed, ignoring\r\n", keycode);
-      return; // Already pressed
-    }
+  if (keycode == 0) {
+    return;
   }
-  
-  // Add key if there's space
-  if (pressed_key_count < MAX_PRESSED_KEYS) {
-    pressed_keys[pressed_key_count] = keycode;
-    pressed_key_count++;
-    usb_app_cdc_printf("Added key 0x%02X, total pressed: %d\r\n", keycode, pressed_key_count);
-  } else {
-    usb_app_cdc_printf("Key buffer full, dropping key 0x%02X\r\n", keycode);
+
+  if (key_refcount[keycode] != 0U) {
+    if (key_refcount[keycode] < UINT8_MAX) {
+      key_refcount[keycode]++;
+    }
+    TRACE_DEBUG(KEY_ADD_REF, keycode, key_refcount[keycode]);
+    return;
   }
+
+  key_refcount[keycode] = 1U;
+  key_bitmap[keycode >> 5] |= (1UL << (keycode & 31U));
+  pressed_key_count++;
+  TRACE_DEBUG(KEY_ADDED, keycode, pressed_key_count);
 }
 
 /**
-  * @brief Remove a key from the pressed keys array
+  * @brief Drop a reference to a pressed key, releasing it on the last one
   * @param keycode: HID keycode to remove
   * @retval None
   */
 void key_state_remove_key(uint8_t keycode)
 {
-  // Find and remove the key
-  for (uint8_t i = 0; i < pressed_key_count; i++) {
-    if (pressed_keys[i] == keycode) {
-      // Shift remaining keys down
-      for (uint8_t j = i; j < pressed_key_count - 1; j++) {
-        pressed_keys[j] = pressed_keys[j + 1];
-      }
-      pressed_key_count--;
-      pressed_keys[pressed_key_count] = 0; // Clear the last slot
-      usb_app_cdc_printf("Removed key 0x%02X, total pressed: %d\r\n", keycode, pressed_key_count);
-      return;
-    }
+  if (keycode == 0) {
+    return;
+  }
+
+  if (key_refcount[keycode] == 0U) {
+    TRACE_WARN(KEY_RELEASE_UNPRESSED, keycode);
+    return;
+  }
+
+  if (--key_refcount[keycode] != 0U) {
+    return;
   }
-  usb_app_cdc_printf("Key 0x%02X not found in pressed array\r\n", keycode);
+
+  key_bitmap[keycode >> 5] &= ~(1UL << (keycode & 31U));
+  pressed_key_count--;
+  TRACE_DEBUG(KEY_REMOVED, keycode, pressed_key_count);
 }
 
 /**
@@ -118,7 +178,7 @@ void key_state_remove_key(uint8_t keycode)
   */
 void key_state_update_hid_report(void)
 {
-  hid_report_dirty = true;
+  key_state_queue_report(false);
   key_state_task();
 }
 
@@ -129,17 +189,54 @@ void key_state_update_hid_report(void)
   */
 void key_state_send_encoder_event(uint8_t keycode)
 {
-  usb_app_cdc_printf("Encoder event: keycode=0x%02X with %d held keys\r\n", keycode, pressed_key_count);
-  
-  if (encoder_tap_state != ENCODER_TAP_IDLE) {
-    usb_app_cdc_printf("Encoder tap: previous event pending, forcing release\r\n");
-    key_state_force_encoder_release();
+  TRACE_INFO(ENCODER_TAP, keycode, pressed_key_count);
+
+  if (keycode == 0) {
+    return;
+  }
+
+  for (uint8_t i = 0; i < encoder_tap_count; i++) {
+    encoder_tap_slot_t *slot = &encoder_taps[i];
+    if (slot->keycode != keycode) {
+      continue;
+    }
+
+    // Same key still tapping: queue another tap behind it and cut the hold
+    // short so the taps go out back to back
+    if (slot->taps == UINT8_MAX) {
+      TRACE_WARN(ENCODER_TAP_DROPPED, keycode);
+      return;
+    }
+    if (slot->source == LATENCY_SRC_NONE) {
+      slot->source = pending_source;
+      slot->detect_cycles = pending_cycles;
+    }
+    pending_source = LATENCY_SRC_NONE;
+    slot->taps++;
+    TRACE_DEBUG(ENCODER_TAP_QUEUED, keycode, slot->taps);
+    if (slot->pressed) {
+      slot->due = HAL_GetTick();
+      key_state_sort_encoder_taps();
+    }
     key_state_task();
+    return;
+  }
+
+  if (encoder_tap_count == ENCODER_TAP_SLOTS) {
+    TRACE_WARN(ENCODER_TAP_DROPPED, keycode);
+    pending_source = LATENCY_SRC_NONE;
+    return;
   }
 
-  encoder_tap_keycode = keycode;
-  encoder_tap_release_time = HAL_GetTick() + ENCODER_TAP_DELAY_MS;
-  encoder_tap_state = ENCODER_TAP_WAIT_PRESS_FLUSH;
+  // New key: press right away, the press carries this detent's stamp
+  encoder_taps[encoder_tap_count++] = (encoder_tap_slot_t){
+    .keycode = keycode,
+    .taps = 0,
+    .pressed = true,
+    .source = LATENCY_SRC_NONE,
+    .due = HAL_GetTick() + ENCODER_TAP_DELAY_MS,
+  };
+  key_state_sort_encoder_taps();
 
   key_state_add_key(keycode);
   key_state_update_hid_report();
@@ -155,9 +252,155 @@ uint8_t key_state_get_pressed_count(void)
   return pressed_key_count;
 }
 
+static bool key_state_boot_protocol(void)
+{
+#if KEY_STATE_NKRO
+  return tud_hid_n_get_protocol(0) == HID_PROTOCOL_BOOT;
+#else
+  return true;
+#endif
+}
+
+// Format a report from modifier byte + usage bitmap for the active protocol
+static bool key_state_send_bitmap(uint8_t modifier, const uint32_t bitmap[8])
+{
+  if (!key_state_boot_protocol()) {
+    key_state_nkro_report_t report;
+    report.modifier = modifier;
+    memcpy(report.bitmap, bitmap, sizeof(report.bitmap));
+    return tud_hid_n_report(0, 0, &report, sizeof(report));
+  }
+
+  // Boot protocol: first six usages, or ErrorRollOver in every slot
+  uint8_t keycodes[MAX_PRESSED_KEYS] = {0};
+  uint8_t count = 0;
+  for (uint8_t w = 0; w < 7U; w++) {
+    uint32_t bits = bitmap[w];
+    while (bits) {
+      uint8_t usage = (uint8_t)((w << 5) | (uint8_t)__builtin_ctz(bits));
+      bits &= bits - 1U;
+      if (count == MAX_PRESSED_KEYS) {
+        TRACE_WARN(KEY_ROLLOVER, pressed_key_count);
+        memset(keycodes, KEY_STATE_ERROR_ROLLOVER, sizeof(keycodes));
+        return tud_hid_n_keyboard_report(0, 0, modifier, keycodes);
+      }
+      keycodes[count++] = usage;
+    }
+  }
+
+  return tud_hid_n_keyboard_report(0, 0, modifier, keycodes);
+}
+
+/**
+  * @brief Send a one-off keyboard report outside the tracked key state
+  * @param modifier: modifier byte
+  * @param keycodes: up to six usages, or NULL for none
+  * @retval true if the report was queued
+  */
+bool key_state_send_keyboard_report(uint8_t modifier, const uint8_t keycodes[MAX_PRESSED_KEYS])
+{
+  uint32_t bitmap[8] = {0};
+  if (keycodes != NULL) {
+    for (uint8_t i = 0; i < MAX_PRESSED_KEYS; i++) {
+      if (keycodes[i] != 0U) {
+        bitmap[keycodes[i] >> 5] |= (1UL << (keycodes[i] & 31U));
+      }
+    }
+  }
+  return key_state_send_bitmap(modifier, bitmap);
+}
+
+/**
+  * @brief Resend the current state after the host switched report protocol
+  * @param None
+  * @retval None
+  */
+void key_state_protocol_changed(void)
+{
+  key_state_queue_report(true);
+}
+
+/**
+  * @brief Send the next queued report; called when the previous one completed
+  * @param None
+  * @retval None
+  */
+void key_state_report_complete(void)
+{
+  if (in_flight_source != LATENCY_SRC_NONE) {
+    latency_record(in_flight_source, trace_cycles() - in_flight_cycles);
+    in_flight_source = LATENCY_SRC_NONE;
+  }
+  key_state_try_flush();
+}
+
+/**
+  * @brief Attach a detection timestamp to the next key state transition
+  * @param source: latency_source_t of the input
+  * @param detect_cycles: trace_cycles() value taken when the input was detected
+  * @retval None
+  */
+void key_state_set_event_stamp(uint8_t source, uint32_t detect_cycles)
+{
+  pending_source = source;
+  pending_cycles = detect_cycles;
+}
+
+/**
+  * @brief Number of times the report queue was full and a transition merged
+  * @param None
+  * @retval Overflow count since init
+  */
+uint32_t key_state_get_report_overflows(void)
+{
+  return report_queue_overflows;
+}
+
+/**
+  * @brief Check whether queued reports are still waiting to be sent
+  * @param None
+  * @retval true if at least one snapshot has not been handed to USB yet
+  */
+bool key_state_report_pending(void)
+{
+  return report_queue_count != 0U;
+}
+
+// Snapshot the current key state onto the report queue
+static void key_state_queue_report(bool force)
+{
+  uint8_t source = pending_source;
+  pending_source = LATENCY_SRC_NONE;
+
+  if (!force && memcmp(last_queued.bitmap, key_bitmap, sizeof(key_bitmap)) == 0) {
+    return;
+  }
+  memcpy(last_queued.bitmap, key_bitmap, sizeof(key_bitmap));
+  last_queued.source = source;
+  last_queued.detect_cycles = pending_cycles;
+
+  if (report_queue_count == KEY_STATE_REPORT_QUEUE_SIZE) {
+    // Full: fold this transition into the newest pending snapshot, keeping
+    // the older stamp so the merged edge is measured from its first input
+    uint8_t newest = (uint8_t)((report_queue_head + report_queue_count - 1U) % KEY_STATE_REPORT_QUEUE_SIZE);
+    memcpy(report_queue[newest].bitmap, key_bitmap, sizeof(key_bitmap));
+    if (report_queue[newest].source == LATENCY_SRC_NONE) {
+      report_queue[newest].source = source;
+      report_queue[newest].detect_cycles = pending_cycles;
+    }
+    report_queue_overflows++;
+    TRACE_WARN(HID_QUEUE_OVERFLOW, report_queue_overflows);
+    return;
+  }
+
+  uint8_t slot = (uint8_t)((report_queue_head + report_queue_count) % KEY_STATE_REPORT_QUEUE_SIZE);
+  report_queue[slot] = last_queued;
+  report_queue_count++;
+}
+
 static void key_state_try_flush(void)
 {
-  if (!hid_report_dirty) {
+  if (report_queue_count == 0U) {
     return;
   }
 
@@ -165,56 +408,89 @@ static void key_state_try_flush(void)
     return;
   }
 
-  uint8_t report[8] = {0};
-  for (uint8_t i = 0; i < pressed_key_count && i < 6; i++) {
-    report[2 + i] = pressed_keys[i];
-  }
+  // Usages 0xE0-0xE7 live in the modifier byte in both report formats
+  uint32_t bitmap[8];
+  memcpy(bitmap, report_queue[report_queue_head].bitmap, sizeof(bitmap));
+  uint8_t modifier = (uint8_t)bitmap[7];
+  bitmap[7] &= ~0xFFUL;
 
-  bool sent = tud_hid_n_keyboard_report(0, 0, report[0], &report[2]);
-  usb_app_cdc_printf("HID report updated: [%02X %02X %02X %02X %02X %02X], %s\r\n",
-               report[2], report[3], report[4], report[5], report[6], report[7],
-               sent ? "sent" : "queued");
+  bool sent = key_state_send_bitmap(modifier, bitmap);
+  TRACE_DEBUG(HID_REPORT_SEND, report_queue_count, modifier,
+                sent ? TRACE_STR_SENT : TRACE_STR_QUEUED);
 
   if (sent) {
-    hid_report_dirty = false;
+    in_flight_source = report_queue[report_queue_head].source;
+    in_flight_cycles = report_queue[report_queue_head].detect_cycles;
+    report_queue_head = (uint8_t)((report_queue_head + 1U) % KEY_STATE_REPORT_QUEUE_SIZE);
+    report_queue_count--;
   }
 }
 
 void key_state_task(void)
 {
   key_state_try_flush();
+  key_state_encoder_tap_task();
+  key_state_try_flush();
+}
 
-  switch (encoder_tap_state) {
-    case ENCODER_TAP_WAIT_PRESS_FLUSH:
-      if (!hid_report_dirty && (int32_t)(HAL_GetTick() - encoder_tap_release_time) >= 0) {
-        usb_app_cdc_printf("Encoder tap: triggering release for keycode=0x%02X\r\n", encoder_tap_keycode);
-        key_state_remove_key(encoder_tap_keycode);
-        hid_report_dirty = true;
-        encoder_tap_state = ENCODER_TAP_WAIT_RELEASE_FLUSH;
-      }
-      break;
-    case ENCODER_TAP_WAIT_RELEASE_FLUSH:
-      if (!hid_report_dirty) {
-        usb_app_cdc_printf("Encoder tap: completed for keycode=0x%02X\r\n", encoder_tap_keycode);
-        encoder_tap_state = ENCODER_TAP_IDLE;
-        encoder_tap_keycode = 0;
-      }
-      break;
-    default:
-      break;
+// Insertion sort by deadline; the array is short and nearly sorted
+static void key_state_sort_encoder_taps(void)
+{
+  for (uint8_t i = 1; i < encoder_tap_count; i++) {
+    encoder_tap_slot_t slot = encoder_taps[i];
+    uint8_t j = i;
+    while (j > 0U && (int32_t)(encoder_taps[j - 1U].due - slot.due) > 0) {
+      encoder_taps[j] = encoder_taps[j - 1U];
+      j--;
+    }
+    encoder_taps[j] = slot;
   }
-
-  key_state_try_flush();
 }
 
-static void key_state_force_encoder_release(void)
+// Advance every due slot by one edge and send the result as one report. Runs
+// only once the previous report is out, so each edge of a key reaches the host.
+static void key_state_encoder_tap_task(void)
 {
-  if (encoder_tap_state == ENCODER_TAP_IDLE) {
+  if (encoder_tap_count == 0U || report_queue_count != 0U) {
+    return;
+  }
+
+  uint32_t now = HAL_GetTick();
+  if ((int32_t)(now - encoder_taps[0].due) < 0) {
     return;
   }
 
-  key_state_remove_key(encoder_tap_keycode);
-  hid_report_dirty = true;
-  encoder_tap_state = ENCODER_TAP_IDLE;
-  encoder_tap_keycode = 0;
-}
\ No newline at end of file
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < encoder_tap_count; i++) {
+    encoder_tap_slot_t slot = encoder_taps[i];
+
+    if ((int32_t)(now - slot.due) >= 0) {
+      if (slot.pressed) {
+        TRACE_DEBUG(ENCODER_TAP_RELEASE, slot.keycode);
+        key_state_remove_key(slot.keycode);
+        slot.pressed = false;
+        slot.due = now;
+        if (slot.taps == 0U) {
+          TRACE_DEBUG(ENCODER_TAP_DONE, slot.keycode);
+          continue;
+        }
+      } else {
+        key_state_add_key(slot.keycode);
+        if (slot.source != LATENCY_SRC_NONE) {
+          pending_source = slot.source;
+          pending_cycles = slot.detect_cycles;
+          slot.source = LATENCY_SRC_NONE;
+        }
+        slot.taps--;
+        slot.pressed = true;
+        slot.due = now + (slot.taps != 0U ? 0U : ENCODER_TAP_DELAY_MS);
+      }
+    }
+
+    encoder_taps[kept++] = slot;
+  }
+  encoder_tap_count = kept;
+  key_state_sort_encoder_taps();
+
+  key_state_queue_report(false);
+}
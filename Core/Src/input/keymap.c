@@ -5,28 +5,68 @@
 #include "i2c_manager.h"
 #include "usb_app.h"
 #include "config_protocol.h"  // For slider_config_t definition
+#include "input/combo.h"
+#include "input/debounce.h"
+#include "input/magnetic_switch.h"
+#include "macro.h"
 
 #include <stddef.h>
 
 // EEPROM initialization flag
 static bool keymap_initialized = false;
-static uint8_t active_layer_mask = 0x01;
+static uint32_t active_layer_mask = 0x01;
 static uint8_t default_layer_index = 0;
 static uint8_t persistent_layer_index = 0;
 
+_Static_assert(KEYMAP_LAYER_COUNT >= 1 && KEYMAP_LAYER_COUNT <= 32, "Layer masks are 32-bit");
+
+// Momentary layers are reference counted so overlapping MO() keys for the
+// same layer keep it on until the last one is released. Among momentary
+// layers the highest index wins; the persistent layer sits below all of them.
+static uint8_t momentary_refcount[KEYMAP_LAYER_COUNT];
+static uint32_t momentary_mask = 0;
+
+// Resolved view of the active layer stack, rebuilt only when layers or stored maps change.
+// Each profile keeps its own copy, stamped with the stack it was built for, so
+// switching back to a profile whose stack is unchanged only swaps the pointer.
+// One spare table lets a committed transaction be resolved off to the side and
+// swapped in whole, so no scan ever sees half of it.
+//
+// key_layers has a bit per layer that maps the key to something other than
+// KC_NO/KC_TRANSPARENT. It only changes with the stored maps, and resolving a
+// key against any layer stack is a mask and a CLZ on it.
 typedef struct {
-    uint8_t layer;
-    uint8_t refcount;
-} momentary_layer_entry_t;
+    uint32_t key_layers[MATRIX_ROWS][MATRIX_COLS];
+    uint16_t keymap[MATRIX_ROWS][MATRIX_COLS];
+#if ENCODER_COUNT > 0
+    uint16_t encoder_map[ENCODER_COUNT][2];
+#endif
+#if SLIDER_COUNT > 0
+    slider_config_t slider_config[SLIDER_COUNT];
+#endif
+    uint32_t momentary_mask;    // Stack keymap/encoder_map/slider_config were resolved for
+    uint8_t persistent_layer;
+    bool layers_valid;
+    bool valid;
+} resolved_profile_t;
 
-static momentary_layer_entry_t momentary_layers[KEYMAP_LAYER_COUNT];
-static uint8_t momentary_layer_count = 0;
+static resolved_profile_t resolved_tables[EEPROM_PROFILE_COUNT + 1];
+static resolved_profile_t *resolved_profiles[EEPROM_PROFILE_COUNT];
+static resolved_profile_t *resolved_spare = NULL;
+static resolved_profile_t *resolved = &resolved_tables[0];
 
 static void keymap_broadcast_layer_state(void);
 static void keymap_recompute_active_mask(bool propagate, bool force_broadcast);
-static uint8_t keymap_first_active_layer(uint8_t mask);
+static uint8_t keymap_first_active_layer(uint32_t mask);
+static uint8_t keymap_highest_layer(uint32_t mask);
 static void keymap_clear_momentary_layers(void);
-static momentary_layer_entry_t *keymap_find_momentary_entry(uint8_t layer);
+static uint16_t keymap_lookup_keycode(uint8_t layer, uint8_t row, uint8_t col);
+static void keymap_update_key_layer(resolved_profile_t *target, uint8_t layer, uint8_t row, uint8_t col);
+static void keymap_rebuild_resolved(void);
+static void keymap_resolve_into(resolved_profile_t *target);
+static void keymap_setup_resolved(void);
+static void keymap_invalidate_resolved(void);
+static bool keymap_resolved_current(const resolved_profile_t *target);
 
 // Matrix pin configuration from pin_config.h (which includes keyboard config)
 const pin_t matrix_cols[MATRIX_COLS] = MATRIX_COL_PINS;
@@ -59,7 +99,10 @@ void keymap_init(void)
         // EEPROM init failure already logged; proceed with defaults
     }
 
-    uint8_t stored_mask = 0;
+    keymap_setup_resolved();
+    resolved = resolved_profiles[eeprom_get_active_profile()];
+
+    uint32_t stored_mask = 0;
     uint8_t stored_default = 0;
 
     if (!eeprom_get_layer_state(&stored_mask, &stored_default)) {
@@ -71,16 +114,10 @@ void keymap_init(void)
         stored_default = 0;
     }
 
-    uint8_t allowed_mask = (KEYMAP_LAYER_COUNT >= 8)
-        ? 0xFF
-        : (uint8_t)((1u << KEYMAP_LAYER_COUNT) - 1u);
-    stored_mask &= allowed_mask;
+    stored_mask &= KEYMAP_LAYER_MASK_ALL;
 
     if (stored_mask == 0) {
-        stored_mask = (uint8_t)(1u << stored_default);
-        if (stored_mask == 0) {
-            stored_mask = 1u;
-        }
+        stored_mask = KEYMAP_LAYER_BIT(stored_default);
     }
 
     default_layer_index = stored_default;
@@ -96,6 +133,16 @@ void keymap_init(void)
     keymap_initialized = true;
 }
 
+static uint16_t keymap_lookup_keycode(uint8_t layer, uint8_t row, uint8_t col)
+{
+    uint16_t stored = eeprom_get_keycode(layer, row, col);
+    if (stored != 0) {
+        return stored;
+    }
+
+    return keycodes[layer][row][col];
+}
+
 uint16_t keymap_get_keycode(uint8_t layer, uint8_t row, uint8_t col)
 {
     if (layer >= KEYMAP_LAYER_COUNT || row >= MATRIX_ROWS || col >= MATRIX_COLS) {
@@ -106,18 +153,7 @@ uint16_t keymap_get_keycode(uint8_t layer, uint8_t row, uint8_t col)
         keymap_init();
     }
 
-    uint16_t stored = eeprom_get_keycode(layer, row, col);
-    uint16_t compiled = keycodes[layer][row][col];
-    
-    // Detailed debug logging
-    usb_app_cdc_printf("KEYMAP_GET: [L%d,%d,%d] EEPROM=0x%04X Compiled=0x%04X\r\n", 
-                       layer, row, col, stored, compiled);
-    
-    if (stored != 0) {
-        return stored;
-    }
-
-    return compiled;
+    return keymap_lookup_keycode(layer, row, col);
 }
 
 uint16_t keymap_get_active_keycode(uint8_t row, uint8_t col)
@@ -130,28 +166,11 @@ uint16_t keymap_get_active_keycode(uint8_t row, uint8_t col)
         keymap_init();
     }
 
-    for (int8_t idx = (int8_t)momentary_layer_count - 1; idx >= 0; --idx) {
-        uint8_t layer = momentary_layers[(uint8_t)idx].layer;
-        if (layer >= KEYMAP_LAYER_COUNT) {
-            continue;
-        }
-
-        uint16_t code = keymap_get_keycode(layer, row, col);
-        if (code == KC_TRANSPARENT || code == KC_NO) {
-            continue;
-        }
-
-        return code;
-    }
-
-    if (persistent_layer_index < KEYMAP_LAYER_COUNT) {
-        uint16_t base_code = keymap_get_keycode(persistent_layer_index, row, col);
-        if (base_code != KC_TRANSPARENT && base_code != KC_NO) {
-            return base_code;
-        }
+    if (!resolved->valid) {
+        keymap_rebuild_resolved();
     }
 
-    return KC_NO;
+    return resolved->keymap[row][col];
 }
 
 bool keymap_set_keycode(uint8_t layer, uint8_t row, uint8_t col, uint16_t keycode)
@@ -164,7 +183,16 @@ bool keymap_set_keycode(uint8_t layer, uint8_t row, uint8_t col, uint16_t keycod
         keymap_init();
     }
 
-    return eeprom_set_keycode(layer, row, col, keycode);
+    if (!eeprom_set_keycode(layer, row, col, keycode)) {
+        return false;
+    }
+
+    // Staged edits only reach the resolved tables on commit
+    if (!eeprom_stage_active()) {
+        keymap_update_key_layer(resolved, layer, row, col);
+        resolved->valid = false;
+    }
+    return true;
 }
 
 bool keymap_get_encoder_map(uint8_t layer, uint8_t encoder_id, uint16_t *ccw_keycode, uint16_t *cw_keycode)
@@ -206,43 +234,12 @@ bool keymap_get_active_encoder_map(uint8_t encoder_id, uint16_t *ccw_keycode, ui
         keymap_init();
     }
 
-    for (int8_t idx = (int8_t)momentary_layer_count - 1; idx >= 0; --idx) {
-        uint8_t layer = momentary_layers[(uint8_t)idx].layer;
-        if (layer >= KEYMAP_LAYER_COUNT) {
-            continue;
-        }
-
-        uint16_t temp_ccw = 0;
-        uint16_t temp_cw = 0;
-        keymap_get_encoder_map(layer, encoder_id, &temp_ccw, &temp_cw);
-
-        if (temp_ccw == KC_TRANSPARENT && temp_cw == KC_TRANSPARENT) {
-            continue;
-        }
-
-        if (temp_ccw != KC_NO || temp_cw != KC_NO) {
-            *ccw_keycode = temp_ccw;
-            *cw_keycode = temp_cw;
-            return true;
-        }
+    if (!resolved->valid) {
+        keymap_rebuild_resolved();
     }
 
-    if (persistent_layer_index < KEYMAP_LAYER_COUNT) {
-        uint16_t temp_ccw = 0;
-        uint16_t temp_cw = 0;
-        keymap_get_encoder_map(persistent_layer_index, encoder_id, &temp_ccw, &temp_cw);
-
-        if (!(temp_ccw == KC_TRANSPARENT && temp_cw == KC_TRANSPARENT)) {
-            if (temp_ccw != KC_NO || temp_cw != KC_NO) {
-                *ccw_keycode = temp_ccw;
-                *cw_keycode = temp_cw;
-                return true;
-            }
-        }
-    }
-
-    *ccw_keycode = KC_NO;
-    *cw_keycode = KC_NO;
+    *ccw_keycode = resolved->encoder_map[encoder_id][0];
+    *cw_keycode = resolved->encoder_map[encoder_id][1];
     return true;
 #else
     // No encoders on this keyboard
@@ -263,7 +260,14 @@ bool keymap_set_encoder_map(uint8_t layer, uint8_t encoder_id, uint16_t ccw_keyc
         keymap_init();
     }
 
-    return eeprom_set_encoder_map(layer, encoder_id, ccw_keycode, cw_keycode);
+    if (!eeprom_set_encoder_map(layer, encoder_id, ccw_keycode, cw_keycode)) {
+        return false;
+    }
+
+    if (!eeprom_stage_active()) {
+        resolved->valid = false;
+    }
+    return true;
 #else
     // No encoders on this keyboard
     return false;
@@ -309,26 +313,12 @@ bool keymap_get_active_slider_config(uint8_t slider_id, slider_config_t *config)
         keymap_init();
     }
 
-    // Check momentary layers first (top to bottom)
-    for (int8_t idx = (int8_t)momentary_layer_count - 1; idx >= 0; --idx) {
-        uint8_t layer = momentary_layers[(uint8_t)idx].layer;
-        if (layer >= KEYMAP_LAYER_COUNT) {
-            continue;
-        }
-
-        slider_config_t temp_config;
-        if (keymap_get_slider_config(layer, slider_id, &temp_config)) {
-            // Check if this layer has a non-transparent configuration
-            // For sliders, we consider a config transparent if MIDI CC is 0
-            if (temp_config.midi_cc != 0) {
-                *config = temp_config;
-                return true;
-            }
-        }
+    if (!resolved->valid) {
+        keymap_rebuild_resolved();
     }
 
-    // Fall back to persistent layer
-    return keymap_get_slider_config(persistent_layer_index, slider_id, config);
+    *config = resolved->slider_config[slider_id];
+    return true;
 #else
     // No sliders on this keyboard
     return false;
@@ -346,90 +336,230 @@ bool keymap_set_slider_config(uint8_t layer, uint8_t slider_id, const slider_con
         keymap_init();
     }
 
-    return eeprom_set_slider_config(layer, slider_id, config);
+    if (!eeprom_set_slider_config(layer, slider_id, config)) {
+        return false;
+    }
+
+    if (!eeprom_stage_active()) {
+        resolved->valid = false;
+    }
+    return true;
 #else
     // No sliders on this keyboard
     return false;
 #endif
 }
 
+// The EEPROM load can invalidate the cache before keymap_init() runs
+static void keymap_setup_resolved(void)
+{
+    if (resolved_spare) {
+        return;
+    }
 
+    for (uint8_t profile = 0; profile < EEPROM_PROFILE_COUNT; ++profile) {
+        resolved_profiles[profile] = &resolved_tables[profile];
+    }
+    resolved_spare = &resolved_tables[EEPROM_PROFILE_COUNT];
+}
 
-static uint8_t keymap_first_active_layer(uint8_t mask)
+// Stored maps were replaced (EEPROM load or reset) for every profile
+static void keymap_invalidate_resolved(void)
 {
-    for (uint8_t idx = 0; idx < KEYMAP_LAYER_COUNT; ++idx) {
-        if ((mask & (uint8_t)(1u << idx)) != 0u) {
-            return idx;
-        }
+    keymap_setup_resolved();
+    for (uint8_t profile = 0; profile < EEPROM_PROFILE_COUNT; ++profile) {
+        resolved_profiles[profile]->valid = false;
     }
+}
 
-    return KEYMAP_LAYER_COUNT;
+void keymap_invalidate_cache(void)
+{
+    keymap_invalidate_resolved();
+    for (uint8_t profile = 0; profile < EEPROM_PROFILE_COUNT; ++profile) {
+        resolved_profiles[profile]->layers_valid = false;
+    }
+    resolved = resolved_profiles[eeprom_get_active_profile()];
+    combo_invalidate_cache();
 }
 
-static void keymap_clear_momentary_layers(void)
+static void keymap_update_key_layer(resolved_profile_t *target, uint8_t layer, uint8_t row, uint8_t col)
 {
-    for (uint8_t i = 0; i < KEYMAP_LAYER_COUNT; ++i) {
-        momentary_layers[i].layer = 0;
-        momentary_layers[i].refcount = 0;
+    if (!target->layers_valid) {
+        return;
+    }
+
+    uint16_t code = keymap_lookup_keycode(layer, row, col);
+    if (code != KC_TRANSPARENT && code != KC_NO) {
+        target->key_layers[row][col] |= KEYMAP_LAYER_BIT(layer);
+    } else {
+        target->key_layers[row][col] &= ~KEYMAP_LAYER_BIT(layer);
     }
-    momentary_layer_count = 0;
 }
 
-static momentary_layer_entry_t *keymap_find_momentary_entry(uint8_t layer)
+static void keymap_build_key_layers(resolved_profile_t *target)
 {
-    for (uint8_t i = 0; i < momentary_layer_count; ++i) {
-        if (momentary_layers[i].layer == layer) {
-            return &momentary_layers[i];
+    for (uint8_t row = 0; row < MATRIX_ROWS; ++row) {
+        for (uint8_t col = 0; col < MATRIX_COLS; ++col) {
+            uint32_t layers = 0;
+            for (uint8_t layer = 0; layer < KEYMAP_LAYER_COUNT; ++layer) {
+                uint16_t code = keymap_lookup_keycode(layer, row, col);
+                if (code != KC_TRANSPARENT && code != KC_NO) {
+                    layers |= KEYMAP_LAYER_BIT(layer);
+                }
+            }
+            target->key_layers[row][col] = layers;
         }
     }
+    target->layers_valid = true;
+}
 
-    return NULL;
+static void keymap_rebuild_resolved(void)
+{
+    keymap_resolve_into(resolved);
 }
 
-static void keymap_recompute_active_mask(bool propagate, bool force_broadcast)
+// Flatten the layer stack into resolved tables so lookups on the input path
+// are a single array read. Keys pick their layer from key_layers, so the cost
+// per key is the same however many layers are stacked.
+static void keymap_resolve_into(resolved_profile_t *target)
 {
-    if (persistent_layer_index >= KEYMAP_LAYER_COUNT) {
-        persistent_layer_index = default_layer_index;
-        if (persistent_layer_index >= KEYMAP_LAYER_COUNT) {
-            persistent_layer_index = 0;
+    if (!target->layers_valid) {
+        keymap_build_key_layers(target);
+    }
+
+    uint32_t persistent_bit = KEYMAP_LAYER_BIT(persistent_layer_index);
+
+    for (uint8_t row = 0; row < MATRIX_ROWS; ++row) {
+        for (uint8_t col = 0; col < MATRIX_COLS; ++col) {
+            uint32_t layers = target->key_layers[row][col];
+            uint32_t momentary = layers & momentary_mask;
+            uint16_t keycode = KC_NO;
+            if (momentary != 0u) {
+                keycode = keymap_lookup_keycode(keymap_highest_layer(momentary), row, col);
+            } else if ((layers & persistent_bit) != 0u) {
+                keycode = keymap_lookup_keycode(persistent_layer_index, row, col);
+            }
+            target->keymap[row][col] = keycode;
         }
     }
 
-    uint8_t allowed_mask = (KEYMAP_LAYER_COUNT >= 8)
-        ? 0xFF
-        : (uint8_t)((1u << KEYMAP_LAYER_COUNT) - 1u);
+#if ENCODER_COUNT > 0 || SLIDER_COUNT > 0
+    // Encoders and sliders are few; walk the stack top-down for them
+    uint8_t order[KEYMAP_LAYER_COUNT + 1];
+    uint8_t order_count = 0;
+    uint32_t pending = momentary_mask;
+    while (pending != 0u) {
+        uint8_t layer = keymap_highest_layer(pending);
+        order[order_count++] = layer;
+        pending &= ~KEYMAP_LAYER_BIT(layer);
+    }
+#if SLIDER_COUNT > 0
+    uint8_t momentary_count = order_count;
+#endif
+    if (persistent_layer_index < KEYMAP_LAYER_COUNT) {
+        order[order_count++] = persistent_layer_index;
+    }
+#endif
 
-    uint8_t mask = (uint8_t)(1u << persistent_layer_index);
-    if (mask == 0) {
-        mask = 1u;
+#if ENCODER_COUNT > 0
+    for (uint8_t enc = 0; enc < ENCODER_COUNT; ++enc) {
+        target->encoder_map[enc][0] = KC_NO;
+        target->encoder_map[enc][1] = KC_NO;
+        for (uint8_t i = 0; i < order_count; ++i) {
+            uint16_t temp_ccw = 0;
+            uint16_t temp_cw = 0;
+            keymap_get_encoder_map(order[i], enc, &temp_ccw, &temp_cw);
+
+            if (temp_ccw == KC_TRANSPARENT && temp_cw == KC_TRANSPARENT) {
+                continue;
+            }
+            if (temp_ccw != KC_NO || temp_cw != KC_NO) {
+                target->encoder_map[enc][0] = temp_ccw;
+                target->encoder_map[enc][1] = temp_cw;
+                break;
+            }
+        }
     }
+#endif
 
-    for (uint8_t i = 0; i < momentary_layer_count; ++i) {
-        uint8_t layer = momentary_layers[i].layer;
-        if (layer >= KEYMAP_LAYER_COUNT) {
-            continue;
+#if SLIDER_COUNT > 0
+    for (uint8_t slider = 0; slider < SLIDER_COUNT; ++slider) {
+        // Momentary layers only win when their slider has a MIDI CC assigned;
+        // otherwise the persistent layer's configuration applies as-is
+        bool found = false;
+        for (uint8_t i = 0; i < momentary_count; ++i) {
+            slider_config_t temp_config;
+            if (keymap_get_slider_config(order[i], slider, &temp_config) && temp_config.midi_cc != 0) {
+                target->slider_config[slider] = temp_config;
+                found = true;
+                break;
+            }
         }
-        mask |= (uint8_t)(1u << layer);
+        if (!found) {
+            keymap_get_slider_config(persistent_layer_index, slider, &target->slider_config[slider]);
+        }
+    }
+#endif
+
+    target->momentary_mask = momentary_mask;
+    target->persistent_layer = persistent_layer_index;
+    target->valid = true;
+}
+
+static bool keymap_resolved_current(const resolved_profile_t *target)
+{
+    return target->valid && target->momentary_mask == momentary_mask &&
+           target->persistent_layer == persistent_layer_index;
+}
+
+static uint8_t keymap_first_active_layer(uint32_t mask)
+{
+    mask &= KEYMAP_LAYER_MASK_ALL;
+    if (mask == 0u) {
+        return KEYMAP_LAYER_COUNT;
     }
 
-    mask &= allowed_mask;
+    return (uint8_t)__builtin_ctz(mask);
+}
+
+static uint8_t keymap_highest_layer(uint32_t mask)
+{
+    return (uint8_t)(31u - (uint32_t)__builtin_clz(mask));
+}
+
+static void keymap_clear_momentary_layers(void)
+{
+    for (uint8_t i = 0; i < KEYMAP_LAYER_COUNT; ++i) {
+        momentary_refcount[i] = 0;
+    }
+    momentary_mask = 0;
+}
 
-    if (mask == 0) {
+static void keymap_recompute_active_mask(bool propagate, bool force_broadcast)
+{
+    if (persistent_layer_index >= KEYMAP_LAYER_COUNT) {
         persistent_layer_index = default_layer_index;
         if (persistent_layer_index >= KEYMAP_LAYER_COUNT) {
             persistent_layer_index = 0;
         }
-        mask = (uint8_t)(1u << persistent_layer_index);
-        if (mask == 0) {
-            mask = 1u;
-        }
     }
 
+    momentary_mask &= KEYMAP_LAYER_MASK_ALL;
+    uint32_t mask = KEYMAP_LAYER_BIT(persistent_layer_index) | momentary_mask;
+
     bool changed = (mask != active_layer_mask);
     if (changed) {
         active_layer_mask = mask;
     }
 
+    // Resolution depends only on the momentary set and the persistent layer.
+    // Resolve here rather than on the next lookup, so the key press that follows
+    // a layer change does not pay for the rebuild. Other profiles catch up when
+    // they are switched to.
+    if (!keymap_resolved_current(resolved)) {
+        keymap_rebuild_resolved();
+    }
+
     if (propagate && (changed || force_broadcast)) {
         keymap_broadcast_layer_state();
     }
@@ -437,10 +567,109 @@ static void keymap_recompute_active_mask(bool propagate, bool force_broadcast)
 
 static void keymap_broadcast_layer_state(void)
 {
-    i2c_manager_broadcast_layer_state(active_layer_mask, default_layer_index);
+    i2c_manager_broadcast_layer_state(active_layer_mask, default_layer_index, eeprom_get_active_profile());
+}
+
+// Make another configuration profile live. Its resolved tables stay cached
+// from the last time it was used, so unless the layer stack changed since,
+// this is a pointer swap and the next lookup reads the new profile directly.
+// Not for interrupt context: it queues an EEPROM record and reloads the
+// profile's debounce and calibration settings.
+bool keymap_set_profile(uint8_t profile, bool propagate)
+{
+    if (profile >= EEPROM_PROFILE_COUNT) {
+        return false;
+    }
+
+    if (!keymap_initialized) {
+        keymap_init();
+    }
+
+    if (profile == eeprom_get_active_profile()) {
+        return true;
+    }
+
+    if (!eeprom_set_active_profile(profile)) {
+        return false;
+    }
+
+    resolved = resolved_profiles[profile];
+
+    // Follow the new profile's default layer; held momentary layers stay on
+    uint32_t stored_mask = 0;
+    uint8_t stored_default = 0;
+    if (eeprom_get_layer_state(&stored_mask, &stored_default) &&
+        stored_default < KEYMAP_LAYER_COUNT && stored_default != default_layer_index) {
+        default_layer_index = stored_default;
+        persistent_layer_index = stored_default;
+        keymap_recompute_active_mask(false, false);
+    } else if (!keymap_resolved_current(resolved)) {
+        keymap_rebuild_resolved();
+    }
+
+    debounce_reload_config();
+    magnetic_switch_reload_calibration();
+    combo_invalidate_cache();
+
+    if (propagate) {
+        keymap_broadcast_layer_state();
+    }
+
+    return true;
+}
+
+bool keymap_config_begin(void)
+{
+    if (!keymap_initialized) {
+        keymap_init();
+    }
+
+    return eeprom_stage_begin();
+}
+
+// Make a staged transaction live between two scans: its tables are resolved
+// into the spare buffer first and then swapped in with a single pointer store.
+bool keymap_config_commit(void)
+{
+    if (!keymap_initialized) {
+        keymap_init();
+    }
+
+    uint8_t profile = 0;
+    if (!eeprom_stage_commit(&profile)) {
+        return false;
+    }
+
+    if (profile != eeprom_get_active_profile()) {
+        // Switched away mid-transaction; resolve when that profile is next used
+        resolved_profiles[profile]->layers_valid = false;
+        resolved_profiles[profile]->valid = false;
+        return true;
+    }
+
+    resolved_spare->layers_valid = false;
+    keymap_resolve_into(resolved_spare);
+    resolved_profile_t *previous = resolved_profiles[profile];
+    resolved_profiles[profile] = resolved_spare;
+    resolved = resolved_spare;
+    resolved_spare = previous;
+    return true;
 }
 
-uint8_t keymap_get_layer_mask(void)
+void keymap_config_abort(void)
+{
+    eeprom_stage_abort();
+}
+
+uint8_t keymap_get_profile(void)
+{
+    if (!keymap_initialized) {
+        keymap_init();
+    }
+    return eeprom_get_active_profile();
+}
+
+uint32_t keymap_get_layer_mask(void)
 {
     if (!keymap_initialized) {
         keymap_init();
@@ -466,16 +695,10 @@ void keymap_layer_on(uint8_t layer)
         keymap_init();
     }
 
-    momentary_layer_entry_t *entry = keymap_find_momentary_entry(layer);
-    if (entry) {
-        if (entry->refcount < UINT8_MAX) {
-            entry->refcount++;
-        }
-    } else if (momentary_layer_count < KEYMAP_LAYER_COUNT) {
-        momentary_layers[momentary_layer_count].layer = layer;
-        momentary_layers[momentary_layer_count].refcount = 1;
-        momentary_layer_count++;
+    if (momentary_refcount[layer] < UINT8_MAX) {
+        momentary_refcount[layer]++;
     }
+    momentary_mask |= KEYMAP_LAYER_BIT(layer);
 
     keymap_recompute_active_mask(true, false);
 }
@@ -490,29 +713,16 @@ void keymap_layer_off(uint8_t layer)
         keymap_init();
     }
 
-    for (uint8_t i = 0; i < momentary_layer_count; ++i) {
-        if (momentary_layers[i].layer != layer) {
-            continue;
-        }
-
-        if (momentary_layers[i].refcount > 0) {
-            momentary_layers[i].refcount--;
-        }
-
-        if (momentary_layers[i].refcount == 0) {
-            for (uint8_t j = i; j + 1u < momentary_layer_count; ++j) {
-                momentary_layers[j] = momentary_layers[j + 1u];
-            }
-            if (momentary_layer_count > 0) {
-                momentary_layer_count--;
-                momentary_layers[momentary_layer_count].layer = 0;
-                momentary_layers[momentary_layer_count].refcount = 0;
-            }
-        }
-
-        keymap_recompute_active_mask(true, false);
+    if (momentary_refcount[layer] == 0) {
         return;
     }
+
+    momentary_refcount[layer]--;
+    if (momentary_refcount[layer] == 0) {
+        momentary_mask &= ~KEYMAP_LAYER_BIT(layer);
+    }
+
+    keymap_recompute_active_mask(true, false);
 }
 
 void keymap_layer_move(uint8_t layer)
@@ -533,23 +743,19 @@ void keymap_layer_move(uint8_t layer)
     keymap_recompute_active_mask(true, false);
 }
 
-void keymap_apply_layer_mask(uint8_t mask, uint8_t default_layer, bool propagate, bool update_default)
+void keymap_apply_layer_mask(uint32_t mask, uint8_t default_layer, bool propagate, bool update_default)
 {
     if (!keymap_initialized) {
         keymap_init();
     }
 
-    uint8_t allowed_mask = (KEYMAP_LAYER_COUNT >= 8)
-        ? 0xFF
-        : (uint8_t)((1u << KEYMAP_LAYER_COUNT) - 1u);
-
     uint8_t previous_default = default_layer_index;
     uint8_t sanitized_default = previous_default;
     if (update_default) {
         if (default_layer < KEYMAP_LAYER_COUNT) {
             sanitized_default = default_layer;
         } else {
-            sanitized_default = keymap_first_active_layer(mask & allowed_mask);
+            sanitized_default = keymap_first_active_layer(mask);
             if (sanitized_default >= KEYMAP_LAYER_COUNT) {
                 sanitized_default = previous_default;
             }
@@ -560,7 +766,7 @@ void keymap_apply_layer_mask(uint8_t mask, uint8_t default_layer, bool propagate
         }
     }
 
-    uint8_t sanitized_mask = mask & allowed_mask;
+    uint32_t sanitized_mask = mask & KEYMAP_LAYER_MASK_ALL;
     if (sanitized_mask == 0) {
         uint8_t fallback = persistent_layer_index;
         if (update_default) {
@@ -573,41 +779,31 @@ void keymap_apply_layer_mask(uint8_t mask, uint8_t default_layer, bool propagate
             fallback = 0;
         }
 
-        sanitized_mask = (uint8_t)(1u << fallback);
-        if (sanitized_mask == 0) {
-            sanitized_mask = 1u;
-        }
+        sanitized_mask = KEYMAP_LAYER_BIT(fallback);
     }
 
     if (update_default) {
-        uint8_t ensure_bit = (uint8_t)(1u << sanitized_default);
-        if (ensure_bit != 0) {
-            sanitized_mask |= ensure_bit;
-        }
+        sanitized_mask |= KEYMAP_LAYER_BIT(sanitized_default);
     }
 
     bool default_changed = false;
     if (update_default && sanitized_default != previous_default) {
         default_layer_index = sanitized_default;
         default_changed = true;
-        uint8_t persist_mask = (uint8_t)(1u << default_layer_index);
-        if (persist_mask == 0) {
-            persist_mask = 1u;
-        }
-        eeprom_set_layer_state(persist_mask, default_layer_index);
+        eeprom_set_layer_state(KEYMAP_LAYER_BIT(default_layer_index), default_layer_index);
     }
 
     uint8_t candidate_persistent = persistent_layer_index;
-    uint8_t current_bit = (candidate_persistent < KEYMAP_LAYER_COUNT)
-        ? (uint8_t)(1u << candidate_persistent)
+    uint32_t current_bit = (candidate_persistent < KEYMAP_LAYER_COUNT)
+        ? KEYMAP_LAYER_BIT(candidate_persistent)
         : 0u;
 
     if (update_default) {
         candidate_persistent = sanitized_default;
     } else {
         if (current_bit == 0u || (sanitized_mask & current_bit) == 0u) {
-            uint8_t default_bit = (uint8_t)(1u << default_layer_index);
-            if (default_bit != 0u && (sanitized_mask & default_bit) != 0u) {
+            uint32_t default_bit = KEYMAP_LAYER_BIT(default_layer_index);
+            if ((sanitized_mask & default_bit) != 0u) {
                 candidate_persistent = default_layer_index;
             } else {
                 candidate_persistent = keymap_first_active_layer(sanitized_mask);
@@ -627,21 +823,11 @@ void keymap_apply_layer_mask(uint8_t mask, uint8_t default_layer, bool propagate
 
     persistent_layer_index = candidate_persistent;
 
+    // Every other layer in the mask becomes a momentary layer held once
     keymap_clear_momentary_layers();
-    for (uint8_t layer = 0; layer < KEYMAP_LAYER_COUNT; ++layer) {
-        uint8_t bit = (uint8_t)(1u << layer);
-        if ((sanitized_mask & bit) == 0) {
-            continue;
-        }
-        if (layer == persistent_layer_index) {
-            continue;
-        }
-        if (momentary_layer_count >= KEYMAP_LAYER_COUNT) {
-            break;
-        }
-        momentary_layers[momentary_layer_count].layer = layer;
-        momentary_layers[momentary_layer_count].refcount = 1;
-        momentary_layer_count++;
+    momentary_mask = sanitized_mask & ~KEYMAP_LAYER_BIT(persistent_layer_index);
+    for (uint32_t pending = momentary_mask; pending != 0u; pending &= pending - 1u) {
+        momentary_refcount[__builtin_ctz(pending)] = 1;
     }
 
     keymap_recompute_active_mask(propagate, default_changed);
@@ -653,12 +839,7 @@ void keymap_persist_default_layer_state(void)
         keymap_init();
     }
 
-    uint8_t persist_bit = (uint8_t)(1u << default_layer_index);
-    if (persist_bit == 0) {
-        persist_bit = 1u;
-    }
-
-    eeprom_set_layer_state(persist_bit, default_layer_index);
+    eeprom_set_layer_state(KEYMAP_LAYER_BIT(default_layer_index), default_layer_index);
 }
 
 bool keymap_translate_keycode(uint16_t keycode, bool pressed, uint8_t *hid_code)
@@ -689,6 +870,25 @@ bool keymap_translate_keycode(uint16_t keycode, bool pressed, uint8_t *hid_code)
         return false;
     }
 
+    if (IS_OP_PROFILE(keycode)) {
+        if (pressed) {
+            keymap_set_profile(OP_PROFILE_TARGET(keycode), true);
+        }
+        return false;
+    }
+
+    if (IS_OP_MACRO(keycode)) {
+        if (pressed) {
+            macro_play(OP_MACRO_TARGET(keycode));
+        }
+        return false;
+    }
+
+    // Tap-hold keys reaching this point (e.g. from an encoder) act as their tap key
+    if (IS_OP_TAP_HOLD(keycode)) {
+        keycode = OP_TAP_HOLD_TAP_KEY(keycode);
+    }
+
     *hid_code = op_keycode_to_hid(keycode);
     return (*hid_code != 0);
 }
@@ -4,6 +4,8 @@
 #include "main.h"
 #include "i2c_manager.h"
 #include "eeprom_emulation.h"
+#include "trace.h"
+#include "latency.h"
 
 // Global magnetic switch configurations
 magnetic_switch_config_t magnetic_switches[MAX_MAGNETIC_SWITCHES];
@@ -12,6 +14,34 @@ uint8_t magnetic_switch_count = 0;
 // Static variables for calibration
 static mag_switch_calibration_state_t calibration_states[MAX_MAGNETIC_SWITCHES];
 
+// Reasonable values so a switch works before it was ever calibrated
+static void magnetic_switch_set_default_calibration(uint8_t switch_id) {
+    magnetic_switches[switch_id].unpressed_value = 100;      // Typical low value
+    magnetic_switches[switch_id].pressed_value = 3000;       // Typical high value when pressed
+    magnetic_switches[switch_id].sensitivity = 20;           // 20% trigger point
+    magnetic_switches[switch_id].is_calibrated = true;       // Enable by default with reasonable values
+    magnetic_switch_calculate_threshold(switch_id);
+}
+
+// Apply the calibration stored in the active profile, if it has one
+static bool magnetic_switch_load_calibration(uint8_t switch_id) {
+    uint16_t unpressed, pressed;
+    uint8_t sensitivity;
+    bool is_calibrated;
+
+    if (!eeprom_get_magnetic_switch_calibration(switch_id, &unpressed, &pressed, &sensitivity, &is_calibrated) ||
+        !is_calibrated) {
+        return false;
+    }
+
+    magnetic_switches[switch_id].unpressed_value = unpressed;
+    magnetic_switches[switch_id].pressed_value = pressed;
+    magnetic_switches[switch_id].sensitivity = sensitivity;
+    magnetic_switches[switch_id].is_calibrated = true;
+    magnetic_switch_calculate_threshold(switch_id);
+    return true;
+}
+
 void magnetic_switch_init(void) {
     // Initialize ADC for magnetic switch readings
     adc_init();
@@ -36,26 +66,25 @@ void magnetic_switch_init(void) {
     
     // Load calibration data from EEPROM
     for (uint8_t i = 0; i < magnetic_switch_count; i++) {
-        uint16_t unpressed, pressed;
-        uint8_t sensitivity;
-        bool is_calibrated;
-        
-        if (eeprom_get_magnetic_switch_calibration(i, &unpressed, &pressed, &sensitivity, &is_calibrated)) {
-            if (is_calibrated) {
-                magnetic_switches[i].unpressed_value = unpressed;
-                magnetic_switches[i].pressed_value = pressed;
-                magnetic_switches[i].sensitivity = sensitivity;
-                magnetic_switches[i].is_calibrated = true;
-                magnetic_switch_calculate_threshold(i);
-                usb_app_cdc_printf("Loaded calibration for switch %d from EEPROM: unpressed=%d pressed=%d sensitivity=%d%%\r\n",
-                                 i, unpressed, pressed, sensitivity);
-            }
+        if (magnetic_switch_load_calibration(i)) {
+            usb_app_cdc_printf("Loaded calibration for switch %d from EEPROM: unpressed=%d pressed=%d sensitivity=%d%%\r\n",
+                             i, magnetic_switches[i].unpressed_value, magnetic_switches[i].pressed_value,
+                             magnetic_switches[i].sensitivity);
         }
     }
     
     usb_app_cdc_printf("Magnetic switches initialized (count: %d)\r\n", magnetic_switch_count);
 }
 
+// Re-read calibration after the active configuration profile changed
+void magnetic_switch_reload_calibration(void) {
+    for (uint8_t i = 0; i < magnetic_switch_count; i++) {
+        if (!magnetic_switch_load_calibration(i)) {
+            magnetic_switch_set_default_calibration(i);
+        }
+    }
+}
+
 void magnetic_switch_update(void) {
     for (uint8_t i = 0; i < magnetic_switch_count; i++) {
         // Use percentage-based detection (0-100) with hysteresis
@@ -74,18 +103,21 @@ void magnetic_switch_update(void) {
 
         // Only send events if state actually changed
         if (is_pressed != was_pressed) {
+            uint32_t detect_cycles = trace_cycles();
             magnetic_switches[i].is_pressed = is_pressed;
             
             if (is_pressed) {
                 usb_app_cdc_printf("MAG_SW[%d]: PRESS at %d%% (keycode=0x%04X) - Key will be held\r\n", 
                                  i, pct, magnetic_switches[i].keycode);
                 // Use row 0 for magnetic switches (row 254 is reserved for encoders which send tap events)
-                i2c_manager_process_local_key_event(0, i, 1, magnetic_switches[i].keycode);
+                i2c_manager_process_local_key_event(0, i, 1, magnetic_switches[i].keycode,
+                                                    LATENCY_SRC_MAGNETIC, detect_cycles);
             } else {
                 usb_app_cdc_printf("MAG_SW[%d]: RELEASE at %d%% (keycode=0x%04X) - Key released\r\n", 
                                  i, pct, magnetic_switches[i].keycode);
                 // Use row 0 for magnetic switches (row 254 is reserved for encoders which send tap events)
-                i2c_manager_process_local_key_event(0, i, 0, magnetic_switches[i].keycode);
+                i2c_manager_process_local_key_event(0, i, 0, magnetic_switches[i].keycode,
+                                                    LATENCY_SRC_MAGNETIC, detect_cycles);
             }
         }
         // While at 100%, the key stays pressed in the HID report (no events sent)
@@ -231,12 +263,11 @@ void magnetic_switch_complete_calibration(uint8_t switch_id) {
     // Calculate initial threshold
     magnetic_switch_calculate_threshold(switch_id);
     
-    // Save calibration to EEPROM
+    // Save calibration to EEPROM (committed once configuration goes idle)
     eeprom_set_magnetic_switch_calibration(switch_id, 
                                           magnetic_switches[switch_id].unpressed_value,
                                           magnetic_switches[switch_id].pressed_value,
                                           magnetic_switches[switch_id].sensitivity);
-    eeprom_save_config();
     
     usb_app_cdc_printf("Completed calibration for switch %d (unpressed: %d, pressed: %d, threshold: %d) - Saved to EEPROM\r\n", 
                 switch_id, 
@@ -259,7 +290,6 @@ void magnetic_switch_set_sensitivity(uint8_t switch_id, uint8_t sensitivity) {
                                               magnetic_switches[switch_id].unpressed_value,
                                               magnetic_switches[switch_id].pressed_value,
                                               magnetic_switches[switch_id].sensitivity);
-        eeprom_save_config();
     }
     
     usb_app_cdc_printf("Set sensitivity for switch %d: %d%% (threshold: %d)\r\n", 
@@ -317,13 +347,7 @@ void magnetic_switch_setup_from_config(void) {
         HAL_GPIO_Init(magnetic_switches[i].gpio_port, &GPIO_InitStruct);
         
         // Set up default calibration values for immediate use
-        magnetic_switches[i].unpressed_value = 100;      // Typical low value
-        magnetic_switches[i].pressed_value = 3000;       // Typical high value when pressed
-        magnetic_switches[i].sensitivity = 20;           // 20% trigger point
-        magnetic_switches[i].is_calibrated = true;       // Enable by default with reasonable values
-        
-        // Calculate threshold
-        magnetic_switch_calculate_threshold(i);
+        magnetic_switch_set_default_calibration(i);
         
         usb_app_cdc_printf("Magnetic switch %d: CH%d, PA%d, KC=0x%04X, default range %d-%d\r\n",
                            i, 
@@ -1,18 +1,421 @@
 #include "matrix.h"
+#include "debounce.h"
 #include "keymap.h"
 #include "main.h"
 #include "midi_handler.h"
+#include "combo.h"
 #include "op_keycodes.h"
+#include "tap_hold.h"
+#include "trace.h"
+
+// Settle time after driving a column, in NOP loop iterations
+#ifndef MATRIX_SETTLE_NOPS
+#define MATRIX_SETTLE_NOPS 20
+#endif
+
+// Background scan: TIM2 steps through the columns on its own and the main loop
+// only diffs completed snapshots. Enable per keyboard with MATRIX_SCAN_BACKGROUND 1.
+#ifndef MATRIX_SCAN_BACKGROUND
+#define MATRIX_SCAN_BACKGROUND 0
+#endif
+
+// Full-matrix scans per second in background mode
+#ifndef MATRIX_SCAN_RATE_HZ
+#define MATRIX_SCAN_RATE_HZ 4000
+#endif
+
+// Delay between column drive and row sample in DMA mode, in microseconds
+#ifndef MATRIX_SCAN_SETTLE_US
+#define MATRIX_SCAN_SETTLE_US 2
+#endif
+
+// Snapshot frames kept in the circular capture buffer
+#define MATRIX_SCAN_FRAMES 8
+
+_Static_assert(MATRIX_ROWS <= 32, "matrix rows are packed into a 32-bit word per column");
+_Static_assert(MATRIX_COLS <= 32, "debounced state is packed into a 32-bit word per row");
 
 static matrix_event_cb_t user_cb = NULL;
-static uint8_t state[MATRIX_ROWS][MATRIX_COLS] = {0};
+static uint32_t event_cycles = 0;
 static uint16_t active_keycode_cache[MATRIX_ROWS][MATRIX_COLS] = {0};
+// Key state as one bitmap per row (bit c = column c): debounced input and last dispatched
+static uint32_t cooked[MATRIX_ROWS] = {0};
+static uint32_t matrix_state[MATRIX_ROWS] = {0};
+
+// Port-batched scan tables, built once from MATRIX_ROW_PINS / MATRIX_COL_PINS.
+// Rows sharing a GPIO port are sampled with a single IDR read per column.
+static GPIO_TypeDef *row_ports[MATRIX_ROWS];
+static uint8_t row_port_count = 0;
+static uint8_t row_port_index[MATRIX_ROWS];
+static uint8_t row_shift[MATRIX_ROWS];
+static uint32_t col_set_bits[MATRIX_COLS];
+static uint32_t col_reset_bits[MATRIX_COLS];
+
+#if MATRIX_SCAN_BACKGROUND
+typedef enum {
+    MATRIX_SCAN_POLL = 0,   // matrix_scan() drives the columns itself
+    MATRIX_SCAN_TIMER_ISR,  // TIM2 update interrupt steps one column per tick
+    MATRIX_SCAN_TIMER_DMA   // TIM2 update/CC1 requests DMA the BSRR writes and IDR reads
+} matrix_scan_mode_t;
+
+static matrix_scan_mode_t scan_mode = MATRIX_SCAN_POLL;
+// Drive words written to the column port BSRR by DMA (one column set, all others reset)
+static uint32_t bg_drive[MATRIX_COLS];
+// Snapshots: row bits per column (ISR mode) or raw row-port IDR (DMA mode)
+static volatile uint32_t bg_frames[MATRIX_SCAN_FRAMES][MATRIX_COLS];
+static volatile uint8_t bg_write_frame = 0;
+static volatile uint8_t bg_column = 0;
+// Frames completed by the timer ISR, or capture buffer wraps seen by the DMA ISR
+static volatile uint32_t bg_frames_done = 0;
+static volatile uint32_t bg_dma_laps = 0;
+// Sequence number of the next frame to diff, and frames lapped before they were read
+static uint32_t bg_read_seq = 0;
+static uint32_t bg_overruns = 0;
+#endif
 
 void matrix_register_callback(matrix_event_cb_t cb)
 {
     user_cb = cb;
 }
 
+uint32_t matrix_get_event_cycles(void)
+{
+    return event_cycles;
+}
+
+static uint8_t pin_to_shift(uint16_t pin)
+{
+    return (uint8_t)__builtin_ctz(pin);
+}
+
+static void matrix_build_scan_tables(void)
+{
+    row_port_count = 0;
+    for (uint8_t r = 0; r < MATRIX_ROWS; ++r) {
+        uint8_t p = 0;
+        while (p < row_port_count && row_ports[p] != matrix_rows[r].port) {
+            ++p;
+        }
+        if (p == row_port_count) {
+            row_ports[row_port_count++] = matrix_rows[r].port;
+        }
+        row_port_index[r] = p;
+        row_shift[r] = pin_to_shift(matrix_rows[r].pin);
+    }
+
+    for (uint8_t c = 0; c < MATRIX_COLS; ++c) {
+        col_set_bits[c] = matrix_cols[c].pin;
+        col_reset_bits[c] = (uint32_t)matrix_cols[c].pin << 16;
+    }
+}
+
+static uint32_t matrix_extract_rows(const uint32_t *idr)
+{
+    uint32_t rows = 0;
+    for (uint8_t r = 0; r < MATRIX_ROWS; ++r) {
+        rows |= ((idr[row_port_index[r]] >> row_shift[r]) & 1u) << r;
+    }
+    return rows;
+}
+
+// Drive one column, sample every row port once and return the row bits (bit r = row r)
+static uint32_t matrix_read_column(uint8_t c)
+{
+    uint32_t idr[MATRIX_ROWS];
+
+    matrix_cols[c].port->BSRR = col_set_bits[c];
+    for (volatile int i = 0; i < MATRIX_SETTLE_NOPS; ++i) __NOP();
+
+    for (uint8_t p = 0; p < row_port_count; ++p) {
+        idr[p] = row_ports[p]->IDR;
+    }
+
+    matrix_cols[c].port->BSRR = col_reset_bits[c];
+
+    return matrix_extract_rows(idr);
+}
+
+// Dispatch one debounced key transition
+void matrix_dispatch_keycode(uint8_t r, uint8_t c, uint16_t kc, uint8_t pressed)
+{
+    if (kc == KC_NO) {
+        return;
+    }
+
+    // Handle MIDI keycodes
+    midi_handle_keycode(kc, pressed);
+
+    uint8_t hid = 0;
+    bool should_send = keymap_translate_keycode(kc, pressed, &hid);
+
+    if (should_send && user_cb)
+    {
+        user_cb(r, c, pressed, hid);
+    }
+}
+
+void matrix_process_key(uint8_t r, uint8_t c, uint8_t pressed)
+{
+    uint16_t kc = pressed ? keymap_get_active_keycode(r, c)
+                          : active_keycode_cache[r][c];
+
+    if (pressed) {
+        active_keycode_cache[r][c] = kc;
+    } else if (kc == KC_NO) {
+        kc = keymap_get_active_keycode(r, c);
+    }
+
+    // Events taken by the combo or tap-hold engine come back through here when
+    // replayed, so a buffered release keeps its cached keycode until then
+    if (combo_process_key(r, c, pressed)) {
+        return;
+    }
+    if (tap_hold_process_key(r, c, kc, pressed)) {
+        // A release the engine settled itself (the tap-hold key's own) is never replayed
+        if (!pressed && !tap_hold_release_buffered(r, c)) {
+            active_keycode_cache[r][c] = KC_NO;
+        }
+        return;
+    }
+
+    if (!pressed) {
+        active_keycode_cache[r][c] = KC_NO;
+    }
+
+    matrix_dispatch_keycode(r, c, kc, pressed);
+}
+
+// Debounce one full raw sample and dispatch every key whose debounced state changed
+static void matrix_process_raw(const uint32_t raw[MATRIX_ROWS])
+{
+    event_cycles = trace_cycles();
+    if (!debounce_update(raw, cooked, HAL_GetTick())) {
+        return;
+    }
+
+    for (uint8_t r = 0; r < MATRIX_ROWS; ++r)
+    {
+        uint32_t changed = cooked[r] ^ matrix_state[r];
+        if (changed == 0) {
+            continue;
+        }
+        matrix_state[r] = cooked[r];
+
+        // Visit only the keys that flipped, lowest column first
+        while (changed) {
+            uint8_t c = (uint8_t)__builtin_ctz(changed);
+            changed &= changed - 1u;
+            matrix_process_key(r, c, (uint8_t)((cooked[r] >> c) & 1u));
+        }
+    }
+}
+
+// Transpose one column's row bits into the per-row raw bitmaps
+static inline void matrix_store_column(uint32_t raw[MATRIX_ROWS], uint8_t c, uint32_t rows)
+{
+    for (uint8_t r = 0; r < MATRIX_ROWS; ++r) {
+        raw[r] |= ((rows >> r) & 1u) << c;
+    }
+}
+
+#if MATRIX_SCAN_BACKGROUND
+static uint32_t matrix_timer_clock_hz(void)
+{
+    uint32_t pclk1 = HAL_RCC_GetPCLK1Freq();
+    // APB1 timers run at twice PCLK1 whenever the APB1 prescaler divides
+    return (RCC->CFGR & RCC_CFGR_PPRE1_2) ? pclk1 * 2u : pclk1;
+}
+
+static bool matrix_single_port(const pin_t *pins, uint8_t count)
+{
+    for (uint8_t i = 1; i < count; ++i) {
+        if (pins[i].port != pins[0].port) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void matrix_bg_start(void)
+{
+    uint32_t ticks = matrix_timer_clock_hz() / ((uint32_t)MATRIX_SCAN_RATE_HZ * MATRIX_COLS);
+    uint32_t settle = (matrix_timer_clock_hz() / 1000000u) * MATRIX_SCAN_SETTLE_US;
+    if (ticks < 2u) {
+        return;
+    }
+    if (settle >= ticks - 1u) {
+        settle = ticks / 2u;
+    }
+
+    __HAL_RCC_TIM2_CLK_ENABLE();
+    TIM2->CR1 = 0;
+    TIM2->DIER = 0;
+    TIM2->PSC = 0;
+    TIM2->ARR = ticks - 1u;
+    TIM2->EGR = TIM_EGR_UG;
+    TIM2->SR = 0;
+
+    bg_write_frame = 0;
+    bg_column = 0;
+    bg_frames_done = 0;
+    bg_dma_laps = 0;
+    bg_read_seq = 0;
+
+    // DMA needs one column port (single BSRR target) and one row port (single IDR source)
+    if (matrix_single_port(matrix_cols, MATRIX_COLS) && matrix_single_port(matrix_rows, MATRIX_ROWS)) {
+        uint32_t all_cols = 0;
+        for (uint8_t c = 0; c < MATRIX_COLS; ++c) {
+            all_cols |= matrix_cols[c].pin;
+        }
+        for (uint8_t c = 0; c < MATRIX_COLS; ++c) {
+            bg_drive[c] = col_set_bits[c] | ((all_cols & ~col_set_bits[c]) << 16);
+        }
+
+        __HAL_RCC_DMAMUX1_CLK_ENABLE();
+        __HAL_RCC_DMA1_CLK_ENABLE();
+
+        // DMA1 CH1 / DMAMUX CH0: drive table -> column BSRR on every update event
+        DMA1_Channel1->CCR = 0;
+        DMA1_Channel1->CPAR = (uint32_t)&matrix_cols[0].port->BSRR;
+        DMA1_Channel1->CMAR = (uint32_t)bg_drive;
+        DMA1_Channel1->CNDTR = MATRIX_COLS;
+        DMAMUX1_Channel0->CCR = DMA_REQUEST_TIM2_UP;
+        DMA1_Channel1->CCR = DMA_CCR_DIR | DMA_CCR_MINC | DMA_CCR_CIRC |
+                             DMA_CCR_PSIZE_1 | DMA_CCR_MSIZE_1 | DMA_CCR_PL_1 | DMA_CCR_EN;
+
+        // DMA1 CH2 / DMAMUX CH1: row IDR -> capture frames on CC1, settle ticks after the drive
+        DMA1_Channel2->CCR = 0;
+        DMA1_Channel2->CPAR = (uint32_t)&matrix_rows[0].port->IDR;
+        DMA1_Channel2->CMAR = (uint32_t)bg_frames;
+        DMA1_Channel2->CNDTR = MATRIX_SCAN_FRAMES * MATRIX_COLS;
+        DMAMUX1_Channel1->CCR = DMA_REQUEST_TIM2_CH1;
+        // Transfer-complete interrupt counts buffer wraps so a lapped reader can be detected
+        DMA1_Channel2->CCR = DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_TCIE |
+                             DMA_CCR_PSIZE_1 | DMA_CCR_MSIZE_1 | DMA_CCR_PL_1 | DMA_CCR_EN;
+        HAL_NVIC_SetPriority(DMA1_Channel2_IRQn, 1, 0);
+        HAL_NVIC_EnableIRQ(DMA1_Channel2_IRQn);
+
+        TIM2->CCMR1 = 0;
+        TIM2->CCR1 = settle;
+        // Start past the compare point so the first request is a drive, not a sample
+        TIM2->CNT = settle + 1u;
+        TIM2->DIER = TIM_DIER_UDE | TIM_DIER_CC1DE;
+        scan_mode = MATRIX_SCAN_TIMER_DMA;
+    } else {
+        // Pins spread across ports: sample and step one column per update interrupt.
+        // The column stays driven for a whole tick, which doubles as settle time.
+        matrix_cols[0].port->BSRR = col_set_bits[0];
+        TIM2->DIER = TIM_DIER_UIE;
+        HAL_NVIC_SetPriority(TIM2_IRQn, 1, 0);
+        HAL_NVIC_EnableIRQ(TIM2_IRQn);
+        scan_mode = MATRIX_SCAN_TIMER_ISR;
+    }
+
+    TIM2->CR1 = TIM_CR1_CEN;
+}
+
+// Total frames completed since the scan started
+static uint32_t matrix_bg_frames_done(void)
+{
+    if (scan_mode == MATRIX_SCAN_TIMER_DMA) {
+        uint32_t laps;
+        uint32_t pos;
+        bool pending;
+        // Retry if the wrap interrupt ran in between, so the count and position belong together
+        do {
+            laps = bg_dma_laps;
+            pos = (MATRIX_SCAN_FRAMES * MATRIX_COLS) - DMA1_Channel2->CNDTR;
+            pending = (DMA1->ISR & DMA_ISR_TCIF2) != 0u;
+        } while (laps != bg_dma_laps);
+        // Wrapped but the transfer-complete interrupt has not run yet
+        if (pending && pos < (MATRIX_SCAN_FRAMES * MATRIX_COLS) / 2u) {
+            laps++;
+        }
+        return laps * MATRIX_SCAN_FRAMES + pos / MATRIX_COLS;
+    }
+    return bg_frames_done;
+}
+
+// Diff every snapshot completed since the last call
+static void matrix_scan_frames(void)
+{
+    uint32_t done = matrix_bg_frames_done();
+
+    // The frame being written shares a slot with the one MATRIX_SCAN_FRAMES behind it,
+    // so anything older than that has been overwritten
+    uint32_t behind = done - bg_read_seq;
+    if (behind > MATRIX_SCAN_FRAMES - 1u) {
+        uint32_t lost = behind - (MATRIX_SCAN_FRAMES - 1u);
+        bg_read_seq += lost;
+        bg_overruns += lost;
+        TRACE_WARN(MATRIX_SCAN_OVERRUN, lost, bg_overruns);
+    }
+
+    while (bg_read_seq != done) {
+        uint8_t frame = (uint8_t)(bg_read_seq % MATRIX_SCAN_FRAMES);
+        uint32_t snapshot[MATRIX_COLS];
+        for (uint8_t c = 0; c < MATRIX_COLS; ++c) {
+            snapshot[c] = bg_frames[frame][c];
+        }
+        bg_read_seq++;
+
+        uint32_t raw[MATRIX_ROWS] = {0};
+        for (uint8_t c = 0; c < MATRIX_COLS; ++c) {
+            uint32_t rows = (scan_mode == MATRIX_SCAN_TIMER_DMA)
+                                ? matrix_extract_rows(&snapshot[c])
+                                : snapshot[c];
+            matrix_store_column(raw, c, rows);
+        }
+        matrix_process_raw(raw);
+    }
+}
+#endif
+
+void matrix_timer_isr(void)
+{
+#if MATRIX_SCAN_BACKGROUND
+    if ((TIM2->SR & TIM_SR_UIF) == 0u) {
+        return;
+    }
+    TIM2->SR = ~TIM_SR_UIF;
+
+    uint8_t c = bg_column;
+    uint32_t idr[MATRIX_ROWS];
+    for (uint8_t p = 0; p < row_port_count; ++p) {
+        idr[p] = row_ports[p]->IDR;
+    }
+    matrix_cols[c].port->BSRR = col_reset_bits[c];
+    bg_frames[bg_write_frame][c] = matrix_extract_rows(idr);
+
+    if (++c == MATRIX_COLS) {
+        c = 0;
+        bg_write_frame = (uint8_t)((bg_write_frame + 1u) % MATRIX_SCAN_FRAMES);
+        bg_frames_done++;
+    }
+    bg_column = c;
+    matrix_cols[c].port->BSRR = col_set_bits[c];
+#endif
+}
+
+void matrix_dma_isr(void)
+{
+#if MATRIX_SCAN_BACKGROUND
+    if ((DMA1->ISR & DMA_ISR_TCIF2) != 0u) {
+        DMA1->IFCR = DMA_IFCR_CTCIF2;
+        bg_dma_laps++;
+    }
+#endif
+}
+
+uint32_t matrix_get_scan_overruns(void)
+{
+#if MATRIX_SCAN_BACKGROUND
+    return bg_overruns;
+#else
+    return 0;
+#endif
+}
+
 void matrix_init(void)
 {
     // Ensure GPIO clocks are enabled for ports we may use (safe default A..E)
@@ -48,54 +451,32 @@ void matrix_init(void)
             active_keycode_cache[r][c] = KC_NO;
         }
     }
+
+    matrix_build_scan_tables();
+    debounce_init();
+
+#if MATRIX_SCAN_BACKGROUND
+    matrix_bg_start();
+#endif
 }
 
 void matrix_scan(void)
 {
+#if MATRIX_SCAN_BACKGROUND
+    if (scan_mode != MATRIX_SCAN_POLL) {
+        matrix_scan_frames();
+        combo_task();
+        tap_hold_task();
+        return;
+    }
+#endif
+
     // Scan all columns in one call for better responsiveness
+    uint32_t raw[MATRIX_ROWS] = {0};
     for (uint8_t c = 0; c < MATRIX_COLS; ++c) {
-        // drive this column high
-        HAL_GPIO_WritePin(matrix_cols[c].port, matrix_cols[c].pin, GPIO_PIN_SET);
-        // minimal settle time for high-speed scanning
-        for (volatile int i = 0; i < 20; ++i) __NOP();
-
-        for (uint8_t r = 0; r < MATRIX_ROWS; ++r)
-        {
-            GPIO_PinState s = HAL_GPIO_ReadPin(matrix_rows[r].port, matrix_rows[r].pin);
-            uint8_t pressed = (s == GPIO_PIN_SET) ? 1 : 0;
-            if (pressed != state[r][c])
-            {
-                state[r][c] = pressed;
-                uint16_t kc = pressed ? keymap_get_active_keycode(r, c)
-                                      : active_keycode_cache[r][c];
-
-                if (pressed) {
-                    active_keycode_cache[r][c] = kc;
-                } else {
-                    active_keycode_cache[r][c] = KC_NO;
-                    if (kc == KC_NO) {
-                        kc = keymap_get_active_keycode(r, c);
-                    }
-                }
-
-                if (kc == KC_NO) {
-                    continue;
-                }
-
-                // Handle MIDI keycodes
-                midi_handle_keycode(kc, pressed);
-
-                uint8_t hid = 0;
-                bool should_send = keymap_translate_keycode(kc, pressed, &hid);
-
-                if (should_send && user_cb)
-                {
-                    user_cb(r, c, pressed, hid);
-                }
-            }
-        }
-
-        // release column quickly
-        HAL_GPIO_WritePin(matrix_cols[c].port, matrix_cols[c].pin, GPIO_PIN_RESET);
+        matrix_store_column(raw, c, matrix_read_column(c));
     }
+    matrix_process_raw(raw);
+    combo_task();
+    tap_hold_task();
 }
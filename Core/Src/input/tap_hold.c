@@ -0,0 +1,167 @@
+#include "tap_hold.h"
+#include "eeprom_emulation.h"
+#include "op_keycodes.h"
+#include <string.h>
+
+typedef struct {
+    uint8_t row;
+    uint8_t col;
+    uint8_t pressed;
+} tap_hold_event_t;
+
+// The one tap-hold key whose role is not decided yet. Only one key can be
+// pending at a time (everything after it is buffered), so a single deadline
+// is all the timer state needed.
+static struct {
+    bool active;
+    uint8_t row;
+    uint8_t col;
+    uint8_t flags;
+    uint16_t keycode;
+    uint16_t term_ms;
+    uint32_t start_ms;
+} tapping;
+
+static tap_hold_event_t buffer[TAP_HOLD_BUFFER_SIZE];
+static uint8_t buffer_count = 0;
+
+// Tap-hold keys currently acting as their hold action (bit c = column c)
+static uint32_t holding[MATRIX_ROWS];
+
+void tap_hold_get_key_config(uint8_t row, uint8_t col, uint16_t *tapping_term_ms, uint8_t *flags)
+{
+    uint16_t term = 0;
+    uint8_t key_flags = 0;
+
+    if (!eeprom_get_tap_hold_config(row, col, &term, &key_flags) || term == 0) {
+        if (!eeprom_get_tap_hold_config(EEPROM_TAP_HOLD_PROFILE, EEPROM_TAP_HOLD_PROFILE, &term, &key_flags) ||
+            term == 0) {
+            term = TAP_HOLD_TERM_MS;
+            key_flags = TAP_HOLD_FLAGS;
+        }
+    }
+
+    *tapping_term_ms = term;
+    *flags = key_flags & TAP_HOLD_FLAGS_MASK;
+}
+
+static void tap_hold_send_hold(uint8_t row, uint8_t col, uint16_t keycode, uint8_t pressed)
+{
+    if (IS_OP_LAYER_TAP(keycode)) {
+        matrix_dispatch_keycode(row, col, OP_MO_LAYER(OP_LAYER_TAP_LAYER(keycode)), pressed);
+        return;
+    }
+
+    uint8_t mods = OP_MOD_TAP_MODS(keycode);
+    uint16_t base = (mods & OP_MOD_RIGHT) ? (KC_LEFT_CTRL + 4) : KC_LEFT_CTRL;
+    for (uint8_t bit = 0; bit < 4; ++bit) {
+        if (mods & (1U << bit)) {
+            matrix_dispatch_keycode(row, col, (uint16_t)(base + bit), pressed);
+        }
+    }
+}
+
+// Settle the pending key, then feed the buffered events back through the matrix
+// so they see the layer/modifier state the decision produced
+static void tap_hold_resolve(bool hold)
+{
+    tap_hold_event_t pending[TAP_HOLD_BUFFER_SIZE];
+    uint8_t count = buffer_count;
+    uint8_t row = tapping.row;
+    uint8_t col = tapping.col;
+    uint16_t keycode = tapping.keycode;
+
+    memcpy(pending, buffer, count * sizeof(tap_hold_event_t));
+    buffer_count = 0;
+    tapping.active = false;
+
+    if (hold) {
+        holding[row] |= (1UL << col);
+        tap_hold_send_hold(row, col, keycode, 1);
+    } else {
+        matrix_dispatch_keycode(row, col, OP_TAP_HOLD_TAP_KEY(keycode), 1);
+    }
+
+    for (uint8_t i = 0; i < count; ++i) {
+        matrix_process_key(pending[i].row, pending[i].col, pending[i].pressed);
+    }
+
+    if (!hold) {
+        matrix_dispatch_keycode(row, col, OP_TAP_HOLD_TAP_KEY(keycode), 0);
+    }
+}
+
+// A buffered release only counts for permissive hold if its press came after the tap-hold key
+static bool tap_hold_press_buffered(uint8_t row, uint8_t col)
+{
+    for (uint8_t i = 0; i < buffer_count; ++i) {
+        if (buffer[i].row == row && buffer[i].col == col && buffer[i].pressed) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool tap_hold_release_buffered(uint8_t row, uint8_t col)
+{
+    for (uint8_t i = 0; i < buffer_count; ++i) {
+        if (buffer[i].row == row && buffer[i].col == col && !buffer[i].pressed) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool tap_hold_process_key(uint8_t row, uint8_t col, uint16_t keycode, uint8_t pressed)
+{
+    // Plain keys with nothing pending never touch the engine
+    if (!tapping.active && !IS_OP_TAP_HOLD(keycode)) {
+        return false;
+    }
+
+    if (tapping.active) {
+        if (row == tapping.row && col == tapping.col) {
+            if (!pressed) {
+                tap_hold_resolve(false);
+            }
+            return true;
+        }
+
+        if (buffer_count == TAP_HOLD_BUFFER_SIZE) {
+            tap_hold_resolve(true);
+            matrix_process_key(row, col, pressed);
+            return true;
+        }
+
+        bool decide_hold = pressed ? (tapping.flags & TAP_HOLD_HOLD_ON_OTHER_KEY_PRESS)
+                                   : ((tapping.flags & TAP_HOLD_PERMISSIVE_HOLD) && tap_hold_press_buffered(row, col));
+        buffer[buffer_count++] = (tap_hold_event_t){ row, col, pressed };
+        if (decide_hold) {
+            tap_hold_resolve(true);
+        }
+        return true;
+    }
+
+    if (!pressed) {
+        if (holding[row] & (1UL << col)) {
+            holding[row] &= ~(1UL << col);
+            tap_hold_send_hold(row, col, keycode, 0);
+        }
+        return true;
+    }
+
+    tapping.active = true;
+    tapping.row = row;
+    tapping.col = col;
+    tapping.keycode = keycode;
+    tapping.start_ms = HAL_GetTick();
+    tap_hold_get_key_config(row, col, &tapping.term_ms, &tapping.flags);
+    return true;
+}
+
+void tap_hold_task(void)
+{
+    if (tapping.active && (uint32_t)(HAL_GetTick() - tapping.start_ms) >= tapping.term_ms) {
+        tap_hold_resolve(true);
+    }
+}
@@ -0,0 +1,80 @@
+#include "latency.h"
+#include "stm32g4xx.h"
+
+#include <string.h>
+
+typedef struct {
+    uint32_t count;
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+    uint64_t total_cycles;
+    uint32_t bins[LATENCY_BIN_COUNT];   // Last bin collects everything beyond the range
+} latency_histogram_t;
+
+static latency_histogram_t histograms[LATENCY_SRC_COUNT];
+
+static uint32_t latency_cycles_to_us(uint32_t cycles)
+{
+    uint32_t per_us = SystemCoreClock / 1000000U;
+    return per_us ? (cycles / per_us) : cycles;
+}
+
+void latency_record(uint8_t source, uint32_t cycles)
+{
+    if (source >= LATENCY_SRC_COUNT) {
+        return;
+    }
+
+    latency_histogram_t *h = &histograms[source];
+    if (h->count == 0U || cycles < h->min_cycles) {
+        h->min_cycles = cycles;
+    }
+    if (cycles > h->max_cycles) {
+        h->max_cycles = cycles;
+    }
+    h->count++;
+    h->total_cycles += cycles;
+
+    uint32_t bin = latency_cycles_to_us(cycles) / LATENCY_BIN_US;
+    if (bin >= LATENCY_BIN_COUNT) {
+        bin = LATENCY_BIN_COUNT - 1U;
+    }
+    h->bins[bin]++;
+}
+
+bool latency_get_stats(uint8_t source, latency_stats_t *stats)
+{
+    if (source >= LATENCY_SRC_COUNT || stats == NULL) {
+        return false;
+    }
+
+    const latency_histogram_t *h = &histograms[source];
+    memset(stats, 0, sizeof(*stats));
+    stats->count = h->count;
+    if (h->count == 0U) {
+        return true;
+    }
+
+    stats->min_us = latency_cycles_to_us(h->min_cycles);
+    stats->max_us = latency_cycles_to_us(h->max_cycles);
+    stats->avg_us = latency_cycles_to_us((uint32_t)(h->total_cycles / h->count));
+
+    // Upper edge of the bin holding the 99th percentile, capped at the max
+    uint32_t target = h->count - (h->count / 100U);
+    uint32_t seen = 0;
+    stats->p99_us = stats->max_us;
+    for (uint32_t b = 0; b < LATENCY_BIN_COUNT - 1U; b++) {
+        seen += h->bins[b];
+        if (seen >= target) {
+            uint32_t edge = (b + 1U) * LATENCY_BIN_US;
+            stats->p99_us = (edge < stats->max_us) ? edge : stats->max_us;
+            break;
+        }
+    }
+    return true;
+}
+
+void latency_reset(void)
+{
+    memset(histograms, 0, sizeof(histograms));
+}
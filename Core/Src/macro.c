@@ -0,0 +1,389 @@
+#include "macro.h"
+#include "key_state.h"
+#include "eeprom_emulation.h"
+#include "usb_app.h"
+#include "class/hid/hid.h"
+#include "stm32g4xx_hal.h"
+
+#include <string.h>
+
+// Playback packs consecutive keys that share a modifier into one report and
+// only sends a release report in between when a key repeats. A report that
+// releases one set of keys and presses another types the new keys, so "abc"
+// costs one report instead of six. Hosts apply the modifier byte before the
+// keys of the same report, so a modifier change rides along with the next keys.
+//
+// Keys within a frame must ascend in usage order: hosts scan the NKRO bitmap
+// (and mostly the boot array) in ascending order, so that is the order they see
+// the presses in. Ordinary words rarely ascend for long, so prose packs to one
+// report per one or two characters ("hello world" takes 9 reports, not 22).
+// Pressing the out-of-order keys in later reports without releasing the earlier
+// ones would not help: each report still adds one ascending run, and keys held
+// longer make a repeat, which needs a release report, more likely.
+
+#define MACRO_SHIFT 0x80U  // Table flag: character needs left shift
+
+static const uint8_t ascii_usage[128] = {
+    ['\t'] = HID_KEY_TAB,                 ['\n'] = HID_KEY_ENTER,
+    [' '] = HID_KEY_SPACE,                ['0'] = HID_KEY_0,
+    ['-'] = HID_KEY_MINUS,                ['_'] = MACRO_SHIFT | HID_KEY_MINUS,
+    ['='] = HID_KEY_EQUAL,                ['+'] = MACRO_SHIFT | HID_KEY_EQUAL,
+    ['['] = HID_KEY_BRACKET_LEFT,         ['{'] = MACRO_SHIFT | HID_KEY_BRACKET_LEFT,
+    [']'] = HID_KEY_BRACKET_RIGHT,        ['}'] = MACRO_SHIFT | HID_KEY_BRACKET_RIGHT,
+    ['\\'] = HID_KEY_BACKSLASH,           ['|'] = MACRO_SHIFT | HID_KEY_BACKSLASH,
+    [';'] = HID_KEY_SEMICOLON,            [':'] = MACRO_SHIFT | HID_KEY_SEMICOLON,
+    ['\''] = HID_KEY_APOSTROPHE,          ['"'] = MACRO_SHIFT | HID_KEY_APOSTROPHE,
+    ['`'] = HID_KEY_GRAVE,                ['~'] = MACRO_SHIFT | HID_KEY_GRAVE,
+    [','] = HID_KEY_COMMA,                ['<'] = MACRO_SHIFT | HID_KEY_COMMA,
+    ['.'] = HID_KEY_PERIOD,               ['>'] = MACRO_SHIFT | HID_KEY_PERIOD,
+    ['/'] = HID_KEY_SLASH,                ['?'] = MACRO_SHIFT | HID_KEY_SLASH,
+    ['!'] = MACRO_SHIFT | HID_KEY_1,      ['@'] = MACRO_SHIFT | HID_KEY_2,
+    ['#'] = MACRO_SHIFT | HID_KEY_3,      ['$'] = MACRO_SHIFT | HID_KEY_4,
+    ['%'] = MACRO_SHIFT | HID_KEY_5,      ['^'] = MACRO_SHIFT | HID_KEY_6,
+    ['&'] = MACRO_SHIFT | HID_KEY_7,      ['*'] = MACRO_SHIFT | HID_KEY_8,
+    ['('] = MACRO_SHIFT | HID_KEY_9,      [')'] = MACRO_SHIFT | HID_KEY_0,
+};
+
+// Keys one report will press
+typedef struct {
+    uint8_t modifier;
+    uint8_t count;
+    uint8_t usages[MACRO_FRAME_KEYS];
+    uint16_t length;        // Source bytes the frame covers
+} macro_frame_t;
+
+static uint8_t text_queue[MACRO_TEXT_QUEUE_SIZE];
+static uint16_t text_head = 0;
+static uint16_t text_count = 0;
+
+// Playing macro: position in the macro area of the active profile
+static bool program = false;
+static uint16_t program_pos = 0;
+
+static bool delaying = false;
+static uint32_t delay_until = 0;
+
+// Usages pressed by the last frame, and usages held by MACRO_DOWN
+static uint32_t typed[8];
+static uint8_t typed_count = 0;
+static uint32_t held[8];
+
+bool macro_ascii_to_hid(uint8_t ascii, uint8_t *modifier, uint8_t *keycode)
+{
+    uint8_t entry = 0;
+
+    if (ascii >= 'a' && ascii <= 'z') {
+        entry = (uint8_t)(HID_KEY_A + (ascii - 'a'));
+    } else if (ascii >= 'A' && ascii <= 'Z') {
+        entry = (uint8_t)(MACRO_SHIFT | (HID_KEY_A + (ascii - 'A')));
+    } else if (ascii >= '1' && ascii <= '9') {
+        entry = (uint8_t)(HID_KEY_1 + (ascii - '1'));
+    } else if (ascii < sizeof(ascii_usage)) {
+        entry = ascii_usage[ascii];
+    }
+
+    *modifier = (entry & MACRO_SHIFT) ? KEYBOARD_MODIFIER_LEFTSHIFT : 0U;
+    *keycode = (uint8_t)(entry & ~MACRO_SHIFT);
+    return *keycode != 0U;
+}
+
+static uint8_t macro_item_length(uint8_t op)
+{
+    switch (op) {
+        case MACRO_TAP:
+        case MACRO_DOWN:
+        case MACRO_UP:
+            return 2;
+        case MACRO_DELAY:
+            return 3;
+        default:
+            return 1;
+    }
+}
+
+// Byte of the macro area, or -1 past its end
+static int16_t macro_program_byte(uint32_t pos)
+{
+    uint8_t byte = 0;
+    if (pos >= EEPROM_MACRO_BYTES || !eeprom_get_macro_data((uint16_t)pos, &byte, 1)) {
+        return -1;
+    }
+    return byte;
+}
+
+// Byte i of the current source, or -1 past what is available
+static int16_t macro_peek(uint16_t i)
+{
+    if (program) {
+        return macro_program_byte((uint32_t)program_pos + i);
+    }
+    if (i < text_count) {
+        return text_queue[(text_head + i) % MACRO_TEXT_QUEUE_SIZE];
+    }
+    return -1;
+}
+
+static void macro_consume(uint16_t length)
+{
+    if (program) {
+        program_pos = (uint16_t)(program_pos + length);
+        return;
+    }
+    text_head = (uint16_t)((text_head + length) % MACRO_TEXT_QUEUE_SIZE);
+    text_count = (uint16_t)(text_count - length);
+}
+
+static bool bitmap_test(const uint32_t bitmap[8], uint8_t usage)
+{
+    return (bitmap[usage >> 5] & (1UL << (usage & 31U))) != 0U;
+}
+
+static void macro_press(uint32_t bitmap[8], uint8_t usage)
+{
+    bitmap[usage >> 5] |= (1UL << (usage & 31U));
+    key_state_add_key(usage);
+}
+
+static void macro_release(uint32_t bitmap[8], uint8_t usage)
+{
+    bitmap[usage >> 5] &= ~(1UL << (usage & 31U));
+    key_state_remove_key(usage);
+}
+
+static void macro_release_all(uint32_t bitmap[8])
+{
+    for (uint8_t w = 0; w < 8U; w++) {
+        while (bitmap[w]) {
+            macro_release(bitmap, (uint8_t)((w << 5) | (uint8_t)__builtin_ctz(bitmap[w])));
+        }
+    }
+}
+
+static void macro_release_typed(void)
+{
+    macro_release_all(typed);
+    typed_count = 0;
+}
+
+// Collect the typed keys that can go out in one report: same modifier,
+// ascending usages, at most MACRO_FRAME_KEYS
+static void macro_gather(macro_frame_t *frame)
+{
+    uint8_t last = 0;
+
+    frame->modifier = 0;
+    frame->count = 0;
+    frame->length = 0;
+
+    while (frame->count < MACRO_FRAME_KEYS) {
+        int16_t byte = macro_peek(frame->length);
+        uint8_t modifier = 0;
+        uint8_t usage = 0;
+        uint8_t used = 1;
+
+        if (byte >= 0x01 && byte <= 0x7F) {
+            if (!macro_ascii_to_hid((uint8_t)byte, &modifier, &usage)) {
+                frame->length++;    // Nothing to type for this character
+                continue;
+            }
+        } else if (!program && byte >= 0) {
+            frame->length++;        // Queued text is plain characters; other bytes type nothing
+            continue;
+        } else if (byte == MACRO_TAP) {
+            int16_t operand = macro_peek((uint16_t)(frame->length + 1U));
+            if (operand <= 0) {
+                break;
+            }
+            usage = (uint8_t)operand;
+            used = 2;
+        } else {
+            break;
+        }
+
+        if (frame->count > 0 && (modifier != frame->modifier || usage <= last)) {
+            break;
+        }
+
+        frame->modifier = modifier;
+        frame->usages[frame->count++] = usage;
+        frame->length = (uint16_t)(frame->length + used);
+        last = usage;
+    }
+}
+
+static void macro_finish(void)
+{
+    macro_release_typed();
+    macro_release_all(held);
+    program = false;
+    delaying = false;
+}
+
+static void macro_run_op(void)
+{
+    int16_t op = macro_peek(0);
+    int16_t operand = macro_peek(1);
+
+    if (op < 0 || op == MACRO_END) {
+        macro_finish();
+        return;
+    }
+
+    switch (op) {
+        case MACRO_TAP:
+            // Only a tap of usage 0 gets here (macro_gather types the others); it types nothing
+            break;
+        case MACRO_DOWN:
+            if (operand > 0 && !bitmap_test(held, (uint8_t)operand)) {
+                macro_press(held, (uint8_t)operand);
+            }
+            break;
+        case MACRO_UP:
+            if (operand > 0 && bitmap_test(held, (uint8_t)operand)) {
+                macro_release(held, (uint8_t)operand);
+            }
+            break;
+        case MACRO_DELAY: {
+            int16_t high = macro_peek(2);
+            if (operand < 0 || high < 0) {
+                macro_finish();
+                return;
+            }
+            delay_until = HAL_GetTick() + (uint32_t)(operand | (high << 8));
+            delaying = true;
+            break;
+        }
+        default:
+            usb_app_cdc_printf("Macro: Unknown op 0x%02X, stopping\r\n", (unsigned)op);
+            macro_finish();
+            return;
+    }
+
+    macro_consume(macro_item_length((uint8_t)op));
+}
+
+// One step changes the key state at most once, i.e. produces at most one report
+static void macro_step(void)
+{
+    macro_frame_t frame;
+    macro_gather(&frame);
+
+    if (frame.count > 0) {
+        if (typed_count > 0) {
+            bool repeat = false;
+            for (uint8_t i = 0; i < frame.count && !repeat; i++) {
+                repeat = bitmap_test(typed, frame.usages[i]);
+            }
+            if (repeat) {
+                macro_release_typed();
+                return;
+            }
+            macro_release_typed();
+        }
+
+        // Modifiers are usages 0xE0-0xE7, one per bit of the modifier byte
+        for (uint8_t bit = 0; bit < 8U; bit++) {
+            if (frame.modifier & (1U << bit)) {
+                macro_press(typed, (uint8_t)(HID_KEY_CONTROL_LEFT + bit));
+            }
+        }
+        for (uint8_t i = 0; i < frame.count; i++) {
+            macro_press(typed, frame.usages[i]);
+        }
+        typed_count = frame.count;
+        macro_consume(frame.length);
+        return;
+    }
+
+    if (frame.length > 0) {
+        macro_consume(frame.length);
+        return;
+    }
+
+    if (typed_count > 0) {
+        macro_release_typed();
+        return;
+    }
+
+    if (program) {
+        macro_run_op();
+    }
+}
+
+void macro_task(void)
+{
+    if (!program && text_count == 0U && typed_count == 0U) {
+        return;
+    }
+
+    // Pace playback to the host: the next step waits until the last report is on its way
+    if (key_state_report_pending()) {
+        return;
+    }
+
+    if (delaying) {
+        if ((int32_t)(HAL_GetTick() - delay_until) < 0) {
+            return;
+        }
+        delaying = false;
+    }
+
+    macro_step();
+    key_state_update_hid_report();
+}
+
+bool macro_play(uint8_t index)
+{
+    if (program) {
+        usb_app_cdc_printf("Macro: %u dropped, another macro is playing\r\n", index);
+        return false;
+    }
+
+    uint16_t pos = 0;
+    for (uint8_t n = 0; n < index; ) {
+        int16_t op = macro_program_byte(pos);
+        if (op < 0) {
+            return false;
+        }
+        if (op == MACRO_END) {
+            n++;
+            pos++;
+        } else {
+            pos = (uint16_t)(pos + macro_item_length((uint8_t)op));
+        }
+    }
+
+    int16_t op = macro_program_byte(pos);
+    if (op < 0 || op == MACRO_END) {
+        return false;
+    }
+
+    // Queued text pauses while the macro plays and resumes after it
+    program = true;
+    program_pos = pos;
+    return true;
+}
+
+bool macro_queue_char(uint8_t ascii)
+{
+    if (text_count == MACRO_TEXT_QUEUE_SIZE) {
+        return false;
+    }
+
+    text_queue[(text_head + text_count) % MACRO_TEXT_QUEUE_SIZE] = ascii;
+    text_count++;
+    return true;
+}
+
+void macro_stop(void)
+{
+    text_head = 0;
+    text_count = 0;
+    macro_finish();
+    key_state_update_hid_report();
+}
+
+bool macro_busy(void)
+{
+    return program || text_count != 0U || typed_count != 0U;
+}
@@ -37,6 +37,8 @@
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
 #include "usb_app.h"
+#include "trace.h"
+#include "latency.h"
 #include "input/matrix.h"
 #include "input/encoder.h"
 #include "input/keymap.h"
@@ -47,6 +49,7 @@
 #include "pin_config.h"
 #include "i2c.h"
 #include "i2c_manager.h"
+#include "eeprom_emulation.h"
 #include "tusb.h"
 #include "ws2812.h"
 #ifndef USB_DEMO_ENABLE_MOUSE
@@ -90,8 +93,7 @@ static ws2812_strip_t led_strip;
 static void matrix_cb(uint8_t row, uint8_t col, uint8_t pressed, uint8_t keycode)
 {
   // Debug output for key detection
-  usb_app_cdc_printf("Key %s: row=%d, col=%d, keycode=0x%02X\r\n", 
-               pressed ? "PRESSED" : "RELEASED", row, col, keycode);
+  TRACE_INFO(KEY_EVENT, pressed ? TRACE_STR_PRESSED : TRACE_STR_RELEASED, row, col, keycode);
   
   // No visual feedback on LED strip to avoid flashing
   // (LEDs will maintain their master/slave status colors)
@@ -99,7 +101,8 @@ static void matrix_cb(uint8_t row, uint8_t col, uint8_t pressed, uint8_t keycode
   (void)row; (void)col; // unused in this simple handler
   if (keycode == 0) return;
 
-  i2c_manager_process_local_key_event(row, col, pressed, keycode);
+  i2c_manager_process_local_key_event(row, col, pressed, keycode,
+                                      LATENCY_SRC_MATRIX, matrix_get_event_cycles());
 }
 
 static void ws2812_apply_mode(uint8_t master_mode)
@@ -161,6 +164,7 @@ int main(void)
   MX_GPIO_Init();
   MX_I2C2_Init();
   /* USER CODE BEGIN 2 */
+  trace_init();
   usb_app_init();
   key_state_init();
   encoder_init();
@@ -237,6 +241,9 @@ int main(void)
     // Additional I2C task processing
     i2c_manager_task();
 
+    // Advance background EEPROM writes
+    eeprom_task();
+
 #if USB_DEMO_ENABLE_MOUSE || USB_DEMO_ENABLE_MIDI
     // USB demo code here if enabled
 #endif
@@ -25,6 +25,8 @@
 #include "tusb.h"
 #include "i2c_manager.h"
 #include "i2c.h"
+#include "matrix.h"
+#include "encoder.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -246,5 +248,45 @@ void I2C2_ER_IRQHandler(void)
   /* USER CODE END I2C2_ER_IRQn 1 */
 }
 
+/**
+  * @brief This function handles TIM2 global interrupt (background matrix scan).
+  */
+void TIM2_IRQHandler(void)
+{
+  matrix_timer_isr();
+}
+
+/**
+  * @brief This function handles DMA1 channel 2 global interrupt (matrix capture wraps).
+  */
+void DMA1_Channel2_IRQHandler(void)
+{
+  matrix_dma_isr();
+}
+
+/**
+  * @brief This function handles TIM7 global interrupt (background encoder sampling).
+  */
+void TIM7_DAC_IRQHandler(void)
+{
+  encoder_timer_isr();
+}
+
+/**
+  * @brief This function handles flash global interrupt (EEPROM erase/program completion).
+  */
+void FLASH_IRQHandler(void)
+{
+  HAL_FLASH_IRQHandler();
+}
+
+/**
+  * @brief This function handles PVD interrupt (brown-out warning, commits EEPROM changes).
+  */
+void PVD_PVM_IRQHandler(void)
+{
+  HAL_PWREx_PVD_PVM_IRQHandler();
+}
+
 /* USER CODE END 1 */
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
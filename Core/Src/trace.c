@@ -0,0 +1,51 @@
+#include "trace.h"
+#include "cdc_log.h"
+
+#include <string.h>
+
+#ifndef TRACE_DEFAULT_ENABLED
+#define TRACE_DEFAULT_ENABLED 1
+#endif
+
+static volatile bool trace_enabled = TRACE_DEFAULT_ENABLED;
+
+void trace_init(void)
+{
+    // DWT cycle counter: timestamps for trace records and latency measurements
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+void trace_set_enabled(bool enabled)
+{
+    trace_enabled = enabled;
+}
+
+bool trace_is_enabled(void)
+{
+    return trace_enabled;
+}
+
+void trace_emit(uint8_t id, uint8_t nargs, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    if (!trace_enabled) {
+        return;
+    }
+
+    uint8_t record[7 + 4 * TRACE_MAX_ARGS];
+    uint32_t cycles = DWT->CYCCNT;
+    uint32_t args[TRACE_MAX_ARGS] = { a0, a1, a2, a3 };
+
+    if (nargs > TRACE_MAX_ARGS) {
+        nargs = TRACE_MAX_ARGS;
+    }
+
+    record[0] = TRACE_SYNC_BYTE;
+    record[1] = id;
+    record[2] = nargs;
+    memcpy(&record[3], &cycles, sizeof(cycles));
+    memcpy(&record[7], args, 4U * nargs);
+
+    cdc_log_write_record(record, (uint16_t)(7U + 4U * nargs));
+}
@@ -6,6 +6,10 @@
 #include "class/cdc/cdc_device.h"
 #include "class/midi/midi_device.h"
 #include "config_protocol.h"
+#include "cdc_log.h"
+#include "key_state.h"
+#include "eeprom_emulation.h"
+#include "macro.h"
 
 #include "stm32g4xx_hal.h"
 
@@ -15,21 +19,10 @@
 #include <stdarg.h>
 #include <stdio.h>
 
-#define HID_QUEUE_SIZE     64U
-#define HID_QUEUE_MASK     (HID_QUEUE_SIZE - 1U)
-
-static uint8_t hid_queue[HID_QUEUE_SIZE];
-static uint16_t hid_queue_head;
-static uint16_t hid_queue_tail;
-static bool keyboard_pending_release;
 static bool cdc_line_active;
 static bool cdc_last_char_cr;
 static void cdc_task(void);
-static void hid_task(void);
 static void midi_task(void);
-static bool hid_queue_push(uint8_t value);
-static bool hid_queue_pop(uint8_t *value);
-static bool ascii_to_hid(uint8_t ascii, uint8_t *modifier, uint8_t *keycode);
 static bool midi_write_packet(uint8_t const packet[4]);
 
 void usb_app_init(void)
@@ -55,7 +48,8 @@ void usb_app_task(void)
 {
 	tud_task();
 	cdc_task();
-	hid_task();
+	cdc_log_task();
+	macro_task();
 	midi_task();
 	config_protocol_task();
 }
@@ -74,9 +68,9 @@ static void cdc_task(void)
 
 	if (!cdc_line_active)
 	{
+		static const char banner[] = "TinyUSB composite CDC + Keyboard + Mouse + MIDI ready.\r\n";
 		cdc_line_active = true;
-		tud_cdc_write_str("TinyUSB composite CDC + Keyboard + Mouse + MIDI ready.\r\n");
-		tud_cdc_write_flush();
+		cdc_log_write(banner, (uint16_t) (sizeof(banner) - 1U));
 	}
 
 	uint8_t buf[64];
@@ -96,7 +90,7 @@ static void cdc_task(void)
 
 		if (ch == '\r')
 		{
-			hid_queue_push('\n');
+			macro_queue_char('\n');
 			cdc_last_char_cr = true;
 			continue;
 		}
@@ -108,46 +102,7 @@ static void cdc_task(void)
 		}
 
 		cdc_last_char_cr = false;
-		hid_queue_push(ch);
-	}
-}
-
-//--------------------------------------------------------------------+
-// HID task
-//--------------------------------------------------------------------+
-
-// HID Task: Processes keyboard events and sends reports
-// With 8 kHz USB polling (CFG_TUD_HID_POLL_INTERVAL = 1), the host polls
-// every 125 µs. TinyUSB handles the timing automatically; we just need to
-// ensure the report buffer is updated with the current state.
-static void hid_task(void)
-{
-	if (keyboard_pending_release && tud_hid_n_ready(0))
-	{
-		tud_hid_n_keyboard_report(0, 0, 0, NULL);
-		keyboard_pending_release = false;
-	}
-
-	if (tud_hid_n_ready(0) && !keyboard_pending_release)
-	{
-		uint8_t ascii;
-		while (hid_queue_pop(&ascii))
-		{
-			uint8_t modifier = 0;
-			uint8_t keycode = 0;
-
-			if (!ascii_to_hid(ascii, &modifier, &keycode))
-			{
-				continue;
-			}
-
-			uint8_t keycodes[6] = { keycode, 0, 0, 0, 0, 0 };
-			if (tud_hid_n_keyboard_report(0, 0, modifier, keycodes))
-			{
-				keyboard_pending_release = true;
-				break;
-			}
-		}
+		macro_queue_char(ch);
 	}
 }
 
@@ -169,193 +124,6 @@ static void midi_task(void)
 	}
 }
 
-//--------------------------------------------------------------------+
-// Queue helpers
-//--------------------------------------------------------------------+
-
-static bool hid_queue_push(uint8_t value)
-{
-	uint16_t next = (uint16_t) ((hid_queue_head + 1U) & HID_QUEUE_MASK);
-
-	if (next == hid_queue_tail)
-	{
-		return false;
-	}
-
-	hid_queue[hid_queue_head] = value;
-	hid_queue_head = next;
-	return true;
-}
-
-static bool hid_queue_pop(uint8_t *value)
-{
-	if (hid_queue_head == hid_queue_tail)
-	{
-		return false;
-	}
-
-	*value = hid_queue[hid_queue_tail];
-	hid_queue_tail = (uint16_t) ((hid_queue_tail + 1U) & HID_QUEUE_MASK);
-	return true;
-}
-
-//--------------------------------------------------------------------+
-// ASCII to HID conversion
-//--------------------------------------------------------------------+
-
-static bool ascii_to_hid(uint8_t ascii, uint8_t *modifier, uint8_t *keycode)
-{
-	*modifier = 0;
-	*keycode = 0;
-
-	if (ascii >= 'a' && ascii <= 'z')
-	{
-		*keycode = (uint8_t) (HID_KEY_A + (ascii - 'a'));
-		return true;
-	}
-
-	if (ascii >= 'A' && ascii <= 'Z')
-	{
-		*modifier = KEYBOARD_MODIFIER_LEFTSHIFT;
-		*keycode = (uint8_t) (HID_KEY_A + (ascii - 'A'));
-		return true;
-	}
-
-	if (ascii >= '1' && ascii <= '9')
-	{
-		*keycode = (uint8_t) (HID_KEY_1 + (ascii - '1'));
-		return true;
-	}
-
-	switch (ascii)
-	{
-		case '0':
-			*keycode = HID_KEY_0;
-			return true;
-		case '\n':
-			*keycode = HID_KEY_ENTER;
-			return true;
-		case '\t':
-			*keycode = HID_KEY_TAB;
-			return true;
-		case ' ':
-			*keycode = HID_KEY_SPACE;
-			return true;
-		case '-':
-			*keycode = HID_KEY_MINUS;
-			return true;
-		case '_':
-			*modifier = KEYBOARD_MODIFIER_LEFTSHIFT;
-			*keycode = HID_KEY_MINUS;
-			return true;
-		case '=':
-			*keycode = HID_KEY_EQUAL;
-			return true;
-		case '+':
-			*modifier = KEYBOARD_MODIFIER_LEFTSHIFT;
-			*keycode = HID_KEY_EQUAL;
-			return true;
-		case '[':
-			*keycode = HID_KEY_BRACKET_LEFT;
-			return true;
-		case '{':
-			*modifier = KEYBOARD_MODIFIER_LEFTSHIFT;
-			*keycode = HID_KEY_BRACKET_LEFT;
-			return true;
-		case ']':
-			*keycode = HID_KEY_BRACKET_RIGHT;
-			return true;
-		case '}':
-			*modifier = KEYBOARD_MODIFIER_LEFTSHIFT;
-			*keycode = HID_KEY_BRACKET_RIGHT;
-			return true;
-		case ';':
-			*keycode = HID_KEY_SEMICOLON;
-			return true;
-		case ':':
-			*modifier = KEYBOARD_MODIFIER_LEFTSHIFT;
-			*keycode = HID_KEY_SEMICOLON;
-			return true;
-		case '\'':
-			*keycode = HID_KEY_APOSTROPHE;
-			return true;
-		case '"':
-			*modifier = KEYBOARD_MODIFIER_LEFTSHIFT;
-			*keycode = HID_KEY_APOSTROPHE;
-			return true;
-		case '`':
-			*keycode = HID_KEY_GRAVE;
-			return true;
-		case '~':
-			*modifier = KEYBOARD_MODIFIER_LEFTSHIFT;
-			*keycode = HID_KEY_GRAVE;
-			return true;
-		case ',':
-			*keycode = HID_KEY_COMMA;
-			return true;
-		case '<':
-			*modifier = KEYBOARD_MODIFIER_LEFTSHIFT;
-			*keycode = HID_KEY_COMMA;
-			return true;
-		case '.':
-			*keycode = HID_KEY_PERIOD;
-			return true;
-		case '>':
-			*modifier = KEYBOARD_MODIFIER_LEFTSHIFT;
-			*keycode = HID_KEY_PERIOD;
-			return true;
-		case '/':
-			*keycode = HID_KEY_SLASH;
-			return true;
-		case '?':
-			*modifier = KEYBOARD_MODIFIER_LEFTSHIFT;
-			*keycode = HID_KEY_SLASH;
-			return true;
-		case '!':
-			*modifier = KEYBOARD_MODIFIER_LEFTSHIFT;
-			*keycode = HID_KEY_1;
-			return true;
-		case '@':
-			*modifier = KEYBOARD_MODIFIER_LEFTSHIFT;
-			*keycode = HID_KEY_2;
-			return true;
-		case '#':
-			*modifier = KEYBOARD_MODIFIER_LEFTSHIFT;
-			*keycode = HID_KEY_3;
-			return true;
-		case '$':
-			*modifier = KEYBOARD_MODIFIER_LEFTSHIFT;
-			*keycode = HID_KEY_4;
-			return true;
-		case '%':
-			*modifier = KEYBOARD_MODIFIER_LEFTSHIFT;
-			*keycode = HID_KEY_5;
-			return true;
-		case '^':
-			*modifier = KEYBOARD_MODIFIER_LEFTSHIFT;
-			*keycode = HID_KEY_6;
-			return true;
-		case '&':
-			*modifier = KEYBOARD_MODIFIER_LEFTSHIFT;
-			*keycode = HID_KEY_7;
-			return true;
-		case '*':
-			*modifier = KEYBOARD_MODIFIER_LEFTSHIFT;
-			*keycode = HID_KEY_8;
-			return true;
-		case '(':
-			*modifier = KEYBOARD_MODIFIER_LEFTSHIFT;
-			*keycode = HID_KEY_9;
-			return true;
-		case ')':
-			*modifier = KEYBOARD_MODIFIER_LEFTSHIFT;
-			*keycode = HID_KEY_0;
-			return true;
-		default:
-			return false;
-	}
-}
-
 //--------------------------------------------------------------------+
 // Public helpers
 //--------------------------------------------------------------------+
@@ -419,22 +187,21 @@ bool usb_app_midi_send_cc(uint8_t channel, uint8_t controller, uint8_t value)
 
 void tud_mount_cb(void)
 {
-	hid_queue_head = 0;
-	hid_queue_tail = 0;
-	keyboard_pending_release = false;
+	macro_stop();
 }
 
 void tud_umount_cb(void)
 {
-	hid_queue_head = 0;
-	hid_queue_tail = 0;
-	keyboard_pending_release = false;
+	macro_stop();
 	cdc_line_active = false;
 }
 
 void tud_suspend_cb(bool remote_wakeup_en)
 {
 	(void) remote_wakeup_en;
+
+	// The host may cut power while suspended, so don't wait for the idle commit
+	eeprom_save_config();
 }
 
 //--------------------------------------------------------------------+
@@ -455,18 +222,18 @@ static bool midi_write_packet(uint8_t const packet[4])
 // Public helpers
 //--------------------------------------------------------------------+
 
+// Buffered: the message lands in the cdc_log ring and is drained by usb_app_task()
 void usb_app_cdc_printf(const char *format, ...)
 {
-    char buffer[256];
+    if (!cdc_log_is_enabled())
+    {
+        return;
+    }
+
     va_list args;
     va_start(args, format);
-    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    cdc_log_vprintf(format, args);
     va_end(args);
-    if (len > 0)
-    {
-        tud_cdc_write(buffer, (uint32_t)len);
-        tud_cdc_write_flush();
-    }
 }
 
 void tud_resume_cb(void)
@@ -483,6 +250,29 @@ uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_t
 	return 0;
 }
 
+// The keyboard queue sends its next snapshot as soon as the previous one is out
+void tud_hid_report_complete_cb(uint8_t instance, uint8_t const *report, uint16_t len)
+{
+	(void) report;
+	(void) len;
+
+	if (instance == 0)
+	{
+		key_state_report_complete();
+	}
+}
+
+// Boot hosts (BIOS, bootloaders) switch the keyboard to the 6-key boot report
+void tud_hid_set_protocol_cb(uint8_t instance, uint8_t protocol)
+{
+	(void) protocol;
+
+	if (instance == 0)
+	{
+		key_state_protocol_changed();
+	}
+}
+
 void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t const *buffer, uint16_t bufsize)
 {
 	(void) report_id;
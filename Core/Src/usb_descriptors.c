@@ -2,6 +2,7 @@
 #include "class/hid/hid.h"
 #include "device/usbd.h"
 #include <string.h>
+#include "key_state.h"
 
 #define USB_VID  0xCafe
 #define USB_PID  0x4011
@@ -48,10 +49,50 @@ enum
 // HID Report Descriptor
 //--------------------------------------------------------------------+
 
+#if KEY_STATE_NKRO
+// NKRO keyboard: modifier byte + 128-bit usage bitmap (0x00-0x7F) + LED output.
+// Hosts that select boot protocol ignore this and get the 8-byte boot report.
+static uint8_t const desc_hid_report_keyboard[] =
+{
+	HID_USAGE_PAGE ( HID_USAGE_PAGE_DESKTOP                  ),
+	HID_USAGE      ( HID_USAGE_DESKTOP_KEYBOARD              ),
+	HID_COLLECTION ( HID_COLLECTION_APPLICATION              ),
+		// Modifiers
+		HID_USAGE_PAGE   ( HID_USAGE_PAGE_KEYBOARD              ),
+		HID_USAGE_MIN    ( 224                                  ),
+		HID_USAGE_MAX    ( 231                                  ),
+		HID_LOGICAL_MIN  ( 0                                    ),
+		HID_LOGICAL_MAX  ( 1                                    ),
+		HID_REPORT_COUNT ( 8                                    ),
+		HID_REPORT_SIZE  ( 1                                    ),
+		HID_INPUT        ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+		// Key bitmap
+		HID_USAGE_PAGE   ( HID_USAGE_PAGE_KEYBOARD              ),
+		HID_USAGE_MIN    ( 0                                    ),
+		HID_USAGE_MAX    ( KEY_STATE_NKRO_BITMAP_BYTES * 8 - 1  ),
+		HID_LOGICAL_MIN  ( 0                                    ),
+		HID_LOGICAL_MAX  ( 1                                    ),
+		HID_REPORT_COUNT_N ( KEY_STATE_NKRO_BITMAP_BYTES * 8, 2 ),
+		HID_REPORT_SIZE  ( 1                                    ),
+		HID_INPUT        ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+		// LEDs
+		HID_USAGE_PAGE   ( HID_USAGE_PAGE_LED                   ),
+		HID_USAGE_MIN    ( 1                                    ),
+		HID_USAGE_MAX    ( 5                                    ),
+		HID_REPORT_COUNT ( 5                                    ),
+		HID_REPORT_SIZE  ( 1                                    ),
+		HID_OUTPUT       ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+		HID_REPORT_COUNT ( 1                                    ),
+		HID_REPORT_SIZE  ( 3                                    ),
+		HID_OUTPUT       ( HID_CONSTANT                         ),
+	HID_COLLECTION_END
+};
+#else
 static uint8_t const desc_hid_report_keyboard[] =
 {
 	TUD_HID_REPORT_DESC_KEYBOARD()
 };
+#endif
 
 static uint8_t const desc_hid_report_mouse[] =
 {
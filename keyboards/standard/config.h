@@ -13,6 +13,10 @@
 /* Encoder configuration */
 #define ENCODER_COUNT 25
 
+/* Debounce: eager per-key keeps first-edge latency, 5 ms lockout */
+#define DEBOUNCE_ALGORITHM DEBOUNCE_EAGER_PK
+#define DEBOUNCE_MS 5
+
 /* Layout definition */
 #include "input/board_layout_types.h"
 
@@ -0,0 +1,20 @@
+#ifndef HOST_HID_H
+#define HOST_HID_H
+
+// Subset of the tinyusb HID usage constants used by the host-tested modules
+
+#define KEYBOARD_MODIFIER_LEFTSHIFT 0x02
+
+enum {
+	HID_KEY_A = 0x04,
+	HID_KEY_1 = 0x1E, HID_KEY_2, HID_KEY_3, HID_KEY_4, HID_KEY_5,
+	HID_KEY_6, HID_KEY_7, HID_KEY_8, HID_KEY_9, HID_KEY_0,
+	HID_KEY_ENTER = 0x28,
+	HID_KEY_TAB = 0x2B, HID_KEY_SPACE, HID_KEY_MINUS, HID_KEY_EQUAL,
+	HID_KEY_BRACKET_LEFT, HID_KEY_BRACKET_RIGHT, HID_KEY_BACKSLASH,
+	HID_KEY_SEMICOLON = 0x33, HID_KEY_APOSTROPHE, HID_KEY_GRAVE,
+	HID_KEY_COMMA, HID_KEY_PERIOD, HID_KEY_SLASH,
+	HID_KEY_CONTROL_LEFT = 0xE0,
+};
+
+#endif // HOST_HID_H
@@ -0,0 +1,11 @@
+#ifndef ENCODER_TEST_CONFIG_H
+#define ENCODER_TEST_CONFIG_H
+
+// Standard board with two encoders wired to the fake ports in test_encoder.c
+
+#include <standard/config.h>
+
+#undef ENCODER_COUNT
+#define ENCODER_COUNT 2
+
+#endif // ENCODER_TEST_CONFIG_H
@@ -0,0 +1,66 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "usb_app.h"
+#include "trace.h"
+
+// Peripheral register blocks that host_shim.h redirects the CMSIS macros to
+DWT_Type fake_dwt;
+TIM_TypeDef fake_tim7;
+RCC_TypeDef fake_rcc;
+PWR_TypeDef fake_pwr;
+
+uint32_t host_tick_ms;
+
+uint32_t HAL_GetTick(void) {
+	return host_tick_ms;
+}
+
+void HAL_Delay(uint32_t delay) {
+	host_tick_ms += delay;
+}
+
+uint32_t HAL_RCC_GetPCLK1Freq(void) {
+	return 170000000u;
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type irq, uint32_t preempt, uint32_t sub) {
+	(void)irq;
+	(void)preempt;
+	(void)sub;
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type irq) {
+	(void)irq;
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef *port, GPIO_InitTypeDef *init) {
+	(void)port;
+	(void)init;
+}
+
+// Console output is only interesting when a test fails; set HOST_TEST_LOG=1
+// to see it.
+void usb_app_cdc_printf(const char *format, ...) {
+	static int enabled = -1;
+	if (enabled < 0) {
+		const char *env = getenv("HOST_TEST_LOG");
+		enabled = (env && env[0] == '1') ? 1 : 0;
+	}
+	if (!enabled) {
+		return;
+	}
+	va_list args;
+	va_start(args, format);
+	vprintf(format, args);
+	va_end(args);
+}
+
+void trace_emit(uint8_t id, uint8_t nargs, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {
+	(void)id;
+	(void)nargs;
+	(void)a0;
+	(void)a1;
+	(void)a2;
+	(void)a3;
+}
@@ -0,0 +1,30 @@
+#ifndef HOST_SHIM_H
+#define HOST_SHIM_H
+
+// Force-included ahead of every host test translation unit. The HAL and
+// CMSIS headers compile natively, but the peripheral macros point at fixed
+// STM32 addresses; redirect the ones the firmware modules touch to plain
+// structs defined in host_fakes.c.
+
+#include "stm32g4xx_hal.h"
+
+#undef DWT
+extern DWT_Type fake_dwt;
+#define DWT (&fake_dwt)
+
+#undef TIM7
+extern TIM_TypeDef fake_tim7;
+#define TIM7 (&fake_tim7)
+
+#undef RCC
+extern RCC_TypeDef fake_rcc;
+#define RCC (&fake_rcc)
+
+#undef PWR
+extern PWR_TypeDef fake_pwr;
+#define PWR (&fake_pwr)
+
+// Simulated millisecond clock returned by HAL_GetTick()
+extern uint32_t host_tick_ms;
+
+#endif // HOST_SHIM_H
@@ -0,0 +1,36 @@
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+// Minimal assertion helpers for the host tests. Failures are counted and
+// reported; TEST_RESULT() turns the count into the process exit status
+// that ctest checks.
+
+#include <stdio.h>
+
+static int test_failures;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+		test_failures++; \
+	} \
+} while (0)
+
+#define CHECK_EQ(actual, expected) do { \
+	long long check_a_ = (long long)(actual); \
+	long long check_e_ = (long long)(expected); \
+	if (check_a_ != check_e_) { \
+		printf("%s:%d: %s == %lld, expected %lld\n", __FILE__, __LINE__, #actual, check_a_, check_e_); \
+		test_failures++; \
+	} \
+} while (0)
+
+#define RUN_TEST(fn) do { \
+	int before_ = test_failures; \
+	fn(); \
+	printf("%-40s %s\n", #fn, (test_failures == before_) ? "ok" : "FAILED"); \
+} while (0)
+
+#define TEST_RESULT() (test_failures ? 1 : 0)
+
+#endif // TEST_CHECK_H
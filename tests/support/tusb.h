@@ -0,0 +1,17 @@
+#ifndef HOST_TUSB_H
+#define HOST_TUSB_H
+
+// Host stand-in for the tinyusb entry points the input modules call. Tests
+// that send reports provide the definitions.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define HID_PROTOCOL_BOOT 0
+
+bool tud_hid_n_ready(uint8_t instance);
+bool tud_hid_n_report(uint8_t instance, uint8_t report_id, const void *report, uint16_t len);
+bool tud_hid_n_keyboard_report(uint8_t instance, uint8_t report_id, uint8_t modifier, const uint8_t keycode[6]);
+uint8_t tud_hid_n_get_protocol(uint8_t instance);
+
+#endif // HOST_TUSB_H
@@ -0,0 +1,201 @@
+// Host test for the combo engine in combo.c. The fake matrix looks keys up
+// in a flat map, gives combo_process_key() the first look at every event
+// like matrix.c does, and logs dispatched keycodes as "XX+" / "XX-".
+
+#include <string.h>
+#include "combo.h"
+#include "eeprom_emulation.h"
+#include "keymap.h"
+#include "test_check.h"
+
+#define KEY(row, col) ((uint8_t)((row) * MATRIX_COLS + (col)))
+#define NO EEPROM_COMBO_NO_KEY
+
+static combo_eeprom_t stored_combos[EEPROM_COMBO_COUNT];
+static uint16_t stored_term;
+static uint32_t layer_mask = 1u;
+static uint16_t active_keycode[MATRIX_ROWS][MATRIX_COLS];
+static char out[512];
+
+bool eeprom_get_combo(uint8_t index, combo_eeprom_t *combo) {
+	*combo = stored_combos[index];
+	return true;
+}
+
+uint16_t eeprom_get_combo_term(void) {
+	return stored_term;
+}
+
+uint32_t keymap_get_layer_mask(void) {
+	return layer_mask;
+}
+
+// Base layer: 0x04 upwards in key order
+static uint16_t base_keycode(uint8_t row, uint8_t col) {
+	return (uint16_t)(0x04 + KEY(row, col));
+}
+
+void matrix_dispatch_keycode(uint8_t row, uint8_t col, uint16_t keycode, uint8_t pressed) {
+	(void)row;
+	(void)col;
+	size_t len = strlen(out);
+	snprintf(out + len, sizeof(out) - len, "%02X%c ", keycode, pressed ? '+' : '-');
+}
+
+void matrix_process_key(uint8_t row, uint8_t col, uint8_t pressed) {
+	uint16_t keycode = pressed ? base_keycode(row, col) : active_keycode[row][col];
+	if (pressed) {
+		active_keycode[row][col] = keycode;
+	}
+	if (combo_process_key(row, col, pressed)) {
+		return;
+	}
+	matrix_dispatch_keycode(row, col, keycode, pressed);
+}
+
+static void set_combo(uint8_t index, uint8_t layer, uint8_t k0, uint8_t k1, uint8_t k2, uint8_t k3, uint16_t keycode) {
+	stored_combos[index] = (combo_eeprom_t){ layer, { k0, k1, k2, k3 }, keycode };
+}
+
+static void setup_combos(void) {
+	memset(stored_combos, 0, sizeof(stored_combos));
+	set_combo(0, 0, KEY(0, 0), KEY(0, 1), NO, NO, 0x29);
+	set_combo(1, 0, KEY(0, 0), KEY(0, 1), KEY(0, 2), NO, 0x2A);
+	set_combo(2, 3, KEY(0, 4), KEY(0, 5), NO, NO, 0x2B);
+	set_combo(3, 0, KEY(0, 6), KEY(1, 0), NO, NO, 0x2C);	// spans two rows
+	stored_term = 0;
+	layer_mask = 1u;
+	combo_invalidate_cache();
+}
+
+// Replay a script: "<row><col>d" press, "<row><col>u" release, "t<n>" wait
+// n*10 ms. combo_task() runs 1 ms after every event, like the matrix scan.
+static void run(const char *script, const char *expected) {
+	memset(out, 0, sizeof(out));
+	host_tick_ms = 1000;
+	for (const char *s = script; *s; ) {
+		if (*s == ' ') {
+			s++;
+			continue;
+		}
+		if (*s == 't') {
+			host_tick_ms += (uint32_t)(s[1] - '0') * 10u;
+			s += 2;
+		} else {
+			matrix_process_key((uint8_t)(s[0] - '0'), (uint8_t)(s[1] - '0'), s[2] == 'd');
+			s += 3;
+			host_tick_ms++;
+		}
+		combo_task();
+	}
+	if (strcmp(out, expected) != 0) {
+		printf("  script \"%s\": got \"%s\", expected \"%s\"\n", script, out, expected);
+	}
+	CHECK(strcmp(out, expected) == 0);
+}
+
+static void test_plain_key_passes_through(void) {
+	setup_combos();
+	run("03d 03u", "07+ 07- ");
+	// Non-member keys are not even buffered
+	CHECK(!combo_process_key(0, 3, 1));
+	CHECK(!combo_process_key(0, 3, 0));
+}
+
+// A chord that could still grow waits for the window, then fires
+static void test_two_key_combo_after_window(void) {
+	setup_combos();
+	run("00d 01d t9 00u 01u", "29+ 29- ");
+}
+
+// The longest combo fires as soon as it is complete
+static void test_three_key_combo(void) {
+	setup_combos();
+	run("00d 01d 02d 02u 00u 01u", "2A+ 2A- ");
+}
+
+// Releasing any key of the chord releases the combo and swallows the others
+static void test_release_order(void) {
+	setup_combos();
+	run("00d 01d 01u 00u", "29+ 29- ");
+	run("00d 01d t9 01u t9 00u", "29+ 29- ");
+}
+
+// A lone member key becomes a plain key on release or after the window
+static void test_single_member_key(void) {
+	setup_combos();
+	run("00d 00u", "04+ 04- ");
+	run("00d t9 00u", "04+ 04- ");
+}
+
+// Another key ends the window: the buffered press goes out first
+static void test_interrupted_by_other_key(void) {
+	setup_combos();
+	run("00d 03d 03u 00u", "04+ 07+ 07- 04- ");
+}
+
+// With no longer combo possible, the chord fires without waiting
+static void test_fires_immediately(void) {
+	setup_combos();
+	run("06d 10d 10u 06u", "2C+ 2C- ");
+}
+
+static void test_layer(void) {
+	setup_combos();
+	run("04d 05d 05u 04u", "08+ 09+ 09- 08- ");
+	layer_mask = 1u | KEYMAP_LAYER_BIT(3);
+	run("04d 05d 05u 04u", "2B+ 2B- ");
+}
+
+// Keys slower than the stored window are plain presses
+static void test_stored_term(void) {
+	setup_combos();
+	stored_term = 20;
+	combo_invalidate_cache();
+	CHECK_EQ(combo_get_term(), 20);
+	run("06d t3 10d 10u 06u", "0A+ 0B+ 0B- 0A- ");
+	stored_term = 0;
+	combo_invalidate_cache();
+	CHECK_EQ(combo_get_term(), COMBO_TERM_MS);
+	run("06d t3 10d 10u 06u", "2C+ 2C- ");
+}
+
+// Slots with a single distinct key, an out-of-range key or no keycode are skipped
+static void test_invalid_slots(void) {
+	memset(stored_combos, 0, sizeof(stored_combos));
+	set_combo(0, 0, KEY(0, 0), KEY(0, 0), NO, NO, 0x29);
+	set_combo(1, 0, KEY(0, 2), KEY(0, 3), NO, NO, KC_NO);
+	set_combo(2, KEYMAP_LAYER_COUNT, KEY(0, 4), KEY(0, 5), NO, NO, 0x2B);
+	set_combo(3, 0, KEY(0, 6), MATRIX_ROWS * MATRIX_COLS, NO, NO, 0x2C);
+	combo_invalidate_cache();
+	run("00d 00u", "04+ 04- ");
+	run("02d 03d 03u 02u", "06+ 07+ 07- 06- ");
+	run("04d 05d 05u 04u", "08+ 09+ 09- 08- ");
+	run("06d 06u", "0A+ 0A- ");
+}
+
+// Edits to the stored combos apply after the cache is invalidated
+static void test_invalidate(void) {
+	setup_combos();
+	run("00d 01d 01u 00u", "29+ 29- ");
+	set_combo(0, 0, KEY(0, 2), KEY(0, 3), NO, NO, 0x2D);
+	run("02d 03d 03u 02u", "06+ 07+ 07- 06- ");
+	combo_invalidate_cache();
+	run("02d 03d 03u 02u", "2D+ 2D- ");
+	run("00d 01d 01u 00u", "04+ 05+ 05- 04- ");
+}
+
+int main(void) {
+	RUN_TEST(test_plain_key_passes_through);
+	RUN_TEST(test_two_key_combo_after_window);
+	RUN_TEST(test_three_key_combo);
+	RUN_TEST(test_release_order);
+	RUN_TEST(test_single_member_key);
+	RUN_TEST(test_interrupted_by_other_key);
+	RUN_TEST(test_fires_immediately);
+	RUN_TEST(test_layer);
+	RUN_TEST(test_stored_term);
+	RUN_TEST(test_invalid_slots);
+	RUN_TEST(test_invalidate);
+	return TEST_RESULT();
+}
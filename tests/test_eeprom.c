@@ -0,0 +1,590 @@
+// Host test for the sparse override tables, the change table and the
+// log/compaction writer in eeprom_emulation.c. The module is included directly
+// so the tests can step its background job and inspect the change table. Flash
+// is an anonymous mapping at the STM32 address of the EEPROM region; the flash
+// backend completes every operation on the next poll.
+//
+// The override tables and the change table are built smaller than on the
+// target (see CMakeLists.txt) so the dense migrations overflow the former and
+// bursts of edits fill the latter.
+
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include "../Core/Src/eeprom_emulation.c"
+#include "test_check.h"
+
+#define FLASH_BASE_HOST 0x08000000UL
+#define FLASH_SIZE_HOST 0x80000UL
+
+// Compiled keymap: zero except one key, so "set back to the compiled value"
+// can be told apart from KC_NO
+#define COMPILED_LAYER 1
+#define COMPILED_ROW   2
+#define COMPILED_COL   3
+#define COMPILED_KEY   0x0042
+
+const uint16_t keycodes[KEYMAP_LAYER_COUNT][MATRIX_ROWS][MATRIX_COLS] = {
+	[COMPILED_LAYER][COMPILED_ROW][COMPILED_COL] = COMPILED_KEY,
+};
+const uint16_t encoder_map[KEYMAP_LAYER_COUNT][ENCODER_COUNT][2];
+#if SLIDER_COUNT > 0
+const slider_config_t slider_config_map[KEYMAP_LAYER_COUNT][SLIDER_COUNT];
+#else
+const slider_config_t slider_config_map[KEYMAP_LAYER_COUNT][1];
+#endif
+
+void keymap_invalidate_cache(void) {
+}
+
+HAL_StatusTypeDef HAL_PWR_ConfigPVD(PWR_PVDTypeDef *config) {
+	(void)config;
+	return HAL_OK;
+}
+
+// The warning commits the configuration, so it must not fire before there is one
+static bool pvd_enabled_early;
+
+void HAL_PWR_EnablePVD(void) {
+	if (!eeprom_initialized) {
+		pvd_enabled_early = true;
+	}
+}
+
+static eeprom_flash_status_t flash_status = EEPROM_FLASH_IDLE;
+static uint32_t flash_polls;
+
+void eeprom_flash_init(void) {
+}
+
+bool eeprom_flash_is_dual_bank(void) {
+	return true;
+}
+
+bool eeprom_flash_erase_async(uint32_t address, uint32_t size) {
+	memset((void *)(uintptr_t)address, 0xFF, size);
+	flash_status = EEPROM_FLASH_DONE;
+	return true;
+}
+
+bool eeprom_flash_program_async(uint32_t address, uint64_t data) {
+	uint64_t *target = (uint64_t *)(uintptr_t)address;
+	// Flash can only be programmed once per erase
+	CHECK(*target == UINT64_MAX);
+	*target = data;
+	flash_status = EEPROM_FLASH_DONE;
+	return true;
+}
+
+eeprom_flash_status_t eeprom_flash_poll(void) {
+	eeprom_flash_status_t status = flash_status;
+	if (status == EEPROM_FLASH_DONE || status == EEPROM_FLASH_ERROR) {
+		flash_status = EEPROM_FLASH_IDLE;
+	}
+	// Let eeprom_flush() time out instead of spinning forever on a bug
+	if (++flash_polls % 1024U == 0U) {
+		host_tick_ms++;
+	}
+	return status;
+}
+
+static bool map_flash(void) {
+#ifdef MAP_FIXED_NOREPLACE
+	int fixed = MAP_FIXED_NOREPLACE;
+#else
+	int fixed = MAP_FIXED;
+#endif
+	void *flash = mmap((void *)FLASH_BASE_HOST, FLASH_SIZE_HOST, PROT_READ | PROT_WRITE,
+	                   fixed | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return flash == (void *)FLASH_BASE_HOST;
+}
+
+// Blank flash and a cold boot of the module
+static void boot_blank(void) {
+	memset((void *)EEPROM_START_ADDRESS, 0xFF, EEPROM_END_ADDRESS - EEPROM_START_ADDRESS);
+	eeprom_initialized = false;
+	migration_dropped = 0;
+	active_profile = 0;
+	CHECK(eeprom_init());
+	CHECK(!eeprom_is_busy());
+	CHECK(!pvd_enabled_early);
+}
+
+static bool override_table_sorted(const eeprom_data_t *profile) {
+	for (uint16_t i = 1; i < profile->keymap_override_count; i++) {
+		const keymap_override_t *a = &profile->keymap_overrides[i - 1U];
+		const keymap_override_t *b = &profile->keymap_overrides[i];
+		if (override_key(a->layer, a->cell) >= override_key(b->layer, b->cell)) {
+			return false;
+		}
+	}
+	for (uint16_t i = 1; i < profile->encoder_override_count; i++) {
+		const encoder_override_t *a = &profile->encoder_overrides[i - 1U];
+		const encoder_override_t *b = &profile->encoder_overrides[i];
+		if (override_key(a->layer, a->encoder_id) >= override_key(b->layer, b->encoder_id)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Fold the change table into new images and wait for them
+static void compact_now(void) {
+	compact_required = true;
+	CHECK(eeprom_force_save_config());
+	CHECK(eeprom_flush(EEPROM_FLUSH_TIMEOUT_MS));
+	CHECK_EQ(change_count, 0);
+}
+
+// Inserts land in the image in order regardless of arrival order; updates keep the count
+static void test_override_insert(void) {
+	boot_blank();
+	for (uint16_t i = 0; i < 97; i++) {
+		// 37 is coprime to the cell count, so this visits cells out of order
+		uint16_t n = (uint16_t)((i * 37U) % (3U * MATRIX_ROWS * MATRIX_COLS));
+		uint8_t layer = (uint8_t)(n / (MATRIX_ROWS * MATRIX_COLS));
+		uint8_t cell = (uint8_t)(n % (MATRIX_ROWS * MATRIX_COLS));
+		CHECK(eeprom_set_keycode(layer, cell / MATRIX_COLS, cell % MATRIX_COLS, (uint16_t)(0x100 + n)));
+	}
+	CHECK_EQ(keymap_override_total[0], 97);
+	compact_now();
+	CHECK_EQ(profile_base[0]->keymap_override_count, 97);
+	CHECK(override_table_sorted(profile_base[0]));
+
+	for (uint16_t i = 0; i < 97; i++) {
+		uint16_t n = (uint16_t)((i * 37U) % (3U * MATRIX_ROWS * MATRIX_COLS));
+		uint8_t layer = (uint8_t)(n / (MATRIX_ROWS * MATRIX_COLS));
+		uint8_t cell = (uint8_t)(n % (MATRIX_ROWS * MATRIX_COLS));
+		CHECK_EQ(eeprom_get_keycode(layer, cell / MATRIX_COLS, cell % MATRIX_COLS), 0x100 + n);
+	}
+
+	CHECK(eeprom_set_keycode(0, 0, 0, 0x0777));
+	CHECK_EQ(keymap_override_total[0], 97);
+	CHECK_EQ(eeprom_get_keycode(0, 0, 0), 0x0777);
+	compact_now();
+	CHECK_EQ(profile_base[0]->keymap_override_count, 97);
+	CHECK_EQ(eeprom_get_keycode(0, 0, 0), 0x0777);
+}
+
+// KC_NO or the compiled keycode removes the entry; removing a missing one is fine
+static void test_override_delete(void) {
+	boot_blank();
+	CHECK(eeprom_set_keycode(0, 0, 1, 0x0004));
+	CHECK(eeprom_set_keycode(COMPILED_LAYER, COMPILED_ROW, COMPILED_COL, 0x0005));
+	CHECK(eeprom_set_keycode(2, 0, 0, 0x0006));
+	compact_now();
+	CHECK_EQ(profile_base[0]->keymap_override_count, 3);
+
+	CHECK(eeprom_set_keycode(COMPILED_LAYER, COMPILED_ROW, COMPILED_COL, COMPILED_KEY));
+	CHECK_EQ(keymap_override_total[0], 2);
+	CHECK_EQ(eeprom_get_keycode(COMPILED_LAYER, COMPILED_ROW, COMPILED_COL), KC_NO);
+
+	CHECK(eeprom_set_keycode(0, 0, 1, KC_NO));
+	CHECK_EQ(keymap_override_total[0], 1);
+	CHECK(eeprom_set_keycode(0, 0, 1, KC_NO));
+	CHECK_EQ(keymap_override_total[0], 1);
+	compact_now();
+	CHECK_EQ(profile_base[0]->keymap_override_count, 1);
+	CHECK_EQ(eeprom_get_keycode(2, 0, 0), 0x0006);
+
+	// The compiled value is not stored as an override in the first place
+	CHECK(eeprom_set_keycode(COMPILED_LAYER, COMPILED_ROW, COMPILED_COL, COMPILED_KEY));
+	CHECK_EQ(change_count, 0);
+}
+
+// A full table refuses new keys but still takes updates and deletes
+static void test_override_table_full(void) {
+	boot_blank();
+	for (uint16_t n = 0; n < EEPROM_KEYMAP_OVERRIDES; n++) {
+		uint8_t layer = (uint8_t)(n / (MATRIX_ROWS * MATRIX_COLS));
+		uint8_t cell = (uint8_t)(n % (MATRIX_ROWS * MATRIX_COLS));
+		CHECK(eeprom_set_keycode(layer, cell / MATRIX_COLS, cell % MATRIX_COLS, 0x0100));
+	}
+	CHECK_EQ(keymap_override_total[0], EEPROM_KEYMAP_OVERRIDES);
+	CHECK(!eeprom_set_keycode(KEYMAP_LAYER_COUNT - 1, 0, 0, 0x0200));
+	CHECK(eeprom_set_keycode(0, 0, 0, 0x0300));
+	CHECK(eeprom_set_keycode(0, 0, 1, KC_NO));
+	CHECK(eeprom_set_keycode(KEYMAP_LAYER_COUNT - 1, 0, 0, 0x0200));
+	compact_now();
+	CHECK_EQ(profile_base[0]->keymap_override_count, EEPROM_KEYMAP_OVERRIDES);
+	CHECK(override_table_sorted(profile_base[0]));
+
+	for (uint16_t n = 0; n < EEPROM_ENCODER_OVERRIDES; n++) {
+		CHECK(eeprom_set_encoder_map((uint8_t)(n / ENCODER_COUNT), (uint8_t)(n % ENCODER_COUNT), 1, 2));
+	}
+	CHECK(!eeprom_set_encoder_map(KEYMAP_LAYER_COUNT - 1, 0, 1, 2));
+	CHECK(eeprom_set_encoder_map(0, 0, KC_NO, KC_NO));
+	compact_now();
+	CHECK_EQ(profile_base[0]->encoder_override_count, EEPROM_ENCODER_OVERRIDES - 1);
+	CHECK(override_table_sorted(profile_base[0]));
+}
+
+// Changes to the same entry share one table entry holding the latest value
+static void test_record_coalescing(void) {
+	boot_blank();
+	CHECK_EQ(change_pending_count(), 0);
+
+	CHECK(eeprom_set_keycode(0, 1, 1, 0x0004));
+	CHECK(eeprom_set_keycode(0, 1, 1, 0x0005));
+	CHECK(eeprom_set_keycode(0, 1, 1, 0x0006));
+	CHECK_EQ(change_pending_count(), 1);
+	CHECK_EQ(changes[0].data[3], 0x06);
+
+	CHECK(eeprom_set_keycode(0, 1, 2, 0x0007));
+	CHECK(eeprom_set_encoder_map(0, 1, 0x10, 0x11));
+	CHECK(eeprom_set_encoder_map(0, 1, 0x12, 0x13));
+	CHECK_EQ(change_pending_count(), 3);
+
+	// The same key in another profile is a separate entry
+	CHECK(eeprom_set_active_profile(1));
+	CHECK(eeprom_set_keycode(0, 1, 1, 0x0008));
+	CHECK_EQ(change_pending_count(), 5);
+
+	uint32_t tail = log_write_offset;
+	CHECK(eeprom_save_config());
+	CHECK(eeprom_flush(EEPROM_FLUSH_TIMEOUT_MS));
+	CHECK_EQ(log_write_offset - tail, 5U * EEPROM_RECORD_SIZE);
+	CHECK_EQ(change_pending_count(), 0);
+	const eeprom_record_t *record = (const eeprom_record_t *)(uintptr_t)(sector_address(active_sector) + tail);
+	CHECK_EQ(record->check, record_check(record));
+
+	CHECK(eeprom_load_config());
+	CHECK_EQ(eeprom_get_active_profile(), 1);
+	CHECK_EQ(eeprom_get_keycode(0, 1, 1), 0x0008);
+	CHECK(eeprom_set_active_profile(0));
+	CHECK_EQ(eeprom_get_keycode(0, 1, 1), 0x0006);
+	CHECK_EQ(eeprom_get_keycode(0, 1, 2), 0x0007);
+	uint16_t ccw = 0, cw = 0;
+	CHECK(eeprom_get_encoder_map(0, 1, &ccw, &cw));
+	CHECK_EQ(ccw, 0x12);
+	CHECK_EQ(cw, 0x13);
+}
+
+// Key i of a run of distinct keys starting on layer 2
+static void run_key(uint8_t i, uint8_t *layer, uint8_t *row, uint8_t *col) {
+	*layer = (uint8_t)(2U + i / (MATRIX_ROWS * MATRIX_COLS));
+	*row = (uint8_t)(i % (MATRIX_ROWS * MATRIX_COLS) / MATRIX_COLS);
+	*col = (uint8_t)(i % MATRIX_COLS);
+}
+
+// More changes than one append job programs are logged over several jobs; a
+// change table filled to its threshold is folded into new images
+static void test_change_table_compacts(void) {
+	boot_blank();
+	uint8_t sector = active_sector;
+	uint32_t tail = log_write_offset;
+	uint8_t layer, row, col;
+	uint8_t n = 0;
+	for (; n < EEPROM_PENDING_RECORDS + 8U; n++) {
+		run_key(n, &layer, &row, &col);
+		CHECK(eeprom_set_keycode(layer, row, col, (uint16_t)(0x0200 + n)));
+	}
+	CHECK(!compact_required);
+	CHECK(eeprom_save_config());
+	CHECK(eeprom_flush(EEPROM_FLUSH_TIMEOUT_MS));
+	CHECK_EQ(active_sector, sector);
+	CHECK_EQ(log_write_offset - tail, (uint32_t)n * EEPROM_RECORD_SIZE);
+
+	for (; change_count < EEPROM_COMPACT_THRESHOLD; n++) {
+		run_key(n, &layer, &row, &col);
+		CHECK(eeprom_set_keycode(layer, row, col, (uint16_t)(0x0200 + n)));
+	}
+	CHECK(compact_required);
+	CHECK(eeprom_flush(EEPROM_FLUSH_TIMEOUT_MS));
+	CHECK(active_sector != sector);
+	CHECK_EQ(change_count, 0);
+	CHECK(eeprom_load_config());
+	for (uint8_t i = 0; i < n; i++) {
+		run_key(i, &layer, &row, &col);
+		CHECK_EQ(eeprom_get_keycode(layer, row, col), 0x0200 + i);
+	}
+}
+
+// After a compaction every getter is served by the image in flash
+static void test_settings_read_from_flash(void) {
+	boot_blank();
+	static const uint8_t macro[] = { 'h', 'i', 0, 'y', 'o', 0 };
+	combo_eeprom_t combo = { .layer = 1, .keys = { 3, 4, EEPROM_COMBO_NO_KEY, EEPROM_COMBO_NO_KEY }, .keycode = 0x0029 };
+	CHECK(eeprom_set_magnetic_switch_calibration(2, 100, 900, 40));
+	CHECK(eeprom_set_layer_state(0x05, 2));
+	CHECK(eeprom_set_debounce_config(1, 7));
+	CHECK(eeprom_set_tap_hold_config(1, 2, 180, 0x03));
+	CHECK(eeprom_set_tap_hold_config(EEPROM_TAP_HOLD_PROFILE, EEPROM_TAP_HOLD_PROFILE, 220, 0x01));
+	CHECK(eeprom_set_combo(5, &combo));
+	CHECK(eeprom_set_combo_term(45));
+	CHECK(eeprom_set_macro_data(6, macro, sizeof(macro)));
+
+	for (int pass = 0; pass < 2; pass++) {
+		uint16_t unpressed = 0, pressed = 0, term = 0;
+		uint8_t sensitivity = 0, algorithm = 0, time_ms = 0, flags = 0, default_layer = 0;
+		uint32_t mask = 0;
+		bool calibrated = false;
+		CHECK(eeprom_get_magnetic_switch_calibration(2, &unpressed, &pressed, &sensitivity, &calibrated));
+		CHECK(unpressed == 100 && pressed == 900 && sensitivity == 40 && calibrated);
+		CHECK(eeprom_get_layer_state(&mask, &default_layer));
+		CHECK(mask == 0x05 && default_layer == 2);
+		CHECK(eeprom_get_debounce_config(&algorithm, &time_ms));
+		CHECK(algorithm == 1 && time_ms == 7);
+		CHECK(eeprom_get_tap_hold_config(1, 2, &term, &flags));
+		CHECK(term == 180 && flags == 0x03);
+		CHECK(eeprom_get_tap_hold_config(EEPROM_TAP_HOLD_PROFILE, EEPROM_TAP_HOLD_PROFILE, &term, &flags));
+		CHECK(term == 220 && flags == 0x01);
+		combo_eeprom_t stored;
+		CHECK(eeprom_get_combo(5, &stored));
+		CHECK(memcmp(&stored, &combo, sizeof(combo)) == 0);
+		CHECK_EQ(eeprom_get_combo_term(), 45);
+		uint8_t area[16];
+		CHECK(eeprom_get_macro_data(4, area, sizeof(area)));
+		CHECK(area[0] == 0 && area[1] == 0 && memcmp(&area[2], macro, sizeof(macro)) == 0);
+		CHECK(!eeprom_get_macro_data(EEPROM_MACRO_BYTES - 2U, area, 4));
+
+		// Nothing is left in RAM after the second pass's compaction
+		compact_now();
+	}
+	CHECK_EQ(profile_base[0]->debounce_ms, 7);
+	CHECK_EQ(profile_base[0]->combo_term_ms, 45);
+}
+
+// Staged edits stay out of the live profile until commit
+static void test_staged_transaction(void) {
+	boot_blank();
+	CHECK(eeprom_set_keycode(0, 0, 0, 0x0801));
+
+	CHECK(eeprom_stage_begin());
+	CHECK(eeprom_set_keycode(0, 0, 0, 0x0802));
+	CHECK(eeprom_set_keycode(0, 0, 1, 0x0803));
+	CHECK(eeprom_set_encoder_map(1, 2, 0x0804, 0x0805));
+	CHECK_EQ(eeprom_get_keycode(0, 0, 0), 0x0801);
+	CHECK_EQ(eeprom_get_keycode(0, 0, 1), KC_NO);
+	eeprom_stage_abort();
+	CHECK_EQ(keymap_override_total[0], 1);
+
+	CHECK(eeprom_stage_begin());
+	CHECK(eeprom_set_keycode(0, 0, 0, KC_NO));
+	CHECK(eeprom_set_keycode(0, 0, 1, 0x0803));
+	CHECK(eeprom_set_encoder_map(1, 2, 0x0804, 0x0805));
+	CHECK(eeprom_set_encoder_map(1, 3, KC_NO, KC_NO));    // Matches live, logs nothing
+	uint8_t profile = 0xFF;
+	CHECK(eeprom_stage_commit(&profile));
+	CHECK_EQ(profile, 0);
+	CHECK_EQ(change_pending_count(), 3);
+	CHECK_EQ(keymap_override_total[0], 1);
+	CHECK_EQ(encoder_override_total[0], 1);
+
+	CHECK(eeprom_flush(EEPROM_FLUSH_TIMEOUT_MS));
+	CHECK(eeprom_load_config());
+	CHECK_EQ(eeprom_get_keycode(0, 0, 0), KC_NO);
+	CHECK_EQ(eeprom_get_keycode(0, 0, 1), 0x0803);
+	uint16_t ccw = 0, cw = 0;
+	CHECK(eeprom_get_encoder_map(1, 2, &ccw, &cw));
+	CHECK_EQ(cw, 0x0805);
+}
+
+// Step the background job until it is partway through programming a profile image
+static void run_until_mid_image(uint8_t profile) {
+	for (int guard = 0; guard < 100000; guard++) {
+		if (job_state == EEPROM_JOB_IMAGE && job_profile == profile &&
+		    job_remaining < (sizeof(eeprom_data_t) - EEPROM_IMAGE_HEAD_SIZE) / 2U) {
+			return;
+		}
+		eeprom_task();
+	}
+	CHECK(!"compaction never reached the image");
+}
+
+static void run_until_idle(void) {
+	for (int guard = 0; guard < 100000 && job_state != EEPROM_JOB_IDLE; guard++) {
+		eeprom_task();
+	}
+	CHECK_EQ(job_state, EEPROM_JOB_IDLE);
+}
+
+// Edits while an image is being programmed must not reach that image: it
+// holds what was folded when the compaction began, and the edits follow as
+// records
+static void test_edit_during_compaction(void) {
+	boot_blank();
+	for (uint8_t n = 0; n < 20; n++) {
+		CHECK(eeprom_set_keycode(3, n / MATRIX_COLS, n % MATRIX_COLS, (uint16_t)(0x0300 + n)));
+	}
+	CHECK(eeprom_set_encoder_map(3, 4, 0x21, 0x22));
+	CHECK(eeprom_save_config());
+	CHECK(eeprom_flush(EEPROM_FLUSH_TIMEOUT_MS));
+
+	compact_required = true;
+	CHECK(eeprom_force_save_config());
+	run_until_mid_image(0);
+
+	// Inserts ahead of every existing entry and deletes of folded entries
+	CHECK(eeprom_set_keycode(0, 0, 0, 0x0401));
+	CHECK(eeprom_set_keycode(0, 0, 1, 0x0402));
+	CHECK(eeprom_set_keycode(3, 0, 5, KC_NO));
+	CHECK(eeprom_set_encoder_map(0, 0, 0x31, 0x32));
+	CHECK(eeprom_set_encoder_map(3, 4, KC_NO, KC_NO));
+	CHECK_EQ(eeprom_get_keycode(3, 0, 5), KC_NO);
+	run_until_idle();
+	CHECK(last_save_ok);
+
+	// The compacted image is valid on its own and holds the state before the edits
+	const eeprom_data_t *stored = profile_base[0];
+	CHECK(eeprom_image_valid(stored));
+	CHECK_EQ(stored->keymap_override_count, 20);
+	CHECK_EQ(stored->encoder_override_count, 1);
+	CHECK_EQ(stored->keymap_overrides[0].layer, 3);
+	CHECK_EQ(stored->keymap_overrides[5].keycode, 0x0305);
+	CHECK(override_table_sorted(stored));
+	CHECK_EQ(change_count, 5);
+
+	// The edits were kept and persist with the next save
+	CHECK(eeprom_save_config());
+	CHECK(eeprom_flush(EEPROM_FLUSH_TIMEOUT_MS));
+	CHECK(eeprom_load_config());
+	CHECK_EQ(eeprom_get_keycode(0, 0, 0), 0x0401);
+	CHECK_EQ(eeprom_get_keycode(0, 0, 1), 0x0402);
+	CHECK_EQ(eeprom_get_keycode(3, 0, 5), KC_NO);
+	CHECK_EQ(eeprom_get_keycode(3, 0, 6), 0x0306);
+	uint16_t ccw = 0, cw = 0;
+	CHECK(eeprom_get_encoder_map(0, 0, &ccw, &cw));
+	CHECK_EQ(ccw, 0x31);
+	CHECK(eeprom_get_encoder_map(3, 4, &ccw, &cw));
+	CHECK_EQ(ccw, KC_NO);
+	compact_now();
+	CHECK_EQ(profile_base[0]->keymap_override_count, 21);
+	CHECK_EQ(profile_base[0]->encoder_override_count, 1);
+	CHECK(override_table_sorted(profile_base[0]));
+}
+
+// Edits to another profile while this one is programmed end up in flash too
+static void test_edit_other_profile_during_compaction(void) {
+	boot_blank();
+	compact_required = true;
+	CHECK(eeprom_force_save_config());
+	run_until_mid_image(0);
+	CHECK(eeprom_set_active_profile(1));
+	CHECK(eeprom_set_keycode(0, 0, 0, 0x0502));
+	run_until_idle();
+	CHECK(eeprom_save_config());
+	CHECK(eeprom_flush(EEPROM_FLUSH_TIMEOUT_MS));
+	CHECK(eeprom_load_config());
+	CHECK_EQ(eeprom_get_active_profile(), 1);
+	CHECK_EQ(eeprom_get_keycode(0, 0, 0), 0x0502);
+}
+
+// With the supply low, pending changes are appended but the due compaction
+// waits, and a full change table refuses edits instead of compacting
+static void test_brownout_appends_only(void) {
+	boot_blank();
+	uint8_t sector = active_sector;
+	uint8_t layer, row, col;
+	uint8_t n = 0;
+	for (; n < EEPROM_COMPACT_THRESHOLD; n++) {
+		run_key(n, &layer, &row, &col);
+		CHECK(eeprom_set_keycode(layer, row, col, (uint16_t)(0x0900 + n)));
+	}
+	CHECK(compact_required);
+
+	fake_pwr.SR2 |= PWR_SR2_PVDO;
+	HAL_PWR_PVDCallback();
+	uint32_t tail = log_write_offset;
+	CHECK(eeprom_flush(EEPROM_FLUSH_TIMEOUT_MS));
+	CHECK_EQ(active_sector, sector);
+	CHECK_EQ(log_write_offset - tail, (uint32_t)n * EEPROM_RECORD_SIZE);
+	CHECK_EQ(change_pending_count(), 0);
+	CHECK(compact_required);
+
+	for (; change_count < EEPROM_CHANGE_ENTRIES; n++) {
+		run_key(n, &layer, &row, &col);
+		CHECK(eeprom_set_keycode(layer, row, col, (uint16_t)(0x0900 + n)));
+	}
+	run_key(n, &layer, &row, &col);
+	CHECK(!eeprom_set_keycode(layer, row, col, 0x0999));
+	CHECK(eeprom_flush(EEPROM_FLUSH_TIMEOUT_MS));
+	CHECK_EQ(active_sector, sector);
+
+	// Once VDD is back the postponed compaction runs
+	fake_pwr.SR2 &= ~PWR_SR2_PVDO;
+	eeprom_task();
+	CHECK(eeprom_set_keycode(layer, row, col, 0x0999));
+	CHECK(eeprom_save_config());
+	CHECK(eeprom_flush(EEPROM_FLUSH_TIMEOUT_MS));
+	CHECK(active_sector != sector);
+	CHECK(eeprom_load_config());
+	CHECK_EQ(eeprom_get_keycode(layer, row, col), 0x0999);
+	run_key(0, &layer, &row, &col);
+	CHECK_EQ(eeprom_get_keycode(layer, row, col), 0x0900);
+}
+
+static void write_v1_image(void) {
+	static eeprom_data_v1_t legacy;
+	memset(&legacy, 0, sizeof(legacy));
+	legacy.magic = EEPROM_MAGIC;
+	legacy.version = 1;
+	for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+		for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+			legacy.keymap[r][c] = (uint16_t)(0x0600 + r * MATRIX_COLS + c);
+		}
+	}
+	for (uint8_t e = 0; e < ENCODER_COUNT; e++) {
+		legacy.encoder_map[e][0] = (uint16_t)(0x0700 + e);
+		legacy.encoder_map[e][1] = (uint16_t)(0x0780 + e);
+	}
+	legacy.checksum = crc32_compute((const uint8_t *)&legacy + EEPROM_V1_PAYLOAD_OFFSET, EEPROM_V1_PAYLOAD_SIZE);
+	memcpy((void *)EEPROM_LEGACY_ADDRESS, &legacy, sizeof(legacy));
+}
+
+// A dense image with more entries than the tables hold keeps what fits and
+// reports how much was lost
+static void test_migration_counts_drops(void) {
+	memset((void *)EEPROM_START_ADDRESS, 0xFF, EEPROM_END_ADDRESS - EEPROM_START_ADDRESS);
+	crc32_init();
+	write_v1_image();
+	eeprom_initialized = false;
+	migration_dropped = 0;
+	CHECK(eeprom_init());
+
+	// v1 becomes layer 0 plus KC_TRANSPARENT on the other seven legacy layers
+	uint32_t keys = EEPROM_LEGACY_LAYERS_LOADED * MATRIX_ROWS * MATRIX_COLS;
+	uint32_t encoders = EEPROM_LEGACY_LAYERS_LOADED * ENCODER_COUNT;
+	uint32_t expected = (keys - EEPROM_KEYMAP_OVERRIDES) + (encoders - EEPROM_ENCODER_OVERRIDES);
+
+	eeprom_status_t status;
+	eeprom_get_status(&status);
+	CHECK_EQ(status.migration_dropped, expected);
+	CHECK(legacy_image == NULL);
+	CHECK_EQ(profile_base[0]->keymap_override_count, EEPROM_KEYMAP_OVERRIDES);
+	CHECK_EQ(profile_base[0]->encoder_override_count, EEPROM_ENCODER_OVERRIDES);
+	CHECK(override_table_sorted(profile_base[0]));
+
+	// Layer 0 is migrated first and survives in full
+	CHECK_EQ(eeprom_get_keycode(0, 0, 0), 0x0600);
+	CHECK_EQ(eeprom_get_keycode(0, MATRIX_ROWS - 1, MATRIX_COLS - 1), 0x0600 + MATRIX_ROWS * MATRIX_COLS - 1);
+	uint16_t ccw = 0, cw = 0;
+	CHECK(eeprom_get_encoder_map(0, ENCODER_COUNT - 1, &ccw, &cw));
+	CHECK_EQ(cw, 0x0780 + ENCODER_COUNT - 1);
+
+	// The migrated result was written back in the current format
+	CHECK_EQ(*(const uint32_t *)EEPROM_START_ADDRESS, EEPROM_PROFILE_LOG_MAGIC);
+	memset((void *)EEPROM_LEGACY_ADDRESS, 0xFF, sizeof(eeprom_data_v1_t));
+	CHECK(eeprom_load_config());
+	CHECK_EQ(eeprom_get_keycode(0, 0, 0), 0x0600);
+}
+
+int main(void) {
+	if (!map_flash()) {
+		printf("cannot map the flash region at 0x%08lX\n", FLASH_BASE_HOST);
+		return 1;
+	}
+	memset((void *)FLASH_BASE_HOST, 0xFF, FLASH_SIZE_HOST);
+
+	RUN_TEST(test_override_insert);
+	RUN_TEST(test_override_delete);
+	RUN_TEST(test_override_table_full);
+	RUN_TEST(test_record_coalescing);
+	RUN_TEST(test_change_table_compacts);
+	RUN_TEST(test_settings_read_from_flash);
+	RUN_TEST(test_staged_transaction);
+	RUN_TEST(test_edit_during_compaction);
+	RUN_TEST(test_edit_other_profile_during_compaction);
+	RUN_TEST(test_brownout_appends_only);
+	RUN_TEST(test_migration_counts_drops);
+	return TEST_RESULT();
+}
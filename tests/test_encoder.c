@@ -0,0 +1,283 @@
+// Host test for the quadrature decoder in encoder.c. Synthetic A/B waveforms
+// are written to fake GPIO ports and sampled through the same entry points
+// the firmware uses: encoder_task() when polling, the TIM7 update interrupt
+// with ENCODER_SAMPLE_BACKGROUND. The emitted keycodes are counted per
+// encoder and direction.
+
+#include <string.h>
+#include "encoder.h"
+#include "midi_handler.h"
+#include "i2c_manager.h"
+#include "test_check.h"
+
+#define KEY_CW(i)  (0x20 + (i))
+#define KEY_CCW(i) (0x10 + (i))
+#define UNRELATED_PIN GPIO_PIN_12
+
+// State sequences from rest (B<<1 | A = 3 with pull-ups)
+static const uint8_t cw_cycle[4]  = { 2, 0, 1, 3 };
+static const uint8_t ccw_cycle[4] = { 1, 0, 2, 3 };
+
+static GPIO_TypeDef port_a, port_b;
+
+// Encoder 0 is split across two ports, encoder 1 shares port B
+const encoder_pins_t encoder_pins[ENCODER_COUNT] = {
+	{ { &port_a, GPIO_PIN_5 }, { &port_b, GPIO_PIN_3 } },
+	{ { &port_b, GPIO_PIN_6 }, { &port_b, GPIO_PIN_7 } },
+};
+const uint32_t encoder_pulls[ENCODER_COUNT] = { GPIO_PULLUP, GPIO_PULLUP };
+
+static uint8_t sent[64];
+static int sent_count;
+
+bool keymap_get_active_encoder_map(uint8_t encoder_id, uint16_t *ccw_keycode, uint16_t *cw_keycode) {
+	*ccw_keycode = KEY_CCW(encoder_id);
+	*cw_keycode = KEY_CW(encoder_id);
+	return true;
+}
+
+bool keymap_translate_keycode(uint16_t keycode, bool pressed, uint8_t *hid_code) {
+	(void)pressed;
+	*hid_code = (uint8_t)keycode;
+	return true;
+}
+
+void midi_handle_keycode(uint16_t keycode, bool pressed) {
+	(void)keycode;
+	(void)pressed;
+}
+
+void i2c_manager_process_local_key_event(uint8_t row, uint8_t col, uint8_t pressed, uint8_t keycode,
+                                         uint8_t source, uint32_t detect_cycles) {
+	(void)row;
+	(void)col;
+	(void)pressed;
+	(void)source;
+	(void)detect_cycles;
+	if (sent_count < (int)sizeof(sent)) {
+		sent[sent_count] = keycode;
+	}
+	sent_count++;
+}
+
+static int sent_with(uint8_t keycode) {
+	int n = 0;
+	for (int i = 0; i < sent_count && i < (int)sizeof(sent); i++) {
+		n += (sent[i] == keycode);
+	}
+	return n;
+}
+
+static void set_pins(uint8_t idx, uint8_t state) {
+	if (idx == 0) {
+		port_a.IDR = (port_a.IDR & ~GPIO_PIN_5) | ((state & 1) ? GPIO_PIN_5 : 0);
+		port_b.IDR = (port_b.IDR & ~GPIO_PIN_3) | ((state & 2) ? GPIO_PIN_3 : 0);
+	} else {
+		port_b.IDR = (port_b.IDR & ~(GPIO_PIN_6 | GPIO_PIN_7)) |
+		             ((state & 1) ? GPIO_PIN_6 : 0) | ((state & 2) ? GPIO_PIN_7 : 0);
+	}
+}
+
+// One sample of the current pin levels
+static void sample(void) {
+#if ENCODER_SAMPLE_BACKGROUND
+	fake_tim7.SR |= TIM_SR_UIF;
+	encoder_timer_isr();
+#else
+	encoder_task();
+#endif
+}
+
+static void feed(uint8_t idx, uint8_t state) {
+	set_pins(idx, state);
+	sample();
+}
+
+static void feed_cycle(uint8_t idx, const uint8_t *cycle) {
+	for (int k = 0; k < 4; k++) {
+		feed(idx, cycle[k]);
+	}
+}
+
+// Let encoder_task() send everything still queued or counted
+static void drain(void) {
+	for (int k = 0; k < 64; k++) {
+		encoder_task();
+	}
+}
+
+static void reset(void) {
+	set_pins(0, 3);
+	set_pins(1, 3);
+	encoder_init();
+	drain();
+	memset(sent, 0, sizeof(sent));
+	sent_count = 0;
+}
+
+static void test_cw_detent(void) {
+	reset();
+	feed_cycle(0, cw_cycle);
+	drain();
+	CHECK_EQ(sent_count, 1);
+	CHECK_EQ(sent_with(KEY_CW(0)), 1);
+}
+
+static void test_ccw_detent(void) {
+	reset();
+	feed_cycle(1, ccw_cycle);
+	drain();
+	CHECK_EQ(sent_count, 1);
+	CHECK_EQ(sent_with(KEY_CCW(1)), 1);
+}
+
+// A partial turn that goes back to rest does not count
+static void test_reversal_before_detent(void) {
+	static const uint8_t wobble[] = { 2, 0, 2, 3, 1, 3 };
+	reset();
+	for (size_t k = 0; k < sizeof(wobble); k++) {
+		feed(0, wobble[k]);
+	}
+	drain();
+	CHECK_EQ(sent_count, 0);
+}
+
+// Contact chatter on every edge of a CW detent still yields exactly one event
+static void test_bounce(void) {
+	static const uint8_t chatter[] = { 2, 3, 2, 0, 2, 0, 1, 0, 1, 3, 1, 3 };
+	reset();
+	for (size_t k = 0; k < sizeof(chatter); k++) {
+		feed(0, chatter[k]);
+	}
+	drain();
+	CHECK_EQ(sent_count, 1);
+	CHECK_EQ(sent_with(KEY_CW(0)), 1);
+}
+
+// Both lines changing in one sample cannot come from rotation
+static void test_illegal_jumps(void) {
+	reset();
+	for (int k = 0; k < 16; k++) {
+		feed(0, (k & 1) ? 3 : 0);
+	}
+	// A jump inside an otherwise valid CW cycle voids that detent
+	feed(1, 2);
+	feed(1, 1);
+	feed(1, 3);
+	drain();
+	CHECK_EQ(sent_count, 0);
+
+	// The encoder decodes normally afterwards
+	feed_cycle(1, cw_cycle);
+	drain();
+	CHECK_EQ(sent_count, 1);
+	CHECK_EQ(sent_with(KEY_CW(1)), 1);
+}
+
+static void test_unrelated_pin(void) {
+	reset();
+	for (int k = 0; k < 8; k++) {
+		port_a.IDR ^= UNRELATED_PIN;
+		port_b.IDR ^= UNRELATED_PIN;
+		sample();
+	}
+	drain();
+	CHECK_EQ(sent_count, 0);
+}
+
+// Detents closer together than any millisecond gate are all counted
+static void test_fast_spin(void) {
+	reset();
+	for (int d = 0; d < 10; d++) {
+		feed_cycle(0, cw_cycle);
+	}
+	drain();
+	CHECK_EQ(sent_with(KEY_CW(0)), 10);
+	CHECK_EQ(sent_count, 10);
+}
+
+static void test_interleaved_encoders(void) {
+	reset();
+	for (int d = 0; d < 3; d++) {
+		for (int k = 0; k < 4; k++) {
+			feed(0, ccw_cycle[k]);
+			feed(1, cw_cycle[k]);
+		}
+		host_tick_ms += 5;
+	}
+	drain();
+	CHECK_EQ(sent_with(KEY_CCW(0)), 3);
+	CHECK_EQ(sent_with(KEY_CW(1)), 3);
+	CHECK_EQ(sent_count, 6);
+}
+
+#if ENCODER_SAMPLE_BACKGROUND
+static void test_timer_setup(void) {
+	reset();
+	// 170 MHz / 20 kHz fits the 16-bit reload without a prescaler
+	CHECK_EQ(fake_tim7.PSC, 0);
+	CHECK_EQ(fake_tim7.ARR, 8499);
+	CHECK(fake_tim7.DIER & TIM_DIER_UIE);
+	CHECK(fake_tim7.CR1 & TIM_CR1_CEN);
+}
+
+// The ISR keeps counting while the main loop is stalled, past the depth of
+// the event queue, and encoder_task() sends every detent afterwards
+static void test_stalled_main_loop(void) {
+	reset();
+	for (int d = 0; d < 12; d++) {
+		for (int k = 0; k < 4; k++) {
+			feed(0, cw_cycle[k]);
+			if (d < 3) {
+				feed(1, ccw_cycle[k]);
+			}
+		}
+	}
+	CHECK_EQ(sent_count, 0);
+	drain();
+	CHECK_EQ(sent_with(KEY_CW(0)), 12);
+	CHECK_EQ(sent_with(KEY_CCW(1)), 3);
+	CHECK_EQ(sent_count, 15);
+}
+
+// Opposite turns between two drains cancel out in the count
+static void test_net_count(void) {
+	reset();
+	feed_cycle(0, cw_cycle);
+	feed_cycle(0, cw_cycle);
+	feed_cycle(0, ccw_cycle);
+	drain();
+	CHECK_EQ(sent_with(KEY_CW(0)), 1);
+	CHECK_EQ(sent_count, 1);
+}
+
+// The update flag gates sampling
+static void test_isr_requires_update_flag(void) {
+	reset();
+	for (int k = 0; k < 4; k++) {
+		set_pins(0, cw_cycle[k]);
+		fake_tim7.SR = 0;
+		encoder_timer_isr();
+	}
+	drain();
+	CHECK_EQ(sent_count, 0);
+}
+#endif
+
+int main(void) {
+	RUN_TEST(test_cw_detent);
+	RUN_TEST(test_ccw_detent);
+	RUN_TEST(test_reversal_before_detent);
+	RUN_TEST(test_bounce);
+	RUN_TEST(test_illegal_jumps);
+	RUN_TEST(test_unrelated_pin);
+	RUN_TEST(test_fast_spin);
+	RUN_TEST(test_interleaved_encoders);
+#if ENCODER_SAMPLE_BACKGROUND
+	RUN_TEST(test_timer_setup);
+	RUN_TEST(test_stalled_main_loop);
+	RUN_TEST(test_net_count);
+	RUN_TEST(test_isr_requires_update_flag);
+#endif
+	return TEST_RESULT();
+}
@@ -0,0 +1,206 @@
+// Host test for the table-driven decoder internals in encoder.c: the
+// quadrature transition table and the per-port sampling tables. The module
+// is included directly so its static tables can be inspected.
+
+#include "../Core/Src/input/encoder.c"
+#include "test_check.h"
+
+static GPIO_TypeDef port_a, port_b;
+
+// Encoder 0 splits across ports A and B, encoder 1 shares port B
+const encoder_pins_t encoder_pins[ENCODER_COUNT] = {
+	{ { &port_a, GPIO_PIN_5 }, { &port_b, GPIO_PIN_3 } },
+	{ { &port_b, GPIO_PIN_6 }, { &port_b, GPIO_PIN_7 } },
+};
+const uint32_t encoder_pulls[ENCODER_COUNT] = { GPIO_NOPULL, GPIO_NOPULL };
+
+static int detents[ENCODER_COUNT];
+
+bool keymap_get_active_encoder_map(uint8_t encoder_id, uint16_t *ccw_keycode, uint16_t *cw_keycode) {
+	*ccw_keycode = 0x10 + encoder_id;
+	*cw_keycode = 0x20 + encoder_id;
+	return true;
+}
+
+bool keymap_translate_keycode(uint16_t keycode, bool pressed, uint8_t *hid_code) {
+	(void)pressed;
+	*hid_code = (uint8_t)keycode;
+	return true;
+}
+
+void midi_handle_keycode(uint16_t keycode, bool pressed) {
+	(void)keycode;
+	(void)pressed;
+}
+
+void i2c_manager_process_local_key_event(uint8_t row, uint8_t col, uint8_t pressed, uint8_t keycode,
+                                         uint8_t source, uint32_t detect_cycles) {
+	(void)row;
+	(void)source;
+	(void)detect_cycles;
+	(void)keycode;
+	detents[col] += pressed ? 1 : -1;
+}
+
+// Gray-code successor in the CW direction, state = B<<1 | A
+static uint8_t cw_next(uint8_t state) {
+	static const uint8_t next[4] = { 1, 3, 0, 2 };
+	return next[state];
+}
+
+static void set_pins(uint8_t idx, uint8_t state) {
+	if (idx == 0) {
+		port_a.IDR = (port_a.IDR & ~GPIO_PIN_5) | ((state & 1) ? GPIO_PIN_5 : 0);
+		port_b.IDR = (port_b.IDR & ~GPIO_PIN_3) | ((state & 2) ? GPIO_PIN_3 : 0);
+	} else {
+		port_b.IDR = (port_b.IDR & ~(GPIO_PIN_6 | GPIO_PIN_7)) |
+		             ((state & 1) ? GPIO_PIN_6 : 0) | ((state & 2) ? GPIO_PIN_7 : 0);
+	}
+}
+
+static void drain(void) {
+	for (int k = 0; k < 32; k++) {
+		encoder_task();
+	}
+}
+
+static void reset(uint8_t rest) {
+	set_pins(0, rest);
+	set_pins(1, rest);
+	encoder_init();
+	drain();
+	detents[0] = detents[1] = 0;
+}
+
+// Every single-line change counts one step in its direction; no change and
+// two-line changes count nothing
+static void test_transition_table(void) {
+	for (uint8_t os = 0; os < 4; os++) {
+		for (uint8_t ns = 0; ns < 4; ns++) {
+			int expected = 0;
+			if (ns == cw_next(os)) {
+				expected = +1;
+			} else if (os == cw_next(ns)) {
+				expected = -1;
+			}
+			if (enc_transition[(os << 2) | ns] != expected) {
+				printf("transition %u->%u: %d, expected %d\n", os, ns,
+				       enc_transition[(os << 2) | ns], expected);
+			}
+			CHECK_EQ(enc_transition[(os << 2) | ns], expected);
+		}
+	}
+}
+
+// A full cycle in either direction sums to exactly one detent
+static void test_cycle_sums(void) {
+	for (uint8_t start = 0; start < 4; start++) {
+		int cw = 0, ccw = 0;
+		uint8_t s = start;
+		for (int k = 0; k < 4; k++) {
+			uint8_t n = cw_next(s);
+			cw += enc_transition[(s << 2) | n];
+			ccw += enc_transition[(n << 2) | s];
+			s = n;
+		}
+		CHECK_EQ(cw, ENC_STEPS_PER_DETENT);
+		CHECK_EQ(ccw, -ENC_STEPS_PER_DETENT);
+	}
+}
+
+// Port B is shared, so two ports cover four pins
+static void test_port_tables(void) {
+	reset(3);
+	CHECK_EQ(enc_port_count, 2);
+	CHECK(enc_ports[enc_port_a[0]] == &port_a);
+	CHECK(enc_ports[enc_port_b[0]] == &port_b);
+	CHECK_EQ(enc_port_a[1], enc_port_b[0]);
+	CHECK_EQ(enc_port_b[1], enc_port_b[0]);
+	CHECK_EQ(enc_port_mask[enc_port_a[0]], GPIO_PIN_5);
+	CHECK_EQ(enc_port_mask[enc_port_b[0]], GPIO_PIN_3 | GPIO_PIN_6 | GPIO_PIN_7);
+	CHECK_EQ(enc_shift_a[0], 5);
+	CHECK_EQ(enc_shift_b[0], 3);
+	CHECK_EQ(enc_shift_a[1], 6);
+	CHECK_EQ(enc_shift_b[1], 7);
+}
+
+// States are gathered from one IDR snapshot per port
+static void test_state_gather(void) {
+	reset(3);
+	for (uint8_t st = 0; st < 4; st++) {
+		set_pins(0, st);
+		set_pins(1, (uint8_t)(3 - st));
+		uint32_t idr[ENC_MAX_PORTS];
+		encoder_sample(idr);
+		CHECK_EQ(encoder_state(idr, 0), st);
+		CHECK_EQ(encoder_state(idr, 1), 3 - st);
+	}
+}
+
+// A pass with no encoder pin change is skipped, other pins on the port are
+// masked off
+static void test_sample_change_detection(void) {
+	reset(3);
+	uint32_t idr[ENC_MAX_PORTS];
+	CHECK(!encoder_sample(idr));
+	port_a.IDR ^= GPIO_PIN_12;
+	port_b.IDR ^= GPIO_PIN_0;
+	CHECK(!encoder_sample(idr));
+	set_pins(1, 2);
+	CHECK(encoder_sample(idr));
+	CHECK(!encoder_sample(idr));
+}
+
+// Every idle level works as the rest state: a full cycle away from and back
+// to it is one detent, each way
+static void test_all_rest_states(void) {
+	for (uint8_t rest = 0; rest < 4; rest++) {
+		reset(rest);
+		uint8_t s = rest;
+		for (int k = 0; k < 4; k++) {
+			s = cw_next(s);
+			set_pins(0, s);
+			encoder_sample_tick();
+		}
+		for (int k = 0; k < 4; k++) {
+			uint8_t prev = 0;
+			while (cw_next(prev) != s) {
+				prev++;
+			}
+			s = prev;
+			set_pins(1, s);
+			encoder_sample_tick();
+		}
+		drain();
+		CHECK_EQ(detents[0], 1);
+		CHECK_EQ(detents[1], -1);
+	}
+}
+
+// Three quarter-steps and a jump back to rest is not a detent
+static void test_jump_to_rest(void) {
+	reset(3);
+	set_pins(0, 2);
+	encoder_sample_tick();
+	set_pins(0, 0);
+	encoder_sample_tick();
+	set_pins(0, 1);
+	encoder_sample_tick();
+	set_pins(0, 2);	// illegal 1->2
+	encoder_sample_tick();
+	set_pins(0, 3);	// back to rest, re-arms with step cleared
+	encoder_sample_tick();
+	drain();
+	CHECK_EQ(detents[0], 0);
+}
+
+int main(void) {
+	RUN_TEST(test_transition_table);
+	RUN_TEST(test_cycle_sums);
+	RUN_TEST(test_port_tables);
+	RUN_TEST(test_state_gather);
+	RUN_TEST(test_sample_change_detection);
+	RUN_TEST(test_all_rest_states);
+	RUN_TEST(test_jump_to_rest);
+	return TEST_RESULT();
+}
@@ -0,0 +1,224 @@
+// Host test for the encoder tap scheduler in key_state.c. A fake HID
+// endpoint accepts one report per 125 us frame; each report is decoded into
+// press and release edges per usage so the tests can check that every
+// detent reaches the host as its own tap.
+
+#include <string.h>
+#include "key_state.h"
+#include "latency.h"
+#include "tusb.h"
+#include "test_check.h"
+
+#define FRAMES_PER_MS 8
+
+static bool host_busy;
+static bool host_stalled;
+static int reports;
+static uint8_t last_bitmap[KEY_STATE_NKRO_BITMAP_BYTES];
+static int presses[128];
+static int releases[128];
+static uint32_t pressed_at[128];
+static uint32_t held_ms[128];
+
+void latency_record(uint8_t source, uint32_t cycles) {
+	(void)source;
+	(void)cycles;
+}
+
+bool tud_hid_n_ready(uint8_t instance) {
+	(void)instance;
+	return !host_busy && !host_stalled;
+}
+
+uint8_t tud_hid_n_get_protocol(uint8_t instance) {
+	(void)instance;
+	return 1;	// report protocol, NKRO bitmap
+}
+
+bool tud_hid_n_keyboard_report(uint8_t instance, uint8_t report_id, uint8_t modifier, const uint8_t keycode[6]) {
+	(void)instance;
+	(void)report_id;
+	(void)modifier;
+	(void)keycode;
+	CHECK(!"boot report sent in report protocol");
+	return false;
+}
+
+bool tud_hid_n_report(uint8_t instance, uint8_t report_id, const void *report, uint16_t len) {
+	(void)instance;
+	(void)report_id;
+	CHECK_EQ(len, 1 + KEY_STATE_NKRO_BITMAP_BYTES);
+	const uint8_t *bitmap = (const uint8_t *)report + 1;
+	for (int u = 0; u < 128; u++) {
+		bool on = (bitmap[u >> 3] >> (u & 7)) & 1;
+		bool was = (last_bitmap[u >> 3] >> (u & 7)) & 1;
+		if (on && !was) {
+			presses[u]++;
+			pressed_at[u] = host_tick_ms;
+		} else if (!on && was) {
+			releases[u]++;
+			held_ms[u] = host_tick_ms - pressed_at[u];
+		}
+	}
+	memcpy(last_bitmap, bitmap, sizeof(last_bitmap));
+	host_busy = true;
+	reports++;
+	return true;
+}
+
+static bool host_key_down(uint8_t usage) {
+	return (last_bitmap[usage >> 3] >> (usage & 7)) & 1;
+}
+
+// One 125 us frame: the previous IN transfer completes, then the main loop runs
+static void frame(void) {
+	if (host_busy) {
+		host_busy = false;
+		key_state_report_complete();
+	}
+	key_state_task();
+}
+
+static void run_ms(int ms) {
+	for (int i = 0; i < ms * FRAMES_PER_MS; i++) {
+		if (i % FRAMES_PER_MS == 0) {
+			host_tick_ms++;
+		}
+		frame();
+	}
+}
+
+static void reset(void) {
+	key_state_init();
+	host_busy = false;
+	host_stalled = false;
+	reports = 0;
+	memset(last_bitmap, 0, sizeof(last_bitmap));
+	memset(presses, 0, sizeof(presses));
+	memset(releases, 0, sizeof(releases));
+	memset(held_ms, 0, sizeof(held_ms));
+}
+
+// A lone detent presses right away and holds for ENCODER_TAP_DELAY_MS
+static void test_isolated_tap(void) {
+	reset();
+	key_state_send_encoder_event(0x52);
+	CHECK_EQ(presses[0x52], 1);
+	run_ms(20);
+	CHECK_EQ(releases[0x52], 1);
+	CHECK(held_ms[0x52] >= 5);
+	CHECK(held_ms[0x52] <= 6);
+	CHECK_EQ(reports, 2);
+}
+
+// Detents arriving while the key is still tapping are all played back
+static void test_fast_spin(void) {
+	reset();
+	for (int i = 0; i < 10; i++) {
+		key_state_send_encoder_event(0x4F);
+		frame();
+	}
+	run_ms(20);
+	CHECK_EQ(presses[0x4F], 10);
+	CHECK_EQ(releases[0x4F], 10);
+	CHECK(!host_key_down(0x4F));
+	// Queued taps go out back to back, one edge per report
+	CHECK_EQ(reports, 20);
+}
+
+// Taps of different keys run in parallel and share reports
+static void test_two_keys(void) {
+	reset();
+	for (int i = 0; i < 10; i++) {
+		key_state_send_encoder_event(0x4F);
+		if (i == 3 || i == 6) {
+			key_state_send_encoder_event(0x50);
+		}
+		frame();
+	}
+	run_ms(20);
+	CHECK_EQ(presses[0x4F], 10);
+	CHECK_EQ(releases[0x4F], 10);
+	CHECK_EQ(presses[0x50], 2);
+	CHECK_EQ(releases[0x50], 2);
+	CHECK(reports < 24);
+}
+
+// Every encoder of a fully populated board turning at once
+static void test_many_keys(void) {
+	reset();
+	for (uint8_t e = 0; e < 25; e++) {
+		key_state_send_encoder_event((uint8_t)(0x04 + e));
+	}
+	run_ms(20);
+	for (uint8_t e = 0; e < 25; e++) {
+		CHECK_EQ(presses[0x04 + e], 1);
+		CHECK_EQ(releases[0x04 + e], 1);
+	}
+}
+
+// Taps leave keys held by the matrix alone
+static void test_held_key_unaffected(void) {
+	reset();
+	key_state_add_key(0x04);
+	key_state_update_hid_report();
+	run_ms(1);
+	for (int i = 0; i < 3; i++) {
+		key_state_send_encoder_event(0x4F);
+	}
+	run_ms(20);
+	CHECK_EQ(presses[0x4F], 3);
+	CHECK_EQ(presses[0x04], 1);
+	CHECK_EQ(releases[0x04], 0);
+	CHECK(host_key_down(0x04));
+}
+
+// Nothing is lost while the host does not poll; the taps follow once it does
+static void test_host_stall(void) {
+	reset();
+	host_stalled = true;
+	for (int i = 0; i < 3; i++) {
+		key_state_send_encoder_event(0x4F);
+		run_ms(1);
+	}
+	run_ms(20);
+	CHECK_EQ(reports, 0);
+	host_stalled = false;
+	run_ms(20);
+	CHECK_EQ(presses[0x4F], 3);
+	CHECK_EQ(releases[0x4F], 3);
+}
+
+// With every slot taken, a detent for a new key is dropped, not merged
+static void test_slots_full(void) {
+	reset();
+	for (uint8_t k = 0; k < 32; k++) {
+		key_state_send_encoder_event((uint8_t)(0x04 + k));
+	}
+	key_state_send_encoder_event(0x04 + 32);
+	run_ms(20);
+	for (uint8_t k = 0; k < 32; k++) {
+		CHECK_EQ(presses[0x04 + k], 1);
+	}
+	CHECK_EQ(presses[0x04 + 32], 0);
+	CHECK_EQ(key_state_get_pressed_count(), 0);
+}
+
+static void test_zero_keycode_ignored(void) {
+	reset();
+	key_state_send_encoder_event(0);
+	run_ms(20);
+	CHECK_EQ(reports, 0);
+}
+
+int main(void) {
+	RUN_TEST(test_isolated_tap);
+	RUN_TEST(test_fast_spin);
+	RUN_TEST(test_two_keys);
+	RUN_TEST(test_many_keys);
+	RUN_TEST(test_held_key_unaffected);
+	RUN_TEST(test_host_stall);
+	RUN_TEST(test_slots_full);
+	RUN_TEST(test_zero_keycode_ignored);
+	return TEST_RESULT();
+}
@@ -0,0 +1,257 @@
+// Host test for macro playback in macro.c. Reports are captured from a fake
+// key_state and decoded the way a host does: keys newly pressed in a report
+// are typed in ascending usage order, with the modifiers held in that report.
+
+#include <string.h>
+#include "macro.h"
+#include "key_state.h"
+#include "eeprom_emulation.h"
+#include "class/hid/hid.h"
+#include "test_check.h"
+
+static uint8_t macro_area[EEPROM_MACRO_BYTES];
+static uint8_t refcount[256];
+static uint8_t host_state[256];
+static bool report_pending;
+static int reports;
+static char typed_text[512];
+static size_t typed_len;
+
+bool eeprom_get_macro_data(uint16_t offset, uint8_t *data, uint16_t length) {
+	if (offset > EEPROM_MACRO_BYTES || length > EEPROM_MACRO_BYTES - offset) {
+		return false;
+	}
+	memcpy(data, &macro_area[offset], length);
+	return true;
+}
+
+void key_state_add_key(uint8_t keycode) {
+	refcount[keycode]++;
+}
+
+void key_state_remove_key(uint8_t keycode) {
+	CHECK(refcount[keycode] > 0);
+	refcount[keycode]--;
+}
+
+bool key_state_report_pending(void) {
+	return report_pending;
+}
+
+// Character the host types for a usage, '^' marks a control chord
+static void host_type(uint8_t usage, bool shift, bool ctrl) {
+	char c = '?';
+	for (int a = 1; a < 128; a++) {
+		uint8_t modifier, keycode;
+		if (macro_ascii_to_hid((uint8_t)a, &modifier, &keycode) && keycode == usage &&
+		    ((modifier & KEYBOARD_MODIFIER_LEFTSHIFT) != 0) == shift) {
+			c = (char)a;
+			break;
+		}
+	}
+	if (ctrl && typed_len < sizeof(typed_text) - 1) {
+		typed_text[typed_len++] = '^';
+	}
+	if (typed_len < sizeof(typed_text) - 1) {
+		typed_text[typed_len++] = c;
+	}
+}
+
+void key_state_update_hid_report(void) {
+	if (memcmp(refcount, host_state, sizeof(refcount)) == 0) {
+		return;
+	}
+	reports++;
+	bool shift = refcount[HID_KEY_CONTROL_LEFT + 1] != 0;
+	bool ctrl = refcount[HID_KEY_CONTROL_LEFT] != 0;
+	for (int u = 0; u < HID_KEY_CONTROL_LEFT; u++) {
+		if (refcount[u] && !host_state[u]) {
+			host_type((uint8_t)u, shift, ctrl);
+		}
+	}
+	memcpy(host_state, refcount, sizeof(refcount));
+}
+
+static void reset(void) {
+	macro_stop();
+	memset(macro_area, 0, sizeof(macro_area));
+	memset(refcount, 0, sizeof(refcount));
+	memset(host_state, 0, sizeof(host_state));
+	memset(typed_text, 0, sizeof(typed_text));
+	typed_len = 0;
+	reports = 0;
+	report_pending = false;
+}
+
+static void run_until_idle(void) {
+	for (int guard = 0; macro_busy() && guard < 2000; guard++) {
+		macro_task();
+		host_tick_ms++;
+	}
+	CHECK(!macro_busy());
+}
+
+static void type_text(const char *text) {
+	for (const char *p = text; *p; p++) {
+		CHECK(macro_queue_char((uint8_t)*p));
+	}
+	run_until_idle();
+}
+
+static bool all_released(void) {
+	for (int u = 0; u < 256; u++) {
+		if (refcount[u] || host_state[u]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Packed reports still type exactly the queued text, and end with every key up
+static void check_typed(const char *text, int expected_reports) {
+	reset();
+	type_text(text);
+	CHECK(strcmp(typed_text, text) == 0);
+	if (strcmp(typed_text, text) != 0) {
+		printf("  typed \"%s\", expected \"%s\"\n", typed_text, text);
+	}
+	CHECK_EQ(reports, expected_reports);
+	CHECK(all_released());
+}
+
+static void test_ascending_run_packs(void) {
+	// a-f ascend: one report presses all six, one releases them
+	check_typed("abcdef", 2);
+}
+
+static void test_repeat_needs_release(void) {
+	check_typed("aaa", 6);
+}
+
+static void test_prose(void) {
+	check_typed("hello world", 9);
+}
+
+// Shift changes share the report with the next keys
+static void test_modifier_changes(void) {
+	check_typed("Hello World!", 10);
+}
+
+static void test_printable_ascii_round_trip(void) {
+	char text[128];
+	size_t n = 0;
+	for (int c = ' '; c < 0x7F; c++) {
+		text[n++] = (char)c;
+	}
+	text[n++] = '\t';
+	text[n++] = '\n';
+	text[n] = '\0';
+	reset();
+	type_text(text);
+	CHECK(strcmp(typed_text, text) == 0);
+	if (strcmp(typed_text, text) != 0) {
+		printf("  typed \"%s\"\n", typed_text);
+	}
+	CHECK(reports < (int)n);
+	CHECK(all_released());
+}
+
+// Bytes outside ASCII type nothing and do not stall the queue
+static void test_non_ascii_skipped(void) {
+	reset();
+	CHECK(macro_queue_char(0xC3));
+	CHECK(macro_queue_char(0xA9));
+	type_text("b");
+	CHECK(strcmp(typed_text, "b") == 0);
+}
+
+// Playback waits while a report is still queued for the host
+static void test_paced_by_reports(void) {
+	reset();
+	report_pending = true;
+	CHECK(macro_queue_char('a'));
+	for (int i = 0; i < 10; i++) {
+		macro_task();
+	}
+	CHECK_EQ(reports, 0);
+	report_pending = false;
+	run_until_idle();
+	CHECK(strcmp(typed_text, "a") == 0);
+}
+
+static void test_program(void) {
+	// Macro 0: "x". Macro 1: "hi", ctrl down, tap c, ctrl up, wait 5 ms, "!"
+	static const uint8_t prog[] = {
+		'x', MACRO_END,
+		'h', 'i', MACRO_DOWN, HID_KEY_CONTROL_LEFT, MACRO_TAP, HID_KEY_A + 2,
+		MACRO_UP, HID_KEY_CONTROL_LEFT, MACRO_DELAY, 5, 0, '!', MACRO_END,
+	};
+	reset();
+	memcpy(macro_area, prog, sizeof(prog));
+	CHECK(macro_play(1));
+	CHECK(!macro_play(0));	// one macro at a time
+
+	uint32_t start = host_tick_ms;
+	uint32_t bang_at = 0;
+	for (int guard = 0; macro_busy() && guard < 100; guard++) {
+		macro_task();
+		if (!bang_at && strchr(typed_text, '!')) {
+			bang_at = host_tick_ms;
+		}
+		host_tick_ms++;
+	}
+	CHECK(strcmp(typed_text, "hi^c!") == 0);
+	CHECK(bang_at - start >= 5);
+	CHECK(all_released());
+}
+
+static void test_missing_macro(void) {
+	reset();
+	macro_area[0] = 'x';
+	CHECK(!macro_play(1));
+	CHECK(!macro_play(5));
+	CHECK(!macro_busy());
+}
+
+// A tap of usage 0 is skipped like an untypeable character, not an error
+static void test_tap_zero_skipped(void) {
+	static const uint8_t prog[] = { MACRO_TAP, 0, 'a', MACRO_END };
+	reset();
+	memcpy(macro_area, prog, sizeof(prog));
+	CHECK(macro_play(0));
+	run_until_idle();
+	CHECK(strcmp(typed_text, "a") == 0);
+}
+
+// Stopping releases keys held by MACRO_DOWN
+static void test_stop_releases(void) {
+	static const uint8_t prog[] = {
+		MACRO_DOWN, HID_KEY_CONTROL_LEFT, MACRO_DELAY, 0xE8, 0x03, 'a', MACRO_END,
+	};
+	reset();
+	memcpy(macro_area, prog, sizeof(prog));
+	CHECK(macro_play(0));
+	for (int i = 0; i < 5; i++) {
+		macro_task();
+	}
+	CHECK(refcount[HID_KEY_CONTROL_LEFT] == 1);
+	macro_stop();
+	CHECK(!macro_busy());
+	CHECK(all_released());
+	CHECK(strcmp(typed_text, "") == 0);
+}
+
+int main(void) {
+	RUN_TEST(test_ascending_run_packs);
+	RUN_TEST(test_repeat_needs_release);
+	RUN_TEST(test_prose);
+	RUN_TEST(test_modifier_changes);
+	RUN_TEST(test_printable_ascii_round_trip);
+	RUN_TEST(test_non_ascii_skipped);
+	RUN_TEST(test_paced_by_reports);
+	RUN_TEST(test_program);
+	RUN_TEST(test_missing_macro);
+	RUN_TEST(test_tap_zero_skipped);
+	RUN_TEST(test_stop_releases);
+	return TEST_RESULT();
+}
@@ -0,0 +1,232 @@
+// Host test for the tap-hold engine in tap_hold.c. The fake matrix mirrors
+// matrix_process_key(): a two-layer keymap for row 0, a per-key cache of
+// the keycode each press resolved to, and the engine getting the first look
+// at every event. Dispatched keycodes are logged as "XX+" / "XX-", layer
+// changes as "L<n>+" / "L<n>-".
+
+#include <string.h>
+#include "tap_hold.h"
+#include "eeprom_emulation.h"
+#include "op_keycodes.h"
+#include "test_check.h"
+
+#define COLS 4
+
+static uint16_t keymap[2][COLS];
+static uint16_t active_keycode_cache[MATRIX_ROWS][MATRIX_COLS];
+static uint8_t layer;
+static char out[512];
+
+// Per-key configs (term 0 = inherit) and the profile default
+static uint16_t key_term[MATRIX_COLS];
+static uint8_t key_flags[MATRIX_COLS];
+static uint16_t profile_term;
+static uint8_t profile_flags;
+
+bool eeprom_get_tap_hold_config(uint8_t row, uint8_t col, uint16_t *tapping_term_ms, uint8_t *flags) {
+	if (row == EEPROM_TAP_HOLD_PROFILE && col == EEPROM_TAP_HOLD_PROFILE) {
+		*tapping_term_ms = profile_term;
+		*flags = profile_flags;
+		return true;
+	}
+	*tapping_term_ms = key_term[col];
+	*flags = key_flags[col];
+	return true;
+}
+
+void matrix_dispatch_keycode(uint8_t row, uint8_t col, uint16_t keycode, uint8_t pressed) {
+	(void)row;
+	(void)col;
+	size_t len = strlen(out);
+	if (IS_OP_MO_LAYER(keycode)) {
+		layer = pressed ? OP_LAYER_TARGET(keycode) : 0;
+		snprintf(out + len, sizeof(out) - len, "L%u%c ", OP_LAYER_TARGET(keycode), pressed ? '+' : '-');
+		return;
+	}
+	snprintf(out + len, sizeof(out) - len, "%02X%c ", keycode, pressed ? '+' : '-');
+}
+
+static uint16_t lookup(uint8_t col) {
+	uint16_t kc = keymap[layer][col];
+	return (kc == KC_TRANSPARENT) ? keymap[0][col] : kc;
+}
+
+void matrix_process_key(uint8_t r, uint8_t c, uint8_t pressed) {
+	uint16_t kc = pressed ? lookup(c) : active_keycode_cache[r][c];
+	if (pressed) {
+		active_keycode_cache[r][c] = kc;
+	} else if (kc == KC_NO) {
+		kc = lookup(c);
+	}
+	if (tap_hold_process_key(r, c, kc, pressed)) {
+		if (!pressed && !tap_hold_release_buffered(r, c)) {
+			active_keycode_cache[r][c] = KC_NO;
+		}
+		return;
+	}
+	if (!pressed) {
+		active_keycode_cache[r][c] = KC_NO;
+	}
+	matrix_dispatch_keycode(r, c, kc, pressed);
+}
+
+static void setup(uint8_t flags) {
+	keymap[0][0] = KC_MT(OP_MOD_SHIFT, 0x04);
+	keymap[0][1] = 0x05;
+	keymap[0][2] = KC_LT(1, 0x06);
+	keymap[0][3] = 0x07;
+	keymap[1][0] = KC_TRANSPARENT;
+	keymap[1][1] = 0x15;
+	keymap[1][2] = KC_TRANSPARENT;
+	keymap[1][3] = 0x17;
+	memset(key_term, 0, sizeof(key_term));
+	memset(key_flags, 0, sizeof(key_flags));
+	memset(active_keycode_cache, 0, sizeof(active_keycode_cache));
+	profile_term = 200;
+	profile_flags = flags;
+	layer = 0;
+}
+
+// Replay a script: "<col>d" press, "<col>u" release, "t<n>" wait n*100 ms.
+// Events are 10 ms apart and tap_hold_task() runs after each, like the scan.
+static void run(const char *script, const char *expected) {
+	memset(out, 0, sizeof(out));
+	for (const char *s = script; *s; ) {
+		if (*s == ' ') {
+			s++;
+			continue;
+		}
+		if (*s == 't') {
+			host_tick_ms += (uint32_t)(s[1] - '0') * 100u;
+		} else {
+			matrix_process_key(0, (uint8_t)(s[0] - '0'), s[1] == 'd');
+			host_tick_ms += 10;
+		}
+		s += 2;
+		tap_hold_task();
+	}
+	if (strcmp(out, expected) != 0) {
+		printf("  script \"%s\": got \"%s\", expected \"%s\"\n", script, out, expected);
+	}
+	CHECK(strcmp(out, expected) == 0);
+}
+
+static void test_plain_key(void) {
+	setup(0);
+	run("1d 1u", "05+ 05- ");
+	// Plain keys bypass the engine while nothing is pending
+	CHECK(!tap_hold_process_key(0, 1, 0x05, 1));
+}
+
+static void test_tap(void) {
+	setup(0);
+	run("0d 0u", "04+ 04- ");
+}
+
+static void test_hold_after_term(void) {
+	setup(0);
+	run("0d t3 1d 1u 0u", "E1+ 05+ 05- E1- ");
+}
+
+// Without flags, keys pressed inside the term wait for the tap-hold key
+static void test_default_flags(void) {
+	setup(0);
+	run("0d 1d 0u 1u", "04+ 05+ 04- 05- ");
+	run("0d 1d 1u 0u", "04+ 05+ 05- 04- ");
+}
+
+static void test_permissive_hold(void) {
+	setup(TAP_HOLD_PERMISSIVE_HOLD);
+	run("0d 1d 1u 0u", "E1+ 05+ 05- E1- ");
+	// A roll (tap-hold key released first) stays a tap
+	run("0d 1d 0u 1u", "04+ 05+ 04- 05- ");
+}
+
+static void test_hold_on_other_key_press(void) {
+	setup(TAP_HOLD_HOLD_ON_OTHER_KEY_PRESS);
+	run("0d 1d 1u 0u", "E1+ 05+ 05- E1- ");
+}
+
+// Buffered keys are replayed after the decision, so they see the held layer
+static void test_layer_tap(void) {
+	setup(TAP_HOLD_PERMISSIVE_HOLD);
+	run("2d 1d 1u 2u", "L1+ 15+ 15- L1- ");
+	run("2d 2u", "06+ 06- ");
+	setup(0);
+	run("2d 1d 2u 1u", "06+ 05+ 06- 05- ");
+}
+
+// A key pressed on the held layer releases what it pressed after the layer drops
+static void test_layer_release_uses_cache(void) {
+	setup(0);
+	run("2d t3 1d 2u 1u", "L1+ 15+ L1- 15- ");
+}
+
+// Per-key settings win over the profile, which wins over the keyboard default
+static void test_config_precedence(void) {
+	uint16_t term;
+	uint8_t flags;
+	setup(0);
+	profile_term = 0;
+	tap_hold_get_key_config(0, 0, &term, &flags);
+	CHECK_EQ(term, TAP_HOLD_TERM_MS);
+	CHECK_EQ(flags, TAP_HOLD_FLAGS);
+	profile_term = 300;
+	profile_flags = TAP_HOLD_PERMISSIVE_HOLD;
+	tap_hold_get_key_config(0, 0, &term, &flags);
+	CHECK_EQ(term, 300);
+	CHECK_EQ(flags, TAP_HOLD_PERMISSIVE_HOLD);
+	key_term[0] = 120;
+	key_flags[0] = 0xFF;
+	tap_hold_get_key_config(0, 0, &term, &flags);
+	CHECK_EQ(term, 120);
+	CHECK_EQ(flags, TAP_HOLD_FLAGS_MASK);
+
+	// A short per-key term turns the same timing into a hold
+	run("0d t2 0u", "E1+ E1- ");
+}
+
+// Overflowing the event buffer settles the key as a hold
+static void test_buffer_full(void) {
+	setup(0);
+	char script[64] = "0d ";
+	char expected[128] = "E1+ ";
+	for (int i = 0; i < TAP_HOLD_BUFFER_SIZE / 2 + 1; i++) {
+		strcat(script, "1d 1u ");
+		strcat(expected, "05+ 05- ");
+	}
+	strcat(script, "0u");
+	strcat(expected, "E1- ");
+	run(script, expected);
+}
+
+// The tap-hold key's own release is settled by the engine and clears its
+// cached keycode; a buffered release keeps it until it is replayed
+static void test_release_buffered(void) {
+	setup(0);
+	run("0d 1d", "");
+	CHECK(!tap_hold_release_buffered(0, 1));
+	run("1u", "");
+	CHECK(tap_hold_release_buffered(0, 1));
+	CHECK_EQ(active_keycode_cache[0][1], 0x05);
+	run("0u", "04+ 05+ 05- 04- ");
+	CHECK(!tap_hold_release_buffered(0, 1));
+	CHECK_EQ(active_keycode_cache[0][0], KC_NO);
+	CHECK_EQ(active_keycode_cache[0][1], KC_NO);
+}
+
+int main(void) {
+	host_tick_ms = 1000;
+	RUN_TEST(test_plain_key);
+	RUN_TEST(test_tap);
+	RUN_TEST(test_hold_after_term);
+	RUN_TEST(test_default_flags);
+	RUN_TEST(test_permissive_hold);
+	RUN_TEST(test_hold_on_other_key_press);
+	RUN_TEST(test_layer_tap);
+	RUN_TEST(test_layer_release_uses_cache);
+	RUN_TEST(test_config_precedence);
+	RUN_TEST(test_buffer_full);
+	RUN_TEST(test_release_buffered);
+	return TEST_RESULT();
+}
@@ -0,0 +1,172 @@
+"""
+Decode the tokenized trace records the firmware mixes into its CDC output.
+
+Binary records start with 0xA5 (never a byte of the plain-text log):
+    0xA5 | id | nargs | cycles (u32 LE) | args (nargs x u32 LE)
+Format strings come from Core/Inc/trace_events.h, string tokens from the
+TRACE_STR_* defines in Core/Inc/trace.h. Plain text lines are passed through.
+
+Usage: python trace_decode.py [COM_PORT] [--file capture.bin]
+"""
+
+import os
+import re
+import struct
+import sys
+
+REPO_DIR = os.path.dirname(os.path.abspath(__file__))
+EVENTS_H = os.path.join(REPO_DIR, "Core", "Inc", "trace_events.h")
+TRACE_H = os.path.join(REPO_DIR, "Core", "Inc", "trace.h")
+
+SYNC_BYTE = 0xA5
+HEADER_SIZE = 7
+CPU_HZ = 170_000_000  # SYSCLK, DWT->CYCCNT counts core cycles
+
+COM_PORT = "COM3"  # Change this to match your board's COM port
+BAUD_RATE = 115200
+
+
+def load_events(path):
+    events = []
+    pattern = re.compile(r'^TRACE_EVENT\(\s*(\w+)\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)')
+    with open(path) as f:
+        for line in f:
+            m = pattern.match(line.strip())
+            if m:
+                events.append((m.group(1), m.group(2)))
+    return events
+
+
+def load_string_tokens(path):
+    tokens = {}
+    pattern = re.compile(r'#define\s+TRACE_STR_(\w+)\s+(\d+)U?')
+    with open(path) as f:
+        for line in f:
+            m = pattern.search(line)
+            if m:
+                tokens[int(m.group(2))] = m.group(1)
+    return tokens
+
+
+CONVERSION = re.compile(r'%(?:%|[-+ 0#]*\d*(?:\.\d+)?(?:l|ll|h|hh)?([diuxXsc]))')
+
+
+def format_event(fmt, args, tokens):
+    values = list(args)
+
+    def repl(m):
+        if m.group(0) == "%%":
+            return "%"
+        conv = m.group(1)
+        value = values.pop(0) if values else 0
+        spec = re.sub(r'(l|ll|h|hh)(?=[diuxXsc]$)', '', m.group(0))
+        if conv == "s":
+            return tokens.get(value, f"<str {value}>")
+        if conv in "di":
+            value = struct.unpack("<i", struct.pack("<I", value))[0]
+            spec = spec[:-1] + "d"
+        elif conv == "u":
+            spec = spec[:-1] + "d"
+        elif conv == "c":
+            value = value & 0xFF
+        return spec % value
+
+    return CONVERSION.sub(repl, fmt)
+
+
+class TraceDecoder:
+    def __init__(self, events, tokens):
+        self.events = events
+        self.tokens = tokens
+        self.buffer = bytearray()
+        self.text = bytearray()
+        self.last_cycles = None
+        self.elapsed_cycles = 0
+
+    def _timestamp(self, cycles):
+        # CYCCNT wraps every ~25 s at 170 MHz; accumulate deltas so the
+        # printed time stays monotonic as long as records keep flowing
+        if self.last_cycles is not None:
+            self.elapsed_cycles += (cycles - self.last_cycles) & 0xFFFFFFFF
+        self.last_cycles = cycles
+        return self.elapsed_cycles / CPU_HZ
+
+    def _flush_text(self, out):
+        while b"\n" in self.text:
+            line, _, rest = self.text.partition(b"\n")
+            self.text = bytearray(rest)
+            line = line.decode("utf-8", errors="ignore").rstrip("\r")
+            if line:
+                out.append(line)
+
+    def feed(self, data):
+        out = []
+        self.buffer.extend(data)
+        while self.buffer:
+            sync = self.buffer.find(bytes([SYNC_BYTE]))
+            if sync != 0:
+                take = len(self.buffer) if sync < 0 else sync
+                self.text.extend(self.buffer[:take])
+                del self.buffer[:take]
+                self._flush_text(out)
+                continue
+            if len(self.buffer) < HEADER_SIZE:
+                break
+            event_id, nargs = self.buffer[1], self.buffer[2]
+            if nargs > 4:
+                # Not a record header; treat the byte as noise
+                del self.buffer[:1]
+                continue
+            size = HEADER_SIZE + 4 * nargs
+            if len(self.buffer) < size:
+                break
+            cycles = struct.unpack_from("<I", self.buffer, 3)[0]
+            args = struct.unpack_from(f"<{nargs}I", self.buffer, HEADER_SIZE)
+            del self.buffer[:size]
+
+            t = self._timestamp(cycles)
+            if event_id < len(self.events):
+                name, fmt = self.events[event_id]
+                out.append(f"[{t:12.6f}] {name}: {format_event(fmt, args, self.tokens)}")
+            else:
+                out.append(f"[{t:12.6f}] <unknown event {event_id}> {list(args)}")
+        return out
+
+
+def main():
+    events = load_events(EVENTS_H)
+    tokens = load_string_tokens(TRACE_H)
+    decoder = TraceDecoder(events, tokens)
+    print(f"Loaded {len(events)} trace events from {EVENTS_H}")
+
+    args = sys.argv[1:]
+    if "--file" in args:
+        path = args[args.index("--file") + 1]
+        with open(path, "rb") as f:
+            for line in decoder.feed(f.read()):
+                print(line)
+        return
+
+    import serial
+
+    port = args[0] if args else COM_PORT
+    try:
+        ser = serial.Serial(port, BAUD_RATE, timeout=0.1)
+        print(f"Connected to {port}")
+        print("=" * 60)
+        while True:
+            data = ser.read(ser.in_waiting or 1)
+            for line in decoder.feed(data):
+                print(line)
+    except serial.SerialException as e:
+        print(f"Error: Could not open {port}")
+        print(f"Error details: {e}")
+    except KeyboardInterrupt:
+        print("\nExiting...")
+    finally:
+        if 'ser' in locals() and ser.is_open:
+            ser.close()
+
+
+if __name__ == "__main__":
+    main()